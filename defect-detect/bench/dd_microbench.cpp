@@ -0,0 +1,365 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Microbenchmarks of the CPU kernels: the reference models of the
+ * accelerators (emu/dd_kernel_sw.h) and the overlay rendering of
+ * text2overlay, at 720p, 1080p and 4K, on one thread and on several.
+ *
+ * With several threads each thread runs the kernel on a frame of its own,
+ * as the streams of a multi-camera setup do, and the throughput is that of
+ * all of them. The kernels that split a frame into row bands on the worker
+ * pool (src/dd_workers.h) also run tiled: one thread, each frame split into
+ * as many bands as there are threads. Cycles are counted with perf events over every thread of
+ * the run, and left out of the report when the kernel does not allow it.
+ */
+
+#include <glib.h>
+#include <jansson.h>
+#include <linux/perf_event.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "../emu/dd_kernel_sw.h"
+#include "dd_workers.h"
+
+using namespace std;
+
+/* Fruit threshold of the binarize inputs */
+#define BENCH_THRESHOLD     92
+
+/* Output rows are aligned as the accelerator strides are */
+#define BENCH_STRIDE_ALIGN  256
+
+typedef struct _Resolution {
+    const gchar *name;
+    guint width;
+    guint height;
+} Resolution;
+
+static const Resolution resolutions[] = {
+    { "720p",  1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4k",    3840, 2160 },
+};
+
+/* The frames of one thread */
+typedef struct _Frames {
+    guint width;
+    guint height;
+    guint stride;
+    vector<guint8> frame;       /* packed input */
+    vector<guint8> copy;        /* packed output of otsu */
+    vector<guint8> mask;        /* binarized, stride bytes per row */
+    vector<guint8> fwd;
+    vector<guint8> out;
+} Frames;
+
+typedef void (*KernelFunc) (Frames *f);
+
+typedef struct _Kernel {
+    const gchar *name;
+    KernelFunc run;
+    gboolean banded;            /* splits frames on the worker pool */
+} Kernel;
+
+static void
+run_otsu (Frames *f) {
+    dd_sw_otsu (f->frame.data (), f->copy.data (), f->width, f->height);
+}
+
+static void
+run_binarize (Frames *f) {
+    dd_sw_preprocess (f->frame.data (), f->out.data (), f->fwd.data (), BENCH_THRESHOLD, 255,
+                      f->width, f->height, f->stride);
+}
+
+static void
+run_cca (Frames *f) {
+    dd_sw_cca (f->mask.data (), f->out.data (), f->height, f->stride);
+}
+
+/* The two lines text2overlay draws on every frame */
+static void
+run_overlay (Frames *f) {
+    cv::Mat luma (f->height, f->width, CV_8U, f->out.data (), f->stride);
+    cv::putText (luma, "Defect Density: 0.41 %", cv::Point (0, 100), 3, 1.0,
+                 cv::Scalar (255.0, 255.0, 255.0), 1, 1);
+    cv::putText (luma, "Is Defected: Yes", cv::Point (0, 130), 3, 1.0,
+                 cv::Scalar (255.0, 255.0, 255.0), 1, 1);
+}
+
+static const Kernel kernels[] = {
+    { "otsu",     run_otsu,     TRUE },
+    { "binarize", run_binarize, TRUE },
+    { "cca",      run_cca,      FALSE },
+    { "overlay",  run_overlay,  FALSE },
+};
+
+static gchar *output = NULL;
+static gchar *compare = NULL;
+static gchar *only = NULL;
+static gint threads = 0;
+static gdouble min_time = 1.0;
+
+static GOptionEntry entries[] =
+{
+    { "output",   'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the results to a JSON file", "file path"},
+    { "compare",  'c', 0, G_OPTION_ARG_FILENAME, &compare, "Compare with the results of an earlier run", "file path"},
+    { "kernel",   'k', 0, G_OPTION_ARG_STRING, &only, "Run one kernel: otsu, binarize, cca or overlay", "otsu"},
+    { "threads",  'j', 0, G_OPTION_ARG_INT, &threads, "Threads of the multithreaded runs, 0 for one per CPU", "0"},
+    { "min-time", 't', 0, G_OPTION_ARG_DOUBLE, &min_time, "Seconds each run lasts at least", "1.0"},
+    { NULL }
+};
+
+static guint64
+now_ns (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/** @brief
+ *  Open a CPU cycle counter of the calling thread and of the threads it
+ *  creates afterwards.
+ *
+ *  @return the counter, -1 if perf events are not available.
+ */
+static gint
+cycles_open (void) {
+    struct perf_event_attr attr;
+
+    memset (&attr, 0, sizeof (attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof (attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+frames_init (Frames *f, const Resolution *res) {
+    f->width = res->width;
+    f->height = res->height;
+    f->stride = (res->width + BENCH_STRIDE_ALIGN - 1) / BENCH_STRIDE_ALIGN * BENCH_STRIDE_ALIGN;
+    f->frame.resize (f->width * f->height);
+    f->copy.resize (f->width * f->height);
+    f->mask.resize (f->stride * f->height);
+    f->fwd.resize (f->stride * f->height);
+    f->out.resize (f->stride * f->height);
+    dd_sw_make_frame (3, f->width, f->height, f->frame.data ());
+    dd_sw_preprocess (f->frame.data (), f->mask.data (), f->fwd.data (), BENCH_THRESHOLD, 255,
+                      f->width, f->height, f->stride);
+}
+
+/** @brief
+ *  Run a kernel on @n_threads threads, each on its own frames, for at
+ *  least min_time seconds.
+ *
+ *  @param kernel is the kernel to run.
+ *  @param res is the frame size.
+ *  @param n_threads is the number of threads.
+ *  @param bands is the number of row bands of a banded kernel.
+ *  @return the result object.
+ */
+static json_t *
+bench_run (const Kernel *kernel, const Resolution *res, guint n_threads, guint bands) {
+    vector<Frames> frames (n_threads);
+    vector<thread> workers;
+    vector<guint64> iterations (n_threads, 0);
+    guint64 deadline, start, elapsed, total = 0;
+    long long cycles = 0;
+    gint counter;
+    gdouble seconds, pixels;
+    json_t *result;
+
+    dd_workers_set_max_bands (bands);
+    for (guint i = 0; i < n_threads; i++) {
+        frames_init (&frames[i], res);
+        kernel->run (&frames[i]);
+    }
+
+    counter = cycles_open ();
+    if (counter >= 0) {
+        ioctl (counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl (counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    start = now_ns ();
+    deadline = start + (guint64) (min_time * 1e9);
+    for (guint i = 0; i < n_threads; i++) {
+        workers.push_back (thread ([&, i] () {
+            do {
+                kernel->run (&frames[i]);
+                iterations[i]++;
+            } while (now_ns () < deadline || iterations[i] < 3);
+        }));
+    }
+    for (thread &t : workers)
+        t.join ();
+    elapsed = now_ns () - start;
+    if (counter >= 0) {
+        ioctl (counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read (counter, &cycles, sizeof (cycles)) != sizeof (cycles))
+            cycles = 0;
+        close (counter);
+    }
+
+    for (guint64 n : iterations)
+        total += n;
+    seconds = elapsed / 1e9;
+    pixels = (gdouble) total * res->width * res->height;
+
+    result = json_object ();
+    json_object_set_new (result, "kernel", json_string (kernel->name));
+    json_object_set_new (result, "resolution", json_string (res->name));
+    json_object_set_new (result, "width", json_integer (res->width));
+    json_object_set_new (result, "height", json_integer (res->height));
+    json_object_set_new (result, "threads", json_integer (n_threads));
+    json_object_set_new (result, "bands", json_integer (bands));
+    json_object_set_new (result, "frames", json_integer (total));
+    json_object_set_new (result, "seconds", json_real (seconds));
+    json_object_set_new (result, "fps", json_real (total / seconds));
+    json_object_set_new (result, "mpixels_per_s", json_real (pixels / seconds / 1e6));
+    json_object_set_new (result, "cycles_per_pixel", cycles > 0 ? json_real (cycles / pixels) : json_null ());
+    return result;
+}
+
+static json_t *
+find_result (json_t *results, json_t *result) {
+    const gchar *kernel = json_string_value (json_object_get (result, "kernel"));
+    const gchar *res = json_string_value (json_object_get (result, "resolution"));
+    json_int_t n_threads = json_integer_value (json_object_get (result, "threads"));
+    json_int_t bands = json_integer_value (json_object_get (result, "bands"));
+
+    for (gsize i = 0; i < json_array_size (results); i++) {
+        json_t *r = json_array_get (results, i);
+        if (!g_strcmp0 (json_string_value (json_object_get (r, "kernel")), kernel) &&
+            !g_strcmp0 (json_string_value (json_object_get (r, "resolution")), res) &&
+            json_integer_value (json_object_get (r, "threads")) == n_threads &&
+            MAX (json_integer_value (json_object_get (r, "bands")), 1) == bands)
+            return r;
+    }
+    return NULL;
+}
+
+static void
+print_result (json_t *result, json_t *baseline) {
+    json_t *cpp = json_object_get (result, "cycles_per_pixel");
+    gdouble mpix = json_number_value (json_object_get (result, "mpixels_per_s"));
+
+    g_print ("%-9s %-6s %3" JSON_INTEGER_FORMAT " %3" JSON_INTEGER_FORMAT " %9.1f %10.1f ",
+             json_string_value (json_object_get (result, "kernel")),
+             json_string_value (json_object_get (result, "resolution")),
+             json_integer_value (json_object_get (result, "threads")),
+             json_integer_value (json_object_get (result, "bands")),
+             json_number_value (json_object_get (result, "fps")), mpix);
+    if (json_is_number (cpp))
+        g_print ("%8.2f", json_number_value (cpp));
+    else
+        g_print ("%8s", "-");
+    if (baseline) {
+        gdouble before = json_number_value (json_object_get (baseline, "mpixels_per_s"));
+        if (before > 0)
+            g_print (" %+7.1f%%", (mpix / before - 1.0) * 100.0);
+    }
+    g_print ("\n");
+}
+
+int
+main (int argc, char *argv[]) {
+    GOptionContext *optctx;
+    GError *error = NULL;
+    json_error_t jerror;
+    json_t *root, *results, *baseline = NULL;
+    struct utsname host;
+    guint n_threads[2];
+
+    optctx = g_option_context_new ("- Microbenchmarks of the defect detect CPU kernels");
+    g_option_context_add_main_entries (optctx, entries, NULL);
+    if (!g_option_context_parse (optctx, &argc, &argv, &error)) {
+        g_printerr ("Error parsing options: %s\n", error->message);
+        g_option_context_free (optctx);
+        g_clear_error (&error);
+        return -1;
+    }
+    g_option_context_free (optctx);
+
+    if (compare) {
+        baseline = json_load_file (compare, 0, &jerror);
+        if (!baseline) {
+            g_printerr ("%s: %s at line %d\n", compare, jerror.text, jerror.line);
+            return 1;
+        }
+    }
+    n_threads[0] = 1;
+    n_threads[1] = threads > 0 ? threads : MAX (g_get_num_processors (), 1);
+    /* The tiled runs split a frame between the caller and the workers */
+    if (n_threads[1] > 1)
+        dd_workers_init (n_threads[1] - 1);
+
+    root = json_object ();
+    uname (&host);
+    json_object_set_new (root, "host", json_string (host.nodename));
+    json_object_set_new (root, "machine", json_string (host.machine));
+    json_object_set_new (root, "kernel", json_string (host.release));
+    json_object_set_new (root, "compiler", json_string (__VERSION__));
+    json_object_set_new (root, "date", json_integer (time (NULL)));
+    results = json_array ();
+    json_object_set_new (root, "results", results);
+
+    g_print ("%-9s %-6s %3s %3s %9s %10s %8s%s\n", "kernel", "size", "thr", "bnd", "fps", "Mpixel/s", "cyc/pix",
+             baseline ? "    change" : "");
+    for (const Kernel &kernel : kernels) {
+        if (only && g_strcmp0 (only, kernel.name))
+            continue;
+        for (const Resolution &res : resolutions) {
+            for (guint t = 0; t < (n_threads[1] > 1 ? 3 : 1); t++) {
+                json_t *result;
+
+                if (t < 2)
+                    result = bench_run (&kernel, &res, n_threads[t], 1);
+                else if (kernel.banded)
+                    result = bench_run (&kernel, &res, 1, n_threads[1]);
+                else
+                    continue;
+                print_result (result, baseline ? find_result (json_object_get (baseline, "results"), result) : NULL);
+                json_array_append_new (results, result);
+            }
+        }
+    }
+
+    if (output && json_dump_file (root, output, JSON_INDENT (2) | JSON_PRESERVE_ORDER)) {
+        g_printerr ("Cannot write %s\n", output);
+        json_decref (root);
+        return 1;
+    }
+    json_decref (root);
+    if (baseline)
+        json_decref (baseline);
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_emu.h"
+#include "dd_kernel_sw.h"
+
+#include <jansson.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_STATIC (dd_emu_debug);
+#define GST_CAT_DEFAULT dd_emu_debug
+
+typedef int32_t (*KernelInitFunc) (VVASKernel *handle);
+typedef uint32_t (*KernelDeinitFunc) (VVASKernel *handle);
+typedef int32_t (*KernelStartFunc) (VVASKernel *handle, int start, VVASFrame *input[MAX_NUM_OBJECT],
+                                    VVASFrame *output[MAX_NUM_OBJECT]);
+
+typedef struct _Emulation {
+    string format;
+    DDEmuFunc func;
+} Emulation;
+
+struct _DDEmuKernel {
+    VVASKernel *handle;
+    gchar *library;
+    gchar *name;                /* kernel name, NULL for software kernels */
+    void *dl;
+    json_t *root;
+    KernelInitFunc init;
+    KernelDeinitFunc deinit;
+    KernelStartFunc start;
+    guint64 calls;
+    guint64 emulated;
+    guint64 total_ns;
+    guint64 max_ns;
+};
+
+static mutex emu_lock;
+static map<string, Emulation> emulations;
+static map<VVASKernel *, DDEmuKernel *> handles;
+
+static guint64
+now_ns (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+#define ARG_PTR(i) ((guint8 *) (uintptr_t) args[i])
+
+/* in, out, height, width, sigma, threshold */
+static gint
+emulate_otsu (const guint64 *args, guint n_args) {
+    *(guint32 *) ARG_PTR (5) = dd_sw_otsu (ARG_PTR (0), ARG_PTR (1), args[3], args[2]);
+    return 0;
+}
+
+/* in, out, forward pass, fruit pixels, threshold, max value, height, width, stride */
+static gint
+emulate_preprocess (const guint64 *args, guint n_args) {
+    *(guint32 *) ARG_PTR (3) = dd_sw_preprocess (ARG_PTR (0), ARG_PTR (1), ARG_PTR (2), args[4], args[5],
+                                                 args[7], args[6], args[8]);
+    return 0;
+}
+
+/* in, forward pass, out, defect pixels, height, stride */
+static gint
+emulate_cca (const guint64 *args, guint n_args) {
+    *(guint32 *) ARG_PTR (3) = dd_sw_cca (ARG_PTR (0), ARG_PTR (2), args[4], args[5]);
+    return 0;
+}
+
+#undef ARG_PTR
+
+/* Called with the lock held */
+static void
+register_defaults (void) {
+    static gboolean done = FALSE;
+
+    if (done)
+        return;
+    done = TRUE;
+    GST_DEBUG_CATEGORY_INIT (dd_emu_debug, "ddemu", 0, "VVAS runtime emulation");
+    emulations.emplace ("gaussian_otsu_accel", Emulation { "ppuufp", emulate_otsu });
+    emulations.emplace ("preprocess_accel", Emulation { "ppppuuuuu", emulate_preprocess });
+    emulations.emplace ("cca_custom_accel", Emulation { "puppuu", emulate_cca });
+}
+
+void
+dd_emu_register (const gchar *kernel, const gchar *format, DDEmuFunc func) {
+    lock_guard<mutex> guard (emu_lock);
+    register_defaults ();
+    emulations[kernel] = Emulation { format, func };
+}
+
+/* The VVAS runtime calls of the kernel libraries */
+extern "C" {
+
+VVASFrame *
+vvas_alloc_buffer (VVASKernel *handle, uint32_t size, VVASMemoryType mem_type, uint16_t mem_bank,
+                   VVASFrameProps *props) {
+    VVASFrame *frame = g_new0 (VVASFrame, 1);
+
+    frame->vaddr[0] = g_malloc0 (size);
+    frame->paddr[0] = (uint64_t) (uintptr_t) frame->vaddr[0];
+    frame->size[0] = size;
+    frame->n_planes = 1;
+    frame->mem_type = mem_type;
+    if (props)
+        frame->props = *props;
+    return frame;
+}
+
+void
+vvas_free_buffer (VVASKernel *handle, VVASFrame *vvas_frame) {
+    if (!vvas_frame)
+        return;
+    g_free (vvas_frame->vaddr[0]);
+    g_free (vvas_frame);
+}
+
+int32_t
+vvas_kernel_start (VVASKernel *handle, const char *format, ...) {
+    guint64 args[DD_EMU_MAX_ARGS];
+    guint n = 0;
+    DDEmuKernel *kernel;
+    Emulation emulation;
+    va_list ap;
+
+    {
+        lock_guard<mutex> guard (emu_lock);
+        auto h = handles.find (handle);
+        if (h == handles.end () || !h->second->name) {
+            GST_ERROR ("No emulated kernel for handle %p", handle);
+            return -1;
+        }
+        kernel = h->second;
+        auto e = emulations.find (kernel->name);
+        if (e == emulations.end ()) {
+            GST_ERROR ("%s: no emulation of %s", kernel->library, kernel->name);
+            return -1;
+        }
+        emulation = e->second;
+    }
+    if (emulation.format != format) {
+        GST_ERROR ("%s: called with \"%s\", the emulation of %s takes \"%s\"", kernel->library, format,
+                   kernel->name, emulation.format.c_str ());
+        return -1;
+    }
+
+    va_start (ap, format);
+    for (const char *f = format; *f && n < DD_EMU_MAX_ARGS; f++) {
+        switch (*f) {
+            case 'p': args[n++] = va_arg (ap, uint64_t); break;
+            case 'u': args[n++] = va_arg (ap, unsigned int); break;
+            case 'i': args[n++] = (guint64) va_arg (ap, int); break;
+            case 'f': {
+                gdouble value = va_arg (ap, double);
+                memcpy (&args[n++], &value, sizeof (value));
+                break;
+            }
+            default:
+                va_end (ap);
+                GST_ERROR ("%s: unknown argument kind '%c'", kernel->library, *f);
+                return -1;
+        }
+    }
+    va_end (ap);
+
+    __atomic_fetch_add (&kernel->emulated, 1, __ATOMIC_RELAXED);
+    return emulation.func (args, n);
+}
+
+int32_t
+vvas_kernel_done (VVASKernel *handle, int32_t timeout) {
+    /* Emulations complete in vvas_kernel_start () */
+    return 0;
+}
+
+}
+
+DDEmuKernel *
+dd_emu_kernel_open (const gchar *lib_dir, const gchar *config_file) {
+    DDEmuKernel *kernel = g_new0 (DDEmuKernel, 1);
+    json_error_t error;
+    json_t *first, *val;
+    const gchar *library, *name;
+    gchar *path;
+
+    {
+        lock_guard<mutex> guard (emu_lock);
+        register_defaults ();
+    }
+
+    kernel->root = json_load_file (config_file, JSON_DECODE_ANY, &error);
+    if (!kernel->root) {
+        GST_ERROR ("%s: %s at line %d", config_file, error.text, error.line);
+        goto error;
+    }
+    first = json_array_get (json_object_get (kernel->root, "kernels"), 0);
+    library = json_string_value (json_object_get (first, "library-name"));
+    if (!library || !json_is_object (json_object_get (first, "config"))) {
+        GST_ERROR ("%s: no library-name or config in the first kernel", config_file);
+        goto error;
+    }
+    kernel->library = g_strdup (library);
+    /* "cca_custom_accel:{cca_custom_accel_1}", none for software kernels */
+    name = json_string_value (json_object_get (first, "kernel-name"));
+    if (name)
+        kernel->name = g_strndup (name, strcspn (name, ":"));
+
+    if (!lib_dir) {
+        val = json_object_get (kernel->root, "vvas-library-repo");
+        lib_dir = json_is_string (val) ? json_string_value (val) : ".";
+    }
+    path = g_build_filename (lib_dir, library, NULL);
+    kernel->dl = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+    g_free (path);
+    if (!kernel->dl) {
+        GST_ERROR ("%s", dlerror ());
+        goto error;
+    }
+    kernel->init   = (KernelInitFunc) dlsym (kernel->dl, "xlnx_kernel_init");
+    kernel->deinit = (KernelDeinitFunc) dlsym (kernel->dl, "xlnx_kernel_deinit");
+    kernel->start  = (KernelStartFunc) dlsym (kernel->dl, "xlnx_kernel_start");
+    if (!kernel->init || !kernel->deinit || !kernel->start) {
+        GST_ERROR ("%s: missing kernel entry points", library);
+        goto error;
+    }
+
+    kernel->handle = g_new0 (VVASKernel, 1);
+    kernel->handle->kernel_config = json_object_get (first, "config");
+    {
+        lock_guard<mutex> guard (emu_lock);
+        handles[kernel->handle] = kernel;
+    }
+    if (kernel->init (kernel->handle)) {
+        GST_ERROR ("%s: xlnx_kernel_init failed", library);
+        goto error;
+    }
+    GST_DEBUG ("%s loaded, emulating %s", library, kernel->name ? kernel->name : "nothing");
+    return kernel;
+
+error:
+    dd_emu_kernel_close (kernel);
+    return NULL;
+}
+
+gint32
+dd_emu_kernel_start (DDEmuKernel *kernel, VVASFrame *input, VVASFrame *output) {
+    VVASFrame *in[MAX_NUM_OBJECT] = { input };
+    VVASFrame *out[MAX_NUM_OBJECT] = { output };
+    guint64 start, elapsed;
+    gint32 ret;
+
+    start = now_ns ();
+    ret = kernel->start (kernel->handle, 1, in, out);
+    elapsed = now_ns () - start;
+
+    __atomic_fetch_add (&kernel->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&kernel->total_ns, elapsed, __ATOMIC_RELAXED);
+    if (elapsed > __atomic_load_n (&kernel->max_ns, __ATOMIC_RELAXED))
+        __atomic_store_n (&kernel->max_ns, elapsed, __ATOMIC_RELAXED);
+    return ret;
+}
+
+void
+dd_emu_kernel_close (DDEmuKernel *kernel) {
+    if (!kernel)
+        return;
+    if (kernel->handle) {
+        /* Deinit only what init set up */
+        if (kernel->handle->kernel_priv)
+            kernel->deinit (kernel->handle);
+        lock_guard<mutex> guard (emu_lock);
+        handles.erase (kernel->handle);
+    }
+    g_free (kernel->handle);
+    if (kernel->dl)
+        dlclose (kernel->dl);
+    if (kernel->root)
+        json_decref (kernel->root);
+    g_free (kernel->library);
+    g_free (kernel->name);
+    g_free (kernel);
+}
+
+void
+dd_emu_kernel_stats (DDEmuKernel *kernel, DDEmuStats *stats) {
+    stats->name     = kernel->library;
+    stats->calls    = __atomic_load_n (&kernel->calls, __ATOMIC_RELAXED);
+    stats->emulated = __atomic_load_n (&kernel->emulated, __ATOMIC_RELAXED);
+    stats->total_ns = __atomic_load_n (&kernel->total_ns, __ATOMIC_RELAXED);
+    stats->max_ns   = __atomic_load_n (&kernel->max_ns, __ATOMIC_RELAXED);
+}
+
+VVASFrame *
+dd_emu_frame_new (guint width, guint height, guint stride, GstBuffer *meta_from) {
+    VVASFrameProps props;
+    VVASFrame *frame;
+    GstBuffer *buf = gst_buffer_new ();
+
+    memset (&props, 0, sizeof (props));
+    props.width = width;
+    props.height = height;
+    props.stride = stride;
+    frame = vvas_alloc_buffer (NULL, stride * height, VVAS_FRAME_MEMORY, DEFAULT_MEM_BANK, &props);
+    if (meta_from)
+        gst_buffer_copy_into (buf, meta_from, GST_BUFFER_COPY_METADATA, 0, -1);
+    frame->app_priv = buf;
+    return frame;
+}
+
+void
+dd_emu_frame_free (VVASFrame *frame) {
+    if (!frame)
+        return;
+    if (frame->app_priv)
+        gst_buffer_unref ((GstBuffer *) frame->app_priv);
+    vvas_free_buffer (NULL, frame);
+}
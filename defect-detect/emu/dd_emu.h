@@ -0,0 +1,209 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_EMU_H
+#define DD_EMU_H
+
+#include <gst/gst.h>
+#include <vvas/vvas_kernel.h>
+
+/*
+ * Stand-in of the VVAS runtime, to drive the kernel libraries without XRT
+ * or an xclbin.
+ *
+ * libvvasemu defines vvas_alloc_buffer (), vvas_free_buffer (),
+ * vvas_kernel_start () and vvas_kernel_done (). Buffers are ordinary
+ * memory whose physical address is their virtual one, and
+ * vvas_kernel_start () runs the emulation registered for the kernel name
+ * of the handle, synchronously. The unmodified libraries pick these
+ * definitions up when the program is linked against libvvasemu, ahead of
+ * vvasutil, or when they are themselves linked against it (DD_VVAS_EMU).
+ *
+ * gaussian_otsu_accel, preprocess_accel and cca_custom_accel are
+ * registered on first use with the models of dd_kernel_sw.h.
+ */
+
+/* Arguments of a vvas_kernel_start () call */
+#define DD_EMU_MAX_ARGS     16
+
+/** @brief
+ *  Emulation of an accelerator.
+ *
+ *  @param args is the arguments of vvas_kernel_start (), in the order of
+ *  its format: addresses and integers as is, floats as their bits.
+ *  @param n_args is the number of arguments.
+ *  @return 0, or a negative value if the accelerator would fail.
+ */
+typedef gint (*DDEmuFunc) (const guint64 *args, guint n_args);
+
+typedef struct _DDEmuKernel DDEmuKernel;
+
+typedef struct _DDEmuStats {
+    const gchar *name;          /* library */
+    guint64 calls;              /* xlnx_kernel_start () */
+    guint64 emulated;           /* vvas_kernel_start () */
+    guint64 total_ns;
+    guint64 max_ns;
+} DDEmuStats;
+
+/** @brief
+ *  Register the emulation of an accelerator, replacing any earlier one.
+ *
+ *  @param kernel is the kernel name, without the instance ("cca_custom_accel").
+ *  @param format is the vvas_kernel_start () format the kernel is called with.
+ *  @param func is the emulation.
+ *  @return Void.
+ */
+void dd_emu_register (const gchar *kernel, const gchar *format, DDEmuFunc func);
+
+/** @brief
+ *  Load a kernel library and initialize it with the first kernel of a
+ *  vvas_xfilter config, as vvas_xfilter does.
+ *
+ *  @param lib_dir is the directory of the library, NULL for the
+ *  "vvas-library-repo" of the config.
+ *  @param config_file is the vvas_xfilter config.
+ *  @return the kernel, NULL on errors.
+ */
+DDEmuKernel * dd_emu_kernel_open (const gchar *lib_dir, const gchar *config_file);
+
+/** @brief
+ *  Process a frame: xlnx_kernel_start () with one input and one output,
+ *  timed.
+ *
+ *  @param kernel is the kernel.
+ *  @param input is the input frame.
+ *  @param output is the output frame, @input for in-place kernels.
+ *  @return the value xlnx_kernel_start () returned.
+ */
+gint32 dd_emu_kernel_start (DDEmuKernel *kernel, VVASFrame *input, VVASFrame *output);
+
+/** @brief
+ *  Deinitialize and unload a kernel library.
+ *
+ *  @param kernel is the kernel, may be NULL.
+ *  @return Void.
+ */
+void dd_emu_kernel_close (DDEmuKernel *kernel);
+
+/** @brief
+ *  Calls and timing of a kernel.
+ *
+ *  @param kernel is the kernel.
+ *  @param stats is filled with the figures.
+ *  @return Void.
+ */
+void dd_emu_kernel_stats (DDEmuKernel *kernel, DDEmuStats *stats);
+
+/** @brief
+ *  Allocate a GRAY8 frame with the GstBuffer vvas_xfilter would hand the
+ *  kernel as app_priv: a new buffer with the metadata of @meta_from, as
+ *  in transform mode. In-place kernels get their input as output.
+ *
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param stride is the row size.
+ *  @param meta_from is the buffer to copy the metadata from, may be NULL.
+ *  @return the frame, freed with dd_emu_frame_free ().
+ */
+VVASFrame * dd_emu_frame_new (guint width, guint height, guint stride, GstBuffer *meta_from);
+
+/** @brief
+ *  Free a frame of dd_emu_frame_new () and its buffer.
+ *
+ *  @param frame is the frame, may be NULL.
+ *  @return Void.
+ */
+void dd_emu_frame_free (VVASFrame *frame);
+
+/*
+ * The defect detect chain, otsu ! preprocess ! cca ! text2overlay, run frame
+ * by frame with the configs of the application.
+ */
+
+typedef struct _DDEmuChain DDEmuChain;
+
+typedef enum {
+    DD_EMU_STAGE_OTSU,
+    DD_EMU_STAGE_PREPROCESS,
+    DD_EMU_STAGE_CCA,
+    DD_EMU_STAGE_TEXT2OVERLAY,
+    DD_EMU_STAGES
+} DDEmuStage;
+
+typedef struct _DDEmuResult {
+    guint32 threshold;
+    guint32 fruit_pixels;
+    guint32 defect_pixels;
+    gdouble density;
+    gboolean defective;
+} DDEmuResult;
+
+/** @brief
+ *  Called with the output of each stage.
+ *
+ *  @param stage is the stage.
+ *  @param frame is its output frame.
+ *  @param user_data is the data given to dd_emu_chain_run ().
+ *  @return Void.
+ */
+typedef void (*DDEmuStageFunc) (DDEmuStage stage, VVASFrame *frame, gpointer user_data);
+
+/** @brief
+ *  Load the kernel libraries of the chain.
+ *
+ *  @param lib_dir is the directory of the libraries, NULL for the one of
+ *  each config.
+ *  @param config_dir is the directory of the kernel configs.
+ *  @return the chain, NULL on errors.
+ */
+DDEmuChain * dd_emu_chain_open (const gchar *lib_dir, const gchar *config_dir);
+
+/** @brief
+ *  Run a frame through the chain.
+ *
+ *  @param chain is the chain.
+ *  @param data is the packed GRAY8 frame.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param stride is the row size of the preprocess and cca outputs.
+ *  @param result is filled with the result text2overlay attaches.
+ *  @param func is called with the output of each stage, may be NULL.
+ *  @param user_data is passed to @func.
+ *  @return FALSE if a stage failed.
+ */
+gboolean dd_emu_chain_run (DDEmuChain *chain, const guint8 *data, guint width, guint height, guint stride,
+                           DDEmuResult *result, DDEmuStageFunc func, gpointer user_data);
+
+/** @brief
+ *  The kernel of a stage, for its figures.
+ *
+ *  @param chain is the chain.
+ *  @param stage is the stage.
+ *  @return the kernel.
+ */
+DDEmuKernel * dd_emu_chain_kernel (DDEmuChain *chain, DDEmuStage stage);
+
+/** @brief
+ *  Unload the kernel libraries of the chain.
+ *
+ *  @param chain is the chain, may be NULL.
+ *  @return Void.
+ */
+void dd_emu_chain_close (DDEmuChain *chain);
+
+#endif /* DD_EMU_H */
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_emu.h"
+#include "../src/dd_result_meta.h"
+
+#include <gst/vvas/gstinferencemeta.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (dd_emu_chain_debug);
+#define GST_CAT_DEFAULT dd_emu_chain_debug
+
+static const gchar *stage_configs[DD_EMU_STAGES] = {
+    "otsu-accelarator.json",
+    "preprocess-accelarator.json",
+    "cca-accelarator.json",
+    "text2overlay.json",
+};
+
+struct _DDEmuChain {
+    DDEmuKernel *kernels[DD_EMU_STAGES];
+};
+
+DDEmuChain *
+dd_emu_chain_open (const gchar *lib_dir, const gchar *config_dir) {
+    DDEmuChain *chain = g_new0 (DDEmuChain, 1);
+
+    GST_DEBUG_CATEGORY_INIT (dd_emu_chain_debug, "ddemuchain", 0, "Emulated defect detect chain");
+    for (guint i = 0; i < DD_EMU_STAGES; i++) {
+        gchar *path = g_build_filename (config_dir, stage_configs[i], NULL);
+        chain->kernels[i] = dd_emu_kernel_open (lib_dir, path);
+        g_free (path);
+        if (!chain->kernels[i]) {
+            dd_emu_chain_close (chain);
+            return NULL;
+        }
+    }
+    return chain;
+}
+
+static gboolean
+read_result (GstBuffer *buf, DDEmuResult *result) {
+    GstInferenceMeta *meta;
+    GstInferenceClassification *found = NULL;
+    GSList *children;
+
+    meta = (GstInferenceMeta *) gst_buffer_get_meta (buf, gst_inference_meta_api_get_type ());
+    if (!meta || !meta->prediction)
+        return FALSE;
+
+    children = gst_inference_prediction_get_children (meta->prediction);
+    for (GSList *child = children; child && !found; child = g_slist_next (child)) {
+        GstInferencePrediction *pred = (GstInferencePrediction *) child->data;
+        for (GList *l = pred->classifications; l; l = g_list_next (l)) {
+            GstInferenceClassification *c = (GstInferenceClassification *) l->data;
+            if (!g_strcmp0 (c->class_label, DD_RESULT_LABEL) && c->num_classes >= DD_RESULT_VALUES) {
+                found = c;
+                break;
+            }
+        }
+    }
+    g_slist_free (children);
+    if (!found)
+        return FALSE;
+
+    result->threshold     = (guint32) found->probabilities[DD_RESULT_THRESHOLD];
+    result->fruit_pixels  = (guint32) found->probabilities[DD_RESULT_FRUIT_PIXELS];
+    result->defect_pixels = (guint32) found->probabilities[DD_RESULT_DEFECT_PIXELS];
+    result->density       = found->probabilities[DD_RESULT_DENSITY];
+    result->defective     = found->class_id ? TRUE : FALSE;
+    return TRUE;
+}
+
+gboolean
+dd_emu_chain_run (DDEmuChain *chain, const guint8 *data, guint width, guint height, guint stride,
+                  DDEmuResult *result, DDEmuStageFunc func, gpointer user_data) {
+    VVASFrame *in = dd_emu_frame_new (width, height, width, NULL);
+    VVASFrame *frames[DD_EMU_STAGES] = { NULL };
+    VVASFrame *prev = in;
+    gboolean ok = TRUE;
+
+    memcpy (in->vaddr[0], data, width * height);
+    for (guint i = 0; i < DD_EMU_STAGES && ok; i++) {
+        VVASFrame *out;
+
+        /* text2overlay draws in place, the accelerators write a new frame */
+        if (i == DD_EMU_STAGE_TEXT2OVERLAY)
+            out = prev;
+        else
+            out = frames[i] = dd_emu_frame_new (width, height, i == DD_EMU_STAGE_OTSU ? width : stride,
+                                                (GstBuffer *) prev->app_priv);
+
+        /* The accelerator wrappers return TRUE on success, text2overlay 0 */
+        if (i == DD_EMU_STAGE_TEXT2OVERLAY) {
+            dd_emu_kernel_start (chain->kernels[i], out, out);
+            ok = read_result ((GstBuffer *) out->app_priv, result);
+        }
+        else {
+            ok = dd_emu_kernel_start (chain->kernels[i], prev, out) ? TRUE : FALSE;
+        }
+        if (!ok) {
+            GST_ERROR ("%s failed", stage_configs[i]);
+            break;
+        }
+        if (func)
+            func ((DDEmuStage) i, out, user_data);
+        prev = out;
+    }
+
+    dd_emu_frame_free (in);
+    for (guint i = 0; i < DD_EMU_STAGES; i++)
+        dd_emu_frame_free (frames[i]);
+    return ok;
+}
+
+DDEmuKernel *
+dd_emu_chain_kernel (DDEmuChain *chain, DDEmuStage stage) {
+    return chain->kernels[stage];
+}
+
+void
+dd_emu_chain_close (DDEmuChain *chain) {
+    if (!chain)
+        return;
+    for (guint i = 0; i < DD_EMU_STAGES; i++)
+        dd_emu_kernel_close (chain->kernels[i]);
+    g_free (chain);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Drive the unmodified kernel libraries on a machine without XRT: frames of
+ * a .y8 file, or of the synthetic corpus, go through otsu ! preprocess !
+ * cca ! text2overlay with the accelerators emulated by libvvasemu. Prints
+ * the result of each frame and the time spent in each library, and
+ * optionally writes the output of every stage.
+ */
+
+#include "dd_emu.h"
+#include "dd_kernel_sw.h"
+#include "dd_workers.h"
+
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+static gchar *lib_dir = NULL;
+static gchar *config_dir = NULL;
+static gchar *in_file = NULL;
+static gchar *dump_dir = NULL;
+static gint width = DD_SW_CORPUS_WIDTH;
+static gint height = DD_SW_CORPUS_HEIGHT;
+static gint stride = 0;
+static gint frames = 0;
+
+static GOptionEntry entries[] =
+{
+    { "libdir",  'l', 0, G_OPTION_ARG_FILENAME, &lib_dir, "Directory of the kernel libraries, the one of each config by default", "lib path"},
+    { "cfgpath", 'c', 0, G_OPTION_ARG_FILENAME, &config_dir, "Directory of the kernel configs", "/opt/xilinx/xlnx-app-kr260-mv-defect-detect/share/vvas/"},
+    { "infile",  'i', 0, G_OPTION_ARG_FILENAME, &in_file, "GRAY8 frames to process, the synthetic corpus by default", "file path"},
+    { "width",   'w', 0, G_OPTION_ARG_INT, &width, "Frame width", "640"},
+    { "height",  'h', 0, G_OPTION_ARG_INT, &height, "Frame height", "480"},
+    { "stride",  's', 0, G_OPTION_ARG_INT, &stride, "Row size of the preprocess and cca outputs, the width 256 byte aligned by default", "768"},
+    { "frames",  'n', 0, G_OPTION_ARG_INT, &frames, "Frames to process, looping over the input, 0 for each once", "0"},
+    { "dump",    'd', 0, G_OPTION_ARG_FILENAME, &dump_dir, "Write the output of every stage to a directory", "dir path"},
+    { NULL }
+};
+
+static const gchar *stage_names[DD_EMU_STAGES] = { "otsu", "preprocess", "cca", "text2overlay" };
+
+typedef struct _Dump {
+    guint frame;
+    gboolean failed;
+} Dump;
+
+static void
+dump_stage (DDEmuStage stage, VVASFrame *frame, gpointer user_data) {
+    Dump *dump = (Dump *) user_data;
+    gchar *name = g_strdup_printf ("%s-%05u-%ux%u-%u.y8", stage_names[stage], dump->frame,
+                                   frame->props.width, frame->props.height, frame->props.stride);
+    gchar *path = g_build_filename (dump_dir, name, NULL);
+    GError *error = NULL;
+
+    if (!g_file_set_contents (path, (const gchar *) frame->vaddr[0], frame->props.stride * frame->props.height,
+                              &error)) {
+        g_printerr ("%s\n", error->message);
+        g_clear_error (&error);
+        dump->failed = TRUE;
+    }
+    g_free (name);
+    g_free (path);
+}
+
+static void
+print_kernels (DDEmuChain *chain) {
+    g_print ("%-26s %8s %8s %10s %10s\n", "library", "calls", "emulated", "mean ms", "max ms");
+    for (guint i = 0; i < DD_EMU_STAGES; i++) {
+        DDEmuStats stats;
+        dd_emu_kernel_stats (dd_emu_chain_kernel (chain, (DDEmuStage) i), &stats);
+        g_print ("%-26s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %10.3f %10.3f\n", stats.name,
+                 stats.calls, stats.emulated, stats.calls ? stats.total_ns / 1e6 / stats.calls : 0.0,
+                 stats.max_ns / 1e6);
+    }
+}
+
+static void
+print_workers (void) {
+    DDWorkersStats stats;
+
+    dd_workers_stats (&stats);
+    if (!stats.workers)
+        return;
+    g_print ("worker pool: %u threads, %" G_GUINT64_FORMAT " tasks, %" G_GUINT64_FORMAT " stolen, %"
+             G_GUINT64_FORMAT " run by waiting callers, %" G_GUINT64_FORMAT " sleeps\n", stats.workers,
+             (guint64) stats.tasks, (guint64) stats.steals, (guint64) stats.helped, (guint64) stats.sleeps);
+}
+
+int
+main (int argc, char *argv[]) {
+    GOptionContext *optctx;
+    GError *error = NULL;
+    DDEmuChain *chain;
+    gchar *contents = NULL;
+    gsize size = 0, frame_size, available;
+    vector<guint8> synthetic;
+    guint failures = 0;
+
+    optctx = g_option_context_new ("- Run the defect detect kernel libraries with emulated accelerators");
+    g_option_context_add_main_entries (optctx, entries, NULL);
+    g_option_context_add_group (optctx, gst_init_get_option_group ());
+    if (!g_option_context_parse (optctx, &argc, &argv, &error)) {
+        g_printerr ("Error parsing options: %s\n", error->message);
+        g_option_context_free (optctx);
+        g_clear_error (&error);
+        return -1;
+    }
+    g_option_context_free (optctx);
+    gst_init (&argc, &argv);
+
+    if (width <= 0 || height <= 0 || stride < 0 || (stride && stride < width) || frames < 0) {
+        g_printerr ("Invalid frame size or count\n");
+        return -1;
+    }
+    if (!stride)
+        stride = (width + 255) / 256 * 256;
+    frame_size = (gsize) width * height;
+
+    if (in_file) {
+        if (!g_file_get_contents (in_file, &contents, &size, &error)) {
+            g_printerr ("%s\n", error->message);
+            g_clear_error (&error);
+            return 1;
+        }
+        available = size / frame_size;
+        if (!available) {
+            g_printerr ("%s holds no %dx%d frame\n", in_file, width, height);
+            g_free (contents);
+            return 1;
+        }
+    }
+    else {
+        available = DD_SW_CORPUS_FRAMES;
+        synthetic.resize (frame_size * available);
+        for (guint i = 0; i < available; i++)
+            dd_sw_make_frame (i, width, height, synthetic.data () + i * frame_size);
+    }
+    if (!frames)
+        frames = available;
+    if (dump_dir && g_mkdir_with_parents (dump_dir, 0755)) {
+        g_printerr ("Cannot create %s\n", dump_dir);
+        g_free (contents);
+        return 1;
+    }
+
+    chain = dd_emu_chain_open (lib_dir, config_dir ? config_dir : "/opt/xilinx/xlnx-app-kr260-mv-defect-detect/share/vvas/");
+    if (!chain) {
+        g_printerr ("Cannot load the kernel libraries, see GST_DEBUG=ddemu:5\n");
+        g_free (contents);
+        return 1;
+    }
+
+    g_print ("%6s %9s %12s %13s %9s %s\n", "frame", "threshold", "fruit_pixels", "defect_pixels", "density", "decision");
+    for (guint i = 0; i < (guint) frames; i++) {
+        const guint8 *data = (in_file ? (const guint8 *) contents : synthetic.data ()) + (i % available) * frame_size;
+        DDEmuResult result;
+        Dump dump = { i, FALSE };
+
+        if (!dd_emu_chain_run (chain, data, width, height, stride, &result, dump_dir ? dump_stage : NULL, &dump) ||
+            dump.failed) {
+            g_printerr ("Frame %u failed\n", i);
+            failures++;
+            continue;
+        }
+        g_print ("%6u %9u %12u %13u %8.3f%% %s\n", i, result.threshold, result.fruit_pixels, result.defect_pixels,
+                 result.density, result.defective ? "defective" : "good");
+    }
+    print_kernels (chain);
+    print_workers ();
+
+    dd_emu_chain_close (chain);
+    g_free (contents);
+    return failures ? 1 : 0;
+}
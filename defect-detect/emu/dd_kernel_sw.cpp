@@ -0,0 +1,257 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_kernel_sw.h"
+
+#include <string.h>
+#include <vector>
+#include "dd_workers.h"
+
+using namespace std;
+
+/* The belt brightens across the frame and the fruit darkens to its rim,
+ * so that the two overlap in the histogram as under the real lighting */
+#define BELT_LEVEL      30
+#define BELT_GRADIENT   50
+#define FRUIT_LEVEL     200
+#define FRUIT_SHADING   90
+#define DEFECT_LEVEL    60
+#define NOISE_RANGE     8
+
+/* Rows below which a band is not worth a task of the worker pool */
+#define BAND_MIN_ROWS   64
+
+typedef struct _OtsuBands {
+    const guint8 *in;
+    guint8 *out;
+    guint width;
+    guint64 *hists;             /* 256 bins per band */
+} OtsuBands;
+
+typedef struct _BinarizeBands {
+    const guint8 *in;
+    guint8 *out;
+    guint8 *fwd;
+    guint32 threshold;
+    guint32 max_value;
+    guint width;
+    guint stride;
+    guint32 *fruit;             /* per band */
+} BinarizeBands;
+
+static void
+otsu_band (guint band, guint first_row, guint end_row, gpointer user_data) {
+    OtsuBands *b = (OtsuBands *) user_data;
+    guint64 *hist = b->hists + band * 256;
+    gsize first = (gsize) first_row * b->width, end = (gsize) end_row * b->width;
+
+    for (gsize i = first; i < end; i++)
+        hist[b->in[i]]++;
+    if (b->out != b->in)
+        memcpy (b->out + first, b->in + first, end - first);
+}
+
+static void
+binarize_band (guint band, guint first_row, guint end_row, gpointer user_data) {
+    BinarizeBands *b = (BinarizeBands *) user_data;
+    guint32 fruit = 0;
+
+    for (guint y = first_row; y < end_row; y++) {
+        for (guint x = 0; x < b->stride; x++) {
+            guint8 v = x < b->width && b->in[y * b->width + x] > b->threshold ? b->max_value : 0;
+            b->out[y * b->stride + x] = v;
+            b->fwd[y * b->stride + x] = v;
+            fruit += x < b->width && v;
+        }
+    }
+    b->fruit[band] = fruit;
+}
+
+guint32
+dd_sw_otsu (const guint8 *in, guint8 *out, guint width, guint height) {
+    guint64 hist[256] = { 0 };
+    guint64 total = (guint64) width * height, sum = 0, sum_b = 0, w_b = 0;
+    gdouble best = -1;
+    guint32 threshold = 0;
+    guint bands = dd_workers_bands (height, BAND_MIN_ROWS);
+    vector<guint64> hists (bands * 256, 0);
+    OtsuBands b = { in, out, width, hists.data () };
+
+    /* Histogram and copy each band, then sum the band histograms */
+    dd_workers_parallel_rows (height, bands, otsu_band, &b);
+    for (guint i = 0; i < bands; i++)
+        for (guint t = 0; t < 256; t++)
+            hist[t] += hists[i * 256 + t];
+    for (guint t = 0; t < 256; t++)
+        sum += (guint64) t * hist[t];
+    for (guint t = 0; t < 256; t++) {
+        guint64 w_f;
+        gdouble m_b, m_f, between;
+
+        w_b += hist[t];
+        w_f = total - w_b;
+        if (!w_b || !w_f)
+            continue;
+        sum_b += (guint64) t * hist[t];
+        m_b = (gdouble) sum_b / w_b;
+        m_f = (gdouble) (sum - sum_b) / w_f;
+        between = (gdouble) w_b * w_f * (m_b - m_f) * (m_b - m_f);
+        if (between > best) {
+            best = between;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+guint32
+dd_sw_preprocess (const guint8 *in, guint8 *out, guint8 *fwd, guint32 threshold, guint32 max_value,
+                  guint width, guint height, guint stride) {
+    guint bands = dd_workers_bands (height, BAND_MIN_ROWS);
+    vector<guint32> fruit (bands, 0);
+    BinarizeBands b = { in, out, fwd, threshold, max_value, width, stride, fruit.data () };
+    guint32 total = 0;
+
+    dd_workers_parallel_rows (height, bands, binarize_band, &b);
+    for (guint32 n : fruit)
+        total += n;
+    return total;
+}
+
+guint32
+dd_sw_cca (const guint8 *in, guint8 *out, guint height, guint stride) {
+    vector<guint8> reached ((gsize) height * stride, 0);
+    vector<guint32> todo;
+    guint32 defects = 0;
+
+    /* Flood the background from the border */
+    for (guint y = 0; y < height; y++) {
+        for (guint x = 0; x < stride; x++) {
+            guint32 i = y * stride + x;
+            if ((y == 0 || x == 0 || y == height - 1 || x == stride - 1) && !in[i]) {
+                reached[i] = 1;
+                todo.push_back (i);
+            }
+        }
+    }
+    while (!todo.empty ()) {
+        guint32 i = todo.back (), y = i / stride, x = i % stride;
+        guint32 next[4];
+        guint n = 0;
+
+        todo.pop_back ();
+        if (x > 0)
+            next[n++] = i - 1;
+        if (x + 1 < stride)
+            next[n++] = i + 1;
+        if (y > 0)
+            next[n++] = i - stride;
+        if (y + 1 < height)
+            next[n++] = i + stride;
+        for (guint k = 0; k < n; k++) {
+            if (!in[next[k]] && !reached[next[k]]) {
+                reached[next[k]] = 1;
+                todo.push_back (next[k]);
+            }
+        }
+    }
+    for (gsize i = 0; i < reached.size (); i++) {
+        gboolean defect = !in[i] && !reached[i];
+        out[i] = defect ? 255 : 0;
+        defects += defect;
+    }
+    return defects;
+}
+
+void
+dd_sw_mask_grid (const guint8 *mask, guint width, guint height, guint stride,
+                 guint32 grid[DD_SW_GRID * DD_SW_GRID]) {
+    memset (grid, 0, DD_SW_GRID * DD_SW_GRID * sizeof (guint32));
+    for (guint y = 0; y < height; y++)
+        for (guint x = 0; x < width; x++)
+            if (mask[y * stride + x])
+                grid[y * DD_SW_GRID / height * DD_SW_GRID + x * DD_SW_GRID / width]++;
+}
+
+/** @brief
+ *  What the scene of frame @index holds at a pixel, before noise.
+ *
+ *  @param label is set to what the pixel shows.
+ *  @return the noiseless level of the pixel.
+ */
+static gint
+scene_pixel (guint index, guint width, guint height, guint x, guint y, DDSwLabel *label) {
+    gint cx = width / 2 + ((gint) (index % 3) - 1) * (gint) width / 8;
+    gint cy = height / 2;
+    gint rx = width / 5, ry = height / 4;
+    gint dx = (gint) x - cx, dy = (gint) y - cy;
+    /* Squared distance to the center, 1.0 on the rim */
+    gdouble r2 = (gdouble) dx * dx / (rx * rx) + (gdouble) dy * dy / (ry * ry);
+    gint v;
+
+    if (r2 > 1.0) {
+        *label = DD_SW_BELT;
+        return BELT_LEVEL + (gint) (BELT_GRADIENT * x / width);
+    }
+    *label = DD_SW_FRUIT;
+    v = FRUIT_LEVEL - (gint) (FRUIT_SHADING * r2);
+    /* Spots along the long axis of the fruit, growing in size */
+    for (guint k = 0; k < index % 4; k++) {
+        gint sx = cx + ((gint) k - 1) * rx / 2, r = 4 + 3 * k;
+        if (((gint) x - sx) * ((gint) x - sx) + dy * dy <= r * r) {
+            *label = DD_SW_DEFECT;
+            v = DEFECT_LEVEL;
+        }
+    }
+    return v;
+}
+
+void
+dd_sw_make_frame (guint index, guint width, guint height, guint8 *frame) {
+    guint32 seed = 12345 + index * 7919;
+    DDSwLabel label;
+
+    for (guint y = 0; y < height; y++) {
+        for (guint x = 0; x < width; x++) {
+            gint v = scene_pixel (index, width, height, x, y, &label);
+
+            seed = seed * 1103515245 + 12345;
+            v += (gint) ((seed >> 16) % (2 * NOISE_RANGE + 1)) - NOISE_RANGE;
+            frame[y * width + x] = CLAMP (v, 0, 255);
+        }
+    }
+}
+
+void
+dd_sw_make_truth (guint index, guint width, guint height, guint8 *labels) {
+    DDSwLabel label;
+
+    for (guint y = 0; y < height; y++) {
+        for (guint x = 0; x < width; x++) {
+            scene_pixel (index, width, height, x, y, &label);
+            labels[y * width + x] = label;
+        }
+    }
+}
+
+void
+dd_sw_threshold_range (guint32 *min, guint32 *max) {
+    /* The brightest belt or defect pixel, and one below the darkest
+     * fruit pixel, on the rim */
+    *min = MAX (BELT_LEVEL + BELT_GRADIENT, DEFECT_LEVEL) + NOISE_RANGE;
+    *max = FRUIT_LEVEL - FRUIT_SHADING - NOISE_RANGE - 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_KERNEL_SW_H
+#define DD_KERNEL_SW_H
+
+#include <glib.h>
+
+/*
+ * Software models of the accelerators, with the arguments the kernel
+ * libraries pass to vvas_kernel_start (), and the synthetic scenes the
+ * regression suite runs. The models stand in for the hardware, not for
+ * its exact output: the golden results of the synthetic corpus come
+ * from the ground truth of the scenes, never from the models. The otsu
+ * and preprocess models split frames into row bands on the worker pool
+ * (dd_workers.h), with the same results as on one thread.
+ */
+
+/* Frames of the synthetic corpus */
+#define DD_SW_CORPUS_WIDTH     640
+#define DD_SW_CORPUS_HEIGHT    480
+#define DD_SW_CORPUS_FRAMES    8
+
+/* Masks are compared as DD_SW_GRID x DD_SW_GRID cell counts */
+#define DD_SW_GRID             8
+
+/* libvvas_preprocess binarizes at the Otsu threshold less this */
+#define DD_SW_PREPROCESS_OFFSET 13
+
+/* What a pixel of a synthetic scene shows */
+typedef enum {
+    DD_SW_BELT,
+    DD_SW_FRUIT,
+    DD_SW_DEFECT,               /* a dark spot within the fruit */
+} DDSwLabel;
+
+/** @brief
+ *  Otsu threshold of a frame, which is passed through.
+ *
+ *  @param in is the packed input frame.
+ *  @param out is the packed output frame.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @return the threshold.
+ */
+guint32 dd_sw_otsu (const guint8 *in, guint8 *out, guint width, guint height);
+
+/** @brief
+ *  Binarize a frame: pixels above the threshold are fruit.
+ *
+ *  @param in is the packed input frame.
+ *  @param out is the mask, @stride bytes per row.
+ *  @param fwd is the forward pass image, the same mask.
+ *  @param threshold is the fruit threshold.
+ *  @param max_value is the value of fruit pixels in the mask.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param stride is the row size of the outputs.
+ *  @return the fruit pixels.
+ */
+guint32 dd_sw_preprocess (const guint8 *in, guint8 *out, guint8 *fwd, guint32 threshold, guint32 max_value,
+                          guint width, guint height, guint stride);
+
+/** @brief
+ *  Find the defects: background pixels of the mask that are not
+ *  4-connected to its border, i.e. holes in the fruit.
+ *
+ *  @param in is the mask, @stride bytes per row.
+ *  @param out is the defect mask, 255 on defects.
+ *  @param height is the frame height.
+ *  @param stride is the row size, taken as the width.
+ *  @return the defect pixels.
+ */
+guint32 dd_sw_cca (const guint8 *in, guint8 *out, guint height, guint stride);
+
+/** @brief
+ *  Count the set pixels of a mask in each cell of a DD_SW_GRID x
+ *  DD_SW_GRID grid, which tolerates the few pixels an accelerator may
+ *  round differently at the edges of the fruit.
+ *
+ *  @param mask is the mask, @stride bytes per row.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param stride is the row size.
+ *  @param grid is filled with the counts, row by row.
+ *  @return Void.
+ */
+void dd_sw_mask_grid (const guint8 *mask, guint width, guint height, guint stride,
+                      guint32 grid[DD_SW_GRID * DD_SW_GRID]);
+
+/** @brief
+ *  Draw frame @index of the synthetic corpus: a fruit on the belt with
+ *  index % 4 dark spots, and deterministic noise.
+ *
+ *  @param index is the frame number.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param frame is filled with the packed frame.
+ *  @return Void.
+ */
+void dd_sw_make_frame (guint index, guint width, guint height, guint8 *frame);
+
+/** @brief
+ *  Ground truth of frame @index of the synthetic corpus: the DDSwLabel
+ *  of every pixel, from the geometry of the scene alone.
+ *
+ *  @param index is the frame number.
+ *  @param width is the frame width.
+ *  @param height is the frame height.
+ *  @param labels is filled with a DDSwLabel per pixel, packed.
+ *  @return Void.
+ */
+void dd_sw_make_truth (guint index, guint width, guint height, guint8 *labels);
+
+/** @brief
+ *  Binarization thresholds that separate the fruit of the synthetic
+ *  scenes from the belt and the defects despite the noise: every belt
+ *  and defect pixel is at most such a threshold, every fruit pixel
+ *  above it.
+ *
+ *  @param min is set to the lowest such threshold.
+ *  @param max is set to the highest.
+ *  @return Void.
+ */
+void dd_sw_threshold_range (guint32 *min, guint32 *max);
+
+#endif /* DD_KERNEL_SW_H */
@@ -0,0 +1,313 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_affinity.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <mutex>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+/* Elements followed downstream of a task owner to find its group */
+#define MAX_HOPS    32
+
+static const gchar *group_names[DD_THREAD_GROUPS] = { "main", "capture", "kernel", "overlay", "sink" };
+
+static mutex placement_lock;
+static DDAffinityConfig affinity_config;
+static gboolean configured = FALSE;
+static vector<DDThreadPlacement> placements;
+
+const gchar *
+dd_thread_group_name (DDThreadGroup group) {
+    return group < DD_THREAD_GROUPS ? group_names[group] : "none";
+}
+
+static gboolean
+policy_from_json (json_t *obj, DDThreadPolicy *policy) {
+    const gchar *key;
+    json_t *val;
+
+    if (!json_is_object (obj))
+        return FALSE;
+    json_object_foreach (obj, key, val) {
+        if (!g_strcmp0 (key, "cpus")) {
+            gsize i;
+            json_t *cpu;
+            if (!json_is_array (val) || !json_array_size (val))
+                return FALSE;
+            json_array_foreach (val, i, cpu) {
+                json_int_t n = json_integer_value (cpu);
+                if (!json_is_integer (cpu) || n < 0 || n >= sysconf (_SC_NPROCESSORS_CONF) || n >= CPU_SETSIZE)
+                    return FALSE;
+                CPU_SET (n, &policy->cpus);
+            }
+        }
+        else if (!g_strcmp0 (key, "policy")) {
+            if (!g_strcmp0 (json_string_value (val), "fifo"))
+                policy->policy = SCHED_FIFO;
+            else if (!g_strcmp0 (json_string_value (val), "other"))
+                policy->policy = SCHED_OTHER;
+            else
+                return FALSE;
+        }
+        else if (!g_strcmp0 (key, "priority")) {
+            if (!json_is_integer (val) || json_integer_value (val) < 1 || json_integer_value (val) > 99)
+                return FALSE;
+            policy->priority = json_integer_value (val);
+        }
+        else if (!g_strcmp0 (key, "nice")) {
+            if (!json_is_integer (val) || json_integer_value (val) < -20 || json_integer_value (val) > 19)
+                return FALSE;
+            policy->nice = json_integer_value (val);
+        }
+        else {
+            return FALSE;
+        }
+    }
+    /* A priority only means something to SCHED_FIFO, a nice value to SCHED_OTHER */
+    if (json_object_get (obj, "priority") && policy->policy != SCHED_FIFO)
+        return FALSE;
+    if (json_object_get (obj, "nice") && policy->policy != SCHED_OTHER)
+        return FALSE;
+    policy->set = TRUE;
+    return TRUE;
+}
+
+gboolean
+dd_affinity_config_from_json (json_t *obj, DDAffinityConfig *config, gboolean *enabled) {
+    const gchar *key;
+    json_t *val;
+
+    memset (config, 0, sizeof (*config));
+    for (guint i = 0; i < DD_THREAD_GROUPS; i++) {
+        config->groups[i].policy = -1;
+        config->groups[i].priority = 50;
+    }
+    if (!json_is_object (obj))
+        return FALSE;
+
+    json_object_foreach (obj, key, val) {
+        guint group;
+
+        if (!g_strcmp0 (key, "enabled")) {
+            if (!json_is_boolean (val))
+                return FALSE;
+            *enabled = json_is_true (val);
+            continue;
+        }
+        for (group = 0; group < DD_THREAD_GROUPS; group++)
+            if (!g_strcmp0 (key, group_names[group]))
+                break;
+        if (group == DD_THREAD_GROUPS || !policy_from_json (val, &config->groups[group]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+void
+dd_affinity_set_config (const DDAffinityConfig *config) {
+    lock_guard<mutex> guard (placement_lock);
+    affinity_config = *config;
+    configured = TRUE;
+}
+
+static string
+cpus_to_string (const cpu_set_t *cpus) {
+    string str;
+
+    for (gint cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        gint last = cpu;
+        if (!CPU_ISSET (cpu, cpus))
+            continue;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET (last + 1, cpus))
+            last++;
+        if (!str.empty ())
+            str += ",";
+        str += to_string (cpu);
+        if (last > cpu)
+            str += "-" + to_string (last);
+        cpu = last;
+    }
+    return str;
+}
+
+void
+dd_affinity_print_placement (FILE *fp, const DDThreadPlacement *placement) {
+    fprintf (fp, "Thread %d (%s) as %s:", placement->tid, placement->owner.c_str (),
+             dd_thread_group_name (placement->group));
+    if (!placement->cpus.empty ())
+        fprintf (fp, " cpus %s", placement->cpus.c_str ());
+    if (placement->policy == SCHED_FIFO)
+        fprintf (fp, " SCHED_FIFO %d", placement->priority);
+    else if (placement->policy == SCHED_OTHER)
+        fprintf (fp, " SCHED_OTHER nice %d", placement->priority);
+    if (placement->error)
+        fprintf (fp, ", not applied: %s", g_strerror (placement->error));
+    fprintf (fp, "\n");
+}
+
+/* Place the calling thread, called with the placement lock held */
+static void
+place_thread (DDThreadGroup group, const gchar *owner) {
+    const DDThreadPolicy *policy = &affinity_config.groups[group];
+    DDThreadPlacement placement;
+    gint err = 0;
+
+    placement.tid = syscall (SYS_gettid);
+    placement.owner = owner;
+    placement.group = group;
+    placement.policy = policy->policy;
+    placement.priority = policy->policy == SCHED_FIFO ? policy->priority : policy->nice;
+    if (CPU_COUNT (&policy->cpus)) {
+        placement.cpus = cpus_to_string (&policy->cpus);
+        err = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &policy->cpus);
+    }
+    if (!err && policy->policy >= 0) {
+        struct sched_param param;
+        memset (&param, 0, sizeof (param));
+        param.sched_priority = policy->policy == SCHED_FIFO ? policy->priority : 0;
+        err = pthread_setschedparam (pthread_self (), policy->policy, &param);
+        /* The nice value of a thread is set through its tid */
+        if (!err && policy->policy == SCHED_OTHER && setpriority (PRIO_PROCESS, placement.tid, policy->nice))
+            err = errno;
+    }
+    placement.error = err;
+
+    /* Tasks restart on every flushing seek, often on the same thread: report each thread once */
+    for (DDThreadPlacement &known : placements) {
+        if (known.tid == placement.tid && known.owner == placement.owner) {
+            known = placement;
+            return;
+        }
+    }
+    placements.push_back (placement);
+    dd_affinity_print_placement (err ? stderr : stdout, &placement);
+}
+
+gboolean
+dd_affinity_apply_main (void) {
+    lock_guard<mutex> guard (placement_lock);
+
+    if (!configured || !affinity_config.groups[DD_THREAD_MAIN].set)
+        return TRUE;
+    place_thread (DD_THREAD_MAIN, group_names[DD_THREAD_MAIN]);
+    return placements.back ().error == 0;
+}
+
+/* The source pad of an element, the first branch of a tee */
+static GstPad *
+first_src_pad (GstElement *elem) {
+    GstPad *pad = gst_element_get_static_pad (elem, "src");
+    return pad ? pad : gst_element_get_static_pad (elem, "src_0");
+}
+
+/** @brief
+ *  The group of the thread running the task of an element.
+ *
+ *  @param owner is the element owning the task.
+ *  @return the group, DD_THREAD_GROUPS if none applies.
+ */
+static DDThreadGroup
+classify (GstElement *owner) {
+    GstElement *elem = (GstElement *) gst_object_ref (owner);
+    DDThreadGroup group = DD_THREAD_GROUPS;
+
+    if (GST_OBJECT_FLAG_IS_SET (owner, GST_ELEMENT_FLAG_SOURCE)) {
+        gst_object_unref (elem);
+        return DD_THREAD_CAPTURE;
+    }
+    for (guint hops = 0; hops < MAX_HOPS && group == DD_THREAD_GROUPS; hops++) {
+        GstPad *src = first_src_pad (elem), *peer = NULL;
+        GstElement *next = NULL;
+        GstElementFactory *factory;
+        const gchar *factory_name;
+
+        if (src) {
+            peer = gst_pad_get_peer (src);
+            gst_object_unref (src);
+        }
+        if (peer) {
+            next = gst_pad_get_parent_element (peer);
+            gst_object_unref (peer);
+        }
+        gst_object_unref (elem);
+        if (!next)
+            return DD_THREAD_GROUPS;
+        elem = next;
+
+        factory = gst_element_get_factory (elem);
+        factory_name = factory ? GST_OBJECT_NAME (factory) : NULL;
+        if (GST_OBJECT_FLAG_IS_SET (elem, GST_ELEMENT_FLAG_SINK))
+            group = DD_THREAD_SINK;
+        else if (!g_strcmp0 (factory_name, "vvas_xfilter"))
+            group = g_str_has_prefix (GST_ELEMENT_NAME (elem), "text2overlay") ? DD_THREAD_OVERLAY : DD_THREAD_KERNEL;
+        else if (!g_strcmp0 (factory_name, "queue"))
+            break;
+    }
+    gst_object_unref (elem);
+    return group;
+}
+
+static GstBusSyncReply
+stream_status_cb (GstBus *bus, GstMessage *msg, gpointer user_data) {
+    GstStreamStatusType type;
+    GstElement *owner;
+    DDThreadGroup group;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+        return GST_BUS_PASS;
+    /* Posted from the new streaming thread itself */
+    gst_message_parse_stream_status (msg, &type, &owner);
+    if (type != GST_STREAM_STATUS_TYPE_ENTER)
+        return GST_BUS_PASS;
+
+    group = classify (owner);
+    GST_DEBUG ("Task of %s enters as %s", GST_ELEMENT_NAME (owner), dd_thread_group_name (group));
+    if (group == DD_THREAD_GROUPS)
+        return GST_BUS_PASS;
+
+    lock_guard<mutex> guard (placement_lock);
+    if (affinity_config.groups[group].set)
+        place_thread (group, GST_ELEMENT_NAME (owner));
+    return GST_BUS_PASS;
+}
+
+void
+dd_affinity_watch (GstElement *pipeline) {
+    GstBus *bus;
+
+    if (!configured)
+        return;
+    bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+    gst_bus_set_sync_handler (bus, stream_status_cb, NULL, NULL);
+    gst_object_unref (bus);
+}
+
+void
+dd_affinity_placements (vector<DDThreadPlacement> &out) {
+    lock_guard<mutex> guard (placement_lock);
+    out = placements;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_AFFINITY_H
+#define DD_AFFINITY_H
+
+#include <gst/gst.h>
+#include <jansson.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Groups of threads placed alike */
+typedef enum {
+    DD_THREAD_MAIN,             /* GMainLoop, and the threads it starts that are in no other group */
+    DD_THREAD_CAPTURE,          /* streaming threads of the sources */
+    DD_THREAD_KERNEL,           /* streaming threads driving otsu, preprocess or cca */
+    DD_THREAD_OVERLAY,          /* streaming threads driving text2overlay */
+    DD_THREAD_SINK,             /* streaming threads feeding the sinks */
+    DD_THREAD_GROUPS
+} DDThreadGroup;
+
+typedef struct _DDThreadPolicy {
+    gboolean set;               /* the group is configured */
+    cpu_set_t cpus;             /* empty to leave the affinity alone */
+    gint policy;                /* SCHED_OTHER or SCHED_FIFO, -1 to leave it alone */
+    gint priority;              /* SCHED_FIFO priority, 1 to 99 */
+    gint nice;                  /* SCHED_OTHER nice value */
+} DDThreadPolicy;
+
+typedef struct _DDAffinityConfig {
+    DDThreadPolicy groups[DD_THREAD_GROUPS];
+} DDAffinityConfig;
+
+/* A placement applied to a thread */
+typedef struct _DDThreadPlacement {
+    gint tid;
+    std::string owner;          /* element whose task the thread runs, "main" for the main thread */
+    DDThreadGroup group;
+    std::string cpus;           /* "2-3", empty when left alone */
+    gint policy;
+    gint priority;              /* SCHED_FIFO priority or SCHED_OTHER nice */
+    gint error;                 /* errno of the first step that failed, 0 if applied */
+} DDThreadPlacement;
+
+/** @brief
+ *  Name of a thread group, as in pipeline.json.
+ *
+ *  @param group is the group.
+ *  @return the name.
+ */
+const gchar * dd_thread_group_name (DDThreadGroup group);
+
+/** @brief
+ *  Read the placement of the thread groups from the "threads" object of
+ *  pipeline.json:
+ *
+ *    { "enabled": true,
+ *      "capture": { "cpus": [ 1 ], "policy": "fifo", "priority": 60 },
+ *      "kernel":  { "cpus": [ 2, 3 ], "policy": "other", "nice": -5 } }
+ *
+ *  Groups left out keep the placement the kernel gives them.
+ *
+ *  @param obj is the "threads" object.
+ *  @param config is filled with the placements.
+ *  @param enabled is set from "enabled", left alone without it.
+ *  @return FALSE if the config is invalid.
+ */
+gboolean dd_affinity_config_from_json (json_t *obj, DDAffinityConfig *config, gboolean *enabled);
+
+/** @brief
+ *  Set the placements applied from now on.
+ *
+ *  @param config is the placements.
+ *  @return Void.
+ */
+void dd_affinity_set_config (const DDAffinityConfig *config);
+
+/** @brief
+ *  Place the calling thread as the main group. Threads started
+ *  afterwards inherit the placement until they are placed themselves.
+ *
+ *  @return FALSE if the placement could not be fully applied.
+ */
+gboolean dd_affinity_apply_main (void);
+
+/** @brief
+ *  Place the streaming threads of a pipeline as they start.
+ *
+ *  The stream-status message a task posts from its new thread is
+ *  caught by a sync handler on the bus of the pipeline. The group
+ *  follows from the element owning the task: a source is capture,
+ *  otherwise the elements downstream of it are followed to the first
+ *  accelerator stage, text2overlay or sink.
+ *
+ *  @param pipeline is the pipeline.
+ *  @return Void.
+ */
+void dd_affinity_watch (GstElement *pipeline);
+
+/** @brief
+ *  Copy the placements applied so far.
+ *
+ *  @param placements is filled with the placements, oldest first.
+ *  @return Void.
+ */
+void dd_affinity_placements (std::vector<DDThreadPlacement> &placements);
+
+/** @brief
+ *  Print a placement.
+ *
+ *  @param fp is the stream to print to.
+ *  @param placement is the placement.
+ *  @return Void.
+ */
+void dd_affinity_print_placement (FILE *fp, const DDThreadPlacement *placement);
+
+#endif /* DD_AFFINITY_H */
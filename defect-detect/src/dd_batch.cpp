@@ -0,0 +1,93 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_batch.h"
+
+#include <glob.h>
+#include <jansson.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+gboolean
+dd_batch_list_clips (const gchar *pattern, vector<string> &clips) {
+    clips.clear ();
+
+    if (g_file_test (pattern, G_FILE_TEST_IS_DIR)) {
+        GDir *dir = g_dir_open (pattern, 0, NULL);
+        const gchar *name;
+
+        if (!dir)
+            return FALSE;
+        while ((name = g_dir_read_name (dir))) {
+            gchar *path;
+
+            if (!g_str_has_suffix (name, DD_BATCH_CLIP_SUFFIX))
+                continue;
+            path = g_build_filename (pattern, name, NULL);
+            if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+                clips.push_back (path);
+            g_free (path);
+        }
+        g_dir_close (dir);
+    } else {
+        glob_t globbuf;
+
+        if (glob (pattern, 0, NULL, &globbuf) == 0) {
+            for (size_t i = 0; i < globbuf.gl_pathc; i++) {
+                if (g_file_test (globbuf.gl_pathv[i], G_FILE_TEST_IS_REGULAR))
+                    clips.push_back (globbuf.gl_pathv[i]);
+            }
+        }
+        globfree (&globbuf);
+    }
+    sort (clips.begin (), clips.end ());
+    return !clips.empty ();
+}
+
+guint
+dd_batch_compute_units (const gchar *kernels_config) {
+    json_error_t jerror;
+    json_t *root, *kernels, *kernel, *name;
+    const gchar *open, *c;
+    guint units = 1;
+
+    root = json_load_file (kernels_config, 0, &jerror);
+    if (!root)
+        return 1;
+
+    kernels = json_object_get (root, "kernels");
+    kernel = json_is_array (kernels) ? json_array_get (kernels, 0) : NULL;
+    name = kernel ? json_object_get (kernel, "kernel-name") : NULL;
+    if (json_is_string (name) && (open = strchr (json_string_value (name), '{'))) {
+        for (c = open + 1; *c && *c != '}'; c++) {
+            if (*c == ',')
+                units++;
+        }
+    }
+    json_decref (root);
+    return units;
+}
+
+guint
+dd_batch_default_jobs (guint compute_units, guint stages, guint clips) {
+    guint jobs = MAX (compute_units, 1) * MAX (stages, 1);
+
+    jobs = MIN (jobs, g_get_num_processors ());
+    jobs = MIN (jobs, clips);
+    return MAX (jobs, 1);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_BATCH_H
+#define DD_BATCH_H
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+/* Files picked from a directory given to --batch */
+#define DD_BATCH_CLIP_SUFFIX      ".y8"
+
+/** @brief
+ *  List the captures of a batch run.
+ *
+ *  @param pattern is a directory, every DD_BATCH_CLIP_SUFFIX file in it
+ *  is taken, or a shell glob pattern.
+ *  @param clips is filled with the paths, sorted.
+ *  @return FALSE if the pattern matches no file.
+ */
+gboolean dd_batch_list_clips (const gchar *pattern, std::vector<std::string> &clips);
+
+/** @brief
+ *  Count the compute units a kernel config can use.
+ *
+ *  vvas kernel names list the instances of the kernel in braces, e.g.
+ *  "preprocess_accel:{preprocess_accel_1,preprocess_accel_2}".
+ *
+ *  @param kernels_config is the kernel config file of a vvas_xfilter.
+ *  @return the number of compute units, 1 if none is named.
+ */
+guint dd_batch_compute_units (const gchar *kernels_config);
+
+/** @brief
+ *  Pick the number of pipelines run at once.
+ *
+ *  Every pipeline keeps one accelerator stage busy at a time, so
+ *  pipelines beyond the total number of compute units only wait on
+ *  them; each pipeline also needs a core for its software stages.
+ *
+ *  @param compute_units is the smallest number of compute units of an
+ *  accelerator stage.
+ *  @param stages is the number of accelerator stages in the pipeline.
+ *  @param clips is the number of captures to process.
+ *  @return the number of pipelines, at least 1.
+ */
+guint dd_batch_default_jobs (guint compute_units, guint stages, guint clips);
+
+#endif /* DD_BATCH_H */
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_bench.h"
+#include "dd_tracer.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <jansson.h>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+/* Frames whose latency is still being measured, bounded in case a
+ * leaky branch drops them before they reach the sink */
+#define MAX_INFLIGHT_FRAMES   1024
+
+typedef struct _ThreadTicks {
+    string name;
+    guint64 ticks;
+} ThreadTicks;
+
+struct _DDBench {
+    DDBenchConfig config;
+    string json_path;
+    GstElement *pipeline;
+    /* End-to-end latency, entry time keyed by PTS */
+    mutex lock;
+    map<GstClockTime, guint64> inflight;
+    vector<guint64> latency;
+    atomic<guint64> frames;
+    atomic<gboolean> done;
+    guint64 t_first, t_last;
+    gint width, height;         /* negotiated at the sink */
+    guint timeout_id;
+    map<gint, ThreadTicks> cpu_start, cpu_end;
+};
+
+static guint64
+now_ns () {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/** @brief
+ *  Read the CPU time consumed by every thread of the process.
+ *
+ *  Streaming threads are named after their pad by GstTask, which is
+ *  what makes the per thread figures readable.
+ *
+ *  @param threads is filled with the ticks of each thread, keyed by tid.
+ *  @return Void.
+ */
+static void
+read_thread_ticks (map<gint, ThreadTicks> &threads) {
+    DIR *dir = opendir ("/proc/self/task");
+    struct dirent *ent;
+
+    threads.clear ();
+    if (!dir)
+        return;
+    while ((ent = readdir (dir)) != NULL) {
+        gchar path[64], line[512];
+        const gchar *open, *close;
+        guint64 utime, stime;
+        FILE *fp;
+
+        if (ent->d_name[0] == '.')
+            continue;
+        g_snprintf (path, sizeof (path), "/proc/self/task/%s/stat", ent->d_name);
+        fp = fopen (path, "r");
+        if (!fp)
+            continue;
+        if (fgets (line, sizeof (line), fp)) {
+            /* The name is in parentheses and may itself contain spaces */
+            open = strchr (line, '(');
+            close = strrchr (line, ')');
+            if (open && close && close > open &&
+                sscanf (close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %" G_GUINT64_FORMAT
+                        " %" G_GUINT64_FORMAT, &utime, &stime) == 2) {
+                ThreadTicks t;
+                t.name.assign (open + 1, close - open - 1);
+                t.ticks = utime + stime;
+                threads[atoi (ent->d_name)] = t;
+            }
+        }
+        fclose (fp);
+    }
+    closedir (dir);
+}
+
+static void
+finish (DDBench *bench) {
+    gboolean expected = FALSE;
+
+    if (!bench->done.compare_exchange_strong (expected, TRUE))
+        return;
+    bench->t_last = now_ns ();
+    read_thread_ticks (bench->cpu_end);
+    gst_element_post_message (bench->pipeline,
+                              gst_message_new_application (GST_OBJECT (bench->pipeline),
+                                                           gst_structure_new_empty (DD_BENCH_DONE_MESSAGE)));
+}
+
+static gboolean
+timeout_cb (gpointer user_data) {
+    DDBench *bench = (DDBench *) user_data;
+
+    bench->timeout_id = 0;
+    finish (bench);
+    return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn
+entry_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDBench *bench = (DDBench *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    if (!GST_BUFFER_PTS_IS_VALID (buf) || bench->done)
+        return GST_PAD_PROBE_OK;
+
+    lock_guard<mutex> guard (bench->lock);
+    if (bench->inflight.size () >= MAX_INFLIGHT_FRAMES)
+        bench->inflight.erase (bench->inflight.begin ());
+    bench->inflight[GST_BUFFER_PTS (buf)] = now_ns ();
+    return GST_PAD_PROBE_OK;
+}
+
+/* Resolution of the frames reaching the sink, 0x0 if not negotiated */
+static void
+read_frame_size (GstPad *pad, gint *width, gint *height) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    GstStructure *s;
+
+    *width = *height = 0;
+    if (!caps)
+        return;
+    s = gst_caps_get_structure (caps, 0);
+    gst_structure_get_int (s, "width", width);
+    gst_structure_get_int (s, "height", height);
+    gst_caps_unref (caps);
+}
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDBench *bench = (DDBench *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    guint64 now = now_ns ();
+    guint64 frames;
+
+    if (bench->done)
+        return GST_PAD_PROBE_OK;
+
+    if (GST_BUFFER_PTS_IS_VALID (buf)) {
+        lock_guard<mutex> guard (bench->lock);
+        auto it = bench->inflight.find (GST_BUFFER_PTS (buf));
+        if (it != bench->inflight.end ()) {
+            bench->latency.push_back (now - it->second);
+            bench->inflight.erase (it);
+        }
+    }
+
+    frames = ++bench->frames;
+    if (frames == 1) {
+        /* Start measuring once the first frame made it through, so that
+         * device and kernel setup are not part of the figures */
+        bench->t_first = now;
+        read_frame_size (pad, &bench->width, &bench->height);
+        read_thread_ticks (bench->cpu_start);
+        dd_tracer_reset ();
+        if (bench->config.seconds)
+            bench->timeout_id = g_timeout_add_seconds (bench->config.seconds, timeout_cb, bench);
+    }
+    bench->t_last = now;
+    if (bench->config.max_frames && frames >= bench->config.max_frames)
+        finish (bench);
+    return GST_PAD_PROBE_OK;
+}
+
+static void
+add_probe (GstElement *elem, const gchar *pad_name, GstPadProbeType type,
+           GstPadProbeCallback cb, gpointer user_data) {
+    GstPad *pad = gst_element_get_static_pad (elem, pad_name);
+
+    if (!pad)
+        return;
+    gst_pad_add_probe (pad, type, cb, user_data, NULL);
+    gst_object_unref (pad);
+}
+
+DDBench *
+dd_bench_new (DDTopology *topo, GstElement *pipeline, const DDBenchConfig *config) {
+    GstElement *src = dd_topology_get (topo, "src");
+    GstElement *sink = dd_topology_get (topo, "sink");
+    DDBench *bench;
+
+    if (!src || !sink || topo->linked.size () < 2)
+        return NULL;
+
+    bench = new DDBench ();
+    bench->config = *config;
+    if (config->json_path) {
+        bench->json_path = config->json_path;
+        bench->config.json_path = bench->json_path.c_str ();
+    }
+    bench->pipeline = pipeline;
+
+    /* Per-stage service and queueing times come from the tracer */
+    dd_tracer_enable ();
+    dd_tracer_watch (topo);
+
+    /* The element after the source has a static sink pad even when the
+     * source pad itself only shows up later */
+    add_probe (topo->linked[1], "sink", GST_PAD_PROBE_TYPE_BUFFER, entry_probe, bench);
+    add_probe (sink, "sink", GST_PAD_PROBE_TYPE_BUFFER, sink_probe, bench);
+
+    return bench;
+}
+
+static DDLatencySummary
+summarize (vector<guint64> samples) {
+    DDLatencySummary s = DDLatencySummary ();
+    gdouble sum = 0;
+
+    s.count = samples.size ();
+    if (!s.count)
+        return s;
+    sort (samples.begin (), samples.end ());
+    for (guint64 v : samples)
+        sum += v;
+    s.mean = sum / s.count / 1e6;
+    s.p50 = samples[(s.count - 1) * 50 / 100] / 1e6;
+    s.p90 = samples[(s.count - 1) * 90 / 100] / 1e6;
+    s.p99 = samples[(s.count - 1) * 99 / 100] / 1e6;
+    s.max = samples[s.count - 1] / 1e6;
+    return s;
+}
+
+static json_t *
+summary_to_json (const DDLatencySummary *s) {
+    return json_pack ("{s:I, s:f, s:f, s:f, s:f, s:f}",
+                      "count", (json_int_t) s->count, "mean_ms", s->mean,
+                      "p50_ms", s->p50, "p90_ms", s->p90, "p99_ms", s->p99, "max_ms", s->max);
+}
+
+void
+dd_bench_report (DDBench *bench) {
+    guint64 frames = bench->frames;
+    gdouble elapsed, fps = 0;
+    glong hz = sysconf (_SC_CLK_TCK);
+    struct rusage usage;
+    DDLatencySummary lat;
+    json_t *root, *stages, *threads;
+
+    if (!bench->done) {
+        /* Interrupted before a limit was hit */
+        bench->t_last = now_ns ();
+        read_thread_ticks (bench->cpu_end);
+    }
+    elapsed = frames > 1 ? (bench->t_last - bench->t_first) / 1e9 : 0;
+    if (elapsed > 0)
+        fps = (frames - 1) / elapsed;
+    getrusage (RUSAGE_SELF, &usage);
+    lat = summarize (bench->latency);
+
+    root = json_pack ("{s:i, s:i, s:I, s:f, s:f, s:I}",
+                      "width", bench->width, "height", bench->height,
+                      "frames", (json_int_t) frames, "seconds", elapsed, "fps", fps,
+                      "peak_rss_kb", (json_int_t) usage.ru_maxrss);
+    json_object_set_new (root, "latency", summary_to_json (&lat));
+
+    g_print ("Benchmark: %dx%d, %" G_GUINT64_FORMAT " frames in %.2lf s, %.2lf fps\n",
+             bench->width, bench->height, frames, elapsed, fps);
+    g_print ("  %-20s %8s %9s %9s %9s %9s %9s\n", "", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    g_print ("  %-20s %8" G_GUINT64_FORMAT " %9.3lf %9.3lf %9.3lf %9.3lf %9.3lf\n", "end-to-end latency",
+             lat.count, lat.mean, lat.p50, lat.p90, lat.p99, lat.max);
+
+    stages = json_array ();
+    for (const DDTraceStage &stage : dd_tracer_summarize ()) {
+        const DDLatencySummary *s = &stage.service;
+        json_t *obj = json_pack ("{s:s}", "name", stage.name.c_str ());
+
+        g_print ("  %-20s %8" G_GUINT64_FORMAT " %9.3lf %9.3lf %9.3lf %9.3lf %9.3lf\n", stage.name.c_str (),
+                 s->count, s->mean, s->p50, s->p90, s->p99, s->max);
+        if (stage.wait.count) {
+            s = &stage.wait;
+            g_print ("  %-20s %8" G_GUINT64_FORMAT " %9.3lf %9.3lf %9.3lf %9.3lf %9.3lf\n", "  queue wait",
+                     s->count, s->mean, s->p50, s->p90, s->p99, s->max);
+        }
+        json_object_set_new (obj, "service", summary_to_json (&stage.service));
+        json_object_set_new (obj, "wait", summary_to_json (&stage.wait));
+        json_array_append_new (stages, obj);
+    }
+    json_object_set_new (root, "stages", stages);
+
+    g_print ("  CPU per thread:\n");
+    threads = json_array ();
+    for (auto &it : bench->cpu_end) {
+        auto start = bench->cpu_start.find (it.first);
+        guint64 ticks = it.second.ticks - (start != bench->cpu_start.end () ? start->second.ticks : 0);
+        gdouble util = elapsed > 0 ? 100.0 * ticks / hz / elapsed : 0;
+
+        if (!ticks)
+            continue;
+        g_print ("    %-16s %6d %7.1lf %%\n", it.second.name.c_str (), it.first, util);
+        json_array_append_new (threads, json_pack ("{s:i, s:s, s:f}", "tid", it.first,
+                                                   "name", it.second.name.c_str (), "cpu_percent", util));
+    }
+    json_object_set_new (root, "threads", threads);
+    g_print ("  Peak RSS: %ld kB\n", usage.ru_maxrss);
+
+    if (bench->config.json_path) {
+        if (!strcmp (bench->config.json_path, "-")) {
+            json_dumpf (root, stdout, JSON_INDENT (2));
+            g_print ("\n");
+        } else if (json_dump_file (root, bench->config.json_path, JSON_INDENT (2)) != 0) {
+            g_printerr ("Failed to write the benchmark report to %s\n", bench->config.json_path);
+        }
+    }
+    json_decref (root);
+}
+
+void
+dd_bench_free (DDBench *bench) {
+    if (!bench)
+        return;
+    if (bench->timeout_id)
+        g_source_remove (bench->timeout_id);
+    delete bench;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_BENCH_H
+#define DD_BENCH_H
+
+#include <gst/gst.h>
+#include "dd_topology.h"
+
+/* Name of the application message posted on the bus when the run is over */
+#define DD_BENCH_DONE_MESSAGE   "dd-bench-done"
+
+#define DD_BENCH_DEFAULT_SECONDS   10
+
+typedef struct _DDBenchConfig {
+    guint64 max_frames;        /* 0 for no frame limit */
+    guint seconds;             /* 0 for no time limit */
+    const gchar *json_path;    /* "-" for stdout, NULL for no JSON report */
+} DDBenchConfig;
+
+typedef struct _DDBench DDBench;
+
+/** @brief
+ *  Instrument a built topology for a benchmark run.
+ *
+ *  Frames are counted on the sink pad of the sink stage and the
+ *  end-to-end latency is measured between the source and the sink.
+ *  Per-stage service and queueing times come from the latency tracer,
+ *  which is enabled for the run. When the frame or time limit is reached an application
+ *  message named DD_BENCH_DONE_MESSAGE is posted on the pipeline bus.
+ *
+ *  @param topo is the built topology.
+ *  @param pipeline is the pipeline the topology was built into.
+ *  @param config is the run configuration, copied.
+ *  @return the benchmark handle, NULL if the topology has no src or sink.
+ */
+DDBench * dd_bench_new (DDTopology *topo, GstElement *pipeline, const DDBenchConfig *config);
+
+/* Print the human readable report and write the JSON one if requested */
+void dd_bench_report (DDBench *bench);
+
+void dd_bench_free (DDBench *bench);
+
+#endif /* DD_BENCH_H */
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_control.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+#define MAX_CLIENTS         8
+#define MAX_REQUEST_SIZE    65536
+
+typedef struct _Command {
+    DDControlHandler handler;
+    gpointer user_data;
+} Command;
+
+typedef struct _Client {
+    gint fd;
+    string in;
+} Client;
+
+struct _DDControl {
+    string path;
+    gint fd;
+    gint wake[2];               /* written to stop the thread */
+    map<string, Command> commands;
+    vector<Client> clients;
+    thread worker;
+};
+
+static void
+send_response (gint fd, json_t *response) {
+    gchar *text = json_dumps (response, JSON_COMPACT);
+    string line = string (text ? text : "{}") + "\n";
+    size_t done = 0;
+
+    while (done < line.size ()) {
+        ssize_t n = send (fd, line.data () + done, line.size () - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    free (text);
+}
+
+static json_t *
+handle_request (DDControl *control, const string &line) {
+    json_error_t jerror;
+    json_t *request, *result = NULL;
+    const gchar *cmd;
+    gchar *error = NULL;
+    json_t *response;
+
+    request = json_loads (line.c_str (), 0, &jerror);
+    cmd = json_string_value (json_object_get (request, "cmd"));
+    if (!request || !cmd) {
+        error = g_strdup (request ? "missing cmd" : jerror.text);
+    } else if (!strcmp (cmd, "help")) {
+        result = json_array ();
+        for (auto &it : control->commands)
+            json_array_append_new (result, json_string (it.first.c_str ()));
+    } else {
+        auto it = control->commands.find (cmd);
+        if (it == control->commands.end ())
+            error = g_strdup_printf ("unknown command %s", cmd);
+        else
+            result = it->second.handler (request, it->second.user_data, &error);
+        if (!result && !error)
+            error = g_strdup ("failed");
+    }
+    GST_DEBUG ("Control %s: %s", cmd ? cmd : "?", error ? error : "ok");
+
+    if (error) {
+        response = json_pack ("{s:b, s:s}", "ok", 0, "error", error);
+        g_free (error);
+    } else {
+        response = json_pack ("{s:b, s:o}", "ok", 1, "result", result);
+    }
+    json_decref (request);
+    return response;
+}
+
+/* Read what a client sent and answer each complete line, FALSE once
+ * the client is gone */
+static gboolean
+serve_client (DDControl *control, Client *client) {
+    gchar buf[4096];
+    ssize_t n;
+    size_t eol;
+
+    n = recv (client->fd, buf, sizeof (buf), 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return TRUE;
+    if (n <= 0)
+        return FALSE;
+    client->in.append (buf, n);
+    while ((eol = client->in.find ('\n')) != string::npos) {
+        string line = client->in.substr (0, eol);
+        json_t *response;
+
+        client->in.erase (0, eol + 1);
+        if (line.empty ())
+            continue;
+        response = handle_request (control, line);
+        send_response (client->fd, response);
+        json_decref (response);
+    }
+    return client->in.size () <= MAX_REQUEST_SIZE;
+}
+
+static void
+accept_client (DDControl *control) {
+    struct timeval timeout = { 1, 0 };
+    gint fd = accept4 (control->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+    if (fd < 0)
+        return;
+    if (control->clients.size () >= MAX_CLIENTS) {
+        GST_WARNING ("Too many control clients, closing the new one");
+        close (fd);
+        return;
+    }
+    /* A client that stops reading cannot hold the thread for long */
+    setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+    control->clients.push_back ({ fd, "" });
+}
+
+static void
+control_thread (DDControl *control) {
+    for (;;) {
+        vector<struct pollfd> fds;
+
+        fds.push_back ({ control->wake[0], POLLIN, 0 });
+        fds.push_back ({ control->fd, POLLIN, 0 });
+        for (const Client &client : control->clients)
+            fds.push_back ({ client.fd, POLLIN, 0 });
+        if (poll (fds.data (), fds.size (), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            GST_ERROR ("Control socket poll failed: %s", strerror (errno));
+            return;
+        }
+        if (fds[0].revents)
+            return;
+
+        /* Clients first, their indexes match fds */
+        for (size_t i = fds.size () - 1; i >= 2; i--) {
+            Client *client = &control->clients[i - 2];
+            if (fds[i].revents && !serve_client (control, client)) {
+                close (client->fd);
+                control->clients.erase (control->clients.begin () + (i - 2));
+            }
+        }
+        if (fds[1].revents & POLLIN)
+            accept_client (control);
+    }
+}
+
+DDControl *
+dd_control_new (const gchar *path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    DDControl *control;
+    mode_t mask;
+    gint fd, ret;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof (addr.sun_path)) {
+        GST_ERROR ("Control socket path %s is too long", path);
+        return NULL;
+    }
+    strcpy (addr.sun_path, path);
+
+    fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        GST_ERROR ("Could not create the control socket: %s", strerror (errno));
+        return NULL;
+    }
+    /* A socket left behind by a previous run that did not exit cleanly,
+     * anything else at the path is not ours to remove */
+    if (lstat (path, &st) == 0 && S_ISSOCK (st.st_mode))
+        unlink (path);
+    /* Requests change the running parameters, only our user may connect:
+     * the socket is created without access for others, there is no window
+     * between bind () and a chmod () for them to connect in */
+    mask = umask (077);
+    ret = bind (fd, (struct sockaddr *) &addr, sizeof (addr));
+    umask (mask);
+    if (ret != 0 || listen (fd, MAX_CLIENTS) != 0) {
+        GST_ERROR ("Could not listen on %s: %s", path, strerror (errno));
+        if (ret == 0)
+            unlink (path);
+        close (fd);
+        return NULL;
+    }
+    if (chmod (path, 0600) != 0) {
+        GST_ERROR ("Could not restrict %s: %s", path, strerror (errno));
+        close (fd);
+        unlink (path);
+        return NULL;
+    }
+
+    control = new DDControl ();
+    control->path = path;
+    control->fd = fd;
+    control->wake[0] = control->wake[1] = -1;
+    return control;
+}
+
+void
+dd_control_register (DDControl *control, const gchar *cmd, DDControlHandler handler, gpointer user_data) {
+    control->commands[cmd] = { handler, user_data };
+}
+
+gboolean
+dd_control_start (DDControl *control) {
+    if (pipe2 (control->wake, O_CLOEXEC) != 0) {
+        GST_ERROR ("Could not start the control thread: %s", strerror (errno));
+        return FALSE;
+    }
+    control->worker = thread (control_thread, control);
+    GST_DEBUG ("Control socket listening on %s", control->path.c_str ());
+    return TRUE;
+}
+
+void
+dd_control_free (DDControl *control) {
+    if (!control)
+        return;
+    if (control->worker.joinable ()) {
+        if (write (control->wake[1], "q", 1) < 0)
+            GST_WARNING ("Could not wake the control thread");
+        control->worker.join ();
+    }
+    for (const Client &client : control->clients)
+        close (client.fd);
+    if (control->wake[0] >= 0) {
+        close (control->wake[0]);
+        close (control->wake[1]);
+    }
+    close (control->fd);
+    unlink (control->path.c_str ());
+    delete control;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_CONTROL_H
+#define DD_CONTROL_H
+
+#include <gst/gst.h>
+#include <jansson.h>
+
+typedef struct _DDControl DDControl;
+
+/** @brief
+ *  Handle one control request.
+ *
+ *  Called on the control thread, never on a streaming thread nor the
+ *  main loop; handlers must only use thread-safe calls.
+ *
+ *  @param request is the request object, borrowed.
+ *  @param user_data is the pointer given at registration.
+ *  @param error is set to a description when the request fails.
+ *  @return the result, a new reference, or NULL on failure.
+ */
+typedef json_t * (*DDControlHandler) (json_t *request, gpointer user_data, gchar **error);
+
+/** @brief
+ *  Listen for control requests on a UNIX domain stream socket.
+ *
+ *  Requests and responses are JSON objects, one per line. A request
+ *  names its command with "cmd", e.g. {"cmd": "get", "param": "font"};
+ *  the response is {"ok": true, "result": ...} or {"ok": false,
+ *  "error": "..."}. Clients are served on a dedicated thread, started
+ *  by dd_control_start() once every command is registered.
+ *
+ *  @param path is the socket path; a stale socket there is replaced.
+ *  @return the control socket, NULL if it cannot be bound.
+ */
+DDControl * dd_control_new (const gchar *path);
+
+/* Commands must be registered before dd_control_start() */
+void dd_control_register (DDControl *control, const gchar *cmd, DDControlHandler handler, gpointer user_data);
+
+gboolean dd_control_start (DDControl *control);
+
+/* Stop the thread, close the clients and remove the socket */
+void dd_control_free (DDControl *control);
+
+#endif /* DD_CONTROL_H */
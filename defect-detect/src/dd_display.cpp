@@ -0,0 +1,159 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_display.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+static drmModeConnector *
+find_connector (gint fd, drmModeRes *res, guint32 id) {
+    if (id)
+        return drmModeGetConnector (fd, id);
+    for (gint i = 0; i < res->count_connectors; i++) {
+        drmModeConnector *conn = drmModeGetConnector (fd, res->connectors[i]);
+        if (conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes)
+            return conn;
+        drmModeFreeConnector (conn);
+    }
+    return NULL;
+}
+
+static guint32
+find_crtc (gint fd, drmModeRes *res, drmModeConnector *conn) {
+    drmModeEncoder *enc = drmModeGetEncoder (fd, conn->encoder_id ? conn->encoder_id :
+                                             conn->count_encoders ? conn->encoders[0] : 0);
+    guint32 crtc = 0;
+
+    if (!enc)
+        return 0;
+    crtc = enc->crtc_id;
+    for (gint i = 0; !crtc && i < res->count_crtcs; i++) {
+        if (enc->possible_crtcs & (1 << i))
+            crtc = res->crtcs[i];
+    }
+    drmModeFreeEncoder (enc);
+    return crtc;
+}
+
+/* A black framebuffer of the size of the mode, freed with the device */
+static guint32
+black_framebuffer (gint fd, guint width, guint height) {
+    struct drm_mode_create_dumb create;
+    struct drm_mode_map_dumb map;
+    guint32 handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+    guint32 fb = 0;
+    gpointer addr;
+
+    memset (&create, 0, sizeof (create));
+    create.width = width;
+    create.height = height;
+    create.bpp = 24;
+    if (drmIoctl (fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0)
+        return 0;
+    memset (&map, 0, sizeof (map));
+    map.handle = create.handle;
+    if (drmIoctl (fd, DRM_IOCTL_MODE_MAP_DUMB, &map) == 0) {
+        addr = mmap (NULL, create.size, PROT_WRITE, MAP_SHARED, fd, map.offset);
+        if (addr != MAP_FAILED) {
+            memset (addr, 0, create.size);
+            munmap (addr, create.size);
+        }
+    }
+    handles[0] = create.handle;
+    pitches[0] = create.pitch;
+    if (drmModeAddFB2 (fd, width, height, DRM_FORMAT_BGR888, handles, pitches, offsets, &fb, 0) != 0)
+        fb = 0;
+    return fb;
+}
+
+static gboolean
+set_plane_property (gint fd, guint32 plane, const gchar *name, guint64 value) {
+    drmModeObjectProperties *props = drmModeObjectGetProperties (fd, plane, DRM_MODE_OBJECT_PLANE);
+    gboolean ok = FALSE;
+
+    if (!props)
+        return FALSE;
+    for (guint32 i = 0; i < props->count_props && !ok; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty (fd, props->props[i]);
+        if (prop && !strcmp (prop->name, name))
+            ok = drmModeObjectSetProperty (fd, plane, DRM_MODE_OBJECT_PLANE, prop->prop_id, value) == 0;
+        drmModeFreeProperty (prop);
+    }
+    drmModeFreeObjectProperties (props);
+    return ok;
+}
+
+gboolean
+dd_display_setup (const DDDisplayConfig *config) {
+    drmModeRes *res = NULL;
+    drmModeConnector *conn = NULL;
+    drmModeModeInfo *mode = NULL;
+    guint32 crtc, fb;
+    gboolean ok = FALSE;
+    gint fd;
+
+    fd = open (config->card, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        GST_ERROR ("Could not open %s: %s", config->card, strerror (errno));
+        return FALSE;
+    }
+    res = drmModeGetResources (fd);
+    conn = res ? find_connector (fd, res, config->connector) : NULL;
+    if (!conn) {
+        GST_ERROR ("No connector to set the mode of %s", config->card);
+        goto out;
+    }
+    for (gint i = 0; i < conn->count_modes && !mode; i++) {
+        if (conn->modes[i].hdisplay == config->width && conn->modes[i].vdisplay == config->height &&
+            conn->modes[i].vrefresh == config->refresh)
+            mode = &conn->modes[i];
+    }
+    if (!mode) {
+        GST_ERROR ("Connector %u has no %ux%u-%u mode", conn->connector_id, config->width, config->height,
+                   config->refresh);
+        goto out;
+    }
+    crtc = config->crtc ? config->crtc : find_crtc (fd, res, conn);
+    fb = black_framebuffer (fd, config->width, config->height);
+    if (!crtc || !fb) {
+        GST_ERROR ("Could not get a %s for connector %u", crtc ? "framebuffer" : "crtc", conn->connector_id);
+        goto out;
+    }
+    if (drmModeSetCrtc (fd, crtc, fb, 0, 0, &conn->connector_id, 1, mode) != 0) {
+        GST_ERROR ("Could not set %s on crtc %u: %s", mode->name, crtc, strerror (errno));
+        goto out;
+    }
+    if (config->plane && !set_plane_property (fd, config->plane, "alpha", config->alpha))
+        GST_WARNING ("Could not set the alpha of plane %u", config->plane);
+    GST_DEBUG ("Display set to %s on crtc %u, connector %u", mode->name, crtc, conn->connector_id);
+    ok = TRUE;
+
+out:
+    drmModeFreeConnector (conn);
+    drmModeFreeResources (res);
+    close (fd);
+    return ok;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_DISPLAY_H
+#define DD_DISPLAY_H
+
+#include <gst/gst.h>
+
+typedef struct _DDDisplayConfig {
+    const gchar *card;          /* DRM device node */
+    guint32 connector;          /* object ids, 0 for the first usable one */
+    guint32 crtc;
+    guint32 plane;              /* plane whose global alpha is set */
+    guint width, height, refresh;
+    guint alpha;
+} DDDisplayConfig;
+
+/** @brief
+ *  Set the display mode with a black BGR888 framebuffer and the global
+ *  alpha of a plane, as modetest -s/-w did.
+ *
+ *  The device is closed again before returning, so that kmssink can
+ *  become DRM master.
+ *
+ *  @param config is the display configuration.
+ *  @return FALSE if the mode could not be set.
+ */
+gboolean dd_display_setup (const DDDisplayConfig *config);
+
+#endif /* DD_DISPLAY_H */
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_dmabuf.h"
+
+#include <gst/allocators/allocators.h>
+#include <atomic>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+struct _DDCopyMonitor {
+    GstElement *element;        /* not a reference, the element owns the monitor */
+    atomic<guint64> buffers;
+    atomic<guint64> copies;
+};
+
+/* Elements that answer allocation queries by asking downstream */
+static const gchar *transparent[] = { "capsfilter", "identity", "queue", "perf", "videorate" };
+/* Elements that provide buffers the device writes into */
+static const gchar *importers[] = { "vvas_xfilter", "kmssink" };
+/* Elements watched for copies */
+static const gchar *consumers[] = { "vvas_xfilter", "kmssink", "filesink" };
+
+static gboolean
+factory_in (GstElement *element, const gchar **names, guint n) {
+    GstElementFactory *factory = gst_element_get_factory (element);
+    const gchar *name = factory ? GST_OBJECT_NAME (factory) : NULL;
+
+    for (guint i = 0; name && i < n; i++) {
+        if (!g_strcmp0 (name, names[i]))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+gint
+dd_dmabuf_capture_io_mode (GstElement *first) {
+    GstElement *element = (GstElement *) gst_object_ref (first);
+    gint mode = DD_V4L2_IO_MODE_DMABUF;
+
+    while (element) {
+        GstElement *next = NULL;
+
+        if (factory_in (element, importers, G_N_ELEMENTS (importers))) {
+            mode = DD_V4L2_IO_MODE_DMABUF_IMPORT;
+        } else if (factory_in (element, transparent, G_N_ELEMENTS (transparent))) {
+            GstPad *pad = gst_element_get_static_pad (element, "src");
+            GstPad *peer = pad ? gst_pad_get_peer (pad) : NULL;
+
+            if (peer) {
+                next = gst_pad_get_parent_element (peer);
+                gst_object_unref (peer);
+            }
+            if (pad)
+                gst_object_unref (pad);
+        }
+        if (!next)
+            GST_DEBUG ("Capture buffers are negotiated with %s, io-mode %d", GST_ELEMENT_NAME (element), mode);
+        gst_object_unref (element);
+        element = next;
+    }
+    return mode;
+}
+
+static gboolean
+is_device_memory (GstMemory *mem) {
+    if (gst_is_dmabuf_memory (mem))
+        return TRUE;
+    /* VVAS buffers without a dmabuf export are still device buffers */
+    return mem->allocator && g_str_has_prefix (G_OBJECT_TYPE_NAME (mem->allocator), "GstVvas");
+}
+
+static GstPadProbeReturn
+copy_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDCopyMonitor *m = (DDCopyMonitor *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    guint n = gst_buffer_n_memory (buf);
+
+    m->buffers.fetch_add (1, memory_order_relaxed);
+    for (guint i = 0; i < n; i++) {
+        if (!is_device_memory (gst_buffer_peek_memory (buf, i))) {
+            m->copies.fetch_add (1, memory_order_relaxed);
+            GST_LOG ("%s: buffer in system memory", GST_ELEMENT_NAME (m->element));
+            break;
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void
+monitor_free (gpointer data) {
+    delete (DDCopyMonitor *) data;
+}
+
+gboolean
+dd_copy_monitor_wanted (GstElement *element) {
+    return factory_in (element, consumers, G_N_ELEMENTS (consumers));
+}
+
+DDCopyMonitor *
+dd_copy_monitor_new (GstElement *element) {
+    DDCopyMonitor *m = new DDCopyMonitor ();
+    GstPad *pad;
+
+    m->element = element;
+    pad = gst_element_get_static_pad (element, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, copy_probe, m, NULL);
+    gst_object_unref (pad);
+
+    g_object_set_data_full (G_OBJECT (element), "dd-copy-monitor", m, monitor_free);
+    return m;
+}
+
+DDCopyMonitor *
+dd_copy_monitor_get (GstElement *element) {
+    return (DDCopyMonitor *) g_object_get_data (G_OBJECT (element), "dd-copy-monitor");
+}
+
+void
+dd_copy_monitor_stats (DDCopyMonitor *m, DDCopyStats *stats) {
+    stats->name    = GST_ELEMENT_NAME (m->element);
+    stats->buffers = m->buffers.load (memory_order_relaxed);
+    stats->copies  = m->copies.load (memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_DMABUF_H
+#define DD_DMABUF_H
+
+#include <gst/gst.h>
+#include <string>
+
+/* V4L2 io-mode values of v4l2src */
+#define DD_V4L2_IO_MODE_DMABUF         4   /* the driver exports its buffers as dmabuf */
+#define DD_V4L2_IO_MODE_DMABUF_IMPORT  5   /* the driver writes into downstream dmabufs */
+
+typedef struct _DDCopyStats {
+    std::string name;
+    guint64 buffers;            /* buffers received */
+    guint64 copies;             /* of which in memory the device cannot access as is */
+} DDCopyStats;
+
+typedef struct _DDCopyMonitor DDCopyMonitor;
+
+/** @brief
+ *  Pick the V4L2 io-mode of the capture so frames reach the accelerators,
+ *  the display and the file writers without being copied.
+ *
+ *  The pads are followed from @first through the elements that pass
+ *  allocation queries on unchanged. If they lead to a single element
+ *  that provides device buffers, a vvas_xfilter or kmssink, the driver
+ *  imports them; otherwise, e.g. through a tee, the driver exports its
+ *  own buffers and every consumer imports them.
+ *
+ *  @param first is the element linked to the capture source.
+ *  @return one of the DD_V4L2_IO_MODE_* values.
+ */
+gint dd_dmabuf_capture_io_mode (GstElement *first);
+
+/** @brief
+ *  Count the buffers that reach @element in memory that is neither a
+ *  dmabuf nor allocated by VVAS, i.e. frames that were copied on the
+ *  way or that the element has to copy into device memory.
+ *
+ *  @param element is a vvas_xfilter, kmssink or filesink; the monitor
+ *  lives as long as it.
+ *  @return the monitor, owned by the element.
+ */
+DDCopyMonitor * dd_copy_monitor_new (GstElement *element);
+
+/* TRUE if frames arriving at @element are worth watching for copies */
+gboolean dd_copy_monitor_wanted (GstElement *element);
+
+/* Monitor of @element, NULL if it has none */
+DDCopyMonitor * dd_copy_monitor_get (GstElement *element);
+
+/* Read the counters; safe from any thread while the pipeline runs */
+void dd_copy_monitor_stats (DDCopyMonitor *monitor, DDCopyStats *stats);
+
+#endif /* DD_DMABUF_H */
@@ -0,0 +1,420 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_gate.h"
+
+#include <gst/video/video.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+#define DEFAULT_GRID_WIDTH        64
+#define DEFAULT_GRID_HEIGHT       36
+#define DEFAULT_DIFF_THRESHOLD    24
+#define DEFAULT_AREA_PERCENT      2.0
+#define DEFAULT_LEARN_FRAMES      30
+#define DEFAULT_BACKGROUND_RATE   0.05
+#define DEFAULT_HOLD_FRAMES       2
+
+/* Passed frames whose fruit IDs are kept for the results */
+#define MAX_PENDING_FRAMES        64
+
+typedef struct _FrameFruits {
+    GstClockTime pts;
+    vector<guint32> fruits;
+} FrameFruits;
+
+struct _DDGate {
+    GstElement *element;        /* not a reference, the element owns the gate */
+    DDGateConfig config;
+    GstPad *bypass_pad;         /* tee pad feeding the bypass, NULL for none */
+    gint width, height, stride;
+    vector<gfloat> background;
+    vector<guint8> foreground;  /* samples off the background in the last frame */
+    DDTracker *tracker;
+    vector<DDBlob> blobs;
+    vector<guint32> inspect;
+    mutex lock;
+    deque<FrameFruits> pending;
+    guint learned;
+    guint hold;
+    /* Decision for the buffer being pushed; the tee pushes it to its
+     * pads in the thread that made it */
+    gboolean pass;
+    atomic<guint64> frames;
+    atomic<guint64> passed;
+};
+
+void
+dd_gate_config_default (DDGateConfig *config) {
+    config->grid_width = DEFAULT_GRID_WIDTH;
+    config->grid_height = DEFAULT_GRID_HEIGHT;
+    config->diff_threshold = DEFAULT_DIFF_THRESHOLD;
+    config->area_percent = DEFAULT_AREA_PERCENT;
+    config->learn_frames = DEFAULT_LEARN_FRAMES;
+    config->background_rate = DEFAULT_BACKGROUND_RATE;
+    config->hold_frames = DEFAULT_HOLD_FRAMES;
+    config->track = FALSE;
+    dd_tracker_config_default (&config->tracker);
+}
+
+static inline void
+visit (DDGate *g, guint i, vector<guint> &stack) {
+    if (g->foreground[i] == 1) {
+        /* Visited samples are marked 2 */
+        g->foreground[i] = 2;
+        stack.push_back (i);
+    }
+}
+
+/** @brief
+ *  Group the foreground samples of the last frame into blobs, 4-connected.
+ *
+ *  @param g is the gate.
+ *  @return Void.
+ */
+static void
+find_blobs (DDGate *g) {
+    guint w = g->config.grid_width, h = g->config.grid_height;
+    vector<guint> stack;
+
+    g->blobs.clear ();
+    for (guint start = 0; start < w * h; start++) {
+        gdouble sx = 0, sy = 0;
+        DDBlob blob = { 0, 0, 0 };
+
+        if (g->foreground[start] != 1)
+            continue;
+        visit (g, start, stack);
+        while (!stack.empty ()) {
+            guint i = stack.back (), x = i % w, y = i / w;
+            stack.pop_back ();
+            sx += x;
+            sy += y;
+            blob.area++;
+            if (x > 0)
+                visit (g, i - 1, stack);
+            if (x + 1 < w)
+                visit (g, i + 1, stack);
+            if (y > 0)
+                visit (g, i - w, stack);
+            if (y + 1 < h)
+                visit (g, i + w, stack);
+        }
+        blob.x = sx / blob.area + 0.5f;
+        blob.y = sy / blob.area + 0.5f;
+        g->blobs.push_back (blob);
+    }
+}
+
+/** @brief
+ *  Tell whether a frame shows something other than the empty belt, and
+ *  learn the belt from the frames that do not.
+ *
+ *  @param g is the gate.
+ *  @param data is the luma plane.
+ *  @param stride is the stride of the plane.
+ *  @return TRUE if a fruit is present.
+ */
+static gboolean
+fruit_present (DDGate *g, const guint8 *data, gint stride) {
+    const DDGateConfig *c = &g->config;
+    guint samples = c->grid_width * c->grid_height, foreground = 0;
+    gboolean learning = g->learned < c->learn_frames;
+    gboolean present;
+    gfloat rate;
+    guint i = 0;
+
+    for (guint gy = 0; gy < c->grid_height; gy++) {
+        const guint8 *row = data + (gsize) ((2 * gy + 1) * g->height / (2 * c->grid_height)) * stride;
+        for (guint gx = 0; gx < c->grid_width; gx++, i++) {
+            gfloat v = row[(2 * gx + 1) * g->width / (2 * c->grid_width)];
+            g->foreground[i] = !learning &&
+                               (v > g->background[i] + c->diff_threshold || v + c->diff_threshold < g->background[i]);
+            foreground += g->foreground[i];
+        }
+    }
+    present = !learning && foreground * 100.0 >= c->area_percent * samples;
+
+    /* Running mean while learning, then a slow update on empty frames
+     * so the background follows the lighting */
+    if (learning || !present) {
+        rate = learning ? 1.0f / (g->learned + 1) : (gfloat) c->background_rate;
+        i = 0;
+        for (guint gy = 0; gy < c->grid_height; gy++) {
+            const guint8 *row = data + (gsize) ((2 * gy + 1) * g->height / (2 * c->grid_height)) * stride;
+            for (guint gx = 0; gx < c->grid_width; gx++, i++)
+                g->background[i] += rate * (row[(2 * gx + 1) * g->width / (2 * c->grid_width)] - g->background[i]);
+        }
+        if (learning)
+            g->learned++;
+    }
+    return present;
+}
+
+static GstPadProbeReturn
+gate_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDGate *g = (DDGate *) user_data;
+    GstBuffer *buf;
+    GstVideoMeta *meta;
+    GstMapInfo map;
+    gint stride;
+
+    if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+        GstVideoInfo vinfo;
+        GstCaps *caps;
+
+        if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+            gst_event_parse_caps (event, &caps);
+            if (gst_video_info_from_caps (&vinfo, caps)) {
+                g->width = GST_VIDEO_INFO_WIDTH (&vinfo);
+                g->height = GST_VIDEO_INFO_HEIGHT (&vinfo);
+                g->stride = GST_VIDEO_INFO_PLANE_STRIDE (&vinfo, 0);
+                /* A new size means a new background */
+                g->learned = 0;
+            }
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    g->frames.fetch_add (1, memory_order_relaxed);
+    g->pass = TRUE;
+    meta = gst_buffer_get_video_meta (buf);
+    stride = meta ? meta->stride[0] : g->stride;
+    /* Fail open: frames the gate cannot look at go to the accelerators */
+    if (g->width > 0 && g->height > 0 && gst_buffer_map (buf, &map, GST_MAP_READ)) {
+        if (map.size >= (gsize) stride * (g->height - 1) + g->width) {
+            gboolean learning = g->learned < g->config.learn_frames;
+            gboolean present = fruit_present (g, map.data + (meta ? meta->offset[0] : 0), stride);
+
+            if (g->tracker && !learning) {
+                /* Only the frame where a fruit is best centered goes on */
+                if (present)
+                    find_blobs (g);
+                else
+                    g->blobs.clear ();
+                dd_tracker_update (g->tracker, g->blobs, g->inspect);
+                g->pass = !g->inspect.empty ();
+                if (g->pass && GST_BUFFER_PTS_IS_VALID (buf)) {
+                    lock_guard<mutex> guard (g->lock);
+                    g->pending.push_back ({ GST_BUFFER_PTS (buf), g->inspect });
+                    if (g->pending.size () > MAX_PENDING_FRAMES)
+                        g->pending.pop_front ();
+                }
+            } else {
+                if (present)
+                    g->hold = g->config.hold_frames + 1;
+                if (!learning && g->hold == 0)
+                    g->pass = FALSE;
+                else if (g->hold)
+                    g->hold--;
+            }
+        }
+        gst_buffer_unmap (buf, &map);
+    }
+    if (g->pass)
+        g->passed.fetch_add (1, memory_order_relaxed);
+    else if (!g->bypass_pad)
+        return GST_PAD_PROBE_DROP;
+    return GST_PAD_PROBE_OK;
+}
+
+/* On each pad of the tee, drop the buffers meant for the other path */
+static GstPadProbeReturn
+route_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDGate *g = (DDGate *) user_data;
+
+    if ((pad == g->bypass_pad) == (g->pass != FALSE))
+        return GST_PAD_PROBE_DROP;
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+add_route_probe (GstElement *tee, GstPad *pad, gpointer user_data) {
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, route_probe, user_data, NULL);
+    return TRUE;
+}
+
+static void
+gate_free (gpointer data) {
+    DDGate *g = (DDGate *) data;
+
+    if (g->bypass_pad)
+        gst_object_unref (g->bypass_pad);
+    dd_tracker_free (g->tracker);
+    delete g;
+}
+
+DDGate *
+dd_gate_new (DDTopology *topo, const DDGateConfig *config) {
+    GstElement *element = dd_topology_get (topo, DD_GATE_STAGE);
+    GstElement *tee = NULL;
+    DDGate *g;
+    GstPad *pad;
+
+    if (!element)
+        return NULL;
+    g = new DDGate ();
+    g->element = element;
+    g->config = *config;
+    g->config.grid_width = MAX (g->config.grid_width, 1);
+    g->config.grid_height = MAX (g->config.grid_height, 1);
+    g->background.assign (g->config.grid_width * g->config.grid_height, 0.0f);
+    g->foreground.assign (g->config.grid_width * g->config.grid_height, 0);
+    if (g->config.track)
+        g->tracker = dd_tracker_new (&g->config.tracker, g->config.grid_width, g->config.grid_height);
+    g->pass = TRUE;
+
+    for (const DDBypass &bypass : topo->bypasses) {
+        if (bypass.from == DD_GATE_STAGE && bypass.queue) {
+            GstPad *queue_pad = gst_element_get_static_pad (bypass.queue, "sink");
+            g->bypass_pad = gst_pad_get_peer (queue_pad);
+            gst_object_unref (queue_pad);
+            tee = bypass.tee;
+        }
+    }
+
+    pad = gst_element_get_static_pad (element, "src");
+    gst_pad_add_probe (pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                       gate_probe, g, NULL);
+    gst_object_unref (pad);
+    if (tee)
+        gst_element_foreach_src_pad (tee, add_route_probe, g);
+
+    GST_DEBUG ("Gate on a %ux%u grid, %u levels off the belt on %.1lf%% of it, %s", g->config.grid_width,
+               g->config.grid_height, g->config.diff_threshold, g->config.area_percent,
+               g->bypass_pad ? "empty frames bypass the accelerators" : "empty frames are dropped");
+    g_object_set_data_full (G_OBJECT (element), "dd-gate", g, gate_free);
+    return g;
+}
+
+void
+dd_gate_stats (DDGate *g, DDGateStats *stats) {
+    stats->frames   = g->frames.load (memory_order_relaxed);
+    stats->passed   = g->passed.load (memory_order_relaxed);
+    stats->bypassed = stats->frames > stats->passed ? stats->frames - stats->passed : 0;
+    if (g->tracker)
+        dd_tracker_stats (g->tracker, &stats->tracker);
+    else
+        stats->tracker = DDTrackerStats ();
+}
+
+void
+dd_gate_take_fruits (DDGate *g, GstClockTime pts, vector<guint32> &fruits) {
+    lock_guard<mutex> guard (g->lock);
+
+    fruits.clear ();
+    for (auto it = g->pending.begin (); it != g->pending.end (); ++it) {
+        if (it->pts == pts) {
+            fruits.swap (it->fruits);
+            g->pending.erase (it);
+            return;
+        }
+    }
+}
+
+gboolean
+dd_gate_config_from_json (json_t *obj, DDGateConfig *config, gboolean *enabled) {
+    json_t *val;
+
+    dd_gate_config_default (config);
+    if (!json_is_object (obj))
+        return FALSE;
+
+    val = json_object_get (obj, "enabled");
+    if (val) {
+        if (!json_is_boolean (val))
+            return FALSE;
+        *enabled = json_is_true (val);
+    }
+    val = json_object_get (obj, "grid");
+    if (val) {
+        if (!json_is_array (val) || json_array_size (val) != 2 ||
+            json_integer_value (json_array_get (val, 0)) <= 0 || json_integer_value (json_array_get (val, 1)) <= 0)
+            return FALSE;
+        config->grid_width = json_integer_value (json_array_get (val, 0));
+        config->grid_height = json_integer_value (json_array_get (val, 1));
+    }
+    val = json_object_get (obj, "diff-threshold");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 0 || json_integer_value (val) > 255)
+            return FALSE;
+        config->diff_threshold = json_integer_value (val);
+    }
+    val = json_object_get (obj, "area-percent");
+    if (val) {
+        if (!json_is_number (val) || json_number_value (val) < 0 || json_number_value (val) > 100)
+            return FALSE;
+        config->area_percent = json_number_value (val);
+    }
+    val = json_object_get (obj, "learn-frames");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 1)
+            return FALSE;
+        config->learn_frames = json_integer_value (val);
+    }
+    val = json_object_get (obj, "background-rate");
+    if (val) {
+        if (!json_is_number (val) || json_number_value (val) < 0 || json_number_value (val) > 1)
+            return FALSE;
+        config->background_rate = json_number_value (val);
+    }
+    val = json_object_get (obj, "hold-frames");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 0)
+            return FALSE;
+        config->hold_frames = json_integer_value (val);
+    }
+    val = json_object_get (obj, "track");
+    if (val) {
+        if (!json_is_boolean (val))
+            return FALSE;
+        config->track = json_is_true (val);
+    }
+    val = json_object_get (obj, "track-max-distance");
+    if (val) {
+        if (!json_is_number (val) || json_number_value (val) <= 0)
+            return FALSE;
+        config->tracker.max_distance = json_number_value (val);
+    }
+    val = json_object_get (obj, "track-area-ratio");
+    if (val) {
+        if (!json_is_number (val) || json_number_value (val) < 1)
+            return FALSE;
+        config->tracker.max_area_ratio = json_number_value (val);
+    }
+    val = json_object_get (obj, "track-max-missed");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 0)
+            return FALSE;
+        config->tracker.max_missed = json_integer_value (val);
+    }
+    val = json_object_get (obj, "track-min-area");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 1)
+            return FALSE;
+        config->tracker.min_area = json_integer_value (val);
+    }
+    return TRUE;
+}
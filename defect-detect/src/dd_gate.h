@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_GATE_H
+#define DD_GATE_H
+
+#include <gst/gst.h>
+#include <jansson.h>
+#include <vector>
+
+#include "dd_topology.h"
+#include "dd_tracker.h"
+
+/* Stage names of the gate and of the stage its bypass joins */
+#define DD_GATE_STAGE             "gate"
+#define DD_GATE_MERGE_STAGE       "merge"
+
+typedef struct _DDGateConfig {
+    guint grid_width;           /* samples per row */
+    guint grid_height;          /* sampled rows */
+    guint diff_threshold;       /* luma difference to the belt counted as foreground */
+    gdouble area_percent;       /* foreground samples meaning a fruit is present */
+    guint learn_frames;         /* frames learning the empty belt, all passed */
+    gdouble background_rate;    /* weight of an empty frame in the belt background */
+    guint hold_frames;          /* frames still passed after the fruit is gone */
+    gboolean track;             /* pass one frame per fruit instead of every frame showing one */
+    DDTrackerConfig tracker;
+} DDGateConfig;
+
+typedef struct _DDGateStats {
+    guint64 frames;
+    guint64 passed;             /* sent to the accelerators */
+    guint64 bypassed;           /* sent along the bypass, or dropped without one */
+    DDTrackerStats tracker;     /* zero unless tracking */
+} DDGateStats;
+
+typedef struct _DDGate DDGate;
+
+/** @brief
+ *  Only let frames showing a fruit through to the accelerators.
+ *
+ *  Each frame is compared with a background of the empty belt learned
+ *  on a sparse grid of samples. Frames with enough samples off the
+ *  background go down the chain; the others take the bypass of the gate
+ *  stage if the topology has one, and are dropped otherwise. The first
+ *  frames, while the background is learned, all pass.
+ *
+ *  @param topo is the built topology, with a DD_GATE_STAGE stage.
+ *  @param config is the gate configuration, copied.
+ *  @return the gate, owned by the gate element; NULL if there is no gate stage.
+ */
+DDGate * dd_gate_new (DDTopology *topo, const DDGateConfig *config);
+
+/* Read the counters; safe from any thread while the pipeline runs */
+void dd_gate_stats (DDGate *gate, DDGateStats *stats);
+
+/** @brief
+ *  Take the IDs of the fruits a passed frame was sent to inspect, when
+ *  tracking. Safe from any thread; the IDs of a frame are kept until
+ *  taken, for the last few frames.
+ *
+ *  @param gate is the gate.
+ *  @param pts is the timestamp of the frame.
+ *  @param fruits is filled with the IDs, empty if unknown.
+ *  @return Void.
+ */
+void dd_gate_take_fruits (DDGate *gate, GstClockTime pts, std::vector<guint32> &fruits);
+
+void dd_gate_config_default (DDGateConfig *config);
+
+/** @brief
+ *  Parse the "gate" object of pipeline.json over the defaults, e.g.
+ *  { "enabled": true, "grid": [ 64, 36 ], "diff-threshold": 24, "area-percent": 2.0,
+ *    "track": true, "track-max-distance": 8 }.
+ *
+ *  @param obj is the object.
+ *  @param config is filled with the configuration.
+ *  @param enabled is set from "enabled" if present.
+ *  @return FALSE if a value is invalid.
+ */
+gboolean dd_gate_config_from_json (json_t *obj, DDGateConfig *config, gboolean *enabled);
+
+#endif /* DD_GATE_H */
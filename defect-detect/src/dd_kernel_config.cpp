@@ -0,0 +1,41 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_kernel_config.h"
+
+#include "dd_workers.h"
+
+static unsigned int
+config_uint (json_t *config, const char *key, unsigned int fallback) {
+    json_t *val = json_object_get (config, key);
+
+    if (!val || !json_is_integer (val) || json_integer_value (val) < 0)
+        return fallback;
+    return json_integer_value (val);
+}
+
+void
+dd_kernel_config_parse (json_t *config, const char *kernel, DDKernelConfig *kconfig) {
+    kconfig->max_width = config_uint (config, "max_width", DD_KERNEL_DEFAULT_MAX_WIDTH);
+    kconfig->max_height = config_uint (config, "max_height", DD_KERNEL_DEFAULT_MAX_HEIGHT);
+    kconfig->stream_id = config_uint (config, "stream_id", 0);
+    if (kconfig->stream_id >= DD_SCHED_MAX_STREAMS)
+        kconfig->stream_id = 0;
+    kconfig->sched = dd_sched_get (kernel, config_uint (config, "compute_units", 1));
+    /* The first library to set it sizes the pool */
+    if (json_is_integer (json_object_get (config, "cpu_workers")))
+        dd_workers_init (config_uint (config, "cpu_workers", 0));
+}
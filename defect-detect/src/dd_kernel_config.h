@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_KERNEL_CONFIG_H
+#define DD_KERNEL_CONFIG_H
+
+#include <jansson.h>
+
+#include "dd_sched.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest frame when a config does not give one, that of the shipped xclbin */
+#define DD_KERNEL_DEFAULT_MAX_WIDTH     1920
+#define DD_KERNEL_DEFAULT_MAX_HEIGHT    1080
+
+/* The keys every accelerator kernel library reads from its config */
+typedef struct _DDKernelConfig {
+    unsigned int max_width;     /* largest frame the kernel in the xclbin was built for */
+    unsigned int max_height;
+    unsigned int stream_id;     /* below DD_SCHED_MAX_STREAMS */
+    DDSched *sched;             /* compute units shared by every stream */
+} DDKernelConfig;
+
+/** @brief
+ *  Read the keys the accelerator kernel libraries share from the config
+ *  of their kernel:
+ *
+ *    max_width, max_height  largest frame, 1920x1080 by default
+ *    stream_id              stream of the statistics and scheduler, 0 by default
+ *    compute_units          calls of the kernel run at once, 1 by default
+ *    cpu_workers            threads of the shared worker pool, see dd_workers_init()
+ *
+ *  and get the scheduler of the kernel.
+ *
+ *  @param config is the "config" object of the kernel.
+ *  @param kernel is the kernel name, e.g. DD_SCHED_KERNEL_OTSU.
+ *  @param kconfig is filled with the values.
+ *  @return Void.
+ */
+void dd_kernel_config_parse (json_t *config, const char *kernel, DDKernelConfig *kconfig);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DD_KERNEL_CONFIG_H */
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_media.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/media.h>
+#include <linux/v4l2-subdev.h>
+#include <linux/videodev2.h>
+#include <jansson.h>
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+typedef struct _Entity {
+    struct media_entity_desc desc;
+    vector<struct media_pad_desc> pads;
+    vector<struct media_link_desc> links;
+    string node;                /* subdevice node, empty for other entities */
+} Entity;
+
+typedef struct _PadFormat {
+    string entity;
+    guint pad;
+    guint32 code;               /* 0 keeps the current one */
+    guint width, height;        /* 0 for the capture size */
+} PadFormat;
+
+typedef struct _Control {
+    string entity;
+    string name;
+    gint64 value;
+} Control;
+
+static const struct {
+    const gchar *name;
+    guint32 code;
+} bus_codes[] = {
+    { "Y8_1X8",       MEDIA_BUS_FMT_Y8_1X8 },
+    { "Y10_1X10",     MEDIA_BUS_FMT_Y10_1X10 },
+    { "Y12_1X12",     MEDIA_BUS_FMT_Y12_1X12 },
+    { "SRGGB8_1X8",   MEDIA_BUS_FMT_SRGGB8_1X8 },
+    { "SRGGB10_1X10", MEDIA_BUS_FMT_SRGGB10_1X10 },
+    { "SRGGB12_1X12", MEDIA_BUS_FMT_SRGGB12_1X12 },
+    { "UYVY8_1X16",   MEDIA_BUS_FMT_UYVY8_1X16 },
+    { "RBG888_1X24",  MEDIA_BUS_FMT_RBG888_1X24 },
+};
+
+static gint
+xioctl (gint fd, unsigned long request, void *arg) {
+    gint ret;
+
+    do {
+        ret = ioctl (fd, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static gboolean
+starts_with (const gchar *name, const string &prefix) {
+    return !strncmp (name, prefix.c_str (), prefix.size ());
+}
+
+/* /dev node of a character device, e.g. 81:3 -> /dev/v4l-subdev1 */
+static string
+device_node (guint32 major, guint32 minor) {
+    gchar *sys = g_strdup_printf ("/sys/dev/char/%u:%u", major, minor);
+    gchar resolved[PATH_MAX];
+    string node;
+
+    if (realpath (sys, resolved)) {
+        gchar *base = g_path_get_basename (resolved);
+        node = string ("/dev/") + base;
+        g_free (base);
+    }
+    g_free (sys);
+    return node;
+}
+
+static gboolean
+enum_entities (gint fd, map<guint32, Entity> &entities) {
+    struct media_entity_desc desc;
+
+    memset (&desc, 0, sizeof (desc));
+    desc.id = MEDIA_ENT_ID_FLAG_NEXT;
+    while (xioctl (fd, MEDIA_IOC_ENUM_ENTITIES, &desc) == 0) {
+        Entity &entity = entities[desc.id];
+        struct media_links_enum links;
+
+        entity.desc = desc;
+        entity.pads.resize (desc.pads);
+        entity.links.resize (desc.links);
+        memset (&links, 0, sizeof (links));
+        links.entity = desc.id;
+        links.pads = entity.pads.data ();
+        links.links = entity.links.data ();
+        if (xioctl (fd, MEDIA_IOC_ENUM_LINKS, &links) != 0) {
+            GST_ERROR ("Could not list the links of %s: %s", desc.name, strerror (errno));
+            return FALSE;
+        }
+        if ((desc.type & MEDIA_ENT_TYPE_MASK) == MEDIA_ENT_T_V4L2_SUBDEV)
+            entity.node = device_node (desc.dev.major, desc.dev.minor);
+
+        desc.id |= MEDIA_ENT_ID_FLAG_NEXT;
+    }
+    return !entities.empty ();
+}
+
+/** @brief
+ *  List the subdevices feeding the video nodes through enabled links,
+ *  the ones closest to the sensor first.
+ *
+ *  @param entities is the media graph.
+ *  @return the ids of the subdevices.
+ */
+static vector<guint32>
+capture_chain (map<guint32, Entity> &entities) {
+    map<pair<guint32, guint16>, guint32> upstream;
+    vector<guint32> todo, chain;
+    set<guint32> seen;
+
+    for (auto &it : entities) {
+        for (const struct media_link_desc &link : it.second.links) {
+            if (link.flags & MEDIA_LNK_FL_ENABLED)
+                upstream[make_pair (link.sink.entity, link.sink.index)] = link.source.entity;
+        }
+        if (it.second.desc.type == MEDIA_ENT_T_DEVNODE_V4L)
+            todo.push_back (it.first);
+    }
+
+    while (!todo.empty ()) {
+        Entity &entity = entities[todo.back ()];
+        todo.pop_back ();
+        for (const struct media_pad_desc &pad : entity.pads) {
+            auto it = upstream.find (make_pair (entity.desc.id, pad.index));
+            if (!(pad.flags & MEDIA_PAD_FL_SINK) || it == upstream.end () || !seen.insert (it->second).second)
+                continue;
+            if (!entities[it->second].node.empty ())
+                chain.push_back (it->second);
+            todo.push_back (it->second);
+        }
+    }
+    reverse (chain.begin (), chain.end ());
+    return chain;
+}
+
+static gboolean
+parse_bus_code (json_t *val, guint32 *code) {
+    if (json_is_integer (val)) {
+        *code = json_integer_value (val);
+        return TRUE;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS (bus_codes); i++) {
+        if (!g_strcmp0 (json_string_value (val), bus_codes[i].name)) {
+            *code = bus_codes[i].code;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+load_sensor_config (const gchar *path, vector<PadFormat> &formats, vector<Control> &controls) {
+    json_error_t error;
+    json_t *root, *val;
+    size_t i;
+
+    if (!path || !g_file_test (path, G_FILE_TEST_EXISTS))
+        return TRUE;
+    root = json_load_file (path, JSON_DECODE_ANY, &error);
+    if (!root) {
+        GST_ERROR ("Could not parse %s: %s", path, error.text);
+        return FALSE;
+    }
+
+    json_array_foreach (json_object_get (root, "formats"), i, val) {
+        PadFormat format = { "", 0, 0, 0, 0 };
+        json_t *code = json_object_get (val, "code");
+
+        if (!json_is_string (json_object_get (val, "entity")) || (code && !parse_bus_code (code, &format.code))) {
+            GST_ERROR ("Invalid format %zu in %s", i, path);
+            json_decref (root);
+            return FALSE;
+        }
+        format.entity = json_string_value (json_object_get (val, "entity"));
+        format.pad = json_integer_value (json_object_get (val, "pad"));
+        format.width = json_integer_value (json_object_get (val, "width"));
+        format.height = json_integer_value (json_object_get (val, "height"));
+        formats.push_back (format);
+    }
+    json_array_foreach (json_object_get (root, "controls"), i, val) {
+        if (!json_is_string (json_object_get (val, "entity")) || !json_is_string (json_object_get (val, "name")) ||
+            !json_is_integer (json_object_get (val, "value"))) {
+            GST_ERROR ("Invalid control %zu in %s", i, path);
+            json_decref (root);
+            return FALSE;
+        }
+        controls.push_back ({ json_string_value (json_object_get (val, "entity")),
+                              json_string_value (json_object_get (val, "name")),
+                              (gint64) json_integer_value (json_object_get (val, "value")) });
+    }
+    json_decref (root);
+    return TRUE;
+}
+
+static void
+set_pad_format (gint fd, const Entity &entity, guint pad, const vector<PadFormat> &formats,
+                guint width, guint height) {
+    struct v4l2_subdev_format fmt;
+
+    memset (&fmt, 0, sizeof (fmt));
+    fmt.which = V4L2_SUBDEV_FORMAT_ACTIVE;
+    fmt.pad = pad;
+    /* Pads without a format, e.g. of a splitter, are left alone */
+    if (xioctl (fd, VIDIOC_SUBDEV_G_FMT, &fmt) != 0)
+        return;
+
+    fmt.format.width = width;
+    fmt.format.height = height;
+    for (const PadFormat &format : formats) {
+        if (!starts_with (entity.desc.name, format.entity) || format.pad != pad)
+            continue;
+        if (format.code)
+            fmt.format.code = format.code;
+        if (format.width)
+            fmt.format.width = format.width;
+        if (format.height)
+            fmt.format.height = format.height;
+    }
+    if (xioctl (fd, VIDIOC_SUBDEV_S_FMT, &fmt) != 0)
+        GST_WARNING ("Could not set the format of %s:%u: %s", entity.desc.name, pad, strerror (errno));
+    else
+        GST_DEBUG ("%s:%u is 0x%04x/%ux%u", entity.desc.name, pad, fmt.format.code,
+                   fmt.format.width, fmt.format.height);
+}
+
+static void
+set_control (gint fd, const Entity &entity, const Control &control) {
+    struct v4l2_query_ext_ctrl query;
+    struct v4l2_ext_control ctrl;
+    struct v4l2_ext_controls ctrls;
+
+    memset (&query, 0, sizeof (query));
+    query.id = V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+    while (xioctl (fd, VIDIOC_QUERY_EXT_CTRL, &query) == 0) {
+        if (!g_ascii_strcasecmp (query.name, control.name.c_str ()))
+            break;
+        query.id |= V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+    }
+    if (g_ascii_strcasecmp (query.name, control.name.c_str ())) {
+        GST_WARNING ("%s has no control %s", entity.desc.name, control.name.c_str ());
+        return;
+    }
+
+    memset (&ctrl, 0, sizeof (ctrl));
+    memset (&ctrls, 0, sizeof (ctrls));
+    ctrl.id = query.id;
+    if (query.type == V4L2_CTRL_TYPE_INTEGER64)
+        ctrl.value64 = control.value;
+    else
+        ctrl.value = (gint32) control.value;
+    ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ctrls.count = 1;
+    ctrls.controls = &ctrl;
+    if (xioctl (fd, VIDIOC_S_EXT_CTRLS, &ctrls) != 0)
+        GST_WARNING ("Could not set %s of %s to %" G_GINT64_FORMAT ": %s", control.name.c_str (),
+                     entity.desc.name, control.value, strerror (errno));
+}
+
+void
+dd_media_find_capture_devs (vector<string> &devs) {
+    glob_t globbuf;
+
+    if (glob ("/dev/media*", 0, NULL, &globbuf) != 0)
+        return;
+    for (size_t i = 0; i < globbuf.gl_pathc; i++) {
+        struct media_device_info info;
+        gint fd = open (globbuf.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            continue;
+        memset (&info, 0, sizeof (info));
+        if (xioctl (fd, MEDIA_IOC_DEVICE_INFO, &info) == 0 && !strcmp (info.driver, DD_MEDIA_CAPTURE_DRIVER))
+            devs.push_back (globbuf.gl_pathv[i]);
+        close (fd);
+    }
+    globfree (&globbuf);
+}
+
+gboolean
+dd_media_configure (const gchar *media_dev, const gchar *sensor_config, guint width, guint height) {
+    map<guint32, Entity> entities;
+    vector<PadFormat> formats;
+    vector<Control> controls;
+    gboolean ok;
+    gint fd;
+
+    if (!load_sensor_config (sensor_config, formats, controls))
+        return FALSE;
+    fd = open (media_dev, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        GST_ERROR ("Could not open %s: %s", media_dev, strerror (errno));
+        return FALSE;
+    }
+    ok = enum_entities (fd, entities);
+    close (fd);
+    if (!ok) {
+        GST_ERROR ("Could not list the entities of %s", media_dev);
+        return FALSE;
+    }
+
+    for (guint32 id : capture_chain (entities)) {
+        const Entity &entity = entities[id];
+        gint subdev = open (entity.node.c_str (), O_RDWR | O_CLOEXEC);
+
+        if (subdev < 0) {
+            GST_WARNING ("Could not open %s of %s: %s", entity.node.c_str (), entity.desc.name, strerror (errno));
+            continue;
+        }
+        /* Sink pads first, drivers propagate them to their source pads */
+        for (const struct media_pad_desc &pad : entity.pads) {
+            if (pad.flags & MEDIA_PAD_FL_SINK)
+                set_pad_format (subdev, entity, pad.index, formats, width, height);
+        }
+        for (const struct media_pad_desc &pad : entity.pads) {
+            if (pad.flags & MEDIA_PAD_FL_SOURCE)
+                set_pad_format (subdev, entity, pad.index, formats, width, height);
+        }
+        for (const Control &control : controls) {
+            if (starts_with (entity.desc.name, control.entity))
+                set_control (subdev, entity, control);
+        }
+        close (subdev);
+    }
+    return TRUE;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_MEDIA_H
+#define DD_MEDIA_H
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+
+/* Driver of the media devices of the capture pipelines */
+#define DD_MEDIA_CAPTURE_DRIVER   "xilinx-video"
+
+/** @brief
+ *  Find the media devices of the capture pipelines, in the order of
+ *  their /dev/mediaN nodes.
+ *
+ *  @param devs is filled with the device nodes.
+ *  @return Void.
+ */
+void dd_media_find_capture_devs (std::vector<std::string> &devs);
+
+/** @brief
+ *  Configure the sensor and every subdevice between it and the capture
+ *  DMA of a media device.
+ *
+ *  The enabled links are followed upstream from the video nodes and the
+ *  format of each pad on the way is set to width x height, keeping its
+ *  media bus code, sensor first. The optional sensor config then
+ *  overrides pad formats and sets controls:
+ *
+ *    { "formats":  [ { "entity": "imx", "pad": 0, "code": "Y10_1X10" } ],
+ *      "controls": [ { "entity": "imx", "name": "Exposure", "value": 8000 } ] }
+ *
+ *  where "entity" matches the start of the entity names.
+ *
+ *  @param media_dev is the media device node.
+ *  @param sensor_config is the JSON sensor config, NULL for none.
+ *  @param width is the capture width.
+ *  @param height is the capture height.
+ *  @return FALSE if the device could not be configured.
+ */
+gboolean dd_media_configure (const gchar *media_dev, const gchar *sensor_config, guint width, guint height);
+
+#endif /* DD_MEDIA_H */
@@ -0,0 +1,477 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "dd_dmabuf.h"
+#include "dd_sched.h"
+#include "dd_stats.h"
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+#define MAX_REQUEST_SIZE    8192
+
+static const gdouble latency_buckets[] = DD_METRICS_LATENCY_BUCKETS;
+#define N_LATENCY_BUCKETS   G_N_ELEMENTS (latency_buckets)
+
+typedef struct _ElementCounters {
+    string name;
+    guint stream;
+    atomic<guint64> in;
+    atomic<guint64> out;
+} ElementCounters;
+
+typedef struct _Pipeline {
+    DDTopology *topo;
+    guint stream;
+    ElementCounters *first, *last;
+    /* Capture to sink, cumulative buckets are summed at scrape time */
+    atomic<guint64> latency[N_LATENCY_BUCKETS + 1];
+    atomic<guint64> latency_sum_ns;
+} Pipeline;
+
+struct _DDMetrics {
+    gint fd;
+    gint wake[2];
+    guint port;
+    guint streams;
+    vector<ElementCounters *> elements;
+    vector<Pipeline *> pipelines;
+    vector<DDResultsWriter *> writers;
+    thread worker;
+};
+
+static GstPadProbeReturn
+count_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    atomic<guint64> *counter = (atomic<guint64> *) user_data;
+
+    counter->fetch_add (1, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+latency_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    Pipeline *p = (Pipeline *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    GstElement *sink = GST_PAD_PARENT (pad);
+    GstClockTime capture, now;
+    gdouble seconds;
+    guint bucket = 0;
+
+    if (!GST_BUFFER_PTS_IS_VALID (buf))
+        return GST_PAD_PROBE_OK;
+    /* The pipeline runs on the monotonic system clock */
+    capture = gst_element_get_base_time (sink) + GST_BUFFER_PTS (buf);
+    now = g_get_monotonic_time () * GST_USECOND;
+    if (now < capture)
+        return GST_PAD_PROBE_OK;
+    seconds = (now - capture) / (gdouble) GST_SECOND;
+    while (bucket < N_LATENCY_BUCKETS && seconds > latency_buckets[bucket])
+        bucket++;
+    p->latency[bucket].fetch_add (1, memory_order_relaxed);
+    p->latency_sum_ns.fetch_add (now - capture, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+add_pad_probe (GstElement *element, GstPad *pad, gpointer user_data) {
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, count_probe, user_data, NULL);
+    return TRUE;
+}
+
+static gboolean
+add_sink_probe (GstElement *element, GstPad *pad, gpointer user_data) {
+    return add_pad_probe (element, pad, &((ElementCounters *) user_data)->in);
+}
+
+static gboolean
+add_src_probe (GstElement *element, GstPad *pad, gpointer user_data) {
+    return add_pad_probe (element, pad, &((ElementCounters *) user_data)->out);
+}
+
+static void
+write_metrics (DDMetrics *m, ostringstream &out) {
+    const gchar *kernels[] = { DD_SCHED_KERNEL_OTSU, DD_SCHED_KERNEL_PREPROCESS, DD_SCHED_KERNEL_CCA };
+    guint64 now = dd_stats_now_ns ();
+    DDStatsSnapshot snap;
+    DDSchedStats sched;
+    DDQueueStats queue;
+    DDPoolStats pst;
+
+    out << "# HELP dd_element_buffers_in_total Buffers received by a pipeline element.\n"
+           "# TYPE dd_element_buffers_in_total counter\n";
+    for (ElementCounters *e : m->elements)
+        out << "dd_element_buffers_in_total{stream=\"" << e->stream << "\",element=\"" << e->name << "\"} "
+            << e->in.load (memory_order_relaxed) << "\n";
+    out << "# HELP dd_element_buffers_out_total Buffers pushed by a pipeline element.\n"
+           "# TYPE dd_element_buffers_out_total counter\n";
+    for (ElementCounters *e : m->elements)
+        out << "dd_element_buffers_out_total{stream=\"" << e->stream << "\",element=\"" << e->name << "\"} "
+            << e->out.load (memory_order_relaxed) << "\n";
+
+    out << "# HELP dd_element_copies_total Buffers received by a pipeline element in system memory.\n"
+           "# TYPE dd_element_copies_total counter\n";
+    for (Pipeline *p : m->pipelines) {
+        for (GstElement *element : p->topo->linked) {
+            DDCopyMonitor *monitor = dd_copy_monitor_get (element);
+            DDCopyStats copies;
+
+            if (!monitor)
+                continue;
+            dd_copy_monitor_stats (monitor, &copies);
+            out << "dd_element_copies_total{stream=\"" << p->stream << "\",element=\"" << copies.name << "\"} "
+                << copies.copies << "\n";
+        }
+    }
+
+    out << "# HELP dd_frames_in_flight Frames out of the source and not yet at the sink.\n"
+           "# TYPE dd_frames_in_flight gauge\n";
+    for (Pipeline *p : m->pipelines) {
+        guint64 in = p->first->out.load (memory_order_relaxed);
+        guint64 done = p->last->in.load (memory_order_relaxed);
+        out << "dd_frames_in_flight{stream=\"" << p->stream << "\"} " << (in > done ? in - done : 0) << "\n";
+    }
+
+    out << "# HELP dd_queue_level Buffers held by a queue.\n# TYPE dd_queue_level gauge\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDQueueMonitor *q : p->topo->queues) {
+            dd_queue_monitor_stats (q, &queue);
+            out << "dd_queue_level{stream=\"" << p->stream << "\",queue=\"" << queue.name << "\"} "
+                << queue.level << "\n";
+        }
+    }
+    out << "# HELP dd_queue_dropped_total Buffers dropped by a queue.\n# TYPE dd_queue_dropped_total counter\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDQueueMonitor *q : p->topo->queues) {
+            dd_queue_monitor_stats (q, &queue);
+            out << "dd_queue_dropped_total{stream=\"" << p->stream << "\",queue=\"" << queue.name
+                << "\",reason=\"full\"} " << queue.dropped_full << "\n";
+            out << "dd_queue_dropped_total{stream=\"" << p->stream << "\",queue=\"" << queue.name
+                << "\",reason=\"stale\"} " << queue.dropped_stale << "\n";
+        }
+    }
+    out << "# HELP dd_queue_blocked_seconds_total Time upstream spent blocked on a full queue.\n"
+           "# TYPE dd_queue_blocked_seconds_total counter\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDQueueMonitor *q : p->topo->queues) {
+            dd_queue_monitor_stats (q, &queue);
+            out << "dd_queue_blocked_seconds_total{stream=\"" << p->stream << "\",queue=\"" << queue.name << "\"} "
+                << queue.blocked_ns / 1e9 << "\n";
+        }
+    }
+    out << "# HELP dd_pool_buffers_in_use Buffers out of the output pool of a stage.\n"
+           "# TYPE dd_pool_buffers_in_use gauge\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDPoolMonitor *pool : p->topo->pools) {
+            dd_pool_monitor_stats (pool, &pst);
+            if (!pst.in_place)
+                out << "dd_pool_buffers_in_use{stream=\"" << p->stream << "\",stage=\"" << pst.name << "\"} "
+                    << pst.in_use << "\n";
+        }
+    }
+    out << "# HELP dd_pool_buffers_allocated_total Buffers allocated by the output pool of a stage.\n"
+           "# TYPE dd_pool_buffers_allocated_total counter\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDPoolMonitor *pool : p->topo->pools) {
+            dd_pool_monitor_stats (pool, &pst);
+            if (!pst.in_place)
+                out << "dd_pool_buffers_allocated_total{stream=\"" << p->stream << "\",stage=\"" << pst.name
+                    << "\"} " << pst.allocated << "\n";
+        }
+    }
+    out << "# HELP dd_pool_waits_total Frames after which every buffer of the output pool of a stage was in use.\n"
+           "# TYPE dd_pool_waits_total counter\n";
+    for (Pipeline *p : m->pipelines) {
+        for (DDPoolMonitor *pool : p->topo->pools) {
+            dd_pool_monitor_stats (pool, &pst);
+            if (!pst.in_place)
+                out << "dd_pool_waits_total{stream=\"" << p->stream << "\",stage=\"" << pst.name << "\"} "
+                    << pst.waits << "\n";
+        }
+    }
+    if (!m->writers.empty ()) {
+        guint64 dropped = 0;
+        for (DDResultsWriter *w : m->writers)
+            dropped += dd_results_writer_dropped (w);
+        out << "# HELP dd_results_dropped_total Result records dropped by the writer.\n"
+               "# TYPE dd_results_dropped_total counter\n"
+               "dd_results_dropped_total " << dropped << "\n";
+    }
+
+    out << "# HELP dd_latency_seconds Capture to sink latency.\n# TYPE dd_latency_seconds histogram\n";
+    for (Pipeline *p : m->pipelines) {
+        guint64 count = 0;
+        if (!p->topo->live)
+            continue;
+        for (guint b = 0; b <= N_LATENCY_BUCKETS; b++) {
+            count += p->latency[b].load (memory_order_relaxed);
+            out << "dd_latency_seconds_bucket{stream=\"" << p->stream << "\",le=\"";
+            if (b < N_LATENCY_BUCKETS)
+                out << latency_buckets[b];
+            else
+                out << "+Inf";
+            out << "\"} " << count << "\n";
+        }
+        out << "dd_latency_seconds_sum{stream=\"" << p->stream << "\"} "
+            << p->latency_sum_ns.load (memory_order_relaxed) / 1e9 << "\n";
+        out << "dd_latency_seconds_count{stream=\"" << p->stream << "\"} " << count << "\n";
+    }
+
+    out << "# HELP dd_frames_inspected_total Frames with a decision.\n# TYPE dd_frames_inspected_total counter\n";
+    for (guint i = 0; i < m->streams; i++) {
+        if (dd_stats_snapshot (i, DD_STATS_WINDOW_TOTAL, now, &snap) == 0)
+            out << "dd_frames_inspected_total{stream=\"" << i << "\"} " << snap.frames << "\n";
+    }
+    out << "# HELP dd_defects_total Frames decided defective.\n# TYPE dd_defects_total counter\n";
+    for (guint i = 0; i < m->streams; i++) {
+        if (dd_stats_snapshot (i, DD_STATS_WINDOW_TOTAL, now, &snap) == 0)
+            out << "dd_defects_total{stream=\"" << i << "\"} " << snap.defects << "\n";
+    }
+    out << "# HELP dd_decision_rate Decisions per second over the last minute.\n# TYPE dd_decision_rate gauge\n";
+    for (guint i = 0; i < m->streams; i++) {
+        if (dd_stats_snapshot (i, DD_STATS_WINDOW_1M, now, &snap) != 0)
+            continue;
+        gdouble span = snap.span_ns ? snap.span_ns / 1e9 : 60.0;
+        out << "dd_decision_rate{stream=\"" << i << "\",decision=\"good\"} " << (snap.frames - snap.defects) / span << "\n";
+        out << "dd_decision_rate{stream=\"" << i << "\",decision=\"defect\"} " << snap.defects / span << "\n";
+    }
+
+    out << "# HELP dd_kernel_calls_total Kernel calls.\n# TYPE dd_kernel_calls_total counter\n";
+    for (const gchar *kernel : kernels) {
+        for (guint i = 0; i < m->streams; i++) {
+            if (dd_sched_stats (kernel, i, &sched) == 0)
+                out << "dd_kernel_calls_total{stream=\"" << i << "\",kernel=\"" << kernel << "\"} " << sched.calls << "\n";
+        }
+    }
+    out << "# HELP dd_kernel_timeouts_total Kernel calls not completed in time.\n"
+           "# TYPE dd_kernel_timeouts_total counter\n";
+    for (const gchar *kernel : kernels) {
+        for (guint i = 0; i < m->streams; i++) {
+            if (dd_sched_stats (kernel, i, &sched) == 0)
+                out << "dd_kernel_timeouts_total{stream=\"" << i << "\",kernel=\"" << kernel << "\"} "
+                    << sched.timeouts << "\n";
+        }
+    }
+    out << "# HELP dd_kernel_wait_seconds_total Time waiting for a compute unit.\n"
+           "# TYPE dd_kernel_wait_seconds_total counter\n";
+    for (const gchar *kernel : kernels) {
+        for (guint i = 0; i < m->streams; i++) {
+            if (dd_sched_stats (kernel, i, &sched) == 0)
+                out << "dd_kernel_wait_seconds_total{stream=\"" << i << "\",kernel=\"" << kernel << "\"} "
+                    << sched.wait_ns / 1e9 << "\n";
+        }
+    }
+    out << "# HELP dd_kernel_busy_seconds_total Time holding a compute unit.\n"
+           "# TYPE dd_kernel_busy_seconds_total counter\n";
+    for (const gchar *kernel : kernels) {
+        for (guint i = 0; i < m->streams; i++) {
+            if (dd_sched_stats (kernel, i, &sched) == 0)
+                out << "dd_kernel_busy_seconds_total{stream=\"" << i << "\",kernel=\"" << kernel << "\"} "
+                    << sched.busy_ns / 1e9 << "\n";
+        }
+    }
+}
+
+static void
+send_all (gint fd, const string &data) {
+    size_t done = 0;
+
+    while (done < data.size ()) {
+        ssize_t n = send (fd, data.data () + done, data.size () - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        done += n;
+    }
+}
+
+/* One request per connection, then close it */
+static void
+serve (DDMetrics *m, gint fd) {
+    struct timeval timeout = { 1, 0 };
+    string request, status = "200 OK", body;
+    gchar buf[1024];
+    ssize_t n;
+
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+    setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+    while (request.find ("\r\n\r\n") == string::npos && request.size () < MAX_REQUEST_SIZE) {
+        n = recv (fd, buf, sizeof (buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        request.append (buf, n);
+    }
+
+    if (!request.compare (0, 13, "GET /metrics ") || !request.compare (0, 13, "GET /metrics?")) {
+        ostringstream out;
+        write_metrics (m, out);
+        body = out.str ();
+    } else if (request.compare (0, 4, "GET ")) {
+        status = "405 Method Not Allowed";
+    } else {
+        status = "404 Not Found";
+    }
+    send_all (fd, "HTTP/1.0 " + status + "\r\n"
+                  "Content-Type: text/plain; version=0.0.4\r\n"
+                  "Content-Length: " + to_string (body.size ()) + "\r\n"
+                  "Connection: close\r\n\r\n" + body);
+}
+
+static void
+metrics_thread (DDMetrics *m) {
+    for (;;) {
+        struct pollfd fds[2] = { { m->wake[0], POLLIN, 0 }, { m->fd, POLLIN, 0 } };
+        gint fd;
+
+        if (poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            GST_ERROR ("Metrics endpoint poll failed: %s", strerror (errno));
+            return;
+        }
+        if (fds[0].revents)
+            return;
+        fd = accept4 (m->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        serve (m, fd);
+        close (fd);
+    }
+}
+
+DDMetrics *
+dd_metrics_new (guint port) {
+    struct sockaddr_in addr;
+    DDMetrics *m;
+    gint fd, one = 1;
+
+    fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        GST_ERROR ("Could not create the metrics socket: %s", strerror (errno));
+        return NULL;
+    }
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    if (port > G_MAXUINT16 || bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0 || listen (fd, 4) != 0) {
+        GST_ERROR ("Could not listen on 127.0.0.1:%u: %s", port, strerror (errno));
+        close (fd);
+        return NULL;
+    }
+
+    m = new DDMetrics ();
+    m->fd = fd;
+    m->port = port;
+    m->streams = 1;
+    m->wake[0] = m->wake[1] = -1;
+    return m;
+}
+
+void
+dd_metrics_watch (DDMetrics *m, DDTopology *topo, guint stream) {
+    GstElement *sink = dd_topology_get (topo, "sink");
+    Pipeline *p;
+
+    if (!m || topo->linked.empty ())
+        return;
+    p = new Pipeline ();
+    p->topo = topo;
+    p->stream = stream;
+    for (GstElement *element : topo->linked) {
+        ElementCounters *e = new ElementCounters ();
+        e->name = GST_ELEMENT_NAME (element);
+        e->stream = stream;
+        gst_element_foreach_sink_pad (element, add_sink_probe, e);
+        gst_element_foreach_src_pad (element, add_src_probe, e);
+        m->elements.push_back (e);
+        if (!p->first)
+            p->first = e;
+        if (element == sink)
+            p->last = e;
+    }
+    if (!p->last)
+        p->last = m->elements.back ();
+    if (sink && topo->live) {
+        GstPad *pad = gst_element_get_static_pad (sink, "sink");
+        gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, latency_probe, p, NULL);
+        gst_object_unref (pad);
+    }
+    m->pipelines.push_back (p);
+}
+
+void
+dd_metrics_watch_results (DDMetrics *m, DDResultsWriter *writer) {
+    if (m && writer)
+        m->writers.push_back (writer);
+}
+
+void
+dd_metrics_set_streams (DDMetrics *m, guint streams) {
+    if (m)
+        m->streams = MIN (streams, DD_STATS_MAX_STREAMS);
+}
+
+gboolean
+dd_metrics_start (DDMetrics *m) {
+    if (pipe2 (m->wake, O_CLOEXEC) != 0) {
+        GST_ERROR ("Could not start the metrics thread: %s", strerror (errno));
+        return FALSE;
+    }
+    m->worker = thread (metrics_thread, m);
+    GST_DEBUG ("Serving metrics on http://127.0.0.1:%u/metrics", m->port);
+    return TRUE;
+}
+
+void
+dd_metrics_free (DDMetrics *m) {
+    if (!m)
+        return;
+    if (m->worker.joinable ()) {
+        if (write (m->wake[1], "q", 1) < 0)
+            GST_WARNING ("Could not wake the metrics thread");
+        m->worker.join ();
+    }
+    if (m->wake[0] >= 0) {
+        close (m->wake[0]);
+        close (m->wake[1]);
+    }
+    close (m->fd);
+    for (Pipeline *p : m->pipelines)
+        delete p;
+    for (ElementCounters *e : m->elements)
+        delete e;
+    delete m;
+}
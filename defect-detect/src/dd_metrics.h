@@ -0,0 +1,65 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_METRICS_H
+#define DD_METRICS_H
+
+#include <gst/gst.h>
+
+#include "dd_results.h"
+#include "dd_topology.h"
+
+/* Upper bounds of the latency histogram buckets, in seconds */
+#define DD_METRICS_LATENCY_BUCKETS  { 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0 }
+
+typedef struct _DDMetrics DDMetrics;
+
+/** @brief
+ *  Serve metrics in the Prometheus text format over HTTP on localhost.
+ *
+ *  GET /metrics is answered on a thread of its own. Every value comes
+ *  from counters updated with relaxed atomics by the streaming threads,
+ *  so a scrape never takes a lock they use.
+ *
+ *  @param port is the TCP port, bound on 127.0.0.1 only.
+ *  @return the endpoint, NULL if the port cannot be bound.
+ */
+DDMetrics * dd_metrics_new (guint port);
+
+/** @brief
+ *  Count the buffers in and out of every element of a pipeline and the
+ *  latency at its sink. Call from the main thread before the pipeline
+ *  starts, and before dd_metrics_start().
+ *
+ *  @param metrics is the endpoint.
+ *  @param topo is the built topology of the pipeline.
+ *  @param stream is the stream of the pipeline.
+ *  @return Void.
+ */
+void dd_metrics_watch (DDMetrics *metrics, DDTopology *topo, guint stream);
+
+/* Also report the records dropped by @writer */
+void dd_metrics_watch_results (DDMetrics *metrics, DDResultsWriter *writer);
+
+/* Number of streams reported for defect and kernel metrics */
+void dd_metrics_set_streams (DDMetrics *metrics, guint streams);
+
+gboolean dd_metrics_start (DDMetrics *metrics);
+
+/* Stop serving; the watched pipelines must be stopped first */
+void dd_metrics_free (DDMetrics *metrics);
+
+#endif /* DD_METRICS_H */
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_mmapsrc.h"
+#include "dd_rec.h"
+
+#include <gst/app/gstappsrc.h>
+#include <gst/base/gstbasesrc.h>
+#include <gst/video/video.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+/* The pool is only known once the first buffers negotiated the caps */
+#define MAX_POOL_CHECKS   8
+
+/* Shared by the source and every buffer wrapping a frame of it */
+typedef struct _Mapping {
+    gpointer addr;
+    gsize size;
+    atomic<gint> refs;
+} Mapping;
+
+struct _DDMmapSrc {
+    DDMmapSrcConfig config;
+    string location;
+    GstElement *appsrc;
+    Mapping *map;
+    GstVideoInfo info;
+    gsize frame_size;
+    guint64 first, last, cur;
+    guint64 pushed;
+    atomic<guint64> loops;
+    atomic<gint64> seek_to;     /* frame to go to before the next push, -1 for none */
+    GstClockTime duration;
+    /* Timestamps restart from next_pts at the anchor frame after a loop or a seek */
+    GstClockTime next_pts;
+    GstClockTime pts_base;
+    guint64 anchor;
+    gboolean is_rec;
+    gboolean rec_pts;           /* the recording has the capture time of every frame */
+    DDRecIndex rec;
+    GstBufferPool *pool;        /* device memory to import into, if any */
+    guint pool_checks;
+};
+
+static void
+mapping_unref (gpointer data) {
+    Mapping *map = (Mapping *) data;
+
+    if (map->refs.fetch_sub (1) == 1) {
+        munmap (map->addr, map->size);
+        delete map;
+    }
+}
+
+static const guint8 *
+frame_data (DDMmapSrc *src, guint64 index) {
+    if (src->is_rec)
+        return (const guint8 *) src->map->addr + dd_rec_frame_offset (&src->rec, index);
+    return (const guint8 *) src->map->addr + index * src->frame_size;
+}
+
+/* Time of a frame from the start of the file */
+static GstClockTime
+frame_time (DDMmapSrc *src, guint64 index) {
+    if (src->rec_pts)
+        return src->rec.entries[index].pts - src->rec.entries[0].pts;
+    return index * src->duration;
+}
+
+/* Restart the timestamps at @index, right after the last pushed frame */
+static void
+restart_at (DDMmapSrc *src, guint64 index) {
+    src->cur = index;
+    src->anchor = index;
+    src->pts_base = src->next_pts;
+}
+
+static GstBuffer *
+wrap_frame (DDMmapSrc *src, guint64 index) {
+    src->map->refs++;
+    return gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, (gpointer) frame_data (src, index),
+                                        src->frame_size, 0, src->frame_size, src->map, mapping_unref);
+}
+
+/** @brief
+ *  Copy a frame from the mapping into a buffer of the downstream pool.
+ *
+ *  The destination may have a stride wider than the packed frames of
+ *  the file, rows are copied one by one.
+ *
+ *  @param src is the source.
+ *  @param index is the frame to copy.
+ *  @return the buffer, NULL if the pool could not provide one.
+ */
+static GstBuffer *
+import_frame (DDMmapSrc *src, guint64 index) {
+    const guint8 *in = frame_data (src, index);
+    GstBuffer *buf = NULL;
+    GstVideoFrame frame;
+    guint8 *out;
+    gint stride;
+
+    if (gst_buffer_pool_acquire_buffer (src->pool, &buf, NULL) != GST_FLOW_OK)
+        return NULL;
+    if (!gst_video_frame_map (&frame, &src->info, buf, GST_MAP_WRITE)) {
+        gst_buffer_unref (buf);
+        return NULL;
+    }
+    out = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+    stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+    for (guint y = 0; y < src->config.height; y++)
+        memcpy (out + y * stride, in + y * src->config.width, src->config.width);
+    gst_video_frame_unmap (&frame);
+    return buf;
+}
+
+/** @brief
+ *  Decide whether frames are imported into the negotiated pool.
+ *
+ *  A pool handing out system memory brings nothing over wrapping the
+ *  mapping, the frames are then passed without any copy.
+ *
+ *  @param src is the source.
+ *  @return Void.
+ */
+static void
+check_pool (DDMmapSrc *src) {
+    GstBufferPool *pool = gst_base_src_get_buffer_pool (GST_BASE_SRC (src->appsrc));
+    GstBuffer *buf = NULL;
+
+    src->pool_checks++;
+    if (!pool)
+        return;
+    src->pool_checks = MAX_POOL_CHECKS;
+    if (gst_buffer_pool_acquire_buffer (pool, &buf, NULL) == GST_FLOW_OK) {
+        if (gst_buffer_get_size (buf) >= src->frame_size &&
+            !gst_memory_is_type (gst_buffer_peek_memory (buf, 0), GST_ALLOCATOR_SYSMEM)) {
+            src->pool = pool;
+            pool = NULL;
+        }
+        gst_buffer_unref (buf);
+    }
+    if (pool)
+        gst_object_unref (pool);
+    GST_DEBUG ("%s frames of %s", src->pool ? "Importing" : "Wrapping", src->location.c_str ());
+}
+
+static void
+pace (DDMmapSrc *src, GstClockTime pts) {
+    GstClock *clock = gst_element_get_clock (src->appsrc);
+    GstClockID id;
+
+    if (!clock)
+        return;
+    id = gst_clock_new_single_shot_id (clock, gst_element_get_base_time (src->appsrc) + pts);
+    gst_clock_id_wait (id, NULL);
+    gst_clock_id_unref (id);
+    gst_object_unref (clock);
+}
+
+static void
+need_data_cb (GstAppSrc *appsrc, guint length, gpointer user_data) {
+    DDMmapSrc *src = (DDMmapSrc *) user_data;
+    gint64 seek_to = src->seek_to.exchange (-1);
+    GstClockTime pts;
+    GstBuffer *buf = NULL;
+
+    if (seek_to >= 0) {
+        GST_DEBUG ("Seeking to frame %" G_GINT64_FORMAT " of %s", seek_to, src->location.c_str ());
+        restart_at (src, seek_to);
+    }
+    if (src->cur >= src->last) {
+        if (!src->config.loop) {
+            gst_app_src_end_of_stream (appsrc);
+            return;
+        }
+        restart_at (src, src->first);
+        src->loops++;
+    }
+    pts = src->pts_base + frame_time (src, src->cur) - frame_time (src, src->anchor);
+
+    if (!src->pool && src->pool_checks < MAX_POOL_CHECKS && src->pushed)
+        check_pool (src);
+    if (src->pool)
+        buf = import_frame (src, src->cur);
+    if (!buf)
+        buf = wrap_frame (src, src->cur);
+
+    GST_BUFFER_PTS (buf) = pts;
+    GST_BUFFER_DURATION (buf) = src->duration;
+    GST_BUFFER_OFFSET (buf) = src->cur;
+    if (src->config.pace)
+        pace (src, pts);
+
+    gst_app_src_push_buffer (appsrc, buf);
+    src->cur++;
+    src->pushed++;
+    src->next_pts = pts + src->duration;
+}
+
+DDMmapSrc *
+dd_mmapsrc_new (GstElement *appsrc, const DDMmapSrcConfig *config) {
+    GstAppSrcCallbacks callbacks = { need_data_cb, NULL, NULL };
+    DDMmapSrc *src;
+    GstCaps *caps;
+    struct stat st;
+    gpointer addr;
+    guint64 frames;
+    gsize frame_size = (gsize) config->width * config->height;
+    gint fd;
+
+    fd = open (config->location, O_RDONLY);
+    if (fd < 0) {
+        GST_ERROR ("Could not open %s: %s", config->location, strerror (errno));
+        return NULL;
+    }
+    if (fstat (fd, &st) != 0 || !frame_size || (gsize) st.st_size < frame_size) {
+        GST_ERROR ("%s does not hold a single %ux%u frame", config->location, config->width, config->height);
+        close (fd);
+        return NULL;
+    }
+    addr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED) {
+        GST_ERROR ("Could not map %s: %s", config->location, strerror (errno));
+        return NULL;
+    }
+    /* Frames are read in order; captures can be larger than memory, so
+     * no WILLNEED even when looping */
+    madvise (addr, st.st_size, MADV_SEQUENTIAL);
+
+    src = new DDMmapSrc ();
+    src->is_rec = dd_rec_parse (addr, st.st_size, &src->rec);
+    if (!src->is_rec && (gsize) st.st_size >= strlen (DD_REC_MAGIC) &&
+        !memcmp (addr, DD_REC_MAGIC, strlen (DD_REC_MAGIC))) {
+        GST_ERROR ("%s is a damaged recording", config->location);
+        munmap (addr, st.st_size);
+        delete src;
+        return NULL;
+    }
+    if (src->is_rec) {
+        frames = src->rec.frames;
+        src->rec_pts = src->rec.entries != NULL;
+        for (guint64 i = 0; src->rec_pts && i < frames; i++) {
+            if (!GST_CLOCK_TIME_IS_VALID (src->rec.entries[i].pts) ||
+                src->rec.entries[i].pts < src->rec.entries[0].pts)
+                src->rec_pts = FALSE;
+        }
+    } else {
+        frames = st.st_size / frame_size;
+    }
+    src->config = *config;
+    src->location = config->location;
+    src->config.location = src->location.c_str ();
+    src->appsrc = appsrc;
+    src->map = new Mapping ();
+    src->map->addr = addr;
+    src->map->size = st.st_size;
+    src->map->refs = 1;
+    src->frame_size = frame_size;
+    src->seek_to = -1;
+    src->first = config->start_frame;
+    src->last = config->end_frame ? MIN (config->end_frame, frames) : frames;
+    src->cur = src->first;
+    src->anchor = src->first;
+    src->duration = gst_util_uint64_scale_int (GST_SECOND, config->fps_d, config->fps_n);
+    if (src->is_rec && (src->rec.header->width != config->width || src->rec.header->height != config->height)) {
+        GST_ERROR ("%s was recorded at %ux%u, not %ux%u", config->location, src->rec.header->width,
+                   src->rec.header->height, config->width, config->height);
+        dd_mmapsrc_free (src);
+        return NULL;
+    }
+    if (src->first >= src->last) {
+        GST_ERROR ("Frame range %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT " is outside the %" G_GUINT64_FORMAT
+                   " frames of %s", config->start_frame, config->end_frame, frames, config->location);
+        dd_mmapsrc_free (src);
+        return NULL;
+    }
+
+    gst_video_info_set_format (&src->info, GST_VIDEO_FORMAT_GRAY8, config->width, config->height);
+    src->info.fps_n = config->fps_n;
+    src->info.fps_d = config->fps_d;
+    caps = gst_video_info_to_caps (&src->info);
+    g_object_set (G_OBJECT (appsrc), "caps", caps, "format", GST_FORMAT_TIME,
+                  "is-live", config->pace, NULL);
+    gst_caps_unref (caps);
+    gst_app_src_set_callbacks (GST_APP_SRC (appsrc), &callbacks, src, NULL);
+
+    GST_DEBUG ("Playing frames %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT " of %s%s%s%s", src->first, src->last - 1,
+               config->location, config->loop ? ", looped" : "", config->pace ? ", paced" : "",
+               src->rec_pts ? " at the recorded timing" : "");
+    return src;
+}
+
+guint64
+dd_mmapsrc_loops (DDMmapSrc *src) {
+    return src->loops;
+}
+
+gboolean
+dd_mmapsrc_seek (DDMmapSrc *src, guint64 frame) {
+    if (frame < src->first || frame >= src->last)
+        return FALSE;
+    src->seek_to = frame;
+    return TRUE;
+}
+
+void
+dd_mmapsrc_free (DDMmapSrc *src) {
+    if (!src)
+        return;
+    if (src->pool)
+        gst_object_unref (src->pool);
+    mapping_unref (src->map);
+    delete src;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_MMAPSRC_H
+#define DD_MMAPSRC_H
+
+#include <gst/gst.h>
+
+typedef struct _DDMmapSrcConfig {
+    const gchar *location;      /* raw GRAY8 frames back to back, or a DD_REC_EXTENSION recording */
+    guint width, height;
+    guint fps_n, fps_d;
+    guint64 start_frame;        /* first frame played */
+    guint64 end_frame;          /* frame after the last one played, 0 for the end of the file */
+    gboolean loop;              /* go back to start_frame instead of ending the stream */
+    gboolean pace;              /* push at fps_n/fps_d, or the recorded timing, instead of as fast as possible */
+} DDMmapSrcConfig;
+
+typedef struct _DDMmapSrc DDMmapSrc;
+
+/** @brief
+ *  Feed an appsrc with the frames of a memory mapped raw file.
+ *
+ *  Frames are wrapped as buffers backed by the mapping, without any
+ *  copy. When the pool negotiated downstream hands out memory other
+ *  than system memory, e.g. device memory of the accelerators, every
+ *  frame is instead copied once from the mapping into a buffer of
+ *  that pool. Timestamps keep increasing across loops and seeks.
+ *
+ *  Recordings are found by their header; their frames are located
+ *  through the index and their timestamps follow the capture times.
+ *
+ *  @param appsrc is the appsrc element to drive.
+ *  @param config is the source configuration, copied.
+ *  @return the source, NULL if the file cannot be mapped or holds no
+ *  frame in the requested range.
+ */
+DDMmapSrc * dd_mmapsrc_new (GstElement *appsrc, const DDMmapSrcConfig *config);
+
+/* Number of times the source went back to the start frame */
+guint64 dd_mmapsrc_loops (DDMmapSrc *src);
+
+/** @brief
+ *  Play from another frame, without flushing the frames already pushed.
+ *
+ *  @param src is the source.
+ *  @param frame is the frame to go to, within the played range.
+ *  @return FALSE if the frame is outside the played range.
+ */
+gboolean dd_mmapsrc_seek (DDMmapSrc *src, guint64 frame);
+
+/* Call once the appsrc is stopped; the mapping lives until its last buffer is freed */
+void dd_mmapsrc_free (DDMmapSrc *src);
+
+#endif /* DD_MMAPSRC_H */
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_params.h"
+
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+/*
+ * Every stream has two parameter blocks. The publisher fills the one not
+ * current and flips the index with a release store, so a kernel never sees
+ * a half written set. A kernel still copying the other block when a second
+ * set is published in quick succession would race with the publisher;
+ * each block carries a sequence counter, odd while written, and readers
+ * retry if it moved, as in dd_stats.
+ */
+struct ParamsBlock {
+    atomic<uint64_t> seq;
+    atomic<uint64_t> generation;
+    atomic<uint32_t> set;
+    atomic<double>   values[DD_PARAM_COUNT];
+};
+
+struct ParamsStream {
+    ParamsBlock blocks[2];
+    atomic<unsigned int> current;
+    atomic<uint64_t> generation;
+};
+
+static ParamsStream streams[DD_PARAMS_MAX_STREAMS];
+static mutex publish_lock;
+
+static const char *param_names[DD_PARAM_COUNT] = {
+    "max_value",
+    "defect_threshold",
+    "font_size",
+    "font",
+    "x_offset",
+    "y_offset",
+    "is_acc_result",
+};
+
+uint64_t
+dd_params_publish (unsigned int stream, const DDParams *params) {
+    lock_guard<mutex> lock (publish_lock);
+    ParamsStream *s;
+    ParamsBlock *b;
+    unsigned int next;
+    uint64_t seq, generation;
+
+    if (stream >= DD_PARAMS_MAX_STREAMS || !params)
+        return 0;
+    s = &streams[stream];
+    next = 1 - s->current.load (memory_order_relaxed);
+    b = &s->blocks[next];
+    generation = s->generation.load (memory_order_relaxed) + 1;
+
+    seq = b->seq.load (memory_order_relaxed);
+    b->seq.store (seq + 1, memory_order_relaxed);
+    atomic_thread_fence (memory_order_release);
+    b->generation.store (generation, memory_order_relaxed);
+    b->set.store (params->set, memory_order_relaxed);
+    for (unsigned int i = 0; i < DD_PARAM_COUNT; i++)
+        b->values[i].store (params->values[i], memory_order_relaxed);
+    b->seq.store (seq + 2, memory_order_release);
+
+    s->current.store (next, memory_order_release);
+    s->generation.store (generation, memory_order_release);
+    return generation;
+}
+
+int
+dd_params_read (unsigned int stream, uint64_t since, DDParams *params) {
+    ParamsStream *s;
+    ParamsBlock *b;
+    uint64_t s1, s2;
+
+    if (stream >= DD_PARAMS_MAX_STREAMS || !params)
+        return 0;
+    s = &streams[stream];
+    if (s->generation.load (memory_order_acquire) == since)
+        return 0;
+
+    do {
+        b = &s->blocks[s->current.load (memory_order_acquire)];
+        s1 = b->seq.load (memory_order_acquire);
+        params->generation = b->generation.load (memory_order_relaxed);
+        params->set = b->set.load (memory_order_relaxed);
+        for (unsigned int i = 0; i < DD_PARAM_COUNT; i++)
+            params->values[i] = b->values[i].load (memory_order_relaxed);
+        atomic_thread_fence (memory_order_acquire);
+        s2 = b->seq.load (memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+
+    return params->generation != since;
+}
+
+const char *
+dd_params_name (DDParam param) {
+    if (param < 0 || param >= DD_PARAM_COUNT)
+        return "unknown";
+    return param_names[param];
+}
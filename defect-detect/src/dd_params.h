@@ -0,0 +1,84 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_PARAMS_H
+#define DD_PARAMS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DD_PARAMS_MAX_STREAMS        4
+
+/* Kernel parameters that can change while the pipeline runs */
+typedef enum {
+    DD_PARAM_MAX_VALUE,          /* preprocess */
+    DD_PARAM_DEFECT_THRESHOLD,   /* text2overlay */
+    DD_PARAM_FONT_SIZE,
+    DD_PARAM_FONT,
+    DD_PARAM_X_OFFSET,
+    DD_PARAM_Y_OFFSET,
+    DD_PARAM_IS_ACC_RESULT,
+    DD_PARAM_COUNT,
+} DDParam;
+
+typedef struct _DDParams {
+    uint64_t generation;         /* 0 until a set was published */
+    uint32_t set;                /* bit (1 << DDParam) of each value given */
+    double   values[DD_PARAM_COUNT];
+} DDParams;
+
+/** @brief
+ *  Publish a new parameter set for a stream.
+ *
+ *  The set is written into the block the kernels are not reading, then
+ *  made current with a release store. Publishers are serialized.
+ *
+ *  @param stream index of the stream, below DD_PARAMS_MAX_STREAMS.
+ *  @param params the values; generation is ignored.
+ *  @return the generation of the published set, 0 on invalid arguments.
+ */
+uint64_t dd_params_publish (unsigned int stream, const DDParams *params);
+
+/** @brief
+ *  Fetch the parameter set of a stream if it changed.
+ *
+ *  Meant to be called by a kernel once per frame, before it uses its
+ *  parameters: when nothing was published since @since it costs one
+ *  atomic load. It never blocks the publisher nor waits for it.
+ *
+ *  @param stream index of the stream.
+ *  @param since generation the caller already applied, 0 initially.
+ *  @param params filled with the current set when newer.
+ *  @return 1 if @params was filled with a newer set, else 0.
+ */
+int dd_params_read (unsigned int stream, uint64_t since, DDParams *params);
+
+/* Key of the parameter in the kernel JSON config */
+const char * dd_params_name (DDParam param);
+
+static inline int
+dd_params_has (const DDParams *params, DDParam param) {
+    return (params->set >> param) & 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DD_PARAMS_H */
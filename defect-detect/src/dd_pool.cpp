@@ -0,0 +1,282 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_pool.h"
+
+#include <gst/video/video.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+struct _DDPoolMonitor {
+    GstElement *element;        /* not a reference, the element holds one */
+    DDPoolConfig config;
+    gboolean configured;
+    /* The element and every buffer out of the pool hold a reference,
+     * a buffer may be released after the element is gone */
+    atomic<gint> refs;
+    atomic<GstBufferPool *> in_pool;
+    atomic<gboolean> in_place;
+    atomic<guint> min_buffers;
+    atomic<guint> max_buffers;
+    atomic<guint64> negotiations;
+    atomic<guint64> allocated;
+    atomic<guint> in_use;
+    atomic<guint> in_use_max;
+    atomic<guint64> waits;
+    mutex lock;
+    unordered_set<GstBuffer *> seen;
+};
+
+/* Attached to a buffer of the pool until it goes back to the pool,
+ * which drops the metas it did not add itself */
+typedef struct _PoolMeta {
+    GstMeta meta;
+    DDPoolMonitor *monitor;
+} PoolMeta;
+
+static void
+monitor_unref (gpointer data) {
+    DDPoolMonitor *m = (DDPoolMonitor *) data;
+
+    if (m->refs.fetch_sub (1) == 1)
+        delete m;
+}
+
+static gboolean
+pool_meta_init (GstMeta *meta, gpointer params, GstBuffer *buffer) {
+    ((PoolMeta *) meta)->monitor = NULL;
+    return TRUE;
+}
+
+static void
+pool_meta_free (GstMeta *meta, GstBuffer *buffer) {
+    DDPoolMonitor *m = ((PoolMeta *) meta)->monitor;
+
+    if (!m)
+        return;
+    m->in_use.fetch_sub (1, memory_order_relaxed);
+    monitor_unref (m);
+}
+
+static GType
+pool_meta_api_get_type (void) {
+    static gsize type = 0;
+    static const gchar *tags[] = { NULL };
+
+    if (g_once_init_enter (&type))
+        g_once_init_leave (&type, gst_meta_api_type_register ("DDPoolMetaAPI", tags));
+    return type;
+}
+
+static const GstMetaInfo *
+pool_meta_get_info (void) {
+    static gsize info = 0;
+
+    if (g_once_init_enter (&info))
+        g_once_init_leave (&info, (gsize) gst_meta_register (pool_meta_api_get_type (), "DDPoolMeta",
+                                                             sizeof (PoolMeta), pool_meta_init, pool_meta_free,
+                                                             NULL));
+    return (const GstMetaInfo *) info;
+}
+
+/* Called with the answer of downstream, before the stage decides */
+static GstPadProbeReturn
+allocation_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDPoolMonitor *m = (DDPoolMonitor *) user_data;
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    GstBufferPool *pool = NULL;
+    guint size = 0, min = 0, max = 0;
+    gboolean proposed;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
+        return GST_PAD_PROBE_OK;
+
+    proposed = gst_query_get_n_allocation_pools (query) > 0;
+    if (proposed) {
+        gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    } else {
+        GstCaps *caps = NULL;
+        GstVideoInfo vinfo;
+
+        gst_query_parse_allocation (query, &caps, NULL);
+        if (caps && gst_video_info_from_caps (&vinfo, caps))
+            size = vinfo.size;
+    }
+    if (m->configured && gst_query_is_writable (query)) {
+        if (m->config.min_buffers)
+            min = m->config.min_buffers;
+        if (m->config.max_buffers)
+            max = MAX (m->config.max_buffers, min);
+        if (proposed)
+            gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+        else if (size)
+            gst_query_add_allocation_pool (query, NULL, size, min, max);
+
+        if (m->config.align) {
+            GstAllocator *allocator = NULL;
+            GstAllocationParams params;
+
+            gst_allocation_params_init (&params);
+            if (gst_query_get_n_allocation_params (query) > 0) {
+                gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+                params.align = MAX (params.align, (gsize) m->config.align - 1);
+                gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+                if (allocator)
+                    gst_object_unref (allocator);
+            } else {
+                params.align = m->config.align - 1;
+                gst_query_add_allocation_param (query, NULL, &params);
+            }
+        }
+    }
+    if (pool)
+        gst_object_unref (pool);
+
+    GST_DEBUG ("%s: pool of %u to %u buffers of %u bytes", GST_ELEMENT_NAME (m->element), min, max, size);
+    m->min_buffers.store (min, memory_order_relaxed);
+    m->max_buffers.store (max, memory_order_relaxed);
+    m->negotiations.fetch_add (1, memory_order_relaxed);
+    /* A new pool comes with new buffers */
+    lock_guard<mutex> guard (m->lock);
+    m->seen.clear ();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDPoolMonitor *m = (DDPoolMonitor *) user_data;
+
+    m->in_pool.store (GST_PAD_PROBE_INFO_BUFFER (info)->pool, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+src_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDPoolMonitor *m = (DDPoolMonitor *) user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+    PoolMeta *meta;
+    guint in_use, max;
+
+    if (buf->pool && buf->pool == m->in_pool.load (memory_order_relaxed)) {
+        m->in_place.store (TRUE, memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+    if (!buf->pool) {
+        /* Allocated for this frame alone */
+        m->allocated.fetch_add (1, memory_order_relaxed);
+    } else {
+        lock_guard<mutex> guard (m->lock);
+        if (m->seen.insert (buf).second)
+            m->allocated.fetch_add (1, memory_order_relaxed);
+    }
+    /* Shared buffers cannot take the meta, they are only counted once
+     * they come back writable */
+    if (gst_buffer_get_meta (buf, pool_meta_api_get_type ()) || !gst_buffer_is_writable (buf))
+        return GST_PAD_PROBE_OK;
+    meta = (PoolMeta *) gst_buffer_add_meta (buf, pool_meta_get_info (), NULL);
+    if (!meta)
+        return GST_PAD_PROBE_OK;
+    m->refs.fetch_add (1);
+    meta->monitor = m;
+
+    in_use = m->in_use.fetch_add (1, memory_order_relaxed) + 1;
+    if (in_use > m->in_use_max.load (memory_order_relaxed))
+        m->in_use_max.store (in_use, memory_order_relaxed);
+    max = m->max_buffers.load (memory_order_relaxed);
+    if (max && in_use >= max) {
+        m->waits.fetch_add (1, memory_order_relaxed);
+        GST_LOG ("%s: every buffer of the pool is in use", GST_ELEMENT_NAME (m->element));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+DDPoolMonitor *
+dd_pool_monitor_new (GstElement *element, const DDPoolConfig *config) {
+    DDPoolMonitor *m = new DDPoolMonitor ();
+    GstPad *pad;
+
+    pool_meta_get_info ();
+    m->element = element;
+    m->refs = 1;
+    if (config) {
+        m->config = *config;
+        m->configured = TRUE;
+        GST_DEBUG ("%s: min %u, max %u buffers, align %u", GST_ELEMENT_NAME (element),
+                   config->min_buffers, config->max_buffers, config->align);
+    }
+
+    pad = gst_element_get_static_pad (element, "src");
+    if (pad) {
+        gst_pad_add_probe (pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL),
+                           allocation_probe, m, NULL);
+        gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, src_probe, m, NULL);
+        gst_object_unref (pad);
+    }
+    pad = gst_element_get_static_pad (element, "sink");
+    if (pad) {
+        gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, sink_probe, m, NULL);
+        gst_object_unref (pad);
+    }
+
+    g_object_set_data_full (G_OBJECT (element), "dd-pool-monitor", m, monitor_unref);
+    return m;
+}
+
+void
+dd_pool_monitor_stats (DDPoolMonitor *m, DDPoolStats *stats) {
+    stats->name         = GST_ELEMENT_NAME (m->element);
+    stats->min_buffers  = m->min_buffers.load (memory_order_relaxed);
+    stats->max_buffers  = m->max_buffers.load (memory_order_relaxed);
+    stats->negotiations = m->negotiations.load (memory_order_relaxed);
+    stats->allocated    = m->allocated.load (memory_order_relaxed);
+    stats->in_use       = m->in_use.load (memory_order_relaxed);
+    stats->in_use_max   = m->in_use_max.load (memory_order_relaxed);
+    stats->waits        = m->waits.load (memory_order_relaxed);
+    stats->in_place     = m->in_place.load (memory_order_relaxed);
+}
+
+gboolean
+dd_pool_config_from_json (json_t *obj, DDPoolConfig *config) {
+    const gchar *keys[] = { "min-buffers", "max-buffers", "align" };
+    guint *fields[] = { &config->min_buffers, &config->max_buffers, &config->align };
+
+    config->min_buffers = 0;
+    config->max_buffers = 0;
+    config->align = 0;
+    if (!json_is_object (obj))
+        return FALSE;
+
+    for (guint i = 0; i < G_N_ELEMENTS (keys); i++) {
+        json_t *val = json_object_get (obj, keys[i]);
+        if (!val)
+            continue;
+        if (!json_is_integer (val) || json_integer_value (val) < 0 || json_integer_value (val) > G_MAXINT)
+            return FALSE;
+        *fields[i] = json_integer_value (val);
+    }
+    if (config->align & (config->align - 1))
+        return FALSE;
+    if (config->max_buffers && config->max_buffers < config->min_buffers)
+        return FALSE;
+    return TRUE;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_POOL_H
+#define DD_POOL_H
+
+#include <gst/gst.h>
+#include <jansson.h>
+#include <string>
+
+typedef struct _DDPoolConfig {
+    guint min_buffers;          /* allocated when the pool is activated, 0 keeps the negotiated value */
+    guint max_buffers;          /* 0 keeps the negotiated value */
+    guint align;                /* byte alignment of the buffers, a power of two, 0 keeps the negotiated value */
+} DDPoolConfig;
+
+typedef struct _DDPoolStats {
+    std::string name;
+    guint min_buffers;          /* as last negotiated */
+    guint max_buffers;          /* as last negotiated, 0 for no limit */
+    guint64 negotiations;       /* allocation queries, one per caps change */
+    guint64 allocated;          /* distinct buffers seen since the first negotiation */
+    guint in_use;               /* buffers out of the pool now */
+    guint in_use_max;
+    guint64 waits;              /* pushes leaving no free buffer, the next acquire waits */
+    gboolean in_place;          /* the stage writes into its input buffers, it has no pool */
+} DDPoolStats;
+
+typedef struct _DDPoolMonitor DDPoolMonitor;
+
+/** @brief
+ *  Size the output buffer pool of a stage and count its buffers.
+ *
+ *  The pool parameters downstream answers to the allocation query of
+ *  the stage are overridden, so the stage creates its pool with them
+ *  and allocates @min_buffers of them when it activates the pool, i.e.
+ *  before the first frame and again after a caps change, instead of on
+ *  the first frames. Buffers are counted while they are out of the pool.
+ *
+ *  @param element is the stage; the monitor lives as long as it.
+ *  @param config is the pool config, NULL to only count.
+ *  @return the monitor, owned by the element.
+ */
+DDPoolMonitor * dd_pool_monitor_new (GstElement *element, const DDPoolConfig *config);
+
+/* Read the counters; safe from any thread while the pipeline runs */
+void dd_pool_monitor_stats (DDPoolMonitor *monitor, DDPoolStats *stats);
+
+/** @brief
+ *  Parse one entry of the "pools" object of pipeline.json, e.g.
+ *  { "min-buffers": 4, "max-buffers": 8, "align": 4096 }.
+ *
+ *  @param obj is the entry.
+ *  @param config is filled with the pool config.
+ *  @return FALSE if a value is invalid.
+ */
+gboolean dd_pool_config_from_json (json_t *obj, DDPoolConfig *config);
+
+#endif /* DD_POOL_H */
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_queue.h"
+
+#include <atomic>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+struct _DDQueueMonitor {
+    GstElement *queue;          /* not a reference, the queue owns the monitor */
+    DDQueueConfig config;
+    gboolean live;
+    atomic<guint64> pushed;
+    atomic<guint64> popped;
+    atomic<guint64> dropped_full;
+    atomic<guint64> dropped_stale;
+    atomic<guint> level_max;
+    atomic<guint64> blocked_since;
+    atomic<guint64> blocked_ns;
+};
+
+static guint64
+now_ns (void) {
+    return g_get_monotonic_time () * 1000;
+}
+
+static guint
+monitor_level (DDQueueMonitor *m) {
+    guint64 in = m->pushed.load (memory_order_relaxed);
+    guint64 out = m->popped.load (memory_order_relaxed) + m->dropped_full.load (memory_order_relaxed);
+
+    return in > out ? in - out : 0;
+}
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDQueueMonitor *m = (DDQueueMonitor *) user_data;
+    guint level;
+
+    m->pushed.fetch_add (1, memory_order_relaxed);
+    level = monitor_level (m);
+    if (level > m->level_max.load (memory_order_relaxed))
+        m->level_max.store (level, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Emitted by the upstream thread when it finds the queue full, before
+ * it leaks a buffer or waits for room */
+static void
+overrun_cb (GstElement *queue, gpointer user_data) {
+    DDQueueMonitor *m = (DDQueueMonitor *) user_data;
+
+    if (m->config.leaky != DD_QUEUE_LEAKY_NONE) {
+        m->dropped_full.fetch_add (1, memory_order_relaxed);
+    } else {
+        guint64 none = 0;
+        m->blocked_since.compare_exchange_strong (none, now_ns ());
+    }
+}
+
+static gboolean
+is_stale (DDQueueMonitor *m, GstBuffer *buf) {
+    GstClock *clock;
+    GstClockTime now, capture;
+
+    if (!m->live || !m->config.max_age_ms || !GST_BUFFER_PTS_IS_VALID (buf))
+        return FALSE;
+    clock = gst_element_get_clock (m->queue);
+    if (!clock)
+        return FALSE;
+    now = gst_clock_get_time (clock);
+    gst_object_unref (clock);
+    capture = gst_element_get_base_time (m->queue) + GST_BUFFER_PTS (buf);
+    return now > capture && now - capture > (GstClockTime) m->config.max_age_ms * GST_MSECOND;
+}
+
+static GstPadProbeReturn
+src_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    DDQueueMonitor *m = (DDQueueMonitor *) user_data;
+    guint64 since;
+
+    m->popped.fetch_add (1, memory_order_relaxed);
+    /* Room was just made, a blocked upstream goes on */
+    since = m->blocked_since.exchange (0);
+    if (since)
+        m->blocked_ns.fetch_add (now_ns () - since, memory_order_relaxed);
+
+    if (is_stale (m, GST_PAD_PROBE_INFO_BUFFER (info))) {
+        m->dropped_stale.fetch_add (1, memory_order_relaxed);
+        GST_LOG ("%s: dropping a buffer older than %u ms", GST_ELEMENT_NAME (m->queue), m->config.max_age_ms);
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void
+monitor_free (gpointer data) {
+    delete (DDQueueMonitor *) data;
+}
+
+DDQueueMonitor *
+dd_queue_monitor_new (GstElement *queue, const DDQueueConfig *config, gboolean live) {
+    DDQueueMonitor *m = new DDQueueMonitor ();
+    GstPad *pad;
+
+    m->queue = queue;
+    m->live = live;
+    if (config) {
+        m->config = *config;
+        if (config->max_buffers)
+            g_object_set (G_OBJECT (queue), "max-size-buffers", config->max_buffers,
+                          "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+        g_object_set (G_OBJECT (queue), "leaky", (gint) config->leaky, NULL);
+        GST_DEBUG ("%s: max %u buffers, max age %u ms, leaky %s", GST_ELEMENT_NAME (queue),
+                   config->max_buffers, config->max_age_ms, dd_queue_leaky_to_string (config->leaky));
+    } else {
+        gint leaky = 0;
+        g_object_get (G_OBJECT (queue), "leaky", &leaky, NULL);
+        m->config.leaky = (DDQueueLeaky) leaky;
+    }
+
+    pad = gst_element_get_static_pad (queue, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, sink_probe, m, NULL);
+    gst_object_unref (pad);
+    pad = gst_element_get_static_pad (queue, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, src_probe, m, NULL);
+    gst_object_unref (pad);
+    g_signal_connect (queue, "overrun", G_CALLBACK (overrun_cb), m);
+
+    g_object_set_data_full (G_OBJECT (queue), "dd-queue-monitor", m, monitor_free);
+    return m;
+}
+
+void
+dd_queue_monitor_stats (DDQueueMonitor *m, DDQueueStats *stats) {
+    guint64 since = m->blocked_since.load (memory_order_relaxed);
+
+    stats->name          = GST_ELEMENT_NAME (m->queue);
+    stats->pushed        = m->pushed.load (memory_order_relaxed);
+    stats->dropped_full  = m->dropped_full.load (memory_order_relaxed);
+    stats->dropped_stale = m->dropped_stale.load (memory_order_relaxed);
+    stats->level         = monitor_level (m);
+    stats->level_max     = m->level_max.load (memory_order_relaxed);
+    stats->blocked_ns    = m->blocked_ns.load (memory_order_relaxed);
+    /* Still blocked */
+    if (since)
+        stats->blocked_ns += now_ns () - since;
+}
+
+gboolean
+dd_queue_config_from_json (json_t *obj, DDQueueConfig *config) {
+    json_t *val;
+
+    config->max_buffers = 0;
+    config->max_age_ms = 0;
+    config->leaky = DD_QUEUE_LEAKY_NONE;
+    if (!json_is_object (obj))
+        return FALSE;
+
+    val = json_object_get (obj, "max-buffers");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 0)
+            return FALSE;
+        config->max_buffers = json_integer_value (val);
+    }
+    val = json_object_get (obj, "max-age-ms");
+    if (val) {
+        if (!json_is_integer (val) || json_integer_value (val) < 0)
+            return FALSE;
+        config->max_age_ms = json_integer_value (val);
+    }
+    val = json_object_get (obj, "leaky");
+    if (val) {
+        const gchar *str = json_string_value (val);
+        if (!g_strcmp0 (str, "no"))
+            config->leaky = DD_QUEUE_LEAKY_NONE;
+        else if (!g_strcmp0 (str, "upstream"))
+            config->leaky = DD_QUEUE_LEAKY_UPSTREAM;
+        else if (!g_strcmp0 (str, "downstream"))
+            config->leaky = DD_QUEUE_LEAKY_DOWNSTREAM;
+        else
+            return FALSE;
+    }
+    val = json_object_get (obj, "drop-oldest");
+    if (val && json_is_true (val))
+        config->leaky = DD_QUEUE_LEAKY_DOWNSTREAM;
+    return TRUE;
+}
+
+const gchar *
+dd_queue_leaky_to_string (DDQueueLeaky leaky) {
+    switch (leaky) {
+        case DD_QUEUE_LEAKY_UPSTREAM :
+            return "upstream";
+        case DD_QUEUE_LEAKY_DOWNSTREAM :
+            return "downstream";
+        default :
+            return "no";
+    }
+}
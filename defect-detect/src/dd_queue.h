@@ -0,0 +1,81 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_QUEUE_H
+#define DD_QUEUE_H
+
+#include <gst/gst.h>
+#include <jansson.h>
+#include <string>
+
+/* Key of the "queues" object of pipeline.json applied to unnamed queues */
+#define DD_QUEUE_DEFAULT          "default"
+
+typedef enum {
+    DD_QUEUE_LEAKY_NONE,        /* block upstream when full */
+    DD_QUEUE_LEAKY_UPSTREAM,    /* drop the incoming buffer when full */
+    DD_QUEUE_LEAKY_DOWNSTREAM,  /* drop the oldest queued buffer when full */
+} DDQueueLeaky;
+
+typedef struct _DDQueueConfig {
+    guint max_buffers;          /* 0 keeps the element default */
+    guint max_age_ms;           /* drop buffers older than this on dequeue, 0 for no limit */
+    DDQueueLeaky leaky;
+} DDQueueConfig;
+
+typedef struct _DDQueueStats {
+    std::string name;
+    guint64 pushed;             /* buffers offered to the queue */
+    guint64 dropped_full;       /* leaked because the queue was full */
+    guint64 dropped_stale;      /* older than max_age_ms when dequeued */
+    guint level;                /* buffers queued now */
+    guint level_max;
+    guint64 blocked_ns;         /* upstream waiting on a full queue */
+} DDQueueStats;
+
+typedef struct _DDQueueMonitor DDQueueMonitor;
+
+/** @brief
+ *  Apply a policy to a queue and count what happens to its buffers.
+ *
+ *  The age of a buffer is the pipeline clock minus its capture time,
+ *  so it only means something for live sources; set @live to FALSE to
+ *  never drop on age.
+ *
+ *  @param queue is the queue element; the monitor lives as long as it.
+ *  @param config is the policy, NULL to keep the element settings.
+ *  @param live is TRUE if buffer timestamps follow the pipeline clock.
+ *  @return the monitor, owned by the queue.
+ */
+DDQueueMonitor * dd_queue_monitor_new (GstElement *queue, const DDQueueConfig *config, gboolean live);
+
+/* Read the counters; safe from any thread while the pipeline runs */
+void dd_queue_monitor_stats (DDQueueMonitor *monitor, DDQueueStats *stats);
+
+/** @brief
+ *  Parse one entry of the "queues" object of pipeline.json, e.g.
+ *  { "max-buffers": 2, "max-age-ms": 50, "leaky": "downstream" }.
+ *  "drop-oldest": true is the same as "leaky": "downstream".
+ *
+ *  @param obj is the entry.
+ *  @param config is filled with the policy.
+ *  @return FALSE if a value is invalid.
+ */
+gboolean dd_queue_config_from_json (json_t *obj, DDQueueConfig *config);
+
+const gchar * dd_queue_leaky_to_string (DDQueueLeaky leaky);
+
+#endif /* DD_QUEUE_H */
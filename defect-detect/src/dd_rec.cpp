@@ -0,0 +1,322 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dd_rec.h"
+
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+struct _DDRecWriter {
+    string location;
+    gint fd;
+    DDRecResultFunc result_func;
+    DDRecHeader header;
+    GstVideoInfo info;
+    gboolean started;
+    gboolean failed;
+    guint8 *batch;              /* DD_REC_ALIGN aligned */
+    gsize batch_size;
+    gsize batch_used;
+    guint64 batch_offset;       /* of the batch in the file */
+    vector<DDRecIndexEntry> index;
+};
+
+static guint64
+align_up (guint64 size) {
+    return (size + DD_REC_ALIGN - 1) / DD_REC_ALIGN * DD_REC_ALIGN;
+}
+
+static gboolean
+write_at (DDRecWriter *w, gconstpointer data, gsize size, guint64 offset) {
+    const guint8 *p = (const guint8 *) data;
+
+    while (size) {
+        ssize_t n = pwrite (w->fd, p, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            GST_ERROR ("Could not write %s, recording stopped: %s", w->location.c_str (), strerror (errno));
+            w->failed = TRUE;
+            return FALSE;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return TRUE;
+}
+
+static gboolean
+write_header (DDRecWriter *w) {
+    guint8 block[DD_REC_ALIGN] = { 0 };
+
+    memcpy (block, &w->header, sizeof (w->header));
+    return write_at (w, block, sizeof (block), 0);
+}
+
+static void
+flush_batch (DDRecWriter *w) {
+    if (!w->batch_used || w->failed)
+        return;
+    if (write_at (w, w->batch, w->batch_used, w->batch_offset))
+        w->batch_offset += w->batch_used;
+    w->batch_used = 0;
+}
+
+/** @brief
+ *  Size the slots and the batch from the caps of the first frame.
+ *
+ *  @param w is the writer.
+ *  @param caps is the caps of the frames.
+ *  @return FALSE if the frames cannot be recorded.
+ */
+static gboolean
+start (DDRecWriter *w, GstCaps *caps) {
+    if (!caps || !gst_video_info_from_caps (&w->info, caps) ||
+        GST_VIDEO_INFO_FORMAT (&w->info) != GST_VIDEO_FORMAT_GRAY8) {
+        GST_ERROR ("%s: only GRAY8 frames can be recorded", w->location.c_str ());
+        return FALSE;
+    }
+    memcpy (w->header.magic, DD_REC_MAGIC, sizeof (w->header.magic));
+    w->header.header_size   = sizeof (DDRecHeader);
+    w->header.entry_size    = sizeof (DDRecIndexEntry);
+    w->header.width         = GST_VIDEO_INFO_WIDTH (&w->info);
+    w->header.height        = GST_VIDEO_INFO_HEIGHT (&w->info);
+    w->header.fps_n         = GST_VIDEO_INFO_FPS_N (&w->info);
+    w->header.fps_d         = GST_VIDEO_INFO_FPS_D (&w->info);
+    w->header.frame_size    = (guint64) w->header.width * w->header.height;
+    w->header.slot_size     = align_up (w->header.frame_size);
+    w->header.data_offset   = DD_REC_ALIGN;
+    w->header.start_time_us = g_get_real_time ();
+
+    w->batch_size = MAX (DD_REC_BATCH_BYTES / w->header.slot_size, 1) * w->header.slot_size;
+    if (posix_memalign ((void **) &w->batch, DD_REC_ALIGN, w->batch_size) != 0) {
+        w->batch = NULL;
+        GST_ERROR ("%s: could not allocate %" G_GSIZE_FORMAT " bytes", w->location.c_str (), w->batch_size);
+        return FALSE;
+    }
+    memset (w->batch, 0, w->batch_size);
+    w->batch_offset = w->header.data_offset;
+    GST_DEBUG ("Recording %ux%u frames to %s in batches of %" G_GSIZE_FORMAT " frames", w->header.width,
+               w->header.height, w->location.c_str (), w->batch_size / w->header.slot_size);
+    return write_header (w);
+}
+
+static void
+record_frame (DDRecWriter *w, GstBuffer *buf) {
+    guint8 *slot = w->batch + w->batch_used;
+    DDRecIndexEntry entry = { 0 };
+    DDResultRecord result;
+    GstVideoFrame frame;
+    const guint8 *in;
+    gint stride;
+
+    if (!gst_video_frame_map (&frame, &w->info, buf, GST_MAP_READ)) {
+        GST_WARNING ("%s: could not map a frame", w->location.c_str ());
+        return;
+    }
+    in = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+    stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+    for (guint y = 0; y < w->header.height; y++)
+        memcpy (slot + y * w->header.width, in + y * stride, w->header.width);
+    gst_video_frame_unmap (&frame);
+
+    entry.offset = w->batch_offset + w->batch_used;
+    entry.pts = GST_BUFFER_PTS (buf);
+    if (w->result_func && w->result_func (buf, &result)) {
+        entry.flags         = DD_REC_HAS_RESULT;
+        entry.threshold     = result.threshold;
+        entry.fruit_pixels  = result.fruit_pixels;
+        entry.defect_pixels = result.defect_pixels;
+        entry.decision      = result.decision;
+        entry.density       = result.density;
+    }
+    w->index.push_back (entry);
+
+    w->batch_used += w->header.slot_size;
+    if (w->batch_used == w->batch_size)
+        flush_batch (w);
+}
+
+static GstFlowReturn
+new_sample_cb (GstAppSink *sink, gpointer user_data) {
+    DDRecWriter *w = (DDRecWriter *) user_data;
+    GstSample *sample = gst_app_sink_pull_sample (sink);
+
+    if (!sample)
+        return GST_FLOW_EOS;
+    if (!w->started && !w->failed) {
+        w->started = TRUE;
+        w->failed = !start (w, gst_sample_get_caps (sample));
+    }
+    if (!w->failed)
+        record_frame (w, gst_sample_get_buffer (sample));
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+}
+
+/* Append the index and complete the header */
+static void
+writer_free (gpointer data) {
+    DDRecWriter *w = (DDRecWriter *) data;
+
+    if (w->started && !w->failed) {
+        flush_batch (w);
+        w->header.index_offset = w->batch_offset;
+        w->header.frames = w->index.size ();
+        if (!w->failed && write_at (w, w->index.data (), w->index.size () * sizeof (DDRecIndexEntry),
+                                    w->header.index_offset))
+            write_header (w);
+        GST_DEBUG ("Recorded %" G_GUINT64_FORMAT " frames to %s", w->header.frames, w->location.c_str ());
+    }
+    close (w->fd);
+    free (w->batch);
+    delete w;
+}
+
+DDRecWriter *
+dd_rec_writer_new (GstElement *appsink, const gchar *location, DDRecResultFunc result_func) {
+    GstAppSinkCallbacks callbacks = { NULL, NULL, new_sample_cb };
+    DDRecWriter *w;
+    gint fd;
+
+    fd = open (location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        GST_ERROR ("Could not create %s: %s", location, strerror (errno));
+        return NULL;
+    }
+    w = new DDRecWriter ();
+    w->location = location;
+    w->fd = fd;
+    w->result_func = result_func;
+
+    g_object_set (G_OBJECT (appsink), "sync", FALSE, "enable-last-sample", FALSE, NULL);
+    gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, w, NULL);
+    g_object_set_data_full (G_OBJECT (appsink), "dd-rec-writer", w, writer_free);
+    return w;
+}
+
+gboolean
+dd_rec_is_recording (const gchar *location) {
+    return location && g_str_has_suffix (location, DD_REC_EXTENSION);
+}
+
+gboolean
+dd_rec_parse (gconstpointer addr, gsize size, DDRecIndex *index) {
+    const DDRecHeader *h = (const DDRecHeader *) addr;
+
+    if (size < DD_REC_ALIGN || memcmp (h->magic, DD_REC_MAGIC, sizeof (h->magic)) ||
+        h->header_size != sizeof (DDRecHeader) || h->entry_size != sizeof (DDRecIndexEntry) ||
+        !h->frame_size || h->frame_size != (guint64) h->width * h->height ||
+        h->slot_size < h->frame_size || h->data_offset < sizeof (DDRecHeader) || h->data_offset > size)
+        return FALSE;
+
+    index->header = h;
+    index->entries = NULL;
+    if (h->index_offset && h->index_offset <= size &&
+        h->frames <= (size - h->index_offset) / sizeof (DDRecIndexEntry)) {
+        index->entries = (const DDRecIndexEntry *) ((const guint8 *) addr + h->index_offset);
+        /* A truncated or damaged file keeps the frames before the first
+         * entry that points outside of it */
+        for (index->frames = 0; index->frames < h->frames; index->frames++) {
+            guint64 offset = index->entries[index->frames].offset;
+            if (offset < h->data_offset || offset > size || h->frame_size > size - offset)
+                break;
+        }
+        if (index->frames < h->frames)
+            GST_WARNING ("Frame %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " is outside the recording, "
+                         "the frames from it on are dropped", index->frames, h->frames);
+    } else {
+        /* Not closed, every complete slot is a frame */
+        index->frames = (size - h->data_offset) / h->slot_size;
+        GST_WARNING ("Recording without an index, %" G_GUINT64_FORMAT " frames found", index->frames);
+    }
+    return TRUE;
+}
+
+guint64
+dd_rec_frame_offset (const DDRecIndex *index, guint64 n) {
+    if (index->entries)
+        return index->entries[n].offset;
+    return index->header->data_offset + n * index->header->slot_size;
+}
+
+gboolean
+dd_rec_read_header (const gchar *location, DDRecHeader *header) {
+    gint fd = open (location, O_RDONLY | O_CLOEXEC);
+    gboolean ret;
+
+    if (fd < 0)
+        return FALSE;
+    ret = read (fd, header, sizeof (*header)) == sizeof (*header) &&
+          !memcmp (header->magic, DD_REC_MAGIC, sizeof (header->magic));
+    close (fd);
+    return ret;
+}
+
+gboolean
+dd_rec_print_index (const gchar *location, FILE *fp) {
+    DDRecIndex index;
+    struct stat st;
+    gpointer addr;
+    gint fd;
+
+    fd = open (location, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat (fd, &st) != 0 || !st.st_size) {
+        if (fd >= 0)
+            close (fd);
+        return FALSE;
+    }
+    addr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED)
+        return FALSE;
+    if (!dd_rec_parse (addr, st.st_size, &index)) {
+        munmap (addr, st.st_size);
+        return FALSE;
+    }
+
+    fprintf (fp, "frame,pts_ms,result,threshold,fruit_pixels,defect_pixels,density,defective\n");
+    for (guint64 i = 0; i < index.frames; i++) {
+        const DDRecIndexEntry *e = index.entries ? &index.entries[i] : NULL;
+
+        fprintf (fp, "%" G_GUINT64_FORMAT ",", i);
+        if (e && GST_CLOCK_TIME_IS_VALID (e->pts))
+            fprintf (fp, "%.3lf", e->pts / 1e6);
+        if (e && (e->flags & DD_REC_HAS_RESULT))
+            fprintf (fp, ",1,%u,%u,%u,%.4lf,%u\n", e->threshold, e->fruit_pixels, e->defect_pixels, e->density,
+                     e->decision);
+        else
+            fprintf (fp, ",0,,,,,\n");
+    }
+    munmap (addr, st.st_size);
+    return TRUE;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DD_REC_H
+#define DD_REC_H
+
+#include <gst/gst.h>
+
+#include "dd_results.h"
+
+/*
+ * Recording container, little endian:
+ *   header       DDRecHeader, padded to DD_REC_ALIGN bytes
+ *   frames       GRAY8 frames with packed rows, each in a slot of
+ *                slot_size bytes, a multiple of DD_REC_ALIGN
+ *   index        one DDRecIndexEntry per frame, at index_offset
+ * The header is rewritten with the frame count and the index offset when
+ * the recording is closed; a recording that was not closed has neither,
+ * its frames are found from the file size.
+ */
+#define DD_REC_MAGIC              "DDREC001"
+#define DD_REC_EXTENSION          ".ddrec"
+#define DD_REC_ALIGN              4096
+/* Frames are gathered and written at once, in about this many bytes */
+#define DD_REC_BATCH_BYTES        (8 * 1024 * 1024)
+
+/* DDRecIndexEntry flags */
+#define DD_REC_HAS_RESULT         (1 << 0)
+
+typedef struct _DDRecHeader {
+    gchar magic[8];
+    guint32 header_size;        /* sizeof (DDRecHeader) */
+    guint32 entry_size;         /* sizeof (DDRecIndexEntry) */
+    guint32 width, height;
+    guint32 fps_n, fps_d;
+    guint64 frame_size;         /* width * height */
+    guint64 slot_size;
+    guint64 data_offset;        /* DD_REC_ALIGN */
+    guint64 index_offset;       /* 0 until closed */
+    guint64 frames;             /* 0 until closed */
+    gint64 start_time_us;       /* wall clock time of the first frame */
+} DDRecHeader;
+
+typedef struct _DDRecIndexEntry {
+    guint64 offset;             /* of the frame in the file */
+    guint64 pts;                /* GST_CLOCK_TIME_NONE if unknown */
+    guint32 flags;
+    guint32 threshold;
+    guint32 fruit_pixels;
+    guint32 defect_pixels;
+    guint32 decision;           /* 1 if defective */
+    guint32 reserved;
+    gdouble density;            /* percent */
+} DDRecIndexEntry;
+
+/* Frames of a mapped recording */
+typedef struct _DDRecIndex {
+    const DDRecHeader *header;
+    const DDRecIndexEntry *entries; /* NULL if the recording was not closed */
+    guint64 frames;
+} DDRecIndex;
+
+/* Fill @record with the result attached to @buf, FALSE if it has none */
+typedef gboolean (*DDRecResultFunc) (GstBuffer *buf, DDResultRecord *record);
+
+typedef struct _DDRecWriter DDRecWriter;
+
+/** @brief
+ *  Record the frames reaching an appsink.
+ *
+ *  The frames are copied into a batch of slots that is written at once
+ *  when full, so the disk only sees large aligned writes. The index is
+ *  kept in memory and appended when the appsink is destroyed. A failed
+ *  write is logged and stops the recording, never the pipeline.
+ *
+ *  @param appsink is the appsink; the writer lives as long as it.
+ *  @param location is the file to create.
+ *  @param result_func reads the result of a frame, NULL for none.
+ *  @return the writer, owned by the appsink, NULL if the file cannot be created.
+ */
+DDRecWriter * dd_rec_writer_new (GstElement *appsink, const gchar *location, DDRecResultFunc result_func);
+
+/* TRUE if @location names a recording */
+gboolean dd_rec_is_recording (const gchar *location);
+
+/** @brief
+ *  Find the frames of a recording mapped in memory.
+ *
+ *  Every frame found lies within the mapping: the frames of an index
+ *  from the first entry that points past its end are dropped.
+ *
+ *  @param addr is the start of the mapping.
+ *  @param size is the size of the mapping.
+ *  @param index is filled with the header and frames.
+ *  @return FALSE if the mapping is not a recording.
+ */
+gboolean dd_rec_parse (gconstpointer addr, gsize size, DDRecIndex *index);
+
+/* Offset in the file of frame @n of @index */
+guint64 dd_rec_frame_offset (const DDRecIndex *index, guint64 n);
+
+/** @brief
+ *  Read the header of a recording file.
+ *
+ *  @param location is the recording.
+ *  @param header is filled with the header.
+ *  @return FALSE if the file is not a recording.
+ */
+gboolean dd_rec_read_header (const gchar *location, DDRecHeader *header);
+
+/** @brief
+ *  Print the index of a recording as CSV: frame, pts_ms, result,
+ *  threshold, fruit_pixels, defect_pixels, density and defective.
+ *
+ *  @param location is the recording.
+ *  @param fp is the output stream.
+ *  @return FALSE if the file is not a recording.
+ */
+gboolean dd_rec_print_index (const gchar *location, FILE *fp);
+
+#endif /* DD_REC_H */
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_reload.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <glib-unix.h>
+#include <jansson.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include "dd_params.h"
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+typedef struct _ParamRule {
+    DDParam param;
+    gboolean integer;
+    gdouble min, max;
+    /* Values within min and max the kernel still refuses, NULL for none */
+    gboolean (*check) (gdouble value);
+    const gchar *valid;         /* the values check() accepts */
+} ParamRule;
+
+/* cv::putText throws on anything but a Hershey face, plus FONT_ITALIC */
+static gboolean
+check_font (gdouble value) {
+    return value <= 7 || (value >= 16 && value <= 23);
+}
+
+/* What the kernels accept without a restart */
+static const ParamRule rules[] = {
+    { DD_PARAM_MAX_VALUE,        TRUE,  0,    255 },
+    { DD_PARAM_DEFECT_THRESHOLD, FALSE, 0,    100 },
+    { DD_PARAM_FONT_SIZE,        FALSE, 0.1,  10 },
+    { DD_PARAM_FONT,             TRUE,  0,    23,   check_font, "0 to 7 or 16 to 23" },
+    { DD_PARAM_X_OFFSET,         TRUE,  0,    7680 },
+    { DD_PARAM_Y_OFFSET,         TRUE,  0,    4320 },
+    { DD_PARAM_IS_ACC_RESULT,    TRUE,  0,    1 },
+};
+
+struct _DDReload {
+    string dir;
+    guint streams;
+    gint fd;
+    guint source;
+    set<string> files;
+    /* Every value reloaded so far, so that a kernel that skipped a set
+     * still gets its own values from the next one */
+    DDParams params;
+    guint published, rejected;
+    mutex lock;
+};
+
+static const ParamRule *
+find_rule (const gchar *name) {
+    for (guint i = 0; i < G_N_ELEMENTS (rules); i++) {
+        if (!g_strcmp0 (dd_params_name (rules[i].param), name))
+            return &rules[i];
+    }
+    return NULL;
+}
+
+static gboolean
+check_value (const ParamRule *rule, gdouble value) {
+    return value >= rule->min && value <= rule->max && (!rule->integer || value == (gint64) value) &&
+           (!rule->check || rule->check (value));
+}
+
+/* Merge values into the running set; call with the lock held */
+static void
+merge_params (DDReload *reload, const DDParams *params) {
+    for (guint i = 0; i < DD_PARAM_COUNT; i++) {
+        if (dd_params_has (params, (DDParam) i))
+            reload->params.values[i] = params->values[i];
+    }
+    reload->params.set |= params->set;
+}
+
+/* Hand the running set to every stream; call with the lock held */
+static uint64_t
+publish_params (DDReload *reload) {
+    uint64_t generation = 0;
+
+    for (guint stream = 0; stream < reload->streams; stream++)
+        generation = dd_params_publish (stream, &reload->params);
+    reload->published++;
+    return generation;
+}
+
+/** @brief
+ *  Read the tunable parameters of a kernel config file.
+ *
+ *  @param path is the file.
+ *  @param params is filled with the values found.
+ *  @return FALSE if the file cannot be parsed or a value is invalid.
+ */
+static gboolean
+parse_params (const string &path, DDParams *params) {
+    json_error_t error;
+    json_t *root, *config;
+    gboolean ok = TRUE;
+
+    memset (params, 0, sizeof (*params));
+    root = json_load_file (path.c_str (), 0, &error);
+    if (!root) {
+        g_printerr ("Not reloading %s: %s\n", path.c_str (), error.text);
+        return FALSE;
+    }
+    config = json_object_get (json_array_get (json_object_get (root, "kernels"), 0), "config");
+    if (!json_is_object (config)) {
+        g_printerr ("Not reloading %s: no kernel config\n", path.c_str ());
+        json_decref (root);
+        return FALSE;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS (rules) && ok; i++) {
+        const ParamRule *rule = &rules[i];
+        json_t *val = json_object_get (config, dd_params_name (rule->param));
+        gdouble value;
+
+        if (!val)
+            continue;
+        value = json_number_value (val);
+        if (!json_is_number (val) || !check_value (rule, value)) {
+            if (rule->valid)
+                g_printerr ("Not reloading %s: %s must be %s %s\n", path.c_str (),
+                            dd_params_name (rule->param), rule->integer ? "an integer" : "a number",
+                            rule->valid);
+            else
+                g_printerr ("Not reloading %s: %s must be %s from %g to %g\n", path.c_str (),
+                            dd_params_name (rule->param), rule->integer ? "an integer" : "a number",
+                            rule->min, rule->max);
+            ok = FALSE;
+            continue;
+        }
+        params->set |= 1 << rule->param;
+        params->values[rule->param] = value;
+    }
+    json_decref (root);
+    return ok;
+}
+
+static void
+reload_file (DDReload *reload, const string &name) {
+    string path = reload->dir + G_DIR_SEPARATOR_S + name;
+    DDParams params;
+    uint64_t generation = 0;
+
+    if (!parse_params (path, &params)) {
+        lock_guard<mutex> lock (reload->lock);
+        reload->rejected++;
+        return;
+    }
+    if (!params.set) {
+        GST_DEBUG ("%s has no tunable parameter", name.c_str ());
+        return;
+    }
+    {
+        lock_guard<mutex> lock (reload->lock);
+        merge_params (reload, &params);
+        generation = publish_params (reload);
+    }
+    g_print ("Reloaded %s, parameter set %" G_GUINT64_FORMAT "\n", name.c_str (), generation);
+}
+
+static gboolean
+inotify_cb (gint fd, GIOCondition condition, gpointer user_data) {
+    DDReload *reload = (DDReload *) user_data;
+    gchar buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    set<string> changed;
+    ssize_t len;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0) {
+        for (gchar *p = buf; p < buf + len; p += sizeof (struct inotify_event) + ((struct inotify_event *) p)->len) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            if (event->len && reload->files.count (event->name))
+                changed.insert (event->name);
+        }
+    }
+    /* An editor saving a file may trigger several events, reload it once */
+    for (const string &name : changed)
+        reload_file (reload, name);
+    return G_SOURCE_CONTINUE;
+}
+
+DDReload *
+dd_reload_new (const gchar *dir, guint streams) {
+    DDReload *reload;
+    gint fd;
+
+    fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        GST_WARNING ("inotify is not available: %s", strerror (errno));
+        return NULL;
+    }
+    /* Editors often write a new file and rename it over the old one */
+    if (inotify_add_watch (fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        GST_WARNING ("Could not watch %s: %s", dir, strerror (errno));
+        close (fd);
+        return NULL;
+    }
+
+    reload = new DDReload ();
+    reload->dir = dir;
+    reload->streams = MIN (streams, DD_PARAMS_MAX_STREAMS);
+    reload->fd = fd;
+    reload->source = g_unix_fd_add (fd, G_IO_IN, inotify_cb, reload);
+    GST_DEBUG ("Watching %s for parameter changes", dir);
+    return reload;
+}
+
+void
+dd_reload_watch (DDReload *reload, const gchar *file) {
+    DDParams params;
+
+    if (!reload || !reload->files.insert (file).second)
+        return;
+    if (parse_params (reload->dir + G_DIR_SEPARATOR_S + file, &params)) {
+        lock_guard<mutex> lock (reload->lock);
+        merge_params (reload, &params);
+    }
+}
+
+gboolean
+dd_reload_set (DDReload *reload, const gchar *name, gdouble value, const gchar **error) {
+    const ParamRule *rule = find_rule (name);
+    DDParams params;
+
+    if (!reload) {
+        *error = "parameter reload is not available";
+        return FALSE;
+    }
+    if (!rule) {
+        *error = "unknown parameter";
+        return FALSE;
+    }
+    if (!check_value (rule, value)) {
+        *error = "value out of range";
+        return FALSE;
+    }
+    memset (&params, 0, sizeof (params));
+    params.set = 1 << rule->param;
+    params.values[rule->param] = value;
+
+    lock_guard<mutex> lock (reload->lock);
+    merge_params (reload, &params);
+    publish_params (reload);
+    return TRUE;
+}
+
+gboolean
+dd_reload_get (DDReload *reload, const gchar *name, gdouble *value) {
+    const ParamRule *rule = find_rule (name);
+
+    if (!reload || !rule)
+        return FALSE;
+    lock_guard<mutex> lock (reload->lock);
+    if (!dd_params_has (&reload->params, rule->param))
+        return FALSE;
+    *value = reload->params.values[rule->param];
+    return TRUE;
+}
+
+guint
+dd_reload_published (DDReload *reload) {
+    if (!reload)
+        return 0;
+    lock_guard<mutex> lock (reload->lock);
+    return reload->published;
+}
+
+guint
+dd_reload_rejected (DDReload *reload) {
+    if (!reload)
+        return 0;
+    lock_guard<mutex> lock (reload->lock);
+    return reload->rejected;
+}
+
+void
+dd_reload_free (DDReload *reload) {
+    if (!reload)
+        return;
+    g_source_remove (reload->source);
+    close (reload->fd);
+    delete reload;
+}
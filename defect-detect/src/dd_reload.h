@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_RELOAD_H
+#define DD_RELOAD_H
+
+#include <gst/gst.h>
+
+typedef struct _DDReload DDReload;
+
+/** @brief
+ *  Watch the kernel config directory and hand the tunable parameters of
+ *  changed files to the running kernels.
+ *
+ *  Files are watched with inotify from the default main context. A file
+ *  written in place or renamed over is parsed and every tunable value in
+ *  the config of its first kernel is checked; a file with a single
+ *  invalid value is rejected as a whole and the kernels keep their
+ *  parameters. Valid sets are published with dd_params_publish() to
+ *  every stream, the kernels apply them before their next frame.
+ *
+ *  @param dir is the config directory.
+ *  @param streams is the number of running streams.
+ *  @return the watcher, NULL if inotify is not available.
+ */
+DDReload * dd_reload_new (const gchar *dir, guint streams);
+
+/* Reload @file, a name relative to the directory, when it changes;
+ * its current values are taken as the running ones */
+void dd_reload_watch (DDReload *reload, const gchar *file);
+
+/** @brief
+ *  Change one tunable parameter of the running kernels, with the same
+ *  checks as a reloaded file. Safe from any thread.
+ *
+ *  @param reload is the watcher.
+ *  @param name is the parameter key, e.g. "defect_threshold".
+ *  @param value is the new value.
+ *  @param error is set to a static description when rejected.
+ *  @return FALSE if the parameter is unknown or the value invalid.
+ */
+gboolean dd_reload_set (DDReload *reload, const gchar *name, gdouble value, const gchar **error);
+
+/* Running value of a parameter, FALSE if unknown or never given */
+gboolean dd_reload_get (DDReload *reload, const gchar *name, gdouble *value);
+
+/* Number of sets published and rejected so far */
+guint dd_reload_published (DDReload *reload);
+guint dd_reload_rejected (DDReload *reload);
+
+void dd_reload_free (DDReload *reload);
+
+#endif /* DD_RELOAD_H */
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_RESULT_META_H
+#define DD_RESULT_META_H
+
+/*
+ * Layout of the per-frame result attached by the overlay stage.
+ *
+ * The earlier stages pass pointers into their device buffers through the
+ * reserved fields of their predictions, which only stay valid until the
+ * next frame. The overlay copies the final figures by value into an extra
+ * classification, so that they can be read downstream of a queue:
+ *   class_label    DD_RESULT_LABEL
+ *   class_id       1 if the fruit is defective, 0 otherwise
+ *   class_prob     defect density in percent
+ *   probabilities  DD_RESULT_VALUES values indexed by DD_RESULT_*
+ *   labels         the matching names from DD_RESULT_NAMES
+ */
+
+#define DD_RESULT_LABEL   "DEFECT RESULT"
+
+enum {
+    DD_RESULT_FRAME,            /* frame number at the overlay stage */
+    DD_RESULT_THRESHOLD,        /* Otsu threshold */
+    DD_RESULT_FRUIT_PIXELS,
+    DD_RESULT_DEFECT_PIXELS,
+    DD_RESULT_DENSITY,          /* percent */
+    DD_RESULT_DONE_NS,          /* CLOCK_MONOTONIC time of the decision */
+    DD_RESULT_VALUES
+};
+
+#define DD_RESULT_NAMES   { "frame", "threshold", "fruit_pixels", "defect_pixels", "density", "done_ns", NULL }
+
+#endif /* DD_RESULT_META_H */
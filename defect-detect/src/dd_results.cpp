@@ -0,0 +1,242 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_results.h"
+
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static_assert (sizeof (DDResultRecord) == 64, "binary result record must stay 64 bytes");
+
+struct _DDResultsWriter {
+    FILE *fp;
+    DDResultsFormat format;
+    mutex lock;
+    condition_variable cond;
+    vector<DDResultRecord> front;   /* filled by the streaming thread */
+    vector<DDResultRecord> back;    /* written by the writer thread */
+    guint64 dropped;
+    gboolean stop;
+    thread worker;
+    string text;
+    vector<string> sources;     /* names, already quoted for the text format */
+};
+
+static string
+quote_source (const gchar *name, DDResultsFormat format) {
+    string out;
+
+    if (format == DD_RESULTS_JSONL) {
+        json_t *str = json_string (name);
+        gchar *dump = str ? json_dumps (str, JSON_ENCODE_ANY) : NULL;
+
+        out = dump ? dump : "null";
+        free (dump);
+        json_decref (str);
+        return out;
+    }
+    out = "\"";
+    for (const gchar *c = name; *c; c++) {
+        if (*c == '"')
+            out += '"';
+        out += *c;
+    }
+    out += '"';
+    return out;
+}
+
+static void
+write_sources (FILE *fp, const gchar * const *sources) {
+    guint32 count = 0, len;
+
+    for (const gchar * const *s = sources; s && *s; s++)
+        count++;
+    fwrite (&count, sizeof (count), 1, fp);
+    for (const gchar * const *s = sources; s && *s; s++) {
+        len = strlen (*s);
+        fwrite (&len, sizeof (len), 1, fp);
+        fwrite (*s, 1, len, fp);
+    }
+}
+
+static void
+format_record (DDResultsWriter *writer, const DDResultRecord *r) {
+    gchar line[256], pts[32], latency[32], fruit[16];
+    string index;
+    const string *source = &index;
+
+    if (r->pts == G_MAXUINT64)
+        g_strlcpy (pts, writer->format == DD_RESULTS_JSONL ? "null" : "", sizeof (pts));
+    else
+        g_snprintf (pts, sizeof (pts), "%" G_GUINT64_FORMAT, r->pts);
+    if (r->latency_ms < 0)
+        g_strlcpy (latency, writer->format == DD_RESULTS_JSONL ? "null" : "", sizeof (latency));
+    else
+        g_snprintf (latency, sizeof (latency), "%.3f", r->latency_ms);
+    if (!r->fruit)
+        g_strlcpy (fruit, writer->format == DD_RESULTS_JSONL ? "null" : "", sizeof (fruit));
+    else
+        g_snprintf (fruit, sizeof (fruit), "%u", r->fruit);
+    if (r->source < writer->sources.size ())
+        source = &writer->sources[r->source];
+    else
+        index = to_string (r->source);
+
+    /* Names can be longer than a line */
+    if (writer->format == DD_RESULTS_JSONL) {
+        writer->text += "{\"source\":" + *source + ",";
+        g_snprintf (line, sizeof (line),
+                    "\"frame\":%" G_GUINT64_FORMAT ",\"pts\":%s,\"threshold\":%u,\"fruit_pixels\":%u,"
+                    "\"defect_pixels\":%u,\"density\":%.4f,\"defective\":%s,\"latency_ms\":%s,\"fruit\":%s,"
+                    "\"fruits\":%u}\n",
+                    r->frame, pts, r->threshold, r->fruit_pixels, r->defect_pixels, r->density,
+                    r->decision ? "true" : "false", latency, fruit, r->fruits);
+    } else {
+        writer->text += *source + ",";
+        g_snprintf (line, sizeof (line), "%" G_GUINT64_FORMAT ",%s,%u,%u,%u,%.4f,%u,%s,%s,%u\n",
+                    r->frame, pts, r->threshold, r->fruit_pixels, r->defect_pixels, r->density,
+                    r->decision, latency, fruit, r->fruits);
+    }
+    writer->text += line;
+}
+
+static void
+write_batch (DDResultsWriter *writer) {
+    if (writer->back.empty ())
+        return;
+
+    /* One write per batch */
+    if (writer->format == DD_RESULTS_BIN) {
+        fwrite (writer->back.data (), sizeof (DDResultRecord), writer->back.size (), writer->fp);
+    } else {
+        writer->text.clear ();
+        for (const DDResultRecord &r : writer->back)
+            format_record (writer, &r);
+        fwrite (writer->text.data (), 1, writer->text.size (), writer->fp);
+    }
+    fflush (writer->fp);
+    writer->back.clear ();
+}
+
+static void
+writer_thread (DDResultsWriter *writer) {
+    unique_lock<mutex> guard (writer->lock);
+
+    while (TRUE) {
+        writer->cond.wait_for (guard, chrono::milliseconds (DD_RESULTS_FLUSH_MS), [writer] {
+            return writer->stop || writer->front.size () >= DD_RESULTS_BATCH;
+        });
+        writer->front.swap (writer->back);
+        gboolean stop = writer->stop;
+
+        guard.unlock ();
+        write_batch (writer);
+        guard.lock ();
+        if (stop && writer->front.empty ())
+            break;
+    }
+}
+
+DDResultsWriter *
+dd_results_writer_new (const gchar *path, DDResultsFormat format, const gchar * const *sources) {
+    DDResultsWriter *writer;
+    FILE *fp = fopen (path, format == DD_RESULTS_BIN ? "wb" : "w");
+
+    if (!fp)
+        return NULL;
+
+    /* Buffering is done here, a batch goes out in one write */
+    setvbuf (fp, NULL, _IONBF, 0);
+    if (format == DD_RESULTS_BIN) {
+        fwrite (DD_RESULTS_BIN_MAGIC, 1, strlen (DD_RESULTS_BIN_MAGIC), fp);
+        write_sources (fp, sources);
+    } else if (format == DD_RESULTS_CSV) {
+        fputs ("source,frame,pts,threshold,fruit_pixels,defect_pixels,density,defective,latency_ms,fruit,fruits\n", fp);
+    }
+
+    writer = new DDResultsWriter ();
+    writer->fp = fp;
+    writer->format = format;
+    writer->dropped = 0;
+    writer->stop = FALSE;
+    if (format != DD_RESULTS_BIN) {
+        for (const gchar * const *s = sources; s && *s; s++)
+            writer->sources.push_back (quote_source (*s, format));
+    }
+    writer->front.reserve (DD_RESULTS_BATCH * 2);
+    writer->back.reserve (DD_RESULTS_BATCH * 2);
+    writer->worker = thread (writer_thread, writer);
+    return writer;
+}
+
+void
+dd_results_writer_push (DDResultsWriter *writer, const DDResultRecord *record) {
+    gboolean wake;
+
+    {
+        lock_guard<mutex> guard (writer->lock);
+        if (writer->front.size () >= DD_RESULTS_MAX_PENDING) {
+            writer->dropped++;
+            return;
+        }
+        writer->front.push_back (*record);
+        wake = writer->front.size () == DD_RESULTS_BATCH;
+    }
+    if (wake)
+        writer->cond.notify_one ();
+}
+
+guint64
+dd_results_writer_dropped (DDResultsWriter *writer) {
+    lock_guard<mutex> guard (writer->lock);
+    return writer->dropped;
+}
+
+void
+dd_results_writer_free (DDResultsWriter *writer) {
+    if (!writer)
+        return;
+    {
+        lock_guard<mutex> guard (writer->lock);
+        writer->stop = TRUE;
+    }
+    writer->cond.notify_one ();
+    writer->worker.join ();
+    fclose (writer->fp);
+    delete writer;
+}
+
+gboolean
+dd_results_format_from_string (const gchar *str, DDResultsFormat *format) {
+    if (!g_strcmp0 (str, "jsonl"))
+        *format = DD_RESULTS_JSONL;
+    else if (!g_strcmp0 (str, "csv"))
+        *format = DD_RESULTS_CSV;
+    else if (!g_strcmp0 (str, "bin"))
+        *format = DD_RESULTS_BIN;
+    else
+        return FALSE;
+    return TRUE;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_RESULTS_H
+#define DD_RESULTS_H
+
+#include <glib.h>
+
+/* Records handed to the writer thread at once, or after DD_RESULTS_FLUSH_MS */
+#define DD_RESULTS_BATCH          256
+#define DD_RESULTS_FLUSH_MS       1000
+/* Records held in memory before new ones are dropped, if the disk stalls */
+#define DD_RESULTS_MAX_PENDING    (64 * 1024)
+
+/* First bytes of a binary results file, followed by the source table
+ * (u32 count, then u32 length and bytes of each name) and the
+ * DDResultRecord entries */
+#define DD_RESULTS_BIN_MAGIC      "DDRES004"
+
+typedef enum {
+    DD_RESULTS_JSONL,
+    DD_RESULTS_CSV,
+    DD_RESULTS_BIN,
+} DDResultsFormat;
+
+/* One frame; the binary format stores it as is, 64 bytes little endian */
+typedef struct _DDResultRecord {
+    guint64 frame;
+    guint64 pts;                /* GST_CLOCK_TIME_NONE if unknown */
+    guint32 threshold;
+    guint32 fruit_pixels;
+    guint32 defect_pixels;
+    guint32 decision;           /* 1 if defective */
+    gdouble density;            /* percent */
+    gdouble latency_ms;         /* capture to decision, negative if unknown */
+    guint32 source;             /* index in the sources given to the writer */
+    guint32 fruit;              /* tracked fruit ID, 0 when not tracking */
+    /* Tracked fruits the frame was inspected for, each with a record of
+     * this same frame verdict; 0 when not tracking */
+    guint32 fruits;
+    guint32 reserved;           /* 0 */
+} DDResultRecord;
+
+typedef struct _DDResultsWriter DDResultsWriter;
+
+/** @brief
+ *  Open a results file and start its writer thread.
+ *
+ *  Records are appended to a front buffer by the streaming thread and
+ *  written by a dedicated thread after the buffers are swapped, so the
+ *  streaming thread never waits for the disk.
+ *
+ *  Several pipelines may push to the same writer, their records are
+ *  told apart by their source.
+ *
+ *  @param path is the output file, truncated.
+ *  @param format is the record format.
+ *  @param sources is the NULL terminated list of input names, written
+ *  in place of the source index of the records.
+ *  @return the writer, NULL if the file cannot be opened.
+ */
+DDResultsWriter * dd_results_writer_new (const gchar *path, DDResultsFormat format,
+                                         const gchar * const *sources);
+
+/* Queue a record, never blocks on I/O; safe from any thread */
+void dd_results_writer_push (DDResultsWriter *writer, const DDResultRecord *record);
+
+/* Records dropped because the writer could not keep up */
+guint64 dd_results_writer_dropped (DDResultsWriter *writer);
+
+/* Write the pending records, stop the thread and close the file */
+void dd_results_writer_free (DDResultsWriter *writer);
+
+gboolean dd_results_format_from_string (const gchar *str, DDResultsFormat *format);
+
+#endif /* DD_RESULTS_H */
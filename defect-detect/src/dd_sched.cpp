@@ -0,0 +1,188 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_sched.h"
+
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/* A caller waiting for a compute unit, on its own stack */
+struct SchedWaiter {
+    condition_variable cond;
+    bool granted;
+};
+
+struct SchedStream {
+    deque<SchedWaiter *> waiters;
+    atomic<uint64_t> calls;
+    atomic<uint64_t> wait_ns;
+    atomic<uint64_t> wait_max_ns;
+    atomic<uint64_t> busy_ns;
+    atomic<uint64_t> timeouts;
+};
+
+struct _DDSched {
+    string kernel;
+    mutex lock;
+    unsigned int free;          /* idle compute units */
+    unsigned int waiting;       /* callers queued over all streams */
+    unsigned int next;          /* stream served first at the next release */
+    SchedStream streams[DD_SCHED_MAX_STREAMS];
+};
+
+static mutex scheds_lock;
+static DDSched *scheds[DD_SCHED_MAX_KERNELS];
+
+static uint64_t
+now_ns (void) {
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static DDSched *
+find_sched (const char *kernel) {
+    for (unsigned int i = 0; i < DD_SCHED_MAX_KERNELS && scheds[i]; i++) {
+        if (scheds[i]->kernel == kernel)
+            return scheds[i];
+    }
+    return NULL;
+}
+
+DDSched *
+dd_sched_get (const char *kernel, unsigned int compute_units) {
+    lock_guard<mutex> guard (scheds_lock);
+    DDSched *sched = find_sched (kernel);
+
+    if (sched)
+        return sched;
+    for (unsigned int i = 0; i < DD_SCHED_MAX_KERNELS; i++) {
+        if (!scheds[i]) {
+            sched = new DDSched ();
+            sched->kernel = kernel;
+            sched->free = compute_units ? compute_units : 1;
+            scheds[i] = sched;
+            return sched;
+        }
+    }
+    return NULL;
+}
+
+uint64_t
+dd_sched_acquire (DDSched *sched, unsigned int stream) {
+    uint64_t start, acquired;
+    SchedStream *s;
+
+    if (!sched)
+        return 0;
+    stream %= DD_SCHED_MAX_STREAMS;
+    s = &sched->streams[stream];
+    start = now_ns ();
+
+    {
+        unique_lock<mutex> guard (sched->lock);
+
+        if (sched->free && !sched->waiting) {
+            sched->free--;
+        } else {
+            SchedWaiter waiter;
+
+            waiter.granted = false;
+            s->waiters.push_back (&waiter);
+            sched->waiting++;
+            waiter.cond.wait (guard, [&waiter] { return waiter.granted; });
+        }
+    }
+
+    acquired = now_ns ();
+    s->calls.fetch_add (1, memory_order_relaxed);
+    s->wait_ns.fetch_add (acquired - start, memory_order_relaxed);
+    if (acquired - start > s->wait_max_ns.load (memory_order_relaxed))
+        s->wait_max_ns.store (acquired - start, memory_order_relaxed);
+    return acquired;
+}
+
+void
+dd_sched_release (DDSched *sched, unsigned int stream, uint64_t acquired) {
+    SchedWaiter *waiter = NULL;
+    SchedStream *s;
+
+    if (!sched)
+        return;
+    stream %= DD_SCHED_MAX_STREAMS;
+    s = &sched->streams[stream];
+
+    s->busy_ns.fetch_add (now_ns () - acquired, memory_order_relaxed);
+
+    lock_guard<mutex> guard (sched->lock);
+
+    /* Round robin over the streams with a caller queued */
+    for (unsigned int i = 0; i < DD_SCHED_MAX_STREAMS && sched->waiting; i++) {
+        SchedStream *next = &sched->streams[(sched->next + i) % DD_SCHED_MAX_STREAMS];
+
+        if (next->waiters.empty ())
+            continue;
+        waiter = next->waiters.front ();
+        next->waiters.pop_front ();
+        sched->waiting--;
+        sched->next = (sched->next + i + 1) % DD_SCHED_MAX_STREAMS;
+        break;
+    }
+    if (!waiter) {
+        sched->free++;
+        return;
+    }
+    /* The compute unit goes straight to the waiter, never back to the pool */
+    waiter->granted = true;
+    waiter->cond.notify_one ();
+}
+
+void
+dd_sched_timeout (DDSched *sched, unsigned int stream) {
+    if (sched)
+        sched->streams[stream % DD_SCHED_MAX_STREAMS].timeouts.fetch_add (1, memory_order_relaxed);
+}
+
+int
+dd_sched_stats (const char *kernel, unsigned int stream, DDSchedStats *stats) {
+    DDSched *sched;
+    SchedStream *s;
+
+    if (stream >= DD_SCHED_MAX_STREAMS || !stats)
+        return -1;
+    {
+        lock_guard<mutex> guard (scheds_lock);
+        sched = find_sched (kernel);
+    }
+    if (!sched)
+        return -1;
+
+    s = &sched->streams[stream];
+    stats->calls       = s->calls.load (memory_order_relaxed);
+    stats->wait_ns     = s->wait_ns.load (memory_order_relaxed);
+    stats->wait_max_ns = s->wait_max_ns.load (memory_order_relaxed);
+    stats->busy_ns     = s->busy_ns.load (memory_order_relaxed);
+    stats->timeouts    = s->timeouts.load (memory_order_relaxed);
+    return 0;
+}
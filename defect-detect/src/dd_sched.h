@@ -0,0 +1,93 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_SCHED_H
+#define DD_SCHED_H
+
+#include <stdint.h>
+
+#include "dd_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streams served by a scheduler, the same as the statistics */
+#define DD_SCHED_MAX_STREAMS         DD_STATS_MAX_STREAMS
+#define DD_SCHED_MAX_KERNELS         8
+
+/* Kernel names, as used by the kernel libraries */
+#define DD_SCHED_KERNEL_OTSU         "otsu"
+#define DD_SCHED_KERNEL_PREPROCESS   "preprocess"
+#define DD_SCHED_KERNEL_CCA          "cca"
+
+typedef struct _DDSched DDSched;
+
+typedef struct _DDSchedStats {
+    uint64_t calls;
+    uint64_t wait_ns;           /* waiting for a free compute unit */
+    uint64_t wait_max_ns;
+    uint64_t busy_ns;           /* holding a compute unit */
+    uint64_t timeouts;          /* calls the kernel did not complete in time */
+} DDSchedStats;
+
+/** @brief
+ *  Get the scheduler of a kernel, shared by every stream of the process.
+ *
+ *  Each kernel library calls this from its init with the same name, the
+ *  first call creates the scheduler.
+ *
+ *  @param kernel is the kernel name, e.g. "otsu".
+ *  @param compute_units is the number of calls run at once, at least 1.
+ *  @return the scheduler, NULL if DD_SCHED_MAX_KERNELS are in use.
+ */
+DDSched * dd_sched_get (const char *kernel, unsigned int compute_units);
+
+/** @brief
+ *  Wait for a compute unit of the kernel.
+ *
+ *  While the compute units are busy, callers queue per stream and the
+ *  units are handed to the streams in turn, first in first out within
+ *  a stream, so a stream with a backlog cannot starve the others.
+ *
+ *  @param sched is the scheduler, the call returns at once if NULL.
+ *  @param stream index of the stream, below DD_SCHED_MAX_STREAMS.
+ *  @return the time the unit was acquired, to give to dd_sched_release().
+ */
+uint64_t dd_sched_acquire (DDSched *sched, unsigned int stream);
+
+/* Hand the compute unit taken by dd_sched_acquire() to the next stream */
+void dd_sched_release (DDSched *sched, unsigned int stream, uint64_t acquired);
+
+/* Count a call of @stream that the kernel did not complete */
+void dd_sched_timeout (DDSched *sched, unsigned int stream);
+
+/** @brief
+ *  Read the counters of a stream of a kernel.
+ *
+ *  @param kernel is the kernel name.
+ *  @param stream index of the stream.
+ *  @param stats filled with the counters.
+ *  @return 0 on success, -1 if the kernel has no scheduler or the
+ *  stream is invalid.
+ */
+int dd_sched_stats (const char *kernel, unsigned int stream, DDSchedStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DD_SCHED_H */
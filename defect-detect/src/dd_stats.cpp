@@ -0,0 +1,358 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_stats.h"
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+
+using namespace std;
+
+#define STATS_FILE_MAGIC    "dd-stats"
+#define STATS_FILE_VERSION  1
+
+/*
+ * Every window is a ring of time buckets. A bucket is tagged with the epoch
+ * (timestamp / bucket width) it holds, so stale buckets are recycled by the
+ * writer and skipped by the readers without any timer.
+ *
+ * Each bucket is guarded by a sequence counter: a writer makes it odd while
+ * updating and even again when done, readers copy the bucket and retry if
+ * the counter moved. Writers of the same stream, the overlays of concurrent
+ * batch pipelines, take turns: only the one that made the counter odd
+ * updates the bucket. All fields are atomics accessed relaxed, the
+ * ordering comes from the fences around the sequence counter.
+ */
+struct StatsBucket {
+    atomic<uint64_t> seq;
+    atomic<uint64_t> epoch;
+    atomic<uint64_t> frames;
+    atomic<uint64_t> defects;
+    atomic<uint64_t> fruit_pixels;
+    atomic<uint64_t> defect_pixels;
+    atomic<double>   density_sum;
+    atomic<double>   density_max;
+    atomic<uint64_t> hist[DD_STATS_HIST_BINS];
+};
+
+struct StatsWindow {
+    uint64_t bucket_ns;
+    unsigned int nbuckets;
+    StatsBucket *buckets;
+};
+
+#define WINDOW_1S_BUCKETS   10
+#define WINDOW_1M_BUCKETS   60
+#define WINDOW_1H_BUCKETS   60
+
+struct StatsStream {
+    StatsBucket b1s[WINDOW_1S_BUCKETS];
+    StatsBucket b1m[WINDOW_1M_BUCKETS];
+    StatsBucket b1h[WINDOW_1H_BUCKETS];
+    StatsBucket total;
+    StatsWindow windows[DD_STATS_WINDOW_COUNT];
+    /* Restored by dd_stats_load(), only written before streaming starts */
+    DDStatsSnapshot base;
+};
+
+static StatsStream streams[DD_STATS_MAX_STREAMS];
+
+static bool
+stats_init (void) {
+    for (unsigned int i = 0; i < DD_STATS_MAX_STREAMS; i++) {
+        StatsStream *s = &streams[i];
+        s->windows[DD_STATS_WINDOW_1S]    = { 100000000ULL,   WINDOW_1S_BUCKETS, s->b1s };
+        s->windows[DD_STATS_WINDOW_1M]    = { 1000000000ULL,  WINDOW_1M_BUCKETS, s->b1m };
+        s->windows[DD_STATS_WINDOW_1H]    = { 60000000000ULL, WINDOW_1H_BUCKETS, s->b1h };
+        s->windows[DD_STATS_WINDOW_TOTAL] = { 0,              1,                 &s->total };
+    }
+    return true;
+}
+
+static StatsStream *
+stats_stream (unsigned int stream) {
+    /* Zero-initialised statics are valid buckets, only the window table
+     * needs to be filled once */
+    static bool ready = stats_init ();
+
+    if (!ready || stream >= DD_STATS_MAX_STREAMS)
+        return NULL;
+    return &streams[stream];
+}
+
+static unsigned int
+hist_bin (double density) {
+    double edge = DD_STATS_HIST_FIRST_EDGE;
+    unsigned int bin = 0;
+
+    while (bin < DD_STATS_HIST_BINS - 1 && density >= edge) {
+        edge *= 2.0;
+        bin++;
+    }
+    return bin;
+}
+
+static inline void
+bump (atomic<uint64_t> &v, uint64_t delta) {
+    /* Single writer: a plain load/store pair is enough and avoids the
+     * locked read-modify-write */
+    v.store (v.load (memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+static void
+bucket_reset (StatsBucket *b, uint64_t epoch) {
+    b->epoch.store (epoch, memory_order_relaxed);
+    b->frames.store (0, memory_order_relaxed);
+    b->defects.store (0, memory_order_relaxed);
+    b->fruit_pixels.store (0, memory_order_relaxed);
+    b->defect_pixels.store (0, memory_order_relaxed);
+    b->density_sum.store (0.0, memory_order_relaxed);
+    b->density_max.store (0.0, memory_order_relaxed);
+    for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++)
+        b->hist[i].store (0, memory_order_relaxed);
+}
+
+static void
+bucket_add (StatsBucket *b, uint64_t epoch, uint32_t fruit_pixels, uint32_t defect_pixels,
+            double density, int defect, unsigned int bin) {
+    uint64_t seq = b->seq.load (memory_order_relaxed);
+
+    /* Wait for another writer of the stream to finish with the bucket */
+    while ((seq & 1) || !b->seq.compare_exchange_weak (seq, seq + 1, memory_order_acquire,
+                                                       memory_order_relaxed)) {
+        if (seq & 1) {
+            this_thread::yield ();
+            seq = b->seq.load (memory_order_relaxed);
+        }
+    }
+    atomic_thread_fence (memory_order_release);
+
+    if (b->epoch.load (memory_order_relaxed) != epoch)
+        bucket_reset (b, epoch);
+    bump (b->frames, 1);
+    bump (b->defects, defect ? 1 : 0);
+    bump (b->fruit_pixels, fruit_pixels);
+    bump (b->defect_pixels, defect_pixels);
+    b->density_sum.store (b->density_sum.load (memory_order_relaxed) + density, memory_order_relaxed);
+    if (density > b->density_max.load (memory_order_relaxed))
+        b->density_max.store (density, memory_order_relaxed);
+    bump (b->hist[bin], 1);
+
+    b->seq.store (seq + 2, memory_order_release);
+}
+
+static void
+bucket_read (StatsBucket *b, uint64_t *epoch, DDStatsSnapshot *out) {
+    uint64_t s1, s2;
+
+    do {
+        s1 = b->seq.load (memory_order_acquire);
+        *epoch             = b->epoch.load (memory_order_relaxed);
+        out->frames        = b->frames.load (memory_order_relaxed);
+        out->defects       = b->defects.load (memory_order_relaxed);
+        out->fruit_pixels  = b->fruit_pixels.load (memory_order_relaxed);
+        out->defect_pixels = b->defect_pixels.load (memory_order_relaxed);
+        out->density_sum   = b->density_sum.load (memory_order_relaxed);
+        out->density_max   = b->density_max.load (memory_order_relaxed);
+        for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++)
+            out->hist[i] = b->hist[i].load (memory_order_relaxed);
+        atomic_thread_fence (memory_order_acquire);
+        s2 = b->seq.load (memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+static void
+snapshot_merge (DDStatsSnapshot *dst, const DDStatsSnapshot *src) {
+    dst->frames        += src->frames;
+    dst->defects       += src->defects;
+    dst->fruit_pixels  += src->fruit_pixels;
+    dst->defect_pixels += src->defect_pixels;
+    dst->density_sum   += src->density_sum;
+    if (src->density_max > dst->density_max)
+        dst->density_max = src->density_max;
+    for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++)
+        dst->hist[i] += src->hist[i];
+}
+
+void
+dd_stats_record (unsigned int stream, uint64_t ts_ns, uint32_t fruit_pixels,
+                 uint32_t defect_pixels, double density, int defect) {
+    StatsStream *s = stats_stream (stream);
+    unsigned int bin;
+
+    if (!s)
+        return;
+
+    bin = hist_bin (density);
+    for (unsigned int w = 0; w < DD_STATS_WINDOW_COUNT; w++) {
+        StatsWindow *win = &s->windows[w];
+        uint64_t epoch = win->bucket_ns ? ts_ns / win->bucket_ns : 0;
+        bucket_add (&win->buckets[epoch % win->nbuckets], epoch, fruit_pixels, defect_pixels,
+                    density, defect, bin);
+    }
+}
+
+int
+dd_stats_snapshot (unsigned int stream, DDStatsWindow window, uint64_t now_ns,
+                   DDStatsSnapshot *snap) {
+    StatsStream *s = stats_stream (stream);
+    DDStatsSnapshot part;
+    StatsWindow *win;
+    uint64_t now_epoch, epoch;
+
+    if (!s || !snap || window >= DD_STATS_WINDOW_COUNT)
+        return -1;
+
+    memset (snap, 0, sizeof (*snap));
+    win = &s->windows[window];
+    now_epoch = win->bucket_ns ? now_ns / win->bucket_ns : 0;
+
+    for (unsigned int i = 0; i < win->nbuckets; i++) {
+        bucket_read (&win->buckets[i], &epoch, &part);
+        if (epoch > now_epoch || epoch + win->nbuckets <= now_epoch)
+            continue;
+        snapshot_merge (snap, &part);
+    }
+
+    if (window == DD_STATS_WINDOW_TOTAL) {
+        snapshot_merge (snap, &s->base);
+        snap->span_ns = now_ns;
+    } else {
+        snap->span_ns = win->bucket_ns * win->nbuckets;
+    }
+    return 0;
+}
+
+double
+dd_stats_yield (const DDStatsSnapshot *snap) {
+    if (!snap || !snap->frames)
+        return 100.0;
+    return 100.0 * (double)(snap->frames - snap->defects) / (double)snap->frames;
+}
+
+double
+dd_stats_mean_density (const DDStatsSnapshot *snap) {
+    if (!snap || !snap->frames)
+        return 0.0;
+    return snap->density_sum / (double)snap->frames;
+}
+
+double
+dd_stats_hist_upper (unsigned int bin) {
+    double edge = DD_STATS_HIST_FIRST_EDGE;
+
+    if (bin >= DD_STATS_HIST_BINS - 1)
+        return -1.0;
+    while (bin--)
+        edge *= 2.0;
+    return edge;
+}
+
+const char *
+dd_stats_window_name (DDStatsWindow window) {
+    switch (window) {
+        case DD_STATS_WINDOW_1S :
+            return "1s";
+        case DD_STATS_WINDOW_1M :
+            return "1m";
+        case DD_STATS_WINDOW_1H :
+            return "1h";
+        case DD_STATS_WINDOW_TOTAL :
+            return "total";
+        default :
+            return "unknown";
+    }
+}
+
+uint64_t
+dd_stats_now_ns (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+dd_stats_load (const char *path) {
+    FILE *fp;
+    char magic[16];
+    int version;
+    unsigned int stream;
+    DDStatsSnapshot snap;
+    int ret = 0;
+
+    if (!path)
+        return -1;
+    fp = fopen (path, "r");
+    if (!fp)
+        return -1;
+
+    if (fscanf (fp, "%15s %d", magic, &version) != 2 || strcmp (magic, STATS_FILE_MAGIC)
+        || version != STATS_FILE_VERSION) {
+        fclose (fp);
+        return -1;
+    }
+
+    while (fscanf (fp, "%u", &stream) == 1) {
+        memset (&snap, 0, sizeof (snap));
+        if (fscanf (fp, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %lf %lf", &snap.frames, &snap.defects,
+                    &snap.fruit_pixels, &snap.defect_pixels, &snap.density_sum,
+                    &snap.density_max) != 6) {
+            ret = -1;
+            break;
+        }
+        for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++) {
+            if (fscanf (fp, "%" SCNu64, &snap.hist[i]) != 1)
+                ret = -1;
+        }
+        if (ret || stream >= DD_STATS_MAX_STREAMS) {
+            ret = -1;
+            break;
+        }
+        stats_stream (stream)->base = snap;
+    }
+    fclose (fp);
+    return ret;
+}
+
+int
+dd_stats_save (const char *path) {
+    FILE *fp;
+    DDStatsSnapshot snap;
+    uint64_t now = dd_stats_now_ns ();
+
+    if (!path)
+        return -1;
+    fp = fopen (path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf (fp, "%s %d\n", STATS_FILE_MAGIC, STATS_FILE_VERSION);
+    for (unsigned int stream = 0; stream < DD_STATS_MAX_STREAMS; stream++) {
+        dd_stats_snapshot (stream, DD_STATS_WINDOW_TOTAL, now, &snap);
+        if (!snap.frames)
+            continue;
+        fprintf (fp, "%u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %.17g %.17g", stream, snap.frames, snap.defects,
+                 snap.fruit_pixels, snap.defect_pixels, snap.density_sum, snap.density_max);
+        for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++)
+            fprintf (fp, " %" PRIu64, snap.hist[i]);
+        fprintf (fp, "\n");
+    }
+    return fclose (fp) ? -1 : 0;
+}
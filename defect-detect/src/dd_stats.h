@@ -0,0 +1,110 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_STATS_H
+#define DD_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DD_STATS_MAX_STREAMS         4
+#define DD_STATS_HIST_BINS           16
+/* Upper edge of histogram bin 0 in percent; every following bin doubles */
+#define DD_STATS_HIST_FIRST_EDGE     0.01
+
+typedef enum {
+    DD_STATS_WINDOW_1S,
+    DD_STATS_WINDOW_1M,
+    DD_STATS_WINDOW_1H,
+    DD_STATS_WINDOW_TOTAL,
+    DD_STATS_WINDOW_COUNT,
+} DDStatsWindow;
+
+typedef struct _DDStatsSnapshot {
+    uint64_t frames;
+    uint64_t defects;
+    uint64_t fruit_pixels;
+    uint64_t defect_pixels;
+    double   density_sum;
+    double   density_max;
+    uint64_t span_ns;
+    uint64_t hist[DD_STATS_HIST_BINS];
+} DDStatsSnapshot;
+
+/** @brief
+ *  Record the result of one inspected frame.
+ *
+ *  A stream is written by its overlay stage, or by the overlays of every
+ *  concurrent batch pipeline, which take turns on each bucket. A lone
+ *  writer never waits, whatever the readers do.
+ *
+ *  @param stream index of the stream, below DD_STATS_MAX_STREAMS.
+ *  @param ts_ns monotonic timestamp of the frame, see dd_stats_now_ns().
+ *  @param fruit_pixels number of fruit pixels reported by preprocess.
+ *  @param defect_pixels number of defect pixels reported by cca.
+ *  @param density defect density in percent.
+ *  @param defect non-zero if the frame was classified as defective.
+ */
+void dd_stats_record (unsigned int stream, uint64_t ts_ns, uint32_t fruit_pixels,
+                      uint32_t defect_pixels, double density, int defect);
+
+/** @brief
+ *  Take a consistent snapshot of one rolling window.
+ *
+ *  Any number of readers may call this concurrently with the writer.
+ *
+ *  @param stream index of the stream.
+ *  @param window which rolling window to aggregate.
+ *  @param now_ns monotonic reference time, usually dd_stats_now_ns().
+ *  @param snap filled with the aggregated counters.
+ *  @return 0 on success, -1 on invalid arguments.
+ */
+int dd_stats_snapshot (unsigned int stream, DDStatsWindow window, uint64_t now_ns,
+                       DDStatsSnapshot *snap);
+
+/* Percentage of frames without defect, 100.0 for an empty snapshot */
+double dd_stats_yield (const DDStatsSnapshot *snap);
+
+/* Mean defect density in percent, 0.0 for an empty snapshot */
+double dd_stats_mean_density (const DDStatsSnapshot *snap);
+
+/* Upper edge of histogram bin @bin in percent, the last bin is open ended */
+double dd_stats_hist_upper (unsigned int bin);
+
+const char * dd_stats_window_name (DDStatsWindow window);
+
+uint64_t dd_stats_now_ns (void);
+
+/** @brief
+ *  Persist or restore the lifetime totals of every stream.
+ *
+ *  dd_stats_load() must be called before the pipeline starts; the loaded
+ *  values are added on top of what the writer records afterwards.
+ *
+ *  @param path location of the statistics file.
+ *  @return 0 on success, -1 on I/O or format error.
+ */
+int dd_stats_load (const char *path);
+int dd_stats_save (const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DD_STATS_H */
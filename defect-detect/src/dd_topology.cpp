@@ -0,0 +1,443 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_topology.h"
+
+#include <string.h>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+static const DDStageDesc *
+find_stage (DDTopology *topo, const string &name) {
+    for (const DDStageDesc &stage : topo->registry) {
+        if (stage.name == name)
+            return &stage;
+    }
+    return NULL;
+}
+
+void
+dd_topology_register (DDTopology *topo, const gchar *name, const gchar *factory,
+                      const gchar *element_name, guint flags) {
+    DDStageDesc stage;
+    stage.name = name;
+    stage.factory = factory;
+    stage.element_name = element_name ? element_name : "";
+    stage.flags = flags;
+    topo->registry.push_back (stage);
+}
+
+static gboolean
+parse_chain (DDTopology *topo, const gchar *desc, vector<string> &chain) {
+    gchar **tokens;
+    gboolean ret = TRUE;
+
+    chain.clear ();
+    tokens = g_strsplit (desc, "!", -1);
+    for (gchar **tok = tokens; *tok; tok++) {
+        string name (g_strstrip (*tok));
+        if (name.empty ()) {
+            GST_ERROR ("Empty stage in topology \"%s\"", desc);
+            ret = FALSE;
+            break;
+        }
+        if (name != DD_STAGE_QUEUE && !find_stage (topo, name)) {
+            GST_ERROR ("Unknown stage \"%s\" in topology \"%s\"", name.c_str (), desc);
+            ret = FALSE;
+            break;
+        }
+        chain.push_back (name);
+    }
+    g_strfreev (tokens);
+
+    if (ret && chain.empty ()) {
+        GST_ERROR ("Topology is empty");
+        ret = FALSE;
+    }
+    return ret;
+}
+
+gboolean
+dd_topology_parse (DDTopology *topo, const gchar *desc) {
+    return parse_chain (topo, desc, topo->chain);
+}
+
+gboolean
+dd_topology_add_branch (DDTopology *topo, const gchar *tap, const gchar *desc, gboolean leaky) {
+    DDBranch branch;
+
+    if (!find_stage (topo, tap)) {
+        GST_ERROR ("Unknown tap stage \"%s\"", tap);
+        return FALSE;
+    }
+    if (!parse_chain (topo, desc, branch.chain))
+        return FALSE;
+    branch.tap = tap;
+    branch.leaky = leaky;
+    topo->branches.push_back (branch);
+    return TRUE;
+}
+
+gboolean
+dd_topology_add_bypass (DDTopology *topo, const gchar *from, const gchar *to) {
+    DDBypass bypass;
+
+    if (!find_stage (topo, from) || !find_stage (topo, to)) {
+        GST_ERROR ("Unknown stage in bypass %s --> %s", from, to);
+        return FALSE;
+    }
+    bypass.from = from;
+    bypass.to = to;
+    bypass.tee = NULL;
+    bypass.queue = NULL;
+    topo->bypasses.push_back (bypass);
+    return TRUE;
+}
+
+gboolean
+dd_topology_has_stage (DDTopology *topo, const gchar *name) {
+    for (const string &stage : topo->chain) {
+        if (stage == name)
+            return TRUE;
+    }
+    for (const DDBranch &branch : topo->branches) {
+        for (const string &stage : branch.chain) {
+            if (stage == name)
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/** @brief
+ *  This function will be called by the pad-added signal
+ *
+ *  mediasrcbin has sometimes pad for which pad-added signal
+ *  is required to be attached with source element.
+ *  This function will be called when pad is created and is
+ *  ready to link with peer element.
+ *
+ *  @param src The GstElement to be connected with peer element.
+ *  @param new_pad is the pad of source element which needs to be
+ *  linked.
+ *  @param peer is the element following the source in the chain.
+ *  @return Void.
+ */
+static void
+pad_added_cb (GstElement *src, GstPad *new_pad, GstElement *peer) {
+    GstPadLinkReturn ret;
+    GstPad *sink_pad = gst_element_get_static_pad (peer, "sink");
+    GST_DEBUG ("Received new pad '%s' from '%s':", GST_PAD_NAME (new_pad), GST_ELEMENT_NAME (src));
+
+    /* If our peer is already linked, we have nothing to do here */
+    if (gst_pad_is_linked (sink_pad)) {
+        GST_DEBUG ("Pad is already linked. Ignoring");
+        goto exit;
+    }
+
+    /* Attempt the link */
+    ret = gst_pad_link (new_pad, sink_pad);
+    if (GST_PAD_LINK_FAILED (ret)) {
+        GST_ERROR ("Linking failed");
+    }
+exit:
+    /* Unreference the sink pad */
+    gst_object_unref (sink_pad);
+}
+
+static gboolean
+needs_queue (DDTopology *topo, const string &prev, const DDStageDesc *stage) {
+    if (prev == DD_STAGE_QUEUE || (stage->flags & DD_STAGE_LIGHT))
+        return FALSE;
+
+    switch (topo->queue_policy) {
+        case DD_QUEUE_POLICY_BOUNDARY :
+            return (stage->flags & DD_STAGE_THREAD_BOUNDARY) != 0;
+        case DD_QUEUE_POLICY_ALL :
+            return TRUE;
+        default :
+            return FALSE;
+    }
+}
+
+static GstElement *
+make_queue (GstBin *bin, const string &next) {
+    string name = "queue-" + next;
+    GstElement *queue, *existing;
+
+    /* The same stage may be preceded by a queue more than once in a
+     * hand-written topology, keep the instance names unique */
+    for (guint i = 1; (existing = gst_bin_get_by_name (bin, name.c_str ())) != NULL; i++) {
+        gst_object_unref (existing);
+        name = "queue-" + next + "-" + to_string (i);
+    }
+    queue = gst_element_factory_make ("queue", name.c_str ());
+    if (queue)
+        gst_bin_add (bin, queue);
+    return queue;
+}
+
+/** @brief
+ *  Apply the configured policy to a queue and count its drops.
+ *
+ *  @param topo is the topology.
+ *  @param queue is the queue.
+ *  @param branch is TRUE for the queue heading a branch.
+ *  @return Void.
+ */
+static void
+monitor_queue (DDTopology *topo, GstElement *queue, gboolean branch) {
+    auto it = topo->queue_configs.find (GST_ELEMENT_NAME (queue));
+
+    if (it == topo->queue_configs.end () && !branch)
+        it = topo->queue_configs.find (DD_QUEUE_DEFAULT);
+    topo->queues.push_back (dd_queue_monitor_new (queue, it == topo->queue_configs.end () ? NULL : &it->second,
+                                                  topo->live));
+}
+
+/** @brief
+ *  Size the output pool of a stage and count its buffers, for the
+ *  stages that allocate them or have a pool config.
+ *
+ *  @param topo is the topology.
+ *  @param name is the stage name.
+ *  @param stage is the stage.
+ *  @param elem is the element of the stage.
+ *  @return Void.
+ */
+static void
+monitor_pool (DDTopology *topo, const string &name, const DDStageDesc *stage, GstElement *elem) {
+    auto it = topo->pool_configs.find (name);
+
+    if (it == topo->pool_configs.end () && !(stage->flags & DD_STAGE_ALLOCATES))
+        return;
+    topo->pools.push_back (dd_pool_monitor_new (elem, it == topo->pool_configs.end () ? NULL : &it->second));
+}
+
+static gboolean
+link_stage (GstElement *prev_elem, const DDStageDesc *prev_stage, GstElement *elem) {
+    if (prev_stage && (prev_stage->flags & DD_STAGE_DYNAMIC_SRC)) {
+        g_signal_connect (prev_elem, "pad-added", G_CALLBACK (pad_added_cb), elem);
+        return TRUE;
+    }
+    return gst_element_link (prev_elem, elem);
+}
+
+static gboolean
+build_chain (DDTopology *topo, GstBin *bin, const vector<string> &chain,
+             GstElement *prev_elem, const DDStageDesc *prev_stage, string prev);
+
+static gboolean
+build_taps (DDTopology *topo, GstBin *bin, const string &name, gboolean last,
+            GstElement **prev_elem, const DDStageDesc **prev_stage, string *prev) {
+    vector<const DDBranch *> taps;
+    vector<DDBypass *> bypasses;
+    GstElement *tee;
+
+    for (const DDBranch &branch : topo->branches) {
+        if (branch.tap == name)
+            taps.push_back (&branch);
+    }
+    for (DDBypass &bypass : topo->bypasses) {
+        if (bypass.from == name)
+            bypasses.push_back (&bypass);
+    }
+    if (taps.empty () && bypasses.empty ())
+        return TRUE;
+
+    /* A single plain output at the end of the chain is just its continuation */
+    if (last && taps.size () == 1 && !taps[0]->leaky && bypasses.empty ())
+        return build_chain (topo, bin, taps[0]->chain, *prev_elem, *prev_stage, *prev);
+
+    tee = gst_element_factory_make ("tee", ("tee-" + name).c_str ());
+    if (!tee) {
+        GST_ERROR ("could not create tee after %s", name.c_str ());
+        return FALSE;
+    }
+    gst_bin_add (bin, tee);
+    if (!link_stage (*prev_elem, *prev_stage, tee)) {
+        GST_ERROR ("Error linking %s --> tee", name.c_str ());
+        return FALSE;
+    }
+    topo->linked.push_back (tee);
+
+    for (const DDBranch *branch : taps) {
+        GstElement *queue = make_queue (bin, branch->chain[0]);
+        if (!queue) {
+            GST_ERROR ("could not create queue for branch after %s", name.c_str ());
+            return FALSE;
+        }
+        if (branch->leaky) {
+            g_object_set (G_OBJECT (queue), "leaky", 2, "max-size-buffers", DD_LEAKY_QUEUE_BUFFERS,
+                          "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+        }
+        monitor_queue (topo, queue, TRUE);
+        if (!gst_element_link (tee, queue)) {
+            GST_ERROR ("Error linking tee-%s --> queue", name.c_str ());
+            return FALSE;
+        }
+        topo->linked.push_back (queue);
+        if (!build_chain (topo, bin, branch->chain, queue, NULL, DD_STAGE_QUEUE))
+            return FALSE;
+    }
+
+    /* The far end of a bypass may not exist yet, it is linked once the
+     * whole topology is built */
+    for (DDBypass *bypass : bypasses) {
+        GstElement *queue = make_queue (bin, "bypass-" + bypass->to);
+        if (!queue) {
+            GST_ERROR ("could not create queue for bypass after %s", name.c_str ());
+            return FALSE;
+        }
+        monitor_queue (topo, queue, TRUE);
+        if (!gst_element_link (tee, queue)) {
+            GST_ERROR ("Error linking tee-%s --> queue", name.c_str ());
+            return FALSE;
+        }
+        topo->linked.push_back (queue);
+        bypass->tee = tee;
+        bypass->queue = queue;
+    }
+
+    /* The rest of the chain runs in the thread of the tap */
+    *prev_elem = tee;
+    *prev_stage = NULL;
+    *prev = "tee";
+    return TRUE;
+}
+
+static gboolean
+build_chain (DDTopology *topo, GstBin *bin, const vector<string> &chain,
+             GstElement *prev_elem, const DDStageDesc *prev_stage, string prev) {
+    for (size_t i = 0; i < chain.size (); i++) {
+        const string &name = chain[i];
+        const DDStageDesc *stage = find_stage (topo, name);
+        GstElement *elem;
+
+        if (name == DD_STAGE_QUEUE) {
+            /* Explicit queue, named after the stage it feeds */
+            string next = i + 1 < chain.size () ? chain[i + 1] : string ("end");
+            elem = make_queue (bin, next);
+            if (elem)
+                monitor_queue (topo, elem, FALSE);
+        } else {
+            if (prev_elem && needs_queue (topo, prev, stage)) {
+                GstElement *queue = make_queue (bin, name);
+                if (!queue) {
+                    GST_ERROR ("could not create queue in front of %s", name.c_str ());
+                    return FALSE;
+                }
+                monitor_queue (topo, queue, FALSE);
+                if (!link_stage (prev_elem, prev_stage, queue)) {
+                    GST_ERROR ("Error linking %s --> queue", prev.c_str ());
+                    return FALSE;
+                }
+                topo->linked.push_back (queue);
+                prev_elem = queue;
+                prev_stage = NULL;
+                prev = DD_STAGE_QUEUE;
+            }
+            if (topo->elements.count (name)) {
+                GST_ERROR ("Stage %s is used twice in the topology", name.c_str ());
+                return FALSE;
+            }
+            elem = gst_element_factory_make (stage->factory.c_str (),
+                                             stage->element_name.empty () ? NULL : stage->element_name.c_str ());
+            if (elem) {
+                gst_bin_add (bin, elem);
+                topo->elements[name] = elem;
+                monitor_pool (topo, name, stage, elem);
+            }
+        }
+        if (!elem) {
+            GST_ERROR ("could not create element for stage %s", name.c_str ());
+            return FALSE;
+        }
+
+        if (prev_elem && !link_stage (prev_elem, prev_stage, elem)) {
+            GST_ERROR ("Error linking %s --> %s", prev.c_str (), name.c_str ());
+            return FALSE;
+        }
+        topo->linked.push_back (elem);
+        prev_elem = elem;
+        prev_stage = stage;
+        prev = name;
+
+        if (!build_taps (topo, bin, name, i + 1 == chain.size (), &prev_elem, &prev_stage, &prev))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean
+dd_topology_build (DDTopology *topo, GstBin *bin) {
+    for (const DDBranch &branch : topo->branches) {
+        if (!dd_topology_has_stage (topo, branch.tap.c_str ())) {
+            GST_ERROR ("Branch tap %s is not part of the topology", branch.tap.c_str ());
+            return FALSE;
+        }
+    }
+    for (const DDBypass &bypass : topo->bypasses) {
+        if (!dd_topology_has_stage (topo, bypass.from.c_str ()) || !dd_topology_has_stage (topo, bypass.to.c_str ())) {
+            GST_ERROR ("Bypass %s --> %s is not part of the topology", bypass.from.c_str (), bypass.to.c_str ());
+            return FALSE;
+        }
+    }
+    if (!build_chain (topo, bin, topo->chain, NULL, NULL, ""))
+        return FALSE;
+    for (const DDBypass &bypass : topo->bypasses) {
+        if (!bypass.queue || !gst_element_link (bypass.queue, dd_topology_get (topo, bypass.to.c_str ()))) {
+            GST_ERROR ("Error linking bypass %s --> %s", bypass.from.c_str (), bypass.to.c_str ());
+            return FALSE;
+        }
+    }
+
+    GST_DEBUG ("Linked %s successfully", dd_topology_describe (topo).c_str ());
+    return TRUE;
+}
+
+GstElement *
+dd_topology_get (DDTopology *topo, const gchar *name) {
+    auto it = topo->elements.find (name);
+    return it == topo->elements.end () ? NULL : it->second;
+}
+
+string
+dd_topology_describe (DDTopology *topo) {
+    string desc;
+    for (GstElement *elem : topo->linked) {
+        if (!desc.empty ())
+            desc += " --> ";
+        desc += GST_ELEMENT_NAME (elem);
+    }
+    return desc;
+}
+
+gboolean
+dd_queue_policy_from_string (const gchar *str, DDQueuePolicy *policy) {
+    if (!g_strcmp0 (str, "none"))
+        *policy = DD_QUEUE_POLICY_NONE;
+    else if (!g_strcmp0 (str, "boundary"))
+        *policy = DD_QUEUE_POLICY_BOUNDARY;
+    else if (!g_strcmp0 (str, "all"))
+        *policy = DD_QUEUE_POLICY_ALL;
+    else
+        return FALSE;
+    return TRUE;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_TOPOLOGY_H
+#define DD_TOPOLOGY_H
+
+#include <gst/gst.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dd_pool.h"
+#include "dd_queue.h"
+
+/* Stage flags */
+#define DD_STAGE_THREAD_BOUNDARY  (1 << 0)  /* gets its own streaming thread under the boundary policy */
+#define DD_STAGE_LIGHT            (1 << 1)  /* cheap element, never worth a queue in front of it */
+#define DD_STAGE_DYNAMIC_SRC      (1 << 2)  /* source pad appears later through pad-added */
+#define DD_STAGE_ALLOCATES        (1 << 3)  /* allocates its output buffers, its pool is watched */
+
+/* Reserved stage name for an explicit queue in a topology description */
+#define DD_STAGE_QUEUE            "queue"
+
+/* Queue depth of leaky branches, in buffers */
+#define DD_LEAKY_QUEUE_BUFFERS    4
+
+typedef enum {
+    DD_QUEUE_POLICY_NONE,       /* only queues written in the description */
+    DD_QUEUE_POLICY_BOUNDARY,   /* plus one in front of every thread boundary stage */
+    DD_QUEUE_POLICY_ALL,        /* plus one in front of every non-light stage */
+} DDQueuePolicy;
+
+typedef struct _DDStageDesc {
+    std::string name;           /* name used in the topology description */
+    std::string factory;        /* GStreamer element factory */
+    std::string element_name;   /* element instance name, empty for automatic */
+    guint flags;
+} DDStageDesc;
+
+/* Side chain fed by a tee placed after the @tap stage */
+typedef struct _DDBranch {
+    std::string tap;
+    std::vector<std::string> chain;
+    gboolean leaky;             /* drop old buffers instead of throttling the tap */
+} DDBranch;
+
+/* Path from a tee after the @from stage straight into the @to stage,
+ * which takes several inputs, skipping the stages in between */
+typedef struct _DDBypass {
+    std::string from;
+    std::string to;
+    /* Filled by dd_topology_build () */
+    GstElement *tee;
+    GstElement *queue;
+} DDBypass;
+
+typedef struct _DDTopology {
+    std::vector<DDStageDesc> registry;
+    std::vector<std::string> chain;
+    std::vector<DDBranch> branches;
+    std::vector<DDBypass> bypasses;
+    DDQueuePolicy queue_policy;
+    /* Queue policies by queue name; DD_QUEUE_DEFAULT applies to the
+     * queues of the chain, branch queues keep their own unless named */
+    std::map<std::string, DDQueueConfig> queue_configs;
+    /* Output pool configs by stage name */
+    std::map<std::string, DDPoolConfig> pool_configs;
+    gboolean live;              /* buffer timestamps follow the clock, enables max_age_ms */
+    /* Filled by dd_topology_build () */
+    std::map<std::string, GstElement *> elements;
+    std::vector<GstElement *> linked;
+    std::vector<DDQueueMonitor *> queues;
+    std::vector<DDPoolMonitor *> pools;
+} DDTopology;
+
+/** @brief
+ *  Make a stage known to the topology.
+ *
+ *  Registering a stage does not create anything; only the stages named
+ *  in the parsed description are instantiated by dd_topology_build ().
+ *
+ *  @param topo is the topology.
+ *  @param name is the name of the stage in the description.
+ *  @param factory is the element factory to instantiate.
+ *  @param element_name is the element instance name or NULL.
+ *  @param flags is a combination of the DD_STAGE_* flags.
+ *  @return Void.
+ */
+void dd_topology_register (DDTopology *topo, const gchar *name, const gchar *factory,
+                           const gchar *element_name, guint flags);
+
+/** @brief
+ *  Parse a linear topology description.
+ *
+ *  The description lists stage names separated by '!', in the same way
+ *  as gst-launch, e.g. "src ! caps ! otsu ! queue ! preprocess ! sink".
+ *
+ *  @param topo is the topology.
+ *  @param desc is the description.
+ *  @return TRUE if every stage is registered, FALSE otherwise.
+ */
+gboolean dd_topology_parse (DDTopology *topo, const gchar *desc);
+
+/** @brief
+ *  Attach an output branch to a stage of the chain.
+ *
+ *  Every branch gets its own queue behind a tee; a leaky branch drops
+ *  its oldest buffers when it cannot keep up so it never throttles the
+ *  stages in front of the tee. When the tap is the last stage of the
+ *  chain and the only non-leaky branch, it is linked without a tee.
+ *
+ *  @param topo is the topology.
+ *  @param tap is the stage whose output feeds the branch.
+ *  @param desc is the description of the branch, in the chain syntax.
+ *  @param leaky is TRUE for side branches such as dumps.
+ *  @return TRUE if every stage is registered, FALSE otherwise.
+ */
+gboolean dd_topology_add_branch (DDTopology *topo, const gchar *tap, const gchar *desc,
+                                 gboolean leaky);
+
+/** @brief
+ *  Let buffers skip the stages between two stages of the topology.
+ *
+ *  A tee after @from feeds both the rest of the chain and a queue
+ *  linked to a request pad of @to, e.g. a funnel. What each buffer
+ *  takes is up to pad probes on the tee; with none it takes both.
+ *
+ *  @param topo is the topology.
+ *  @param from is a stage of the chain.
+ *  @param to is a later stage, of the chain or of a branch.
+ *  @return TRUE if both stages are registered, FALSE otherwise.
+ */
+gboolean dd_topology_add_bypass (DDTopology *topo, const gchar *from, const gchar *to);
+
+/* TRUE if @name is part of the parsed chain */
+gboolean dd_topology_has_stage (DDTopology *topo, const gchar *name);
+
+/** @brief
+ *  Instantiate, add and link the parsed chain and its branches into @bin.
+ *
+ *  Queues are inserted according to the queue policy. Sources with
+ *  dynamic pads are linked when their pad appears.
+ *
+ *  @param topo is the topology.
+ *  @param bin is the bin the elements are added to.
+ *  @return TRUE on success, FALSE if an element could not be created or linked.
+ */
+gboolean dd_topology_build (DDTopology *topo, GstBin *bin);
+
+/* Element instantiated for stage @name, NULL if the stage is not in the chain */
+GstElement * dd_topology_get (DDTopology *topo, const gchar *name);
+
+/* Human readable "a --> b --> c" form of the linked chain, including queues */
+std::string dd_topology_describe (DDTopology *topo);
+
+gboolean dd_queue_policy_from_string (const gchar *str, DDQueuePolicy *policy);
+
+#endif /* DD_TOPOLOGY_H */
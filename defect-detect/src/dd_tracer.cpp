@@ -0,0 +1,347 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_tracer.h"
+
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+GST_DEBUG_CATEGORY_EXTERN (defectdetect_app);
+#define GST_CAT_DEFAULT defectdetect_app
+
+/* Log-linear histogram: every power of two is split in 2^HIST_SUB_BITS
+ * buckets, i.e. values are kept within 1/16 = 6.25 %, up to 2^HIST_MAX_LOG2 ns */
+#define HIST_SUB_BITS      4
+#define HIST_SUB_COUNT     (1 << HIST_SUB_BITS)
+#define HIST_MAX_LOG2      40
+#define HIST_BUCKETS       ((HIST_MAX_LOG2 - HIST_SUB_BITS + 2) * HIST_SUB_COUNT)
+
+/* Buffers remembered per queue, above the default queue depth of 200 */
+#define QUEUE_RING_SIZE    256
+
+/* Nested pushes followed per thread; a chain is rarely deeper than a few */
+#define MAX_PUSH_DEPTH     32
+
+typedef struct _Histogram {
+    atomic<guint64> count;
+    atomic<guint64> sum;
+    atomic<guint64> max;
+    atomic<guint64> buckets[HIST_BUCKETS];
+} Histogram;
+
+/* Enqueue times of the buffers held by a queue; the upstream thread
+ * produces, the queue thread consumes. Pool buffers come back at the same
+ * address, so a buffer is known by its address, PTS and offset: the entry
+ * of one a leaky queue dropped never matches the next frame in it. */
+typedef struct _QueueRing {
+    GstBuffer *buf[QUEUE_RING_SIZE];
+    GstClockTime pts[QUEUE_RING_SIZE];
+    guint64 offset[QUEUE_RING_SIZE];
+    guint64 ts[QUEUE_RING_SIZE];
+    atomic<guint> head;
+    atomic<guint> tail;
+} QueueRing;
+
+typedef struct _StageTrace {
+    string name;
+    Histogram service;
+    Histogram wait;
+    QueueRing *ring;            /* only for queues */
+} StageTrace;
+
+typedef struct _PushFrame {
+    StageTrace *stage;          /* receiving element, NULL when not watched */
+    guint64 start;
+    guint64 child;              /* time spent in nested pushes */
+} PushFrame;
+
+typedef struct _DDLatencyTracer {
+    GstTracer parent;
+} DDLatencyTracer;
+
+typedef struct _DDLatencyTracerClass {
+    GstTracerClass parent_class;
+} DDLatencyTracerClass;
+
+G_DEFINE_TYPE (DDLatencyTracer, dd_latency_tracer, GST_TYPE_TRACER);
+
+static GstTracer *tracer;
+static GQuark stage_quark;
+static mutex stages_lock;
+static vector<StageTrace *> stages;
+
+static thread_local PushFrame push_stack[MAX_PUSH_DEPTH];
+static thread_local guint push_depth;
+
+static guint
+hist_bucket (guint64 v) {
+    guint msb, shift, b;
+
+    if (v < HIST_SUB_COUNT)
+        return (guint) v;
+    msb = 63 - __builtin_clzll (v);
+    shift = msb - HIST_SUB_BITS;
+    b = (shift + 1) * HIST_SUB_COUNT + (guint) ((v >> shift) & (HIST_SUB_COUNT - 1));
+    return MIN (b, HIST_BUCKETS - 1);
+}
+
+/* Middle of the range of values that land in bucket @b */
+static gdouble
+hist_value (guint b) {
+    guint shift;
+
+    if (b < HIST_SUB_COUNT)
+        return b;
+    shift = b / HIST_SUB_COUNT - 1;
+    return (gdouble) ((guint64) (HIST_SUB_COUNT + b % HIST_SUB_COUNT) << shift) +
+           (gdouble) ((guint64) 1 << shift) / 2;
+}
+
+static void
+hist_record (Histogram *h, guint64 v) {
+    guint64 max = h->max.load (memory_order_relaxed);
+
+    h->buckets[hist_bucket (v)].fetch_add (1, memory_order_relaxed);
+    h->sum.fetch_add (v, memory_order_relaxed);
+    h->count.fetch_add (1, memory_order_relaxed);
+    while (v > max && !h->max.compare_exchange_weak (max, v, memory_order_relaxed))
+        ;
+}
+
+static void
+hist_reset (Histogram *h) {
+    h->count.store (0, memory_order_relaxed);
+    h->sum.store (0, memory_order_relaxed);
+    h->max.store (0, memory_order_relaxed);
+    for (guint b = 0; b < HIST_BUCKETS; b++)
+        h->buckets[b].store (0, memory_order_relaxed);
+}
+
+static DDLatencySummary
+hist_summarize (Histogram *h) {
+    DDLatencySummary s = DDLatencySummary ();
+    const gdouble q[3] = { 0.50, 0.90, 0.99 };
+    gdouble *out[3] = { &s.p50, &s.p90, &s.p99 };
+    guint64 counts[HIST_BUCKETS];
+    guint64 seen = 0, total = 0, n;
+    guint qi = 0;
+
+    /* Buckets are read one by one while writers go on, the quantiles
+     * are taken against the sum of what was actually read */
+    for (guint b = 0; b < HIST_BUCKETS; b++) {
+        counts[b] = h->buckets[b].load (memory_order_relaxed);
+        total += counts[b];
+    }
+    if (!total)
+        return s;
+
+    s.count = total;
+    n = h->count.load (memory_order_relaxed);
+    s.mean = n ? (gdouble) h->sum.load (memory_order_relaxed) / n / 1e6 : 0;
+    s.max = h->max.load (memory_order_relaxed) / 1e6;
+    for (guint b = 0; b < HIST_BUCKETS && qi < 3; b++) {
+        seen += counts[b];
+        while (qi < 3 && seen >= q[qi] * total) {
+            *out[qi] = MIN (hist_value (b) / 1e6, s.max);
+            qi++;
+        }
+    }
+    return s;
+}
+
+static void
+ring_push (QueueRing *ring, GstBuffer *buf, guint64 ts) {
+    guint head = ring->head.load (memory_order_relaxed);
+
+    /* Deeper than the ring, the buffer just goes unmeasured */
+    if (head - ring->tail.load (memory_order_acquire) >= QUEUE_RING_SIZE)
+        return;
+    ring->buf[head % QUEUE_RING_SIZE] = buf;
+    ring->pts[head % QUEUE_RING_SIZE] = GST_BUFFER_PTS (buf);
+    ring->offset[head % QUEUE_RING_SIZE] = GST_BUFFER_OFFSET (buf);
+    ring->ts[head % QUEUE_RING_SIZE] = ts;
+    ring->head.store (head + 1, memory_order_release);
+}
+
+static gboolean
+ring_pop (QueueRing *ring, GstBuffer *buf, guint64 *ts) {
+    guint tail = ring->tail.load (memory_order_relaxed);
+    guint head = ring->head.load (memory_order_acquire);
+
+    /* Entries older than @buf were dropped by a leaky queue */
+    for (guint i = tail; i != head; i++) {
+        if (ring->buf[i % QUEUE_RING_SIZE] == buf && ring->pts[i % QUEUE_RING_SIZE] == GST_BUFFER_PTS (buf) &&
+            ring->offset[i % QUEUE_RING_SIZE] == GST_BUFFER_OFFSET (buf)) {
+            *ts = ring->ts[i % QUEUE_RING_SIZE];
+            ring->tail.store (i + 1, memory_order_release);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static StageTrace *
+element_stage (GstObject *obj) {
+    if (!obj || !GST_IS_ELEMENT (obj))
+        return NULL;
+    return (StageTrace *) g_object_get_qdata (G_OBJECT (obj), stage_quark);
+}
+
+static void
+push_pre (GObject *self, GstClockTime ts, GstPad *pad, GstBuffer *buf) {
+    GstPad *peer = GST_PAD_PEER (pad);
+    StageTrace *from = element_stage (GST_OBJECT_PARENT (pad));
+    StageTrace *to = peer ? element_stage (GST_OBJECT_PARENT (peer)) : NULL;
+    guint64 enq;
+
+    if (buf) {
+        /* Leaving a queue, in the thread of the queue */
+        if (from && from->ring && ring_pop (from->ring, buf, &enq) && to)
+            hist_record (&to->wait, ts - enq);
+        /* Entering a queue, in the thread upstream of it */
+        if (to && to->ring)
+            ring_push (to->ring, buf, ts);
+    }
+
+    if (push_depth < MAX_PUSH_DEPTH) {
+        PushFrame *frame = &push_stack[push_depth];
+        frame->stage = to;
+        frame->start = ts;
+        frame->child = 0;
+    }
+    push_depth++;
+}
+
+static void
+push_post (GObject *self, GstClockTime ts, GstPad *pad, GstFlowReturn res) {
+    PushFrame *frame;
+    guint64 elapsed;
+
+    if (!push_depth)
+        return;
+    push_depth--;
+    if (push_depth >= MAX_PUSH_DEPTH)
+        return;
+
+    frame = &push_stack[push_depth];
+    elapsed = ts - frame->start;
+    if (frame->stage && res == GST_FLOW_OK)
+        hist_record (&frame->stage->service, elapsed - MIN (frame->child, elapsed));
+    if (push_depth)
+        push_stack[push_depth - 1].child += elapsed;
+}
+
+static void
+push_list_pre (GObject *self, GstClockTime ts, GstPad *pad, GstBufferList *list) {
+    push_pre (self, ts, pad, NULL);
+}
+
+static void
+dd_latency_tracer_class_init (DDLatencyTracerClass *klass) {
+}
+
+static void
+dd_latency_tracer_init (DDLatencyTracer *self) {
+    GstTracer *t = GST_TRACER (self);
+
+    gst_tracing_register_hook (t, "pad-push-pre", G_CALLBACK (push_pre));
+    gst_tracing_register_hook (t, "pad-push-post", G_CALLBACK (push_post));
+    /* Lists carry no single buffer but keep the nesting balanced */
+    gst_tracing_register_hook (t, "pad-push-list-pre", G_CALLBACK (push_list_pre));
+    gst_tracing_register_hook (t, "pad-push-list-post", G_CALLBACK (push_post));
+}
+
+gboolean
+dd_tracer_enable (void) {
+    if (tracer)
+        return TRUE;
+    stage_quark = g_quark_from_static_string ("dd-trace-stage");
+    tracer = (GstTracer *) g_object_new (dd_latency_tracer_get_type (), NULL);
+    if (!tracer)
+        return FALSE;
+    /* Kept for the lifetime of the process, hooks cannot be removed */
+    gst_object_ref_sink (tracer);
+    GST_DEBUG ("Latency tracer enabled");
+    return TRUE;
+}
+
+gboolean
+dd_tracer_enabled (void) {
+    return tracer != NULL;
+}
+
+void
+dd_tracer_watch (DDTopology *topo) {
+    if (!tracer)
+        return;
+
+    lock_guard<mutex> guard (stages_lock);
+    for (GstElement *elem : topo->linked) {
+        GstElementFactory *factory = gst_element_get_factory (elem);
+        StageTrace *stage;
+
+        if (g_object_get_qdata (G_OBJECT (elem), stage_quark))
+            continue;
+        stage = new StageTrace ();
+        stage->name = GST_ELEMENT_NAME (elem);
+        if (factory && !g_strcmp0 (GST_OBJECT_NAME (factory), "queue"))
+            stage->ring = new QueueRing ();
+        stages.push_back (stage);
+        g_object_set_qdata (G_OBJECT (elem), stage_quark, stage);
+    }
+}
+
+void
+dd_tracer_reset (void) {
+    lock_guard<mutex> guard (stages_lock);
+    for (StageTrace *stage : stages) {
+        hist_reset (&stage->service);
+        hist_reset (&stage->wait);
+    }
+}
+
+vector<DDTraceStage>
+dd_tracer_summarize (void) {
+    vector<DDTraceStage> out;
+
+    lock_guard<mutex> guard (stages_lock);
+    for (StageTrace *stage : stages) {
+        DDTraceStage s;
+        s.name = stage->name;
+        s.service = hist_summarize (&stage->service);
+        s.wait = hist_summarize (&stage->wait);
+        if (s.service.count || s.wait.count)
+            out.push_back (s);
+    }
+    return out;
+}
+
+void
+dd_tracer_dump (FILE *fp) {
+    vector<DDTraceStage> summary = dd_tracer_summarize ();
+
+    fprintf (fp, "Stage latency (ms)        %10s %8s %8s %8s %8s | %8s %8s %8s %8s\n",
+             "buffers", "service", "p50", "p99", "max", "wait", "p50", "p99", "max");
+    for (const DDTraceStage &s : summary) {
+        fprintf (fp, "  %-23s %10" G_GUINT64_FORMAT " %8.3lf %8.3lf %8.3lf %8.3lf | %8.3lf %8.3lf %8.3lf %8.3lf\n",
+                 s.name.c_str (), s.service.count, s.service.mean, s.service.p50, s.service.p99,
+                 s.service.max, s.wait.mean, s.wait.p50, s.wait.p99, s.wait.max);
+    }
+    fflush (fp);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_TRACER_H
+#define DD_TRACER_H
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "dd_topology.h"
+
+/* Environment variable enabling the tracer without the command line option */
+#define DD_TRACE_ENV   "DD_TRACE"
+
+/* Latency distribution, all values in milliseconds */
+typedef struct _DDLatencySummary {
+    guint64 count;
+    gdouble mean, p50, p90, p99, max;
+} DDLatencySummary;
+
+typedef struct _DDTraceStage {
+    std::string name;
+    DDLatencySummary service;   /* time spent in the element itself */
+    DDLatencySummary wait;      /* time spent in the queue in front of it */
+} DDTraceStage;
+
+/** @brief
+ *  Install the per-stage latency tracer.
+ *
+ *  The tracer hooks into the pad push of every element of the process
+ *  through the GStreamer tracing subsystem. Nothing is hooked until this
+ *  is called, so a disabled tracer costs nothing in the streaming threads.
+ *  Calling it more than once has no further effect.
+ *
+ *  @return TRUE if the tracer is active.
+ */
+gboolean dd_tracer_enable (void);
+
+gboolean dd_tracer_enabled (void);
+
+/** @brief
+ *  Start collecting histograms for the linked elements of a topology.
+ *
+ *  The service time of an element is the time it spends handling a
+ *  buffer, excluding the time spent downstream of it in the same thread.
+ *  The wait time is the time the buffer spent in the queue right in
+ *  front of the element.
+ *
+ *  @param topo is the built topology.
+ *  @return Void.
+ */
+void dd_tracer_watch (DDTopology *topo);
+
+/* Clear the histograms, e.g. at the end of a warm-up */
+void dd_tracer_reset (void);
+
+/* Summaries of the watched elements in link order, safe while running */
+std::vector<DDTraceStage> dd_tracer_summarize (void);
+
+/* Print the summaries as a table */
+void dd_tracer_dump (FILE *fp);
+
+#endif /* DD_TRACER_H */
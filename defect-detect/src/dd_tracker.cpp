@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_tracker.h"
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+#define DEFAULT_MAX_DISTANCE      8.0f
+#define DEFAULT_MAX_AREA_RATIO    2.0f
+#define DEFAULT_MAX_MISSED        3
+#define DEFAULT_MIN_AREA          4
+
+typedef struct _Track {
+    guint32 id;
+    gfloat x, y;
+    gfloat vx, vy;
+    guint area;
+    guint age;                  /* frames seen */
+    guint missed;               /* frames unseen since the last one */
+    gboolean inspected;
+} Track;
+
+struct _DDTracker {
+    DDTrackerConfig config;
+    gfloat cx, cy;              /* center of the view */
+    gfloat width, height;
+    guint32 next_id;
+    vector<Track> tracks;
+    atomic<guint64> fruits;
+    atomic<guint64> inspected;
+    atomic<guint64> lost;
+};
+
+void
+dd_tracker_config_default (DDTrackerConfig *config) {
+    config->max_distance = DEFAULT_MAX_DISTANCE;
+    config->max_area_ratio = DEFAULT_MAX_AREA_RATIO;
+    config->max_missed = DEFAULT_MAX_MISSED;
+    config->min_area = DEFAULT_MIN_AREA;
+}
+
+DDTracker *
+dd_tracker_new (const DDTrackerConfig *config, guint grid_width, guint grid_height) {
+    DDTracker *t = new DDTracker ();
+
+    t->config = *config;
+    t->config.max_area_ratio = MAX (t->config.max_area_ratio, 1.0f);
+    t->width = grid_width;
+    t->height = grid_height;
+    t->cx = grid_width / 2.0f;
+    t->cy = grid_height / 2.0f;
+    t->next_id = 1;
+    return t;
+}
+
+static gfloat
+center_distance (DDTracker *t, gfloat x, gfloat y) {
+    return hypotf (x - t->cx, y - t->cy);
+}
+
+/* TRUE if this is the frame where the fruit is the most centered */
+static gboolean
+best_frame (DDTracker *t, const Track *track) {
+    gfloat nx = track->x + track->vx, ny = track->y + track->vy;
+
+    /* The speed is only known from the second frame on */
+    if (track->age < 2)
+        return FALSE;
+    /* About to leave the view, or moving away from the center */
+    if (nx < 0 || ny < 0 || nx >= t->width || ny >= t->height)
+        return TRUE;
+    return center_distance (t, track->x, track->y) <= center_distance (t, nx, ny);
+}
+
+void
+dd_tracker_update (DDTracker *t, const vector<DDBlob> &blobs, vector<guint32> &inspect) {
+    vector<const DDBlob *> order;
+    vector<gboolean> matched (t->tracks.size (), FALSE);
+
+    inspect.clear ();
+    for (const DDBlob &blob : blobs) {
+        if (blob.area >= t->config.min_area)
+            order.push_back (&blob);
+    }
+    /* Large blobs first, they are the least likely to be noise */
+    sort (order.begin (), order.end (), [] (const DDBlob *a, const DDBlob *b) { return a->area > b->area; });
+
+    for (const DDBlob *blob : order) {
+        gfloat best = t->config.max_distance;
+        gint found = -1;
+
+        for (size_t i = 0; i < t->tracks.size (); i++) {
+            const Track &track = t->tracks[i];
+            gfloat ratio = track.area > blob->area ? (gfloat) track.area / blob->area : (gfloat) blob->area / track.area;
+            gfloat d;
+
+            if (matched[i] || ratio > t->config.max_area_ratio)
+                continue;
+            /* Compared with where the fruit should be by now */
+            d = hypotf (blob->x - (track.x + track.vx * (track.missed + 1)),
+                        blob->y - (track.y + track.vy * (track.missed + 1)));
+            if (d <= best) {
+                best = d;
+                found = i;
+            }
+        }
+        if (found >= 0) {
+            Track &track = t->tracks[found];
+            gfloat vx = (blob->x - track.x) / (track.missed + 1), vy = (blob->y - track.y) / (track.missed + 1);
+            /* Smooth the speed, blob centroids jitter with the sampling */
+            track.vx = track.age > 1 ? (track.vx + vx) / 2 : vx;
+            track.vy = track.age > 1 ? (track.vy + vy) / 2 : vy;
+            track.x = blob->x;
+            track.y = blob->y;
+            track.area = blob->area;
+            track.age++;
+            track.missed = 0;
+            matched[found] = TRUE;
+        } else {
+            Track track = Track ();
+            track.id = t->next_id++;
+            if (!t->next_id)
+                t->next_id = 1;
+            track.x = blob->x;
+            track.y = blob->y;
+            track.area = blob->area;
+            track.age = 1;
+            t->tracks.push_back (track);
+            matched.push_back (TRUE);
+            t->fruits.fetch_add (1, memory_order_relaxed);
+        }
+    }
+
+    for (size_t i = 0; i < t->tracks.size (); ) {
+        Track &track = t->tracks[i];
+
+        if (!matched[i] && ++track.missed > t->config.max_missed) {
+            if (!track.inspected)
+                t->lost.fetch_add (1, memory_order_relaxed);
+            t->tracks.erase (t->tracks.begin () + i);
+            matched.erase (matched.begin () + i);
+            continue;
+        }
+        if (matched[i] && !track.inspected && best_frame (t, &track)) {
+            track.inspected = TRUE;
+            inspect.push_back (track.id);
+            t->inspected.fetch_add (1, memory_order_relaxed);
+        }
+        i++;
+    }
+}
+
+void
+dd_tracker_stats (DDTracker *t, DDTrackerStats *stats) {
+    stats->fruits    = t->fruits.load (memory_order_relaxed);
+    stats->inspected = t->inspected.load (memory_order_relaxed);
+    stats->lost      = t->lost.load (memory_order_relaxed);
+}
+
+void
+dd_tracker_free (DDTracker *t) {
+    delete t;
+}
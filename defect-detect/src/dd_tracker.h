@@ -0,0 +1,76 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_TRACKER_H
+#define DD_TRACKER_H
+
+#include <glib.h>
+#include <vector>
+
+/* A fruit found in one frame, in the coordinates of the sampling grid */
+typedef struct _DDBlob {
+    gfloat x, y;                /* centroid */
+    guint area;                 /* samples */
+} DDBlob;
+
+typedef struct _DDTrackerConfig {
+    gfloat max_distance;        /* largest move between two frames, in samples */
+    gfloat max_area_ratio;      /* largest area change between two frames */
+    guint max_missed;           /* frames a fruit may go unseen before its track ends */
+    guint min_area;             /* smaller blobs are noise */
+} DDTrackerConfig;
+
+typedef struct _DDTrackerStats {
+    guint64 fruits;             /* tracks started */
+    guint64 inspected;          /* tracks sent for inspection */
+    guint64 lost;               /* tracks ended before being inspected */
+} DDTrackerStats;
+
+typedef struct _DDTracker DDTracker;
+
+/** @brief
+ *  Follow fruits across frames by the centroid and area of their blobs.
+ *
+ *  Each fruit is inspected once, in the frame where it is closest to
+ *  the center of the view: the first frame whose centroid is closer to
+ *  the center than the position expected in the next frame, from the
+ *  speed of the fruit so far.
+ *
+ *  @param config is the tracker configuration, copied.
+ *  @param grid_width is the width of the sampling grid.
+ *  @param grid_height is the height of the sampling grid.
+ *  @return the tracker.
+ */
+DDTracker * dd_tracker_new (const DDTrackerConfig *config, guint grid_width, guint grid_height);
+
+/** @brief
+ *  Associate the blobs of a new frame with the fruits being tracked.
+ *
+ *  @param tracker is the tracker.
+ *  @param blobs are the blobs of the frame.
+ *  @param inspect is filled with the IDs of the fruits to inspect in this frame.
+ *  @return Void.
+ */
+void dd_tracker_update (DDTracker *tracker, const std::vector<DDBlob> &blobs, std::vector<guint32> &inspect);
+
+/* Read the counters; safe from any thread */
+void dd_tracker_stats (DDTracker *tracker, DDTrackerStats *stats);
+
+void dd_tracker_config_default (DDTrackerConfig *config);
+
+void dd_tracker_free (DDTracker *tracker);
+
+#endif /* DD_TRACKER_H */
@@ -0,0 +1,338 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dd_workers.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct _DDWorkGroup {
+    atomic<unsigned int> outstanding;
+    mutex lock;
+    condition_variable done;
+};
+
+struct WorkTask {
+    DDWorkFunc func;
+    void *user_data;
+    DDWorkGroup *group;
+};
+
+struct Worker {
+    mutex lock;
+    deque<WorkTask> tasks;      /* the owner takes from the back, thieves from the front */
+    int cpu;                    /* pinned to, -1 if not */
+};
+
+struct WorkPool {
+    vector<Worker *> workers;
+    atomic<unsigned int> queued;    /* tasks in every queue */
+    atomic<unsigned int> sleeping;
+    atomic<unsigned int> next;      /* queue of the next task without a hint */
+    mutex idle_lock;
+    condition_variable idle;
+    atomic<uint64_t> tasks;
+    atomic<uint64_t> steals;
+    atomic<uint64_t> helped;
+    atomic<uint64_t> sleeps;
+};
+
+/* A band of dd_workers_parallel_rows() */
+struct RowsTask {
+    DDRowsFunc func;
+    void *user_data;
+    unsigned int band;
+    unsigned int first_row;
+    unsigned int end_row;
+};
+
+static mutex pool_lock;
+static atomic<WorkPool *> pool (NULL);
+static atomic<unsigned int> max_bands (0);
+
+/* Index of the worker of the calling thread, -1 outside the pool */
+static thread_local int self = -1;
+
+/** @brief
+ *  Take a task: from the back of the caller's own queue first, where the
+ *  tasks it queued last are still in cache, then from the front of the
+ *  others, oldest first.
+ *
+ *  @param p is the pool.
+ *  @param task is filled with the task.
+ *  @return true if a task was taken.
+ */
+static bool
+take_task (WorkPool *p, WorkTask *task) {
+    unsigned int n = p->workers.size ();
+    unsigned int start = self >= 0 ? self : p->next.load (memory_order_relaxed);
+
+    if (!p->queued.load ())
+        return false;
+    if (self >= 0) {
+        Worker *w = p->workers[self];
+        lock_guard<mutex> guard (w->lock);
+
+        if (!w->tasks.empty ()) {
+            *task = w->tasks.back ();
+            w->tasks.pop_back ();
+            p->queued.fetch_sub (1);
+            return true;
+        }
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int victim = (start + i) % n;
+        Worker *w = p->workers[victim];
+
+        if ((int) victim == self)
+            continue;
+        lock_guard<mutex> guard (w->lock);
+        if (!w->tasks.empty ()) {
+            *task = w->tasks.front ();
+            w->tasks.pop_front ();
+            p->queued.fetch_sub (1);
+            /* Callers outside the pool own no queue, they always help */
+            if (self >= 0)
+                p->steals.fetch_add (1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+run_task (WorkPool *p, const WorkTask *task) {
+    DDWorkGroup *group = task->group;
+
+    task->func (task->user_data);
+    p->tasks.fetch_add (1, memory_order_relaxed);
+
+    /* The waiter may free the group as soon as it sees the last task done,
+     * which it only checks under the group lock */
+    lock_guard<mutex> guard (group->lock);
+    if (group->outstanding.fetch_sub (1) == 1)
+        group->done.notify_all ();
+}
+
+static void
+worker_main (WorkPool *p, int index) {
+    Worker *w = p->workers[index];
+    WorkTask task;
+    unsigned int tries = 0;
+
+    self = index;
+    if (w->cpu >= 0) {
+        cpu_set_t cpus;
+
+        CPU_ZERO (&cpus);
+        CPU_SET (w->cpu, &cpus);
+        pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+    }
+
+    for (;;) {
+        if (take_task (p, &task)) {
+            run_task (p, &task);
+            tries = 0;
+            continue;
+        }
+        /* Stay awake a little for the next band, then sleep until a task
+         * is queued */
+        if (++tries < DD_WORKERS_SPIN) {
+            sched_yield ();
+            continue;
+        }
+        tries = 0;
+        p->sleeps.fetch_add (1, memory_order_relaxed);
+        unique_lock<mutex> guard (p->idle_lock);
+        p->sleeping.fetch_add (1);
+        p->idle.wait (guard, [p] { return p->queued.load () > 0; });
+        p->sleeping.fetch_sub (1);
+    }
+}
+
+static WorkPool *
+get_pool (unsigned int workers) {
+    WorkPool *p = pool.load (memory_order_acquire);
+    vector<int> allowed;
+    cpu_set_t cpus;
+
+    if (p)
+        return p;
+
+    lock_guard<mutex> guard (pool_lock);
+    p = pool.load (memory_order_relaxed);
+    if (p)
+        return p;
+
+    if (!sched_getaffinity (0, sizeof (cpus), &cpus)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET (cpu, &cpus))
+                allowed.push_back (cpu);
+        }
+    }
+    if (!workers)
+        workers = allowed.size () > 1 ? allowed.size () - 1 : 1;
+
+    p = new WorkPool ();
+    for (unsigned int i = 0; i < workers; i++) {
+        Worker *w = new Worker ();
+        /* The first allowed CPU is left to the creating thread */
+        w->cpu = allowed.size () > 1 ? allowed[(i + 1) % allowed.size ()] : -1;
+        p->workers.push_back (w);
+    }
+    /* The workers live as long as the process, idle ones sleep */
+    for (unsigned int i = 0; i < workers; i++)
+        thread (worker_main, p, (int) i).detach ();
+    pool.store (p, memory_order_release);
+    return p;
+}
+
+unsigned int
+dd_workers_init (unsigned int workers) {
+    return get_pool (workers)->workers.size ();
+}
+
+DDWorkGroup *
+dd_work_group_new (void) {
+    DDWorkGroup *group = new DDWorkGroup ();
+
+    group->outstanding = 0;
+    return group;
+}
+
+void
+dd_work_group_submit (DDWorkGroup *group, DDWorkFunc func, void *user_data, int hint) {
+    WorkPool *p = get_pool (0);
+    unsigned int n = p->workers.size ();
+    Worker *w;
+
+    if (hint >= 0)
+        w = p->workers[hint % n];
+    else if (self >= 0)
+        w = p->workers[self];
+    else
+        w = p->workers[p->next.fetch_add (1, memory_order_relaxed) % n];
+
+    group->outstanding.fetch_add (1);
+    {
+        lock_guard<mutex> guard (w->lock);
+        w->tasks.push_back ({ func, user_data, group });
+    }
+    p->queued.fetch_add (1);
+
+    /* A worker going to sleep counts itself before it checks the queues */
+    if (p->sleeping.load ()) {
+        lock_guard<mutex> guard (p->idle_lock);
+        p->idle.notify_one ();
+    }
+}
+
+void
+dd_work_group_wait (DDWorkGroup *group) {
+    WorkPool *p = pool.load (memory_order_acquire);
+    WorkTask task;
+
+    while (p && group->outstanding.load ()) {
+        if (take_task (p, &task)) {
+            p->helped.fetch_add (1, memory_order_relaxed);
+            run_task (p, &task);
+            continue;
+        }
+        /* Nothing left to help with: the rest of the group is running */
+        unique_lock<mutex> guard (group->lock);
+        group->done.wait (guard, [group] { return !group->outstanding.load (); });
+    }
+    /* The last task notifies under the lock, which it holds until done */
+    lock_guard<mutex> guard (group->lock);
+}
+
+void
+dd_work_group_free (DDWorkGroup *group) {
+    delete group;
+}
+
+void
+dd_workers_set_max_bands (unsigned int bands) {
+    max_bands.store (bands, memory_order_relaxed);
+}
+
+unsigned int
+dd_workers_bands (unsigned int rows, unsigned int min_rows) {
+    unsigned int bands = max_bands.load (memory_order_relaxed);
+
+    if (bands == 1)
+        return 1;
+    if (!bands)
+        bands = get_pool (0)->workers.size () + 1;
+    if (min_rows && rows / min_rows < bands)
+        bands = rows / min_rows;
+    return bands ? bands : 1;
+}
+
+static void
+run_rows (void *user_data) {
+    RowsTask *t = (RowsTask *) user_data;
+
+    t->func (t->band, t->first_row, t->end_row, t->user_data);
+}
+
+void
+dd_workers_parallel_rows (unsigned int rows, unsigned int bands, DDRowsFunc func, void *user_data) {
+    vector<RowsTask> tasks (bands);
+    DDWorkGroup group;
+
+    if (bands <= 1) {
+        func (0, 0, rows, user_data);
+        return;
+    }
+
+    for (unsigned int i = 0; i < bands; i++) {
+        tasks[i].func = func;
+        tasks[i].user_data = user_data;
+        tasks[i].band = i;
+        tasks[i].first_row = (uint64_t) rows * i / bands;
+        tasks[i].end_row = (uint64_t) rows * (i + 1) / bands;
+    }
+    group.outstanding = 0;
+    /* Band 0 is the caller's, band i goes to worker i - 1 */
+    for (unsigned int i = 1; i < bands; i++)
+        dd_work_group_submit (&group, run_rows, &tasks[i], i - 1);
+    run_rows (&tasks[0]);
+    dd_work_group_wait (&group);
+}
+
+void
+dd_workers_stats (DDWorkersStats *stats) {
+    WorkPool *p = pool.load (memory_order_acquire);
+
+    if (!p) {
+        *stats = DDWorkersStats ();
+        return;
+    }
+    stats->workers = p->workers.size ();
+    stats->tasks = p->tasks.load (memory_order_relaxed);
+    stats->steals = p->steals.load (memory_order_relaxed);
+    stats->helped = p->helped.load (memory_order_relaxed);
+    stats->sleeps = p->sleeps.load (memory_order_relaxed);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_WORKERS_H
+#define DD_WORKERS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Any worker may run the task */
+#define DD_WORKERS_ANY          (-1)
+
+/* Tries of an idle worker to find a task before it sleeps */
+#define DD_WORKERS_SPIN         64
+
+typedef struct _DDWorkGroup DDWorkGroup;
+
+typedef void (*DDWorkFunc) (void *user_data);
+
+/* Process rows [first_row, end_row) of the frame, @band is the band index */
+typedef void (*DDRowsFunc) (unsigned int band, unsigned int first_row, unsigned int end_row,
+                            void *user_data);
+
+typedef struct _DDWorkersStats {
+    unsigned int workers;
+    uint64_t tasks;             /* tasks run, by workers and waiting callers */
+    uint64_t steals;            /* tasks taken from another worker's queue */
+    uint64_t helped;            /* tasks run by callers while they waited */
+    uint64_t sleeps;            /* times a worker found no work and slept */
+} DDWorkersStats;
+
+/** @brief
+ *  Create the worker pool shared by every kernel library of the process.
+ *
+ *  Each kernel library calls this from its init, the first call creates
+ *  the pool and later calls return its size. Without a call the pool is
+ *  created on first use with one worker per CPU the creating thread may
+ *  run on, less one for the caller. Worker i is pinned to the i-th of
+ *  those CPUs, so that a thread group placement of the application also
+ *  bounds the workers.
+ *
+ *  @param workers is the number of threads, 0 for the default.
+ *  @return the number of threads of the pool.
+ */
+unsigned int dd_workers_init (unsigned int workers);
+
+/** @brief
+ *  Start a group of tasks to wait on together.
+ *
+ *  @return the group, to free with dd_work_group_free().
+ */
+DDWorkGroup * dd_work_group_new (void);
+
+/** @brief
+ *  Queue a task of a group.
+ *
+ *  A task with a hint goes to the queue of worker @hint modulo the pool
+ *  size, the same hint every frame keeps the same rows on the same core.
+ *  Idle workers steal queued tasks from the others, so a hint never
+ *  leaves a task waiting behind a busy worker. A task queued from a task
+ *  without a hint stays on the queue of the worker running it.
+ *
+ *  @param group is the group of the task.
+ *  @param func is run with @user_data on one of the workers.
+ *  @param user_data is the task data.
+ *  @param hint is the worker to prefer, DD_WORKERS_ANY for none.
+ *  @return Void.
+ */
+void dd_work_group_submit (DDWorkGroup *group, DDWorkFunc func, void *user_data, int hint);
+
+/** @brief
+ *  Wait for the tasks of a group.
+ *
+ *  The caller runs queued tasks while it waits instead of blocking, so
+ *  tasks may themselves split their work and wait, at any depth, without
+ *  tying up the pool.
+ *
+ *  @param group is the group to wait on.
+ *  @return Void.
+ */
+void dd_work_group_wait (DDWorkGroup *group);
+
+/* Free a group, after dd_work_group_wait() */
+void dd_work_group_free (DDWorkGroup *group);
+
+/** @brief
+ *  Limit the bands dd_workers_bands() splits a frame into, which is one
+ *  per worker plus the caller by default.
+ *
+ *  @param bands is the maximum number of bands, 1 to run every frame on
+ *  the caller, 0 for the default.
+ *  @return Void.
+ */
+void dd_workers_set_max_bands (unsigned int bands);
+
+/** @brief
+ *  Bands to split the rows of a frame into: one per worker plus the
+ *  caller, or the maximum set, and at least @min_rows high.
+ *
+ *  @param rows is the frame height.
+ *  @param min_rows is the height below which a band is not worth a task.
+ *  @return the number of bands, at least 1.
+ */
+unsigned int dd_workers_bands (unsigned int rows, unsigned int min_rows);
+
+/** @brief
+ *  Split the rows of a frame into bands, run @func on each band in the
+ *  pool and wait for all of them.
+ *
+ *  The bands are contiguous and of nearly equal height. The caller runs
+ *  the first band itself and band i is hinted to worker i - 1, so that
+ *  per band data is sized with the @bands returned by dd_workers_bands().
+ *  With a single band @func is called directly.
+ *
+ *  @param rows is the frame height.
+ *  @param bands is the number of bands.
+ *  @param func is run on each band.
+ *  @param user_data is passed to @func.
+ *  @return Void.
+ */
+void dd_workers_parallel_rows (unsigned int rows, unsigned int bands, DDRowsFunc func, void *user_data);
+
+/* Read the counters of the pool, all zero before it is created */
+void dd_workers_stats (DDWorkersStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DD_WORKERS_H */
@@ -15,14 +15,37 @@
  */
 
 #include <gst/gst.h>
+#include <glib-unix.h>
 #include <gst/video/videooverlay.h>
 #include <gst/video/video.h>
+#include <gst/app/gstappsink.h>
+#include <gst/vvas/gstinferencemeta.h>
 #include <string.h>
 #include <unistd.h>
-#include <memory>
-#include <stdexcept>
-#include <glob.h>
-#include <sstream>
+#include <sys/stat.h>
+#include <algorithm>
+#include <jansson.h>
+#include "dd_affinity.h"
+#include "dd_batch.h"
+#include "dd_bench.h"
+#include "dd_control.h"
+#include "dd_metrics.h"
+#include "dd_display.h"
+#include "dd_dmabuf.h"
+#include "dd_gate.h"
+#include "dd_media.h"
+#include "dd_mmapsrc.h"
+#include "dd_params.h"
+#include "dd_pool.h"
+#include "dd_queue.h"
+#include "dd_rec.h"
+#include "dd_reload.h"
+#include "dd_result_meta.h"
+#include "dd_results.h"
+#include "dd_sched.h"
+#include "dd_stats.h"
+#include "dd_topology.h"
+#include "dd_tracer.h"
 
 using namespace std;
 
@@ -30,16 +53,26 @@ GST_DEBUG_CATEGORY (defectdetect_app);
 #define GST_CAT_DEFAULT defectdetect_app
 
 #define PRE_PROCESS_JSON_FILE        "preprocess-accelarator.json"
-#define PRE_PROCESS_STRIDE_JSON_FILE "preprocess-accelarator-stride.json"
 #define OTSU_ACC_JSON_FILE           "otsu-accelarator.json"
 #define CCA_ACC_JSON_FILE            "cca-accelarator.json"
 #define TEXT_2_OVERLAY_JSON_FILE     "text2overlay.json"
+#define PIPELINE_JSON_FILE           "pipeline.json"
+#define SENSOR_JSON_FILE             "sensor.json"
+#define SNAPSHOT_DIR                 "mv-defect-detect-snapshots"
 #define DRM_BUS_ID                   "fd4a0000.display"
+#define DRM_CARD                     "/dev/dri/by-path/platform-fd4a0000.display-card"
+#define DRM_CONNECTOR_ID             43
+#define DRM_CRTC_ID                  41
+#define DRM_PLANE_ID                 40
+#define DISPLAY_REFRESH              60
 #define CAPTURE_FORMAT_Y8            "GRAY8"
-#define MAX_WIDTH                    1920
-#define MAX_HEIGHT                   1080
+#define MAX_WIDTH                    3840
+#define MAX_HEIGHT                   2160
 #define MAX_FRAME_RATE_DENOM         1
 #define MAX_DEMO_MODE_FRAME_RATE     4
+#define STAGE_RAW                    0
+#define STAGE_PREPROCESS             1
+#define STAGE_FINAL                  2
 
 typedef enum {
     DD_SUCCESS,
@@ -51,57 +84,152 @@ typedef enum {
     DD_ERROR_INPUT_OPTIONS_INVALID = -6,
     DD_ERROR_OVERLAY_CREATION_FAIL = -7,
     DD_ERROR_FILE_DUMP_IN_DEMO_NOT_SUPPORTED = -8,
+    DD_ERROR_DUMP_OPTION_INVALID = -9,
+    DD_ERROR_BENCHMARK_OPTIONS_INVALID = -10,
+    DD_ERROR_RESULTS_FORMAT_INVALID = -11,
+    DD_ERROR_BATCH_OPTIONS_INVALID = -12,
+    DD_ERROR_MEDIA_DEVICE_INVALID = -13,
+    DD_ERROR_CAPTURE_SETUP_FAIL = -14,
+    DD_ERROR_CONTROL_SOCKET_FAIL = -15,
+    DD_ERROR_METRICS_FAIL = -16,
     DD_ERROR_OTHER = -99,
 } DD_ERROR_LOG;
 
 typedef struct _AppData {
-    GstElement *pipeline, *capsfilter, *src, *rawvparse;
+    GstElement *pipeline, *capsfilter, *src;
     GstElement *sink;
-    GstElement *queue, *q_raw,*q_raw_1;
     GstElement *perf, *videorate;
     GstElement *preprocess, *otsu, *cca, *text2overlay;
     GstElement *capsfilter_vr, *capsfilter_op;
+    GstElement *results;
+    GstElement *merge;
+    DDResultsWriter *results_writer;
+    DDMmapSrc *mmapsrc;
+    DDGate *gate;
+    DDTopology topo;
+    const gchar *location;      /* input file, NULL for the camera */
+    const gchar *media_device;  /* capture device of the camera */
+    guint source;               /* index of the input in the results */
+    guint stream;               /* stream of the kernel statistics and scheduler */
+    guint stage;                /* stage shown on the display or written with -f */
+    gboolean headless;          /* fakesink instead of the display or -f file */
+    /* Batch mode */
+    guint bus_watch_id;
+    gint64 started_us;
+    guint64 frames, defects;
 } AppData;
 
+typedef struct _BatchRun {
+    vector<string> clips;
+    guint next;
+    guint failed;
+    guint64 frames, defects;
+    gint64 started_us;
+    DDResultsWriter *results_writer;
+    vector<AppData *> running;
+} BatchRun;
+
+typedef struct _DumpOutput {
+    guint stage;
+    string location;
+} DumpOutput;
+
 GMainLoop *loop;
 gboolean file_playback = FALSE;
 gboolean file_dump = FALSE;
 gboolean demo_mode = FALSE;
+gboolean benchmark = FALSE;
+gboolean trace = FALSE;
+gboolean headless = FALSE;
 static gchar* in_file = NULL;
 static gchar* config_path  = (gchar *)"/opt/xilinx/xlnx-app-kr260-mv-defect-detect/share/vvas/";
 static gchar *msg_firmware = (gchar *)"Load the HW accelerator firmware first. Use command: xmutil loadapp kr260-mv-camera\n";
 static gchar* out_file = NULL;
+static gchar* stats_file = NULL;
+static gchar* topology = NULL;
+static gchar* queue_policy = NULL;
+static gchar** dumps = NULL;
+static vector<DumpOutput> dump_outputs;
+static gint bench_frames = 0;
+static gint bench_seconds = 0;
+static gchar* bench_json = NULL;
+static gchar* results_file = NULL;
+static gboolean loop_input = FALSE;
+static gboolean pace_input = FALSE;
+static gint64 start_frame = 0;
+static gint64 end_frame = 0;
+static gchar* results_format = NULL;
+static gchar* batch = NULL;
+static gint jobs = 0;
+static BatchRun batch_run;
+static gchar** media_devices = NULL;
+static vector<string> stream_configs;
+static map<string, DDQueueConfig> queue_configs;
+static map<string, DDPoolConfig> pool_configs;
+static vector<AppData *> app_streams;
+static gboolean gate = FALSE;
+static gboolean track = FALSE;
+static DDGateConfig gate_config;
+static gboolean affinity = FALSE;
+static DDAffinityConfig affinity_config;
+static gboolean startup_profile = FALSE;
+static DDReload *reload = NULL;
+static gchar* control_socket = NULL;
+static DDControl *control = NULL;
+static gint metrics_port = 0;
+static gchar* rec_index = NULL;
+static DDMetrics *metrics = NULL;
+static vector<pair<const gchar *, gint64>> startup_marks;
 guint width =  1920;
 guint height = 1080;
 guint stride_align = 256;
 guint dp = 0;
 guint framerate = 60;
-static string dev_node("");
+static vector<string> capture_devs;
 
 static GOptionEntry entries[] =
 {
     { "infile",       'i', 0, G_OPTION_ARG_FILENAME, &in_file, "Location of input file", "file path"},
-    { "outfile",      'f', 0, G_OPTION_ARG_FILENAME, &out_file, "Location of output file", "file path"},
+    { "outfile",      'f', 0, G_OPTION_ARG_FILENAME, &out_file, "Location of output file, indexed recording if it ends in .ddrec", "file path"},
     { "width",        'w', 0, G_OPTION_ARG_INT, &width, "Resolution width of the input", "1920"},
     { "height",       'h', 0, G_OPTION_ARG_INT, &height, "Resolution height of the input", "1080"},
     { "output",       'o', 0, G_OPTION_ARG_INT, &dp, "Display/dump stage on DP/File", "0"},
     { "framerate",    'r', 0, G_OPTION_ARG_INT, &framerate, "Framerate of input source", "60"},
     { "demomode",     'd', 0, G_OPTION_ARG_INT, &demo_mode, "For Demo mode value must be 1", "0"},
     { "cfgpath",      'c', 0, G_OPTION_ARG_STRING, &config_path, "JSON config file path", "/opt/xilinx/xlnx-app-kr260-mv-defect-detect/share/vvas/"},
+    { "stats-file",   's', 0, G_OPTION_ARG_FILENAME, &stats_file, "File to restore and persist the defect statistics", "file path"},
+    { "topology",     't', 0, G_OPTION_ARG_STRING, &topology, "Stages to link, overrides the one derived from -i/-o/-d", "\"src ! caps ! otsu ! preprocess ! cca ! text2overlay ! caps_op ! perf ! sink\""},
+    { "queue-policy", 'q', 0, G_OPTION_ARG_STRING, &queue_policy, "Where queues are inserted: none, boundary or all", "boundary"},
+    { "dump",         'D', 0, G_OPTION_ARG_FILENAME_ARRAY, &dumps, "Also dump a stage (raw, preprocess or final) to a file, can be repeated", "stage:file path"},
+    { "media-device", 'M', 0, G_OPTION_ARG_FILENAME_ARRAY, &media_devices, "Media device of a camera, can be repeated, all for every camera found", "/dev/mediaN|all"},
+    { "gate",         'g', 0, G_OPTION_ARG_NONE, &gate, "Only send the frames showing a fruit to the accelerators", NULL},
+    { "track",        0,   0, G_OPTION_ARG_NONE, &track, "Track fruits across frames and inspect each one once, implies --gate", NULL},
+    { "loop",         'l', 0, G_OPTION_ARG_NONE, &loop_input, "Play the input file in a loop", NULL},
+    { "start-frame",  0,   0, G_OPTION_ARG_INT64, &start_frame, "First frame of the input file to play", "0"},
+    { "end-frame",    0,   0, G_OPTION_ARG_INT64, &end_frame, "Stop before this frame of the input file, 0 for the end", "0"},
+    { "pace",         0,   0, G_OPTION_ARG_NONE, &pace_input, "Play the input file at the -r framerate instead of as fast as possible", NULL},
+    { "results",      'R', 0, G_OPTION_ARG_FILENAME, &results_file, "Write the per-frame results to a file", "file path"},
+    { "results-format", 0, 0, G_OPTION_ARG_STRING, &results_format, "Format of the results file: jsonl, csv or bin", "jsonl"},
+    { "trace",        'T', 0, G_OPTION_ARG_NONE, &trace, "Trace per-stage latencies, dumped with the queue counters on SIGUSR1 and at exit", NULL},
+    { "benchmark",    'b', 0, G_OPTION_ARG_NONE, &benchmark, "Run headless as fast as possible and report the throughput", NULL},
+    { "bench-frames", 0,   0, G_OPTION_ARG_INT, &bench_frames, "Stop the benchmark after this many frames", "0"},
+    { "bench-seconds", 0,  0, G_OPTION_ARG_INT, &bench_seconds, "Stop the benchmark after this many seconds", "10"},
+    { "bench-json",   0,   0, G_OPTION_ARG_FILENAME, &bench_json, "Also write the benchmark report as JSON, - for stdout", "file path"},
+    { "batch",        'B', 0, G_OPTION_ARG_FILENAME, &batch, "Inspect every .y8 capture of a directory, or the files matching a glob", "dir|glob"},
+    { "jobs",         'j', 0, G_OPTION_ARG_INT, &jobs, "Pipelines run at once in batch mode, 0 for one per compute unit", "0"},
+    { "control-socket", 'S', 0, G_OPTION_ARG_FILENAME, &control_socket, "Serve control requests on a UNIX domain socket", "socket path"},
+    { "metrics-port", 0,   0, G_OPTION_ARG_INT, &metrics_port, "Serve Prometheus metrics on this localhost TCP port, 0 for none", "0"},
+    { "rec-index",    0,   0, G_OPTION_ARG_FILENAME, &rec_index, "Print the frame index of a .ddrec recording as CSV and exit", "file path"},
+    { "startup-profile", 0, 0, G_OPTION_ARG_NONE, &startup_profile, "Print the time spent in each startup step at the first frame", NULL},
     { NULL }
 };
 
-/* Handler for the pad-added signal */
-static void pad_added_cb (GstElement *src, GstPad *pad, AppData *data);
-
 DD_ERROR_LOG set_pipeline_config (AppData *data);
 
 const gchar * error_to_string (gint error_code);
 
 DD_ERROR_LOG create_pipeline (AppData *data);
 
-DD_ERROR_LOG link_pipeline (AppData *data);
-
 void
 signal_handler (gint sig) {
      signal(sig, SIG_IGN);
@@ -113,19 +241,538 @@ signal_handler (gint sig) {
      return;
 }
 
-static std::string exec(const char* cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd, "r"), pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
+/** @brief
+ *  This function records the end of a startup step.
+ *
+ *  @param step is the name of the step, a static string.
+ *  @return Void.
+ */
+static void
+startup_mark (const gchar *step) {
+    startup_marks.push_back (make_pair (step, g_get_monotonic_time ()));
+    if (startup_marks.size () > 1)
+        GST_INFO ("Startup: %s took %.1lf ms", step,
+                  (startup_marks.back ().second - startup_marks[startup_marks.size () - 2].second) / 1e3);
+}
+
+/** @brief
+ *  This function prints the time spent in each startup step, once.
+ *
+ *  @return Void.
+ */
+static void
+print_startup_profile () {
+    static gboolean printed = FALSE;
+
+    if (!startup_profile || printed || startup_marks.empty ())
+        return;
+    printed = TRUE;
+    g_print ("Startup:\n");
+    for (guint i = 1; i < startup_marks.size (); i++)
+        g_print ("  %-16s %8.1lf ms\n", startup_marks[i].first,
+                 (startup_marks[i].second - startup_marks[i - 1].second) / 1e3);
+    g_print ("  %-16s %8.1lf ms\n", "total",
+             (startup_marks.back ().second - startup_marks.front ().second) / 1e3);
+}
+
+/** @brief
+ *  This function ends the startup profile when the first frame reaches
+ *  the sink.
+ *
+ *  @return GstPadProbeReturn.
+ */
+static GstPadProbeReturn
+first_frame_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    startup_mark ("first frame");
+    print_startup_profile ();
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/** @brief
+ *  This function prints the counters of every queue.
+ *
+ *  @param fp is the output stream.
+ *  @return Void.
+ */
+static void
+print_queue_stats (FILE *fp) {
+    vector<AppData *> all (app_streams);
+    DDQueueStats st;
+
+    all.insert (all.end (), batch_run.running.begin (), batch_run.running.end ());
+    fprintf (fp, "Queue                        %10s %10s %10s %6s %6s %12s\n",
+             "buffers", "full", "stale", "level", "max", "blocked ms");
+    for (AppData *data : all) {
+        for (DDQueueMonitor *monitor : data->topo.queues) {
+            string name;
+
+            dd_queue_monitor_stats (monitor, &st);
+            name = all.size () > 1 ? to_string (data->source) + ":" + st.name : st.name;
+            fprintf (fp, "  %-26s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                     " %6u %6u %12.1lf\n", name.c_str (), st.pushed, st.dropped_full, st.dropped_stale,
+                     st.level, st.level_max, st.blocked_ns / 1e6);
+        }
+    }
+    fflush (fp);
+}
+
+/** @brief
+ *  This function prints the counters of the output pool of every stage.
+ *
+ *  @param fp is the output stream.
+ *  @return Void.
+ */
+static void
+print_pool_stats (FILE *fp) {
+    vector<AppData *> all (app_streams);
+    DDPoolStats st;
+
+    all.insert (all.end (), batch_run.running.begin (), batch_run.running.end ());
+    fprintf (fp, "Pool                         %6s %6s %10s %6s %6s %10s %6s\n",
+             "min", "max", "allocated", "in use", "max", "waits", "caps");
+    for (AppData *data : all) {
+        for (DDPoolMonitor *monitor : data->topo.pools) {
+            string name;
+
+            dd_pool_monitor_stats (monitor, &st);
+            name = all.size () > 1 ? to_string (data->source) + ":" + st.name : st.name;
+            if (st.in_place) {
+                fprintf (fp, "  %-26s in place\n", name.c_str ());
+                continue;
+            }
+            fprintf (fp, "  %-26s %6u %6u %10" G_GUINT64_FORMAT " %6u %6u %10" G_GUINT64_FORMAT " %6" G_GUINT64_FORMAT
+                     "\n", name.c_str (), st.min_buffers, st.max_buffers, st.allocated, st.in_use, st.in_use_max,
+                     st.waits, st.negotiations);
+        }
+    }
+    fflush (fp);
+}
+
+/** @brief
+ *  This function prints how many frames reached the accelerators, the
+ *  display and the file writers in memory they cannot use as is.
+ *
+ *  @param fp is the output stream.
+ *  @return Void.
+ */
+static void
+print_copy_stats (FILE *fp) {
+    vector<AppData *> all (app_streams);
+    DDCopyStats st;
+
+    all.insert (all.end (), batch_run.running.begin (), batch_run.running.end ());
+    fprintf (fp, "Copies                       %10s %10s\n", "buffers", "copied");
+    for (AppData *data : all) {
+        for (GstElement *element : data->topo.linked) {
+            DDCopyMonitor *monitor = dd_copy_monitor_get (element);
+            string name;
+
+            if (!monitor)
+                continue;
+            dd_copy_monitor_stats (monitor, &st);
+            name = all.size () > 1 ? to_string (data->source) + ":" + st.name : st.name;
+            fprintf (fp, "  %-26s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n", name.c_str (), st.buffers,
+                     st.copies);
+        }
+    }
+    fflush (fp);
+}
+
+/** @brief
+ *  This function prints how many frames each gate sent to the
+ *  accelerators.
+ *
+ *  @return Void.
+ */
+static void
+print_gate_stats () {
+    DDGateStats st;
+
+    for (AppData *data : app_streams) {
+        if (!data->gate)
+            continue;
+        dd_gate_stats (data->gate, &st);
+        g_print ("Gate%s: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " to the accelerators (%.1lf%%), %"
+                 G_GUINT64_FORMAT " %s\n", app_streams.size () > 1 ? (" " + to_string (data->source)).c_str () : "",
+                 st.frames, st.passed, st.frames ? 100.0 * st.passed / st.frames : 0.0, st.bypassed,
+                 data->merge ? "bypassed" : "dropped");
+        if (gate_config.track)
+            g_print ("  fruits %" G_GUINT64_FORMAT ", inspected %" G_GUINT64_FORMAT ", lost before inspection %"
+                     G_GUINT64_FORMAT "\n", st.tracker.fruits, st.tracker.inspected, st.tracker.lost);
+    }
+}
+
+/** @brief
+ *  This function prints the placement applied to each thread.
+ *
+ *  @param fp is the stream to print to.
+ *  @return Void.
+ */
+static void
+print_thread_placements (FILE *fp) {
+    vector<DDThreadPlacement> placements;
+
+    dd_affinity_placements (placements);
+    for (const DDThreadPlacement &placement : placements)
+        dd_affinity_print_placement (fp, &placement);
+}
+
+/** @brief
+ *  This function dumps the queue counters, and the latency tracer
+ *  histograms when tracing, on SIGUSR1.
+ *
+ *  @param user_data is unused.
+ *  @return gboolean.
+ */
+static gboolean
+stats_dump_cb (gpointer user_data) {
+    print_queue_stats (stdout);
+    print_pool_stats (stdout);
+    print_copy_stats (stdout);
+    print_thread_placements (stdout);
+    if (trace)
+        dd_tracer_dump (stdout);
+    return G_SOURCE_CONTINUE;
+}
+
+/* One snapshot at a time: requests are served by the single control thread */
+typedef struct _Snapshot {
+    GMutex lock;
+    GCond cond;
+    GstBuffer *buf;
+} Snapshot;
+
+static Snapshot snapshot;
+
+static GstPadProbeReturn
+snapshot_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    g_mutex_lock (&snapshot.lock);
+    if (!snapshot.buf)
+        snapshot.buf = gst_buffer_ref (GST_PAD_PROBE_INFO_BUFFER (info));
+    g_cond_signal (&snapshot.cond);
+    g_mutex_unlock (&snapshot.lock);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/** @brief
+ *  This function handles the "get" control request: the running value of
+ *  "param", or of every tunable parameter.
+ *
+ *  @return the result, NULL on error.
+ */
+static json_t *
+control_get (json_t *request, gpointer user_data, gchar **error) {
+    const gchar *name = json_string_value (json_object_get (request, "param"));
+    json_t *result;
+    gdouble value;
+
+    if (name) {
+        if (!dd_reload_get (reload, name, &value)) {
+            *error = g_strdup_printf ("unknown parameter %s", name);
+            return NULL;
+        }
+        return json_real (value);
+    }
+    result = json_object ();
+    for (guint i = 0; i < DD_PARAM_COUNT; i++) {
+        if (dd_reload_get (reload, dd_params_name ((DDParam) i), &value))
+            json_object_set_new (result, dd_params_name ((DDParam) i), json_real (value));
+    }
+    return result;
+}
+
+/** @brief
+ *  This function handles the "set" control request, applied to the
+ *  running kernels before their next frame.
+ *
+ *  @return the result, NULL on error.
+ */
+static json_t *
+control_set (json_t *request, gpointer user_data, gchar **error) {
+    const gchar *name = json_string_value (json_object_get (request, "param"));
+    json_t *value = json_object_get (request, "value");
+    const gchar *reason = NULL;
+
+    if (!name || !json_is_number (value)) {
+        *error = g_strdup ("set needs a param and a numeric value");
+        return NULL;
+    }
+    if (!dd_reload_set (reload, name, json_number_value (value), &reason)) {
+        *error = g_strdup_printf ("%s: %s", name, reason);
+        return NULL;
+    }
+    return json_real (json_number_value (value));
+}
+
+/** @brief
+ *  This function handles the "stats" control request: the defect
+ *  statistics of each stream and the counters of each queue.
+ *
+ *  @return the result.
+ */
+static json_t *
+control_stats (json_t *request, gpointer user_data, gchar **error) {
+    json_t *result = json_object ();
+    json_t *streams = json_array ();
+    json_t *queues = json_array ();
+    json_t *pools = json_array ();
+    json_t *threads = json_array ();
+    vector<DDThreadPlacement> placements;
+    guint64 now = dd_stats_now_ns ();
+    DDStatsSnapshot snap;
+    DDQueueStats st;
+    DDPoolStats pst;
+
+    for (guint i = 0; i < MAX (capture_devs.size(), 1); i++) {
+        json_t *stream = json_object ();
+        json_object_set_new (stream, "stream", json_integer (i));
+        for (guint w = DD_STATS_WINDOW_1S; w < DD_STATS_WINDOW_COUNT; w++) {
+            if (dd_stats_snapshot (i, (DDStatsWindow) w, now, &snap) != 0)
+                continue;
+            json_object_set_new (stream, dd_stats_window_name ((DDStatsWindow) w),
+                                 json_pack ("{s:I, s:I, s:f, s:f, s:f}", "frames", (json_int_t) snap.frames,
+                                            "defects", (json_int_t) snap.defects, "yield", dd_stats_yield (&snap),
+                                            "mean_density", dd_stats_mean_density (&snap),
+                                            "max_density", snap.density_max));
+        }
+        json_array_append_new (streams, stream);
+    }
+    for (AppData *data : app_streams) {
+        for (DDQueueMonitor *monitor : data->topo.queues) {
+            dd_queue_monitor_stats (monitor, &st);
+            json_array_append_new (queues, json_pack ("{s:i, s:s, s:I, s:I, s:I, s:i, s:i, s:f}",
+                                   "stream", data->stream, "name", st.name.c_str (),
+                                   "pushed", (json_int_t) st.pushed, "dropped_full", (json_int_t) st.dropped_full,
+                                   "dropped_stale", (json_int_t) st.dropped_stale, "level", st.level,
+                                   "level_max", st.level_max, "blocked_ms", st.blocked_ns / 1e6));
+        }
+        for (DDPoolMonitor *monitor : data->topo.pools) {
+            dd_pool_monitor_stats (monitor, &pst);
+            json_array_append_new (pools, json_pack ("{s:i, s:s, s:b, s:i, s:i, s:I, s:i, s:i, s:I, s:I}",
+                                   "stream", data->stream, "name", pst.name.c_str (), "in_place", pst.in_place,
+                                   "min_buffers", pst.min_buffers, "max_buffers", pst.max_buffers,
+                                   "allocated", (json_int_t) pst.allocated, "in_use", pst.in_use,
+                                   "in_use_max", pst.in_use_max, "waits", (json_int_t) pst.waits,
+                                   "negotiations", (json_int_t) pst.negotiations));
+        }
+    }
+    dd_affinity_placements (placements);
+    for (const DDThreadPlacement &placement : placements)
+        json_array_append_new (threads, json_pack ("{s:i, s:s, s:s, s:s, s:s, s:i, s:s}",
+                               "tid", placement.tid, "owner", placement.owner.c_str (),
+                               "group", dd_thread_group_name (placement.group), "cpus", placement.cpus.c_str (),
+                               "policy", placement.policy == SCHED_FIFO ? "fifo" :
+                                         placement.policy == SCHED_OTHER ? "other" : "",
+                               "priority", placement.priority,
+                               "error", placement.error ? g_strerror (placement.error) : ""));
+    json_object_set_new (result, "streams", streams);
+    json_object_set_new (result, "queues", queues);
+    json_object_set_new (result, "pools", pools);
+    json_object_set_new (result, "threads", threads);
+    return result;
+}
+
+/** @brief
+ *  Create the directory snapshots are written to, readable by this user
+ *  only, and check that it is a directory of ours and not a link.
+ *
+ *  @return the directory, NULL if it cannot be used.
+ */
+static gchar *
+snapshot_dir (void) {
+    gchar *dir = g_build_filename (g_get_tmp_dir (), SNAPSHOT_DIR, NULL);
+    struct stat st;
+
+    g_mkdir_with_parents (dir, 0700);
+    if (lstat (dir, &st) != 0 || !S_ISDIR (st.st_mode) || st.st_uid != geteuid ()) {
+        g_free (dir);
+        return NULL;
+    }
+    return dir;
+}
+
+/** @brief
+ *  This function handles the "snapshot" control request: the next frame
+ *  reaching the sink of the first stream is written raw to a file of the
+ *  snapshot directory, named "name" or numbered. Clients choose only the
+ *  file name, never the directory.
+ *
+ *  @return the result, NULL on error.
+ */
+static json_t *
+control_snapshot (json_t *request, gpointer user_data, gchar **error) {
+    static guint count = 0;
+    const gchar *base = json_string_value (json_object_get (request, "name"));
+    gint64 deadline = g_get_monotonic_time () + G_TIME_SPAN_SECOND * 2;
+    GstBuffer *buf = NULL;
+    GstMapInfo map;
+    GstPad *pad;
+    gulong probe;
+    gchar *dir, *name, *file;
+    json_t *result = NULL;
+
+    if (base && (!*base || strchr (base, '/') || !strcmp (base, ".") || !strcmp (base, ".."))) {
+        *error = g_strdup ("name must be a file name, without a directory");
+        return NULL;
     }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
+    if (app_streams.empty () || !app_streams[0]->sink) {
+        *error = g_strdup ("no running pipeline");
+        return NULL;
     }
+    pad = gst_element_get_static_pad (app_streams[0]->sink, "sink");
+    g_mutex_lock (&snapshot.lock);
+    gst_buffer_replace (&snapshot.buf, NULL);
+    probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, snapshot_probe, NULL, NULL);
+    while (!snapshot.buf && g_cond_wait_until (&snapshot.cond, &snapshot.lock, deadline))
+        ;
+    buf = snapshot.buf;
+    snapshot.buf = NULL;
+    g_mutex_unlock (&snapshot.lock);
+    if (!buf) {
+        /* No frame in time, the probe is still there */
+        gst_pad_remove_probe (pad, probe);
+        gst_object_unref (pad);
+        *error = g_strdup ("no frame within 2 s");
+        return NULL;
+    }
+    gst_object_unref (pad);
+
+    dir = snapshot_dir ();
+    if (!dir) {
+        gst_buffer_unref (buf);
+        *error = g_strdup_printf ("could not use the snapshot directory %s", SNAPSHOT_DIR);
+        return NULL;
+    }
+    name = g_strdup_printf ("snapshot-%d-%u.y8", getpid (), count++);
+    file = g_build_filename (dir, base ? base : name, NULL);
+    if (gst_buffer_map (buf, &map, GST_MAP_READ)) {
+        if (g_file_set_contents (file, (const gchar *) map.data, map.size, NULL))
+            result = json_pack ("{s:s, s:I, s:I}", "path", file, "bytes", (json_int_t) map.size,
+                                "pts", (json_int_t) GST_BUFFER_PTS (buf));
+        else
+            *error = g_strdup_printf ("could not write %s", file);
+        gst_buffer_unmap (buf, &map);
+    } else {
+        *error = g_strdup ("could not map the frame");
+    }
+    gst_buffer_unref (buf);
+    g_free (file);
+    g_free (name);
+    g_free (dir);
     return result;
 }
 
+/** @brief
+ *  This function handles the "pause" and "resume" control requests for
+ *  every running pipeline.
+ *
+ *  @param user_data is TRUE to pause.
+ *  @return the result, NULL on error.
+ */
+static json_t *
+control_pause (json_t *request, gpointer user_data, gchar **error) {
+    GstState state = GPOINTER_TO_INT (user_data) ? GST_STATE_PAUSED : GST_STATE_PLAYING;
+
+    if (app_streams.empty ()) {
+        *error = g_strdup ("no running pipeline");
+        return NULL;
+    }
+    for (AppData *data : app_streams) {
+        if (gst_element_set_state (data->pipeline, state) == GST_STATE_CHANGE_FAILURE) {
+            *error = g_strdup_printf ("could not set stream %u to %s", data->stream, gst_element_state_get_name (state));
+            return NULL;
+        }
+    }
+    return json_string (gst_element_state_get_name (state));
+}
+
+/** @brief
+ *  This function handles the "seek" control request: every input file
+ *  goes on from "frame".
+ *
+ *  @return the result, NULL on error.
+ */
+static json_t *
+control_seek (json_t *request, gpointer user_data, gchar **error) {
+    json_t *frame = json_object_get (request, "frame");
+
+    if (!json_is_integer (frame) || json_integer_value (frame) < 0) {
+        *error = g_strdup ("\"frame\" must be a frame number");
+        return NULL;
+    }
+    if (app_streams.empty () || !app_streams[0]->mmapsrc) {
+        *error = g_strdup ("no input file");
+        return NULL;
+    }
+    for (AppData *data : app_streams) {
+        if (!dd_mmapsrc_seek (data->mmapsrc, json_integer_value (frame))) {
+            *error = g_strdup_printf ("frame %" JSON_INTEGER_FORMAT " is outside the played range",
+                                      json_integer_value (frame));
+            return NULL;
+        }
+    }
+    return json_integer (json_integer_value (frame));
+}
+
+/** @brief
+ *  This function opens the control socket given with -S, once the
+ *  pipelines it acts on exist.
+ *
+ *  @return FALSE if the socket cannot be served.
+ */
+static gboolean
+start_control () {
+    if (!control_socket)
+        return TRUE;
+    control = dd_control_new (control_socket);
+    if (!control)
+        return FALSE;
+    dd_control_register (control, "get",      control_get,      NULL);
+    dd_control_register (control, "set",      control_set,      NULL);
+    dd_control_register (control, "stats",    control_stats,    NULL);
+    dd_control_register (control, "snapshot", control_snapshot, NULL);
+    dd_control_register (control, "pause",    control_pause,    GINT_TO_POINTER (TRUE));
+    dd_control_register (control, "resume",   control_pause,    GINT_TO_POINTER (FALSE));
+    dd_control_register (control, "seek",     control_seek,     NULL);
+    return dd_control_start (control);
+}
+
+/* Stop serving requests before the pipelines they act on go away */
+static void
+stop_control () {
+    dd_control_free (control);
+    control = NULL;
+}
+
+/** @brief
+ *  This function serves the metrics given with --metrics-port, counting
+ *  the buffers through every element of the running pipelines. Batch
+ *  pipelines come and go, so only their totals are reported.
+ *
+ *  @param results_writer is the results writer, NULL for none.
+ *  @return FALSE if the port cannot be served.
+ */
+static gboolean
+start_metrics (DDResultsWriter *results_writer) {
+    if (metrics_port <= 0)
+        return TRUE;
+    metrics = dd_metrics_new (metrics_port);
+    if (!metrics)
+        return FALSE;
+    for (AppData *data : app_streams)
+        dd_metrics_watch (metrics, &data->topo, data->stream);
+    dd_metrics_watch_results (metrics, results_writer);
+    dd_metrics_set_streams (metrics, MAX (capture_devs.size(), 1));
+    return dd_metrics_start (metrics);
+}
+
+/* The endpoint reads queue and element counters of the pipelines */
+static void
+stop_metrics () {
+    dd_metrics_free (metrics);
+    metrics = NULL;
+}
+
 /** @brief
  *  This function is the callback function required to hadnle the
  *  incoming bus messages.
@@ -159,6 +806,13 @@ message_cb (GstBus *bus, GstMessage *msg, AppData *data) {
             g_main_loop_quit (loop);
         }
     break;
+    case GST_MESSAGE_APPLICATION:
+        if (gst_message_has_name (msg, DD_BENCH_DONE_MESSAGE)) {
+            GST_DEBUG ("Benchmark is over");
+            if (loop && g_main_loop_is_running (loop))
+                g_main_loop_quit (loop);
+        }
+    break;
     case GST_MESSAGE_EOS:
         /* end-of-stream */
         GST_DEBUG ("End Of Stream");
@@ -200,33 +854,266 @@ error_to_string (gint error_code) {
         case DD_ERROR_STATE_CHANGE_FAIL :
             return "state change failed";
         case DD_ERROR_RESOLUTION_NOT_SUPPORTED :
-            return "Resolution WxH should be 1920x1080";
+            return "Resolution is above what the accelerators support";
         case DD_ERROR_INPUT_OPTIONS_INVALID :
             return "Input options are incorrect";
         case DD_ERROR_OVERLAY_CREATION_FAIL :
             return "overlay creation is failed for the display";
 	case DD_ERROR_FILE_DUMP_IN_DEMO_NOT_SUPPORTED:
 	    return "Demo mode is not supported for file sink";
+        case DD_ERROR_DUMP_OPTION_INVALID :
+            return "Dump option must be stage:file with stage raw, preprocess or final";
+        case DD_ERROR_BENCHMARK_OPTIONS_INVALID :
+            return "Benchmark mode cannot be combined with demo mode or a file output";
+        case DD_ERROR_RESULTS_FORMAT_INVALID :
+            return "Results format must be jsonl, csv or bin";
+        case DD_ERROR_BATCH_OPTIONS_INVALID :
+            return "Batch mode cannot be combined with -i, -f, -D, -l, -T, demo mode or benchmark mode";
+        case DD_ERROR_MEDIA_DEVICE_INVALID :
+            return "Media devices only apply to camera input, at most 4 of them";
+        case DD_ERROR_CAPTURE_SETUP_FAIL :
+            return "Could not configure the capture pipeline of the camera";
+        case DD_ERROR_CONTROL_SOCKET_FAIL :
+            return "Could not listen on the control socket";
+        case DD_ERROR_METRICS_FAIL :
+            return "Could not serve the metrics endpoint";
         default :
             return "Unknown Error";
     }
     return "Unknown Error";
 }
+/** @brief
+ *  This function returns the number of -D dumps of a pipeline.
+ *
+ *  Only the first input is dumped.
+ *
+ *  @param data is the application structure.
+ *  @return number of dumps.
+ */
+static guint
+stream_dumps (AppData *data) {
+    return data->source ? 0 : dump_outputs.size();
+}
+
+/** @brief
+ *  This function returns the kernel config file of a stream.
+ *
+ *  The first stream uses the installed file. The others get a copy
+ *  with their stream_id, which the kernels key their statistics and
+ *  their turn on the compute units with.
+ *
+ *  @param config_file is the installed kernel config.
+ *  @param stream is the stream.
+ *  @return config file path.
+ */
+static string
+stream_kernel_config (const string &config_file, guint stream) {
+    json_error_t jerror;
+    json_t *root, *kernels, *config;
+    gchar *base, *name, *path;
+    string out = config_file;
+
+    if (stream == 0)
+        return out;
+    root = json_load_file (config_file.c_str(), 0, &jerror);
+    if (!root) {
+        GST_ERROR ("Could not read %s: %s", config_file.c_str(), jerror.text);
+        return out;
+    }
+    kernels = json_object_get (root, "kernels");
+    for (size_t i = 0; i < json_array_size (kernels); i++) {
+        config = json_object_get (json_array_get (kernels, i), "config");
+        if (json_is_object (config))
+            json_object_set_new (config, "stream_id", json_integer (stream));
+    }
+
+    base = g_path_get_basename (config_file.c_str());
+    name = g_strdup_printf ("mv-defect-detect-%d-stream%u-%s", getpid (), stream, base);
+    path = g_build_filename (g_get_tmp_dir (), name, NULL);
+    if (json_dump_file (root, path, JSON_INDENT (2)) == 0) {
+        out = path;
+        stream_configs.push_back (out);
+    } else {
+        GST_ERROR ("Could not write %s", path);
+    }
+    g_free (path);
+    g_free (name);
+    g_free (base);
+    json_decref (root);
+    return out;
+}
+
+/** @brief
+ *  This function sets the capture io-mode when mediasrcbin creates its
+ *  V4L2 source, so frames are never copied out of the capture buffers.
+ *
+ *  @param bin is the source bin.
+ *  @param sub_bin is the bin the element was added to.
+ *  @param element is the new element.
+ *  @param user_data is the application structure.
+ *  @return Void.
+ */
 void
 on_deep_element_added (GstBin *bin,
                        GstBin *sub_bin,
                        GstElement *element,
                        gpointer user_data) {
-    guint *enable_roi = (guint *) user_data;
+    AppData *data = (AppData *) user_data;
     GstElementFactory *factory = gst_element_get_factory (element);
     const gchar *klass = gst_element_factory_get_klass(factory);
-    if (!g_strcmp0 (klass, "Source/Video") && dp ==0 && !file_dump) {
-        if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "io-mode")) {
-            GST_DEBUG ("Setting io-mode to dmabuf-import");
-            g_object_set (G_OBJECT(element), "io-mode", 5, NULL);
+    GstElement *first;
+    gint io_mode;
+
+    if (g_strcmp0 (klass, "Source/Video") || !g_object_class_find_property(G_OBJECT_GET_CLASS(element), "io-mode"))
+        return;
+    first = data->topo.chain.size () > 1 ? dd_topology_get (&data->topo, data->topo.chain[1].c_str()) : NULL;
+    if (!first)
+        return;
+    io_mode = dd_dmabuf_capture_io_mode (first);
+    GST_DEBUG ("Setting io-mode of %s to %s", GST_ELEMENT_NAME (element),
+               io_mode == DD_V4L2_IO_MODE_DMABUF_IMPORT ? "dmabuf-import" : "dmabuf");
+    g_object_set (G_OBJECT(element), "io-mode", io_mode, NULL);
+}
+
+/** @brief
+ *  This function returns the framerate of the source.
+ *
+ *  Input files are played at the demo mode rate in demo mode.
+ *
+ *  @return frames per second.
+ */
+static guint
+source_framerate () {
+    return (file_playback && demo_mode) ? MAX_DEMO_MODE_FRAME_RATE : framerate;
+}
+
+/** @brief
+ *  This function extracts the result attached by the overlay stage.
+ *
+ *  @param buf is the buffer that went through the overlay stage.
+ *  @param base_time is the base time of the pipeline.
+ *  @param record is filled with the result.
+ *  @return TRUE if the buffer carries a result.
+ */
+static gboolean
+get_frame_result (GstBuffer *buf, GstClockTime base_time, DDResultRecord *record) {
+    GstInferenceMeta *meta;
+    GstInferenceClassification *result = NULL;
+    GSList *children;
+
+    meta = (GstInferenceMeta *) gst_buffer_get_meta (buf, gst_inference_meta_api_get_type ());
+    if (!meta || !meta->prediction)
+        return FALSE;
+
+    children = gst_inference_prediction_get_children (meta->prediction);
+    for (GSList *child = children; child && !result; child = g_slist_next (child)) {
+        GstInferencePrediction *pred = (GstInferencePrediction *) child->data;
+        for (GList *l = pred->classifications; l; l = g_list_next (l)) {
+            GstInferenceClassification *c = (GstInferenceClassification *) l->data;
+            if (!g_strcmp0 (c->class_label, DD_RESULT_LABEL) && c->num_classes >= DD_RESULT_VALUES) {
+                result = c;
+                break;
+            }
+        }
+    }
+    g_slist_free (children);
+    if (!result)
+        return FALSE;
+
+    record->frame         = (guint64) result->probabilities[DD_RESULT_FRAME];
+    record->pts           = GST_BUFFER_PTS (buf);
+    record->threshold     = (guint32) result->probabilities[DD_RESULT_THRESHOLD];
+    record->fruit_pixels  = (guint32) result->probabilities[DD_RESULT_FRUIT_PIXELS];
+    record->defect_pixels = (guint32) result->probabilities[DD_RESULT_DEFECT_PIXELS];
+    record->density       = result->probabilities[DD_RESULT_DENSITY];
+    record->decision      = result->class_id ? 1 : 0;
+    record->latency_ms    = -1;
+    record->fruit         = 0;
+    record->fruits        = 0;
+    record->reserved      = 0;
+    /* The pipeline runs on the monotonic system clock, the same one the
+     * overlay stamps its decision with */
+    if (GST_BUFFER_PTS_IS_VALID (buf) && GST_CLOCK_TIME_IS_VALID (base_time)) {
+        gdouble capture = (gdouble) (base_time + GST_BUFFER_PTS (buf));
+        if (result->probabilities[DD_RESULT_DONE_NS] >= capture)
+            record->latency_ms = (result->probabilities[DD_RESULT_DONE_NS] - capture) / 1e6;
+    }
+    return TRUE;
+}
+
+/** @brief
+ *  This function is called by the results appsink for every frame.
+ *
+ *  It only queues the record; the file is written by the writer thread.
+ *
+ *  @param sink is the results appsink.
+ *  @param user_data is the application structure.
+ *  @return GstFlowReturn.
+ */
+static GstFlowReturn
+results_sample_cb (GstAppSink *sink, gpointer user_data) {
+    AppData *data = (AppData *) user_data;
+    GstSample *sample = gst_app_sink_pull_sample (sink);
+    DDResultRecord record;
+
+    if (!sample)
+        return GST_FLOW_EOS;
+    if (get_frame_result (gst_sample_get_buffer (sample), gst_element_get_base_time (GST_ELEMENT (sink)), &record)) {
+        vector<guint32> fruits;
+        record.source = data->source;
+        /* When tracking, the frame was inspected for one or more fruits. Its
+         * single decision goes into a record per fruit, each marked with
+         * the number of fruits sharing it: the statistics count the frame
+         * once, and a defect on one fruit says nothing of the others */
+        if (data->gate)
+            dd_gate_take_fruits (data->gate, record.pts, fruits);
+        record.fruits = fruits.size ();
+        for (guint32 fruit : fruits) {
+            record.fruit = fruit;
+            dd_results_writer_push (data->results_writer, &record);
         }
+        if (fruits.empty ())
+            dd_results_writer_push (data->results_writer, &record);
+    }
+    else
+        GST_DEBUG ("Frame without result");
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+}
+
+/* Result of a recorded frame, read by the recording writer */
+static gboolean
+rec_frame_result (GstBuffer *buf, DDResultRecord *record) {
+    return get_frame_result (buf, GST_CLOCK_TIME_NONE, record);
+}
+
+/** @brief
+ *  This function returns the element writing the -f or -D file.
+ *
+ *  @param location is the file.
+ *  @return element factory name.
+ */
+static const gchar *
+file_sink (const gchar *location) {
+    return dd_rec_is_recording (location) ? "appsink" : "filesink";
+}
+
+/** @brief
+ *  This function points an element created by file_sink () to its file.
+ *
+ *  @param sink is the element.
+ *  @param location is the file.
+ *  @return FALSE if the recording cannot be created.
+ */
+static gboolean
+set_file_sink (GstElement *sink, const gchar *location) {
+    if (!dd_rec_is_recording (location)) {
+        g_object_set (G_OBJECT (sink), "location", location, NULL);
+        return TRUE;
     }
+    return dd_rec_writer_new (sink, location, rec_frame_result) != NULL;
 }
+
 /** @brief
  *  This function is to set the GstElement properties.
  *
@@ -239,302 +1126,800 @@ on_deep_element_added (GstBin *bin,
  */
 DD_ERROR_LOG
 set_pipeline_config (AppData *data) {
-    gint block_size;
     GstCaps *caps;
     string config_file(config_path);
     gint ret = DD_SUCCESS;
     if (file_playback) {
-        block_size = width * height;
-        g_object_set(G_OBJECT(data->src),            "location",  in_file,         NULL);
-        g_object_set(G_OBJECT(data->src),            "blocksize", block_size,      NULL);
-    } else {
-        g_object_set(G_OBJECT(data->src),            "media-device", "/dev/media0", NULL);
-        g_signal_connect (GST_BIN (data->src),       "deep-element-added", G_CALLBACK (on_deep_element_added), NULL);
+        DDMmapSrcConfig src_config;
+        src_config.location    = data->location;
+        src_config.width       = width;
+        src_config.height      = height;
+        src_config.fps_n       = source_framerate ();
+        src_config.fps_d       = MAX_FRAME_RATE_DENOM;
+        src_config.start_frame = MAX (start_frame, 0);
+        src_config.end_frame   = MAX (end_frame, 0);
+        src_config.loop        = loop_input || benchmark;
+        src_config.pace        = pace_input || demo_mode;
+        data->mmapsrc = dd_mmapsrc_new (data->src, &src_config);
+        if (!data->mmapsrc)
+            return DD_ERROR_FILE_IO;
+    } else if (!benchmark) {
+        g_object_set(G_OBJECT(data->src),            "media-device", data->media_device, NULL);
+        g_signal_connect (GST_BIN (data->src),       "deep-element-added", G_CALLBACK (on_deep_element_added), data);
     }
-    if (file_dump) {
-        g_object_set(G_OBJECT(data->sink),       "location",  out_file,        NULL);
-        //g_object_set(G_OBJECT(data->sink_preprocess),"location",  preprocess_out, NULL);
-        //g_object_set(G_OBJECT(data->sink_display),   "location",  final_out,      NULL);
+    for (guint i = 0; i < stream_dumps (data); i++) {
+        string name = "dump" + to_string(i);
+        if (!set_file_sink (dd_topology_get (&data->topo, name.c_str()), dump_outputs[i].location.c_str()))
+            return DD_ERROR_FILE_IO;
+    }
+    if (data->headless) {
+        g_object_set(G_OBJECT(data->sink),          "sync",      FALSE,           NULL);
+    } else if (file_dump) {
+        if (!set_file_sink (data->sink, out_file))
+            return DD_ERROR_FILE_IO;
     } else {
         g_object_set(G_OBJECT(data->sink),          "bus-id",       DRM_BUS_ID,  NULL);
+        if (file_playback) {
+            /* The source paces itself, show frames as soon as they are ready */
+            g_object_set(G_OBJECT(data->sink),      "sync",         FALSE,       NULL);
+        }
         if (demo_mode) {
-            caps  = gst_caps_new_simple ("video/x-raw",
-                                         "framerate", GST_TYPE_FRACTION, MAX_DEMO_MODE_FRAME_RATE, MAX_FRAME_RATE_DENOM,
-                                         NULL);
-            GST_DEBUG ("new Caps for raw capsfilter %" GST_PTR_FORMAT, caps);
-            g_object_set (G_OBJECT (data->capsfilter_vr),  "caps",  caps, NULL);
-            gst_caps_unref (caps);
-            if (file_playback) {
-                g_object_set (G_OBJECT (data->rawvparse),  "use-sink-caps", FALSE,                    NULL);
-                g_object_set (G_OBJECT (data->rawvparse),  "width",         width,                    NULL);
-                g_object_set (G_OBJECT (data->rawvparse),  "height",        height,                   NULL);
-                g_object_set (G_OBJECT (data->rawvparse),  "format",        GST_VIDEO_FORMAT_GRAY8,     NULL);
-                g_object_set (G_OBJECT (data->rawvparse),  "framerate",     MAX_DEMO_MODE_FRAME_RATE, MAX_FRAME_RATE_DENOM, NULL);
+            if (data->capsfilter_vr) {
+                caps  = gst_caps_new_simple ("video/x-raw",
+                                             "framerate", GST_TYPE_FRACTION, MAX_DEMO_MODE_FRAME_RATE, MAX_FRAME_RATE_DENOM,
+                                             NULL);
+                GST_DEBUG ("new Caps for raw capsfilter %" GST_PTR_FORMAT, caps);
+                g_object_set (G_OBJECT (data->capsfilter_vr),  "caps",  caps, NULL);
+                gst_caps_unref (caps);
             }
         }
     }
-    caps  = gst_caps_new_simple ("video/x-raw",
-                                 "width",     G_TYPE_INT,        width,
-                                 "height",    G_TYPE_INT,        height,
-                                 "format",    G_TYPE_STRING,     CAPTURE_FORMAT_Y8,
-                                 "framerate", GST_TYPE_FRACTION, framerate, MAX_FRAME_RATE_DENOM,
-                                 NULL);
-    GST_DEBUG ("new Caps for src capsfilter %" GST_PTR_FORMAT, caps);
-    g_object_set (G_OBJECT (data->capsfilter),  "caps",  caps, NULL);
-    gst_caps_unref (caps);
-
-
-    caps  = gst_caps_new_simple ("video/x-raw",
-                                 "width",     G_TYPE_INT,        width,
-                                 "height",    G_TYPE_INT,        height,
-                                 "stride-align",    G_TYPE_INT,  stride_align,
-                                 "format",    G_TYPE_STRING,     CAPTURE_FORMAT_Y8,
-                                 NULL);
-    GST_DEBUG ("new Caps for src capsfilter_op %" GST_PTR_FORMAT, caps);
-
-    g_object_set (G_OBJECT (data->capsfilter_op),  "caps",  caps, NULL);
-    gst_caps_unref (caps);
-    if (file_dump){
-    config_file.append(PRE_PROCESS_JSON_FILE);
-    }else{
-    config_file.append(PRE_PROCESS_STRIDE_JSON_FILE);
-    }
-    g_object_set (G_OBJECT(data->preprocess), "kernels-config", config_file.c_str(), NULL);
-    GST_DEBUG ("Config file path is %s", config_file.c_str());
-
-    config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
-    config_file.append(OTSU_ACC_JSON_FILE);
-    g_object_set (G_OBJECT(data->otsu),   "kernels-config", config_file.c_str(), NULL);
-    GST_DEBUG ("Config file path is %s", config_file.c_str());
-
-    config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
-    config_file.append(CCA_ACC_JSON_FILE);
-    g_object_set (G_OBJECT(data->cca),    "kernels-config", config_file.c_str(), NULL);
-    GST_DEBUG ("Config file path is %s", config_file.c_str());
-
-    config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
-    config_file.append(TEXT_2_OVERLAY_JSON_FILE);
-    g_object_set (G_OBJECT(data->text2overlay), "kernels-config", config_file.c_str(), NULL);
-    GST_DEBUG ("Config file path is %s", config_file.c_str());
+    if (data->merge) {
+        /* Both inputs carry the same frames, keep the caps of the first */
+        g_object_set (G_OBJECT (data->merge), "forward-sticky-events", FALSE, NULL);
+    }
+    if (data->results) {
+        GstAppSinkCallbacks callbacks = { NULL, NULL, results_sample_cb };
+        g_object_set (G_OBJECT (data->results), "sync", FALSE, "enable-last-sample", FALSE, NULL);
+        gst_app_sink_set_callbacks (GST_APP_SINK (data->results), &callbacks, data, NULL);
+    }
+    if (data->capsfilter) {
+        caps  = gst_caps_new_simple ("video/x-raw",
+                                     "width",     G_TYPE_INT,        width,
+                                     "height",    G_TYPE_INT,        height,
+                                     "format",    G_TYPE_STRING,     CAPTURE_FORMAT_Y8,
+                                     "framerate", GST_TYPE_FRACTION, source_framerate (), MAX_FRAME_RATE_DENOM,
+                                     NULL);
+        GST_DEBUG ("new Caps for src capsfilter %" GST_PTR_FORMAT, caps);
+        g_object_set (G_OBJECT (data->capsfilter),  "caps",  caps, NULL);
+        gst_caps_unref (caps);
+    }
+
+    if (data->capsfilter_op) {
+        caps  = gst_caps_new_simple ("video/x-raw",
+                                     "width",     G_TYPE_INT,        width,
+                                     "height",    G_TYPE_INT,        height,
+                                     "stride-align",    G_TYPE_INT,  stride_align,
+                                     "format",    G_TYPE_STRING,     CAPTURE_FORMAT_Y8,
+                                     NULL);
+        GST_DEBUG ("new Caps for src capsfilter_op %" GST_PTR_FORMAT, caps);
+
+        g_object_set (G_OBJECT (data->capsfilter_op),  "caps",  caps, NULL);
+        gst_caps_unref (caps);
+    }
+    if (data->preprocess) {
+        config_file.append(PRE_PROCESS_JSON_FILE);
+        dd_reload_watch (reload, PRE_PROCESS_JSON_FILE);
+        g_object_set (G_OBJECT(data->preprocess), "kernels-config", stream_kernel_config (config_file, data->stream).c_str(), NULL);
+        GST_DEBUG ("Config file path is %s", config_file.c_str());
+    }
+
+    if (data->otsu) {
+        config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
+        config_file.append(OTSU_ACC_JSON_FILE);
+        g_object_set (G_OBJECT(data->otsu),   "kernels-config", stream_kernel_config (config_file, data->stream).c_str(), NULL);
+        GST_DEBUG ("Config file path is %s", config_file.c_str());
+    }
+
+    if (data->cca) {
+        config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
+        config_file.append(CCA_ACC_JSON_FILE);
+        g_object_set (G_OBJECT(data->cca),    "kernels-config", stream_kernel_config (config_file, data->stream).c_str(), NULL);
+        GST_DEBUG ("Config file path is %s", config_file.c_str());
+    }
+
+    if (data->text2overlay) {
+        config_file.erase (config_file.begin()+ strlen(config_path), config_file.end()-0);
+        config_file.append(TEXT_2_OVERLAY_JSON_FILE);
+        dd_reload_watch (reload, TEXT_2_OVERLAY_JSON_FILE);
+        g_object_set (G_OBJECT(data->text2overlay), "kernels-config", stream_kernel_config (config_file, data->stream).c_str(), NULL);
+        GST_DEBUG ("Config file path is %s", config_file.c_str());
+    }
     return DD_SUCCESS;
 }
 
 /** @brief
- *  This function is to link all the elements required to run defect
- *  detect use case.
+ *  This function reads the application level settings from
+ *  pipeline.json in the config path.
  *
- *  Link live playback pipeline.
+ *  The file is optional. Values given on the command line take
+ *  precedence over the ones from the file.
  *
- *  @param data is the application structure pointer.
- *  @return Error code.
+ *  @return Void.
  */
-DD_ERROR_LOG
-link_pipeline (AppData *data) {
-    gchar *name1, *name2;
-    gint ret = DD_SUCCESS;
-    if (!file_playback && !demo_mode) {
-        if (dp ==0) {
-            if (!gst_element_link_many(data->capsfilter, data->q_raw, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for capsfilter --> queue --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linked for capsfilter --> queue --> perf --> sink successfully");
-        } else if (dp ==1) {
-            if (!gst_element_link_many(data->capsfilter, data->otsu, data->queue, data->preprocess, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for capsfilter --> otsu --> queue --> preprocess --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for capsfilter --> otsu --> queue --> preprocess --> perf --> sink successfully");
-        } else if (dp ==2) {
-            if (!gst_element_link_many(data->capsfilter, data->otsu, data->queue, data->preprocess, data->q_raw, data->cca, \
-                                        /*data->q_raw,*/ data->text2overlay, data->q_raw_1,data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for caps --> otsu --> q --> preprocess --> q --> cca --> text2overlay --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
+static void
+load_app_config () {
+    string config_file(config_path);
+    json_error_t jerror;
+    json_t *root, *val;
+
+    config_file.append(PIPELINE_JSON_FILE);
+    root = json_load_file (config_file.c_str(), JSON_DECODE_ANY, &jerror);
+    if (!root) {
+        GST_DEBUG ("No application config %s: %s", config_file.c_str(), jerror.text);
+        return;
+    }
+
+    val = json_object_get (root, "topology");
+    if (!topology && val && json_is_string (val) && strlen (json_string_value (val)))
+        topology = g_strdup (json_string_value (val));
+
+    val = json_object_get (root, "queue-policy");
+    if (!queue_policy && val && json_is_string (val))
+        queue_policy = g_strdup (json_string_value (val));
+
+    val = json_object_get (root, "queues");
+    if (json_is_object (val)) {
+        const gchar *name;
+        json_t *entry;
+        json_object_foreach (val, name, entry) {
+            DDQueueConfig queue_config;
+            if (!dd_queue_config_from_json (entry, &queue_config)) {
+                g_printerr ("Ignoring invalid policy of queue %s in %s\n", name, config_file.c_str());
+                continue;
             }
-            GST_DEBUG ("Linking for caps --> otsu --> q --> preprocess --> q --> cca --> text2overlay --> perf --> sink successfully");
+            queue_configs[name] = queue_config;
         }
-    } else if (!file_playback && demo_mode) {
-        if (dp ==0) {
-            if (!gst_element_link_many(data->capsfilter, data->videorate, data->capsfilter_vr, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for capsfilter --> videorate --> capfilter --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linked for capsfilter --> videorate --> capfilter --> perf --> sink successfully");
-        } else if (dp ==1) {
-            if (!gst_element_link_many(data->capsfilter, data->otsu, data->preprocess, data->videorate, \
-                                       data->capsfilter_vr, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for caps --> otsu --> preprocess --> rate --> caps --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for caps --> otsu --> preprocess --> rate --> caps --> perf --> sink successfully");
-        } else if (dp ==2) {
-            if (!gst_element_link_many(data->capsfilter, data->otsu,data->queue, data->preprocess,data->q_raw, data->cca, data->text2overlay, \
-                                       data->q_raw_1, data->videorate, data->capsfilter_vr, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for caps --> otsu --> pp --> cca --> text2overlay --> rate --> caps --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for caps --> otsu --> pp --> cca --> text2overlay --> rate --> caps --> perf --> sink successfully");
-        } 
-    } else if (file_playback && !demo_mode) {
-        if (dp == 0) {
-            if (!gst_element_link_many(data->src, data->capsfilter, data->q_raw, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> caps --> queue --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linked for src --> caps --> queue --> perf --> sink successfully");
-        } else if (dp ==1) {
-            if (!gst_element_link_many(data->src, data->capsfilter, data->otsu, data->queue, data->preprocess, \
-                                       data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> caps --> otsu --> queue --> preprocess --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for src --> caps --> otsu --> queue --> preprocess --> perf --> sink successfully");
-        } else if (dp ==2) {
-            if (!gst_element_link_many(data->src, data->queue, data->capsfilter, data->otsu/*, data->queue*/, data->preprocess, data->q_raw, \
-                                       data->cca, data->text2overlay, data->q_raw_1, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> caps --> otsu --> q --> pp --> q --> cca --> text2overlay --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
+    }
+
+    val = json_object_get (root, "pools");
+    if (json_is_object (val)) {
+        const gchar *name;
+        json_t *entry;
+        json_object_foreach (val, name, entry) {
+            DDPoolConfig pool_config;
+            if (!dd_pool_config_from_json (entry, &pool_config)) {
+                g_printerr ("Ignoring invalid pool of stage %s in %s\n", name, config_file.c_str());
+                continue;
             }
-            GST_DEBUG ("Linking for src --> caps --> otsu --> q --> pp --> q --> cca --> text2overlay --> perf --> sink successfully");
+            pool_configs[name] = pool_config;
         }
-    } else if (file_playback && demo_mode) {
-        if (dp ==0) {
-            if (!gst_element_link_many(data->src,data->capsfilter, data->rawvparse, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> vparse --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linked for src --> vparse --> perf --> sink successfully");
-        } else if (dp ==1) {
-            if (!gst_element_link_many(data->src, data->rawvparse, data->otsu, data->preprocess, \
-                                       data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> vparse --> otsu --> preprocess --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for src --> vparse --> otsu --> preprocess --> perf --> sink successfully");
-        } else if (dp ==2) {
-            if (!gst_element_link_many(data->src, data->rawvparse, data->otsu, data->queue, data->preprocess,data->q_raw, data->cca, data->text2overlay, \
-                                       data->q_raw_1, data->capsfilter_op, data->perf, data->sink, NULL)) {
-                GST_ERROR ("Error linking for src --> vparse --> otsu --> preprocess --> cca --> text2overlay --> perf --> sink");
-                return DD_ERROR_PIPELINE_LINKING_FAIL;
-            }
-            GST_DEBUG ("Linking for src --> vparse --> otsu --> preprocess --> cca --> text2overlay --> perf --> sink successfully");
+    }
+
+    val = json_object_get (root, "gate");
+    if (val) {
+        gboolean enabled = FALSE;
+        if (!dd_gate_config_from_json (val, &gate_config, &enabled))
+            g_printerr ("Ignoring invalid gate config in %s\n", config_file.c_str());
+        else if (enabled)
+            gate = TRUE;
+    }
+
+    val = json_object_get (root, "threads");
+    if (val) {
+        gboolean enabled = TRUE;
+        if (!dd_affinity_config_from_json (val, &affinity_config, &enabled))
+            g_printerr ("Ignoring invalid thread placement in %s\n", config_file.c_str());
+        else
+            affinity = enabled;
+    }
+
+    json_decref (root);
+}
+
+/** @brief
+ *  This function parses the --dump options.
+ *
+ *  @return Error code.
+ */
+static DD_ERROR_LOG
+parse_dump_outputs () {
+    for (gchar **dump = dumps; dump && *dump; dump++) {
+        const gchar *sep = strchr (*dump, ':');
+        DumpOutput out;
+        string stage;
+
+        if (!sep || !sep[1])
+            return DD_ERROR_DUMP_OPTION_INVALID;
+        stage.assign (*dump, sep - *dump);
+        if (stage == "raw" || stage == "0") {
+            out.stage = STAGE_RAW;
+        } else if (stage == "preprocess" || stage == "1") {
+            out.stage = STAGE_PREPROCESS;
+        } else if (stage == "final" || stage == "2") {
+            out.stage = STAGE_FINAL;
+        } else {
+            return DD_ERROR_DUMP_OPTION_INVALID;
         }
+        out.location = sep + 1;
+        dump_outputs.push_back (out);
     }
     return DD_SUCCESS;
 }
 
+/** @brief
+ *  This function returns the stage whose output is the given
+ *  display/dump stage.
+ *
+ *  @param stage is one of the STAGE_* values.
+ *  @return stage name in the topology.
+ */
+static const gchar *
+stage_tap (guint stage) {
+    if (stage >= STAGE_FINAL)
+        return "text2overlay";
+    if (stage == STAGE_PREPROCESS)
+        return "preprocess";
+    return "caps";
+}
+
+/** @brief
+ *  This function derives the processing stages to link from the
+ *  input and demo mode options.
+ *
+ *  The chain goes as far as the deepest stage that is displayed or
+ *  dumped. Outputs are attached to it as branches, queues are added
+ *  by the queue policy when the topology is built.
+ *
+ *  @param stage is the deepest STAGE_* value in use.
+ *  @return topology description.
+ */
+static string
+default_topology (guint stage) {
+    string desc;
+
+    desc = "src ! caps";
+
+    if (stage >= STAGE_PREPROCESS && gate)
+        desc += " ! " DD_GATE_STAGE;
+    if (stage >= STAGE_PREPROCESS)
+        desc += " ! otsu ! preprocess";
+    if (stage >= STAGE_FINAL)
+        desc += " ! cca ! text2overlay";
+    return desc;
+}
+
+/** @brief
+ *  This function derives the display, or -f file, branch.
+ *
+ *  @param data is the application structure.
+ *  @return branch description.
+ */
+static string
+display_branch (AppData *data) {
+    string desc;
+
+    /* Frames without fruit join the display here, past the accelerators */
+    if (data->stage >= STAGE_PREPROCESS && gate)
+        desc += DD_GATE_MERGE_STAGE " ! ";
+    if (!file_playback && demo_mode && !data->headless)
+        desc += "videorate ! caps_vr ! ";
+    if (data->stage >= STAGE_PREPROCESS)
+        desc += "caps_op ! ";
+    desc += "perf ! sink";
+    return desc;
+}
+
 /** @brief
  *  This function is to create a pipeline required to run defect
  *  detect use case.
  *
- *  All GStreamer elements instance has to be created and add
- *  into the pipeline bin. Also link file based pipeline.
+ *  Every stage the application knows about is registered with the
+ *  topology builder, which instantiates and links only the ones named
+ *  in the topology and inserts queues according to the queue policy.
  *
  *  @param data is the application structure pointer.
  *  @return Error code.
  */
 DD_ERROR_LOG
 create_pipeline (AppData *data) {
+    DDTopology *topo = &data->topo;
+    const gchar *sink_name = NULL;
+    string desc;
+    guint deepest = data->stage;
+
     data->pipeline =   gst_pipeline_new("defectdetection");
+    if (!data->pipeline) {
+        GST_ERROR ("could not create pipeline");
+        return DD_ERROR_PIPELINE_CREATE_FAIL;
+    }
+
     if (file_playback) {
-        data->src               =  gst_element_factory_make("filesrc",      NULL);
+        dd_topology_register (topo, "src",      "appsrc",        NULL, 0);
+    } else if (benchmark) {
+        /* Synthetic frames, produced as fast as the pipeline takes them */
+        dd_topology_register (topo, "src",      "videotestsrc",  NULL, DD_STAGE_ALLOCATES);
     } else {
-        data->src               =  gst_element_factory_make("mediasrcbin",  NULL);
+        dd_topology_register (topo, "src",      "mediasrcbin",   NULL, DD_STAGE_DYNAMIC_SRC);
     }
-    if (file_dump) {
-        data->sink          =  gst_element_factory_make("filesink",     NULL);
-        //data->sink_preprocess   =  gst_element_factory_make("filesink",     NULL);
-        //data->sink_display      =  gst_element_factory_make("filesink",     NULL);
-    } else {
-        if (dp == 0) {
-            data->sink     =  gst_element_factory_make("kmssink",       "display-raw");
-        } else if (dp == 1) {
-            data->sink     =  gst_element_factory_make("kmssink",       "display-preprocess");
-        } else if (dp == 2) {
-            data->sink     =  gst_element_factory_make("kmssink",       "display-final");
-        }
-    }
-    data->capsfilter      =  gst_element_factory_make("capsfilter",    NULL);
-    data->capsfilter_vr   =  gst_element_factory_make("capsfilter",    NULL);
-    data->capsfilter_op   =  gst_element_factory_make("capsfilter",    NULL);
-    data->rawvparse       =  gst_element_factory_make("rawvideoparse", NULL);
-    data->preprocess      =  gst_element_factory_make("vvas_xfilter",  "pre-process");
-    data->otsu            =  gst_element_factory_make("vvas_xfilter",  "otsu");
-    data->cca             =  gst_element_factory_make("vvas_xfilter",  "cca");
-    data->text2overlay    =  gst_element_factory_make("vvas_xfilter",  "text2overlay");
-    data->queue           =  gst_element_factory_make("queue",         NULL);
-    data->q_raw           =  gst_element_factory_make("queue",         NULL);
-    data->q_raw_1           =  gst_element_factory_make("queue",         NULL);
-    data->perf            =  gst_element_factory_make("perf",          "perf-raw");
-    data->videorate       =  gst_element_factory_make("videorate",     NULL);
-
-    if (!data->pipeline || !data->src || !data->rawvparse \
-        || !data->preprocess || !data->otsu || !data->cca || !data->text2overlay \
-        || !data->sink \
-        || !data->queue \
-        || !data->q_raw \
-        || !data->q_raw_1 \
-        || !data->perf || !data->videorate || !data->capsfilter || !data->capsfilter_vr || !data->capsfilter_op) {
-           GST_ERROR ("could not create few elements");
-           return DD_ERROR_PIPELINE_CREATE_FAIL;
+    if (data->headless) {
+        sink_name = "bench-sink";
+    } else if (!file_dump) {
+        if (data->stage == 0) {
+            sink_name = "display-raw";
+        } else if (data->stage == 1) {
+            sink_name = "display-preprocess";
+        } else if (data->stage == 2) {
+            sink_name = "display-final";
+        }
+    }
+    dd_topology_register (topo, "sink",         data->headless ? "fakesink" : file_dump ? file_sink (out_file) : "kmssink",
+                          sink_name, 0);
+    dd_topology_register (topo, "caps",         "capsfilter",    NULL,           DD_STAGE_LIGHT);
+    dd_topology_register (topo, "caps_vr",      "capsfilter",    NULL,           DD_STAGE_LIGHT);
+    dd_topology_register (topo, "caps_op",      "capsfilter",    NULL,           DD_STAGE_LIGHT);
+    dd_topology_register (topo, "otsu",         "vvas_xfilter",  "otsu",         DD_STAGE_ALLOCATES);
+    dd_topology_register (topo, "preprocess",   "vvas_xfilter",  "pre-process",  DD_STAGE_THREAD_BOUNDARY | DD_STAGE_ALLOCATES);
+    dd_topology_register (topo, "cca",          "vvas_xfilter",  "cca",          DD_STAGE_THREAD_BOUNDARY | DD_STAGE_ALLOCATES);
+    dd_topology_register (topo, "text2overlay", "vvas_xfilter",  "text2overlay", DD_STAGE_ALLOCATES);
+    dd_topology_register (topo, "videorate",    "videorate",     NULL,           0);
+    dd_topology_register (topo, "perf",         "perf",          "perf-raw",     DD_STAGE_THREAD_BOUNDARY);
+    for (guint i = 0; i < stream_dumps (data); i++) {
+        string name = "dump" + to_string(i);
+        dd_topology_register (topo, name.c_str(), file_sink (dump_outputs[i].location.c_str()), NULL, 0);
+        deepest = MAX (deepest, dump_outputs[i].stage);
+    }
+    dd_topology_register (topo, "results",      "appsink",       "results",      0);
+    dd_topology_register (topo, DD_GATE_STAGE, "identity",   DD_GATE_STAGE,       DD_STAGE_LIGHT);
+    dd_topology_register (topo, DD_GATE_MERGE_STAGE, "funnel", DD_GATE_MERGE_STAGE, DD_STAGE_LIGHT);
+    if (results_file || batch)
+        deepest = STAGE_FINAL;
+
+    topo->queue_policy = DD_QUEUE_POLICY_BOUNDARY;
+    topo->queue_configs = queue_configs;
+    topo->pool_configs = pool_configs;
+    /* Frame ages follow the clock for the camera and paced files only */
+    topo->live = file_playback ? (pace_input || demo_mode) : !benchmark;
+    if (queue_policy && !dd_queue_policy_from_string (queue_policy, &topo->queue_policy)) {
+        GST_ERROR ("Unknown queue policy %s", queue_policy);
+        return DD_ERROR_INPUT_OPTIONS_INVALID;
+    }
+
+    desc = topology ? string (topology) : default_topology (deepest);
+    GST_DEBUG ("Topology is %s", desc.c_str());
+    if (!dd_topology_parse (topo, desc.c_str())) {
+        return DD_ERROR_INPUT_OPTIONS_INVALID;
+    }
+    /* A hand-written topology may already end in the sink */
+    if (!dd_topology_has_stage (topo, "sink")) {
+        desc = display_branch (data);
+        GST_DEBUG ("Display branch after %s is %s", stage_tap (data->stage), desc.c_str());
+        if (!dd_topology_add_branch (topo, stage_tap (data->stage), desc.c_str(), FALSE)) {
+            return DD_ERROR_INPUT_OPTIONS_INVALID;
+        }
+    }
+    for (guint i = 0; i < stream_dumps (data); i++) {
+        string name = "dump" + to_string(i);
+        GST_DEBUG ("Dump branch after %s to %s", stage_tap (dump_outputs[i].stage), dump_outputs[i].location.c_str());
+        if (!dd_topology_add_branch (topo, stage_tap (dump_outputs[i].stage), name.c_str(), TRUE)) {
+            return DD_ERROR_INPUT_OPTIONS_INVALID;
+        }
+    }
+    if (results_file) {
+        /* Leaky, a slow consumer must never hold the inspection back;
+         * offline, every record counts */
+        if (!dd_topology_add_branch (topo, stage_tap (STAGE_FINAL), "results", !batch)) {
+            return DD_ERROR_INPUT_OPTIONS_INVALID;
+        }
+    }
+    if (dd_topology_has_stage (topo, DD_GATE_STAGE) && dd_topology_has_stage (topo, DD_GATE_MERGE_STAGE) &&
+        !dd_topology_add_bypass (topo, DD_GATE_STAGE, DD_GATE_MERGE_STAGE)) {
+        return DD_ERROR_INPUT_OPTIONS_INVALID;
+    }
+    if (!dd_topology_build (topo, GST_BIN (data->pipeline))) {
+        return DD_ERROR_PIPELINE_LINKING_FAIL;
     }
 
+    data->src           = dd_topology_get (topo, "src");
+    data->sink          = dd_topology_get (topo, "sink");
+    data->capsfilter    = dd_topology_get (topo, "caps");
+    data->capsfilter_vr = dd_topology_get (topo, "caps_vr");
+    data->capsfilter_op = dd_topology_get (topo, "caps_op");
+    data->otsu          = dd_topology_get (topo, "otsu");
+    data->preprocess    = dd_topology_get (topo, "preprocess");
+    data->cca           = dd_topology_get (topo, "cca");
+    data->text2overlay  = dd_topology_get (topo, "text2overlay");
+    data->videorate     = dd_topology_get (topo, "videorate");
+    data->perf          = dd_topology_get (topo, "perf");
+    data->results       = dd_topology_get (topo, "results");
+    data->merge         = dd_topology_get (topo, DD_GATE_MERGE_STAGE);
+    data->gate          = dd_gate_new (topo, &gate_config);
+    for (GstElement *element : topo->linked) {
+        if (dd_copy_monitor_wanted (element))
+            dd_copy_monitor_new (element);
+    }
+
+    if (!data->src || !data->sink) {
+        GST_ERROR ("Topology must contain the src and sink stages");
+        return DD_ERROR_INPUT_OPTIONS_INVALID;
+    }
     GST_DEBUG ("All elements are created");
-    gst_bin_add_many(GST_BIN(data->pipeline), data->src, data->rawvparse, \
-                     data->preprocess, data->otsu, data->cca, data->text2overlay, \
-                     data->sink, data->q_raw, data->q_raw_1,\
-                     data->perf, data->videorate, \
-                     data->capsfilter, data->capsfilter_vr, data->capsfilter_op, data->queue, NULL);
     return DD_SUCCESS;
 }
 
-static std::string
-find_capture_dev() {
-    glob_t globbuf;
+/** @brief
+ *  This function prints the defect statistics collected by the
+ *  overlay stage.
+ *
+ *  The same rolling windows are readable from any thread while the
+ *  pipeline is running; this is the summary printed on exit.
+ *
+ *  @param streams is the number of streams.
+ *  @return Void.
+ */
+static void
+print_stats_summary (guint streams) {
+    DDStatsSnapshot snap;
+    guint64 now = dd_stats_now_ns ();
+
+    for (guint i = 0; i < streams; i++) {
+        if (streams > 1)
+            g_print ("Stream %u (%s):\n", i, capture_devs[i].c_str());
+        for (guint w = DD_STATS_WINDOW_1M; w < DD_STATS_WINDOW_COUNT; w++) {
+            if (dd_stats_snapshot (i, (DDStatsWindow) w, now, &snap) != 0 || !snap.frames)
+                continue;
+            g_print ("Defect statistics (%s): frames %" G_GUINT64_FORMAT ", defects %" G_GUINT64_FORMAT
+                     ", yield %.2lf %%, mean density %.3lf %%, max density %.3lf %%\n",
+                     dd_stats_window_name ((DDStatsWindow) w), snap.frames, snap.defects,
+                     dd_stats_yield (&snap), dd_stats_mean_density (&snap), snap.density_max);
+        }
+    }
+}
+
+/** @brief
+ *  This function counts the frames inspected by a batch pipeline.
+ *
+ *  @param pad is the sink pad of the sink.
+ *  @param info is the probe info.
+ *  @param user_data is the application structure of the pipeline.
+ *  @return GstPadProbeReturn.
+ */
+static GstPadProbeReturn
+batch_count_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    AppData *job = (AppData *) user_data;
+    DDResultRecord record;
+
+    job->frames++;
+    if (get_frame_result (GST_PAD_PROBE_INFO_BUFFER (info), GST_CLOCK_TIME_NONE, &record))
+        job->defects += record.decision;
+    return GST_PAD_PROBE_OK;
+}
 
-    glob("/dev/media*", 0, NULL, &globbuf);
-    for (int i = 0; i < globbuf.gl_pathc; i++) {
-        std::ostringstream cmd;
-        cmd << "media-ctl -d " << globbuf.gl_pathv[i] << " -p | grep driver | grep xilinx-video | wc -l";
+static gboolean batch_message_cb (GstBus *bus, GstMessage *msg, AppData *job);
+
+/** @brief
+ *  This function starts the pipeline of the next capture of the batch.
+ *
+ *  A capture whose pipeline cannot be built is counted as failed and
+ *  the following one is tried.
+ *
+ *  @return TRUE if a pipeline was started.
+ */
+static gboolean
+start_batch_clip () {
+    while (batch_run.next < batch_run.clips.size ()) {
+        AppData *job = new AppData ();
+        GstBus *bus;
+        GstPad *pad;
+        gint ret;
 
-        std::string a = exec(cmd.str().c_str());
-        a=a.substr(0, a.find("\n"));
-        if ( a == std::string("1")) {
-            dev_node = globbuf.gl_pathv[i];
-            break;
+        job->source = batch_run.next++;
+        job->location = batch_run.clips[job->source].c_str ();
+        job->results_writer = batch_run.results_writer;
+        job->stage = dp;
+        job->headless = TRUE;
+        ret = create_pipeline (job);
+        if (ret == DD_SUCCESS)
+            ret = set_pipeline_config (job);
+        if (ret == DD_SUCCESS) {
+            pad = gst_element_get_static_pad (job->sink, "sink");
+            gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, batch_count_probe, job, NULL);
+            gst_object_unref (pad);
+            bus = gst_pipeline_get_bus (GST_PIPELINE (job->pipeline));
+            job->bus_watch_id = gst_bus_add_watch (bus, (GstBusFunc)(batch_message_cb), job);
+            gst_object_unref (bus);
+            dd_affinity_watch (job->pipeline);
+            job->started_us = g_get_monotonic_time ();
+            if (gst_element_set_state (job->pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+                GST_DEBUG ("Started %s", job->location);
+                batch_run.running.push_back (job);
+                return TRUE;
+            }
+            ret = DD_ERROR_STATE_CHANGE_FAIL;
+            g_source_remove (job->bus_watch_id);
         }
+        g_printerr ("%s: %s\n", job->location, error_to_string (ret));
+        batch_run.failed++;
+        if (job->pipeline) {
+            gst_element_set_state (job->pipeline, GST_STATE_NULL);
+            gst_object_unref (job->pipeline);
+        }
+        dd_mmapsrc_free (job->mmapsrc);
+        delete job;
     }
-    globfree(&globbuf);
-    return dev_node;
+    return FALSE;
 }
 
+/** @brief
+ *  This function tears down the pipeline of a finished capture and
+ *  starts the next one in its place.
+ *
+ *  @param job is the application structure of the pipeline.
+ *  @param ok is FALSE if the pipeline stopped on an error.
+ *  @return Void.
+ */
+static void
+finish_batch_clip (AppData *job, gboolean ok) {
+    gdouble seconds = (g_get_monotonic_time () - job->started_us) / 1e6;
+
+    gst_element_set_state (job->pipeline, GST_STATE_NULL);
+    gst_object_unref (job->pipeline);
+    dd_mmapsrc_free (job->mmapsrc);
+    batch_run.running.erase (find (batch_run.running.begin (), batch_run.running.end (), job));
+
+    if (ok) {
+        g_print ("[%u/%zu] %s: frames %" G_GUINT64_FORMAT ", defective %" G_GUINT64_FORMAT ", %.1lf fps\n",
+                 job->source + 1, batch_run.clips.size (), job->location, job->frames, job->defects,
+                 seconds > 0 ? job->frames / seconds : 0);
+        batch_run.frames += job->frames;
+        batch_run.defects += job->defects;
+    } else {
+        batch_run.failed++;
+    }
+    delete job;
+
+    start_batch_clip ();
+    if (batch_run.running.empty () && loop && g_main_loop_is_running (loop))
+        g_main_loop_quit (loop);
+}
+
+/** @brief
+ *  This function handles the bus messages of a batch pipeline.
+ *
+ *  The end of a capture only ends its own pipeline.
+ *
+ *  @param bus is the bus of the pipeline.
+ *  @param msg is the message.
+ *  @param job is the application structure of the pipeline.
+ *  @return FALSE once the pipeline is torn down.
+ */
+static gboolean
+batch_message_cb (GstBus *bus, GstMessage *msg, AppData *job) {
+    GError *err;
+    gchar *debug;
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:
+        gst_message_parse_error (msg, &err, &debug);
+        g_printerr ("%s: Error: %s\n", job->location, err->message);
+        g_error_free (err);
+        g_free (debug);
+        finish_batch_clip (job, FALSE);
+        return FALSE;
+    case GST_MESSAGE_EOS:
+        GST_DEBUG ("End Of Stream of %s", job->location);
+        finish_batch_clip (job, TRUE);
+        return FALSE;
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+/** @brief
+ *  This function reads the largest frame each accelerator of the xclbin
+ *  was built for, "max_width" and "max_height" in its kernel config.
+ *
+ *  @param max_width is lowered to the smallest width supported.
+ *  @param max_height is lowered to the smallest height supported.
+ *  @return Void.
+ */
+static void
+kernel_max_resolution (guint *max_width, guint *max_height) {
+    const gchar *accels[] = { OTSU_ACC_JSON_FILE, PRE_PROCESS_JSON_FILE, CCA_ACC_JSON_FILE };
+
+    for (const gchar *accel : accels) {
+        string config_file (config_path);
+        json_error_t jerror;
+        json_t *root, *kernels, *config, *val;
+
+        config_file.append (accel);
+        root = json_load_file (config_file.c_str (), 0, &jerror);
+        if (!root) {
+            GST_WARNING ("Could not read %s: %s", config_file.c_str (), jerror.text);
+            continue;
+        }
+        kernels = json_object_get (root, "kernels");
+        config = json_is_array (kernels) ? json_object_get (json_array_get (kernels, 0), "config") : NULL;
+        val = config ? json_object_get (config, "max_width") : NULL;
+        if (json_is_integer (val))
+            *max_width = MIN (*max_width, (guint) json_integer_value (val));
+        val = config ? json_object_get (config, "max_height") : NULL;
+        if (json_is_integer (val))
+            *max_height = MIN (*max_height, (guint) json_integer_value (val));
+        json_decref (root);
+    }
+}
+
+/** @brief
+ *  This function returns the number of pipelines run at once in batch
+ *  mode, bounded by the compute units of the accelerators and the
+ *  cores unless given with -j.
+ *
+ *  @return number of pipelines.
+ */
+static guint
+batch_jobs () {
+    const gchar *accels[] = { OTSU_ACC_JSON_FILE, PRE_PROCESS_JSON_FILE, CCA_ACC_JSON_FILE };
+    guint units = G_MAXUINT;
+
+    if (jobs > 0)
+        return MIN ((guint) jobs, batch_run.clips.size ());
+    for (const gchar *accel : accels) {
+        string config_file (config_path);
+        config_file.append (accel);
+        units = MIN (units, dd_batch_compute_units (config_file.c_str ()));
+    }
+    GST_DEBUG ("%u compute units per accelerator", units);
+    return dd_batch_default_jobs (units, G_N_ELEMENTS (accels), batch_run.clips.size ());
+}
+
+/** @brief
+ *  This function inspects every capture of the batch, running up to
+ *  @pipelines pipelines at once in this process.
+ *
+ *  The pipelines share the device and the loaded accelerators, and
+ *  push their records to the same results file.
+ *
+ *  @param pipelines is the number of pipelines run at once.
+ *  @return Void.
+ */
+static void
+run_batch (guint pipelines) {
+    gdouble seconds;
+
+    batch_run.started_us = g_get_monotonic_time ();
+    for (guint i = 0; i < pipelines && start_batch_clip (); i++)
+        ;
+    if (!batch_run.running.empty ()) {
+        loop = g_main_loop_new (NULL, FALSE);
+        g_main_loop_run (loop);
+    }
+
+    /* Interrupted, stop the captures still running */
+    batch_run.next = batch_run.clips.size ();
+    while (!batch_run.running.empty ()) {
+        AppData *job = batch_run.running.back ();
+        g_source_remove (job->bus_watch_id);
+        finish_batch_clip (job, FALSE);
+    }
+
+    seconds = (g_get_monotonic_time () - batch_run.started_us) / 1e6;
+    g_print ("Batch: %zu captures, %u failed, frames %" G_GUINT64_FORMAT ", defective %" G_GUINT64_FORMAT
+             ", %.1lf s, %.1lf fps with %u pipelines\n",
+             batch_run.clips.size (), batch_run.failed, batch_run.frames, batch_run.defects,
+             seconds, seconds > 0 ? batch_run.frames / seconds : 0, pipelines);
+}
+
+/** @brief
+ *  This function picks the capture devices of the cameras: the ones
+ *  given with -M, every one found for "-M all", else the first one
+ *  found.
+ *
+ *  @return 0 if every camera is ready.
+ */
 static gint
 check_capture_src() {
-    std::string capturedev("");
-    capturedev = find_capture_dev();
-    if (capturedev == "") {
-        g_printerr("ERROR: Capture device is not ready.\n%s", msg_firmware);
+    std::vector<std::string> found;
+
+    if (!media_devices || !g_strcmp0 (media_devices[0], "all")) {
+        dd_media_find_capture_devs (found);
+        if (found.empty()) {
+            g_printerr("ERROR: Capture device is not ready.\n%s", msg_firmware);
+            return 1;
+        }
+        if (!media_devices)
+            found.resize (1);
+    } else {
+        for (gchar **dev = media_devices; *dev; dev++)
+            found.push_back (*dev);
+    }
+    if (found.size() > DD_STATS_MAX_STREAMS) {
+        g_printerr("ERROR: %s\n", error_to_string (DD_ERROR_MEDIA_DEVICE_INVALID));
         return 1;
     }
 
-    if ( access( capturedev.c_str(), F_OK ) != 0) {
-        g_printerr("ERROR: Device %s is not ready.\n%s", capturedev.c_str(), msg_firmware);
-        return 1;
+    for (const std::string &dev : found) {
+        if ( access( dev.c_str(), F_OK ) != 0) {
+            g_printerr("ERROR: Device %s is not ready.\n%s", dev.c_str(), msg_firmware);
+            return 1;
+        }
     }
+    capture_devs = found;
     return 0;
 }
 
+/** @brief
+ *  This function creates and configures the pipeline of every camera
+ *  after the first one.
+ *
+ *  Only the first camera is shown or written with -f; the others run
+ *  headless up to the decision, with their own kernel stream.
+ *
+ *  @param data is the application structure of the first camera.
+ *  @param cameras is filled with the application structures.
+ *  @return Error code.
+ */
+static DD_ERROR_LOG
+create_camera_pipelines (AppData *data, vector<AppData *> &cameras) {
+    DD_ERROR_LOG ret;
+
+    for (guint i = 1; i < capture_devs.size(); i++) {
+        AppData *cam = new AppData ();
+
+        cameras.push_back (cam);
+        cam->media_device   = capture_devs[i].c_str();
+        cam->source         = i;
+        cam->stream         = i;
+        cam->stage          = STAGE_FINAL;
+        cam->headless       = TRUE;
+        cam->results_writer = data->results_writer;
+        ret = create_pipeline (cam);
+        if (ret == DD_SUCCESS)
+            ret = set_pipeline_config (cam);
+        if (ret != DD_SUCCESS) {
+            g_printerr ("%s: ", cam->media_device);
+            return ret;
+        }
+    }
+    return DD_SUCCESS;
+}
+
+/** @brief
+ *  This function prints how the streams shared the accelerators.
+ *
+ *  @param streams is the number of streams.
+ *  @return Void.
+ */
+static void
+print_sched_summary (guint streams) {
+    const gchar *kernels[] = { DD_SCHED_KERNEL_OTSU, DD_SCHED_KERNEL_PREPROCESS, DD_SCHED_KERNEL_CCA };
+    DDSchedStats st;
+
+    for (const gchar *kernel : kernels) {
+        for (guint i = 0; i < streams; i++) {
+            if (dd_sched_stats (kernel, i, &st) != 0 || !st.calls)
+                continue;
+            g_print ("Stream %u %-10s: calls %" G_GUINT64_FORMAT ", wait mean %.3lf ms max %.3lf ms, busy mean %.3lf ms"
+                     ", timeouts %" G_GUINT64_FORMAT "\n", i, kernel, st.calls, st.wait_ns / 1e6 / st.calls,
+                     st.wait_max_ns / 1e6, st.busy_ns / 1e6 / st.calls, st.timeouts);
+        }
+    }
+}
+
 gint
 main (int argc, char **argv) {
-    AppData data;
+    AppData data = AppData ();
     GstBus *bus;
     gint ret = DD_SUCCESS;
-    guint bus_watch_id;
+    guint bus_watch_id = 0;
+    guint max_width, max_height;
     GOptionContext *optctx;
     GError *error = NULL;
+    DDBench *bench = NULL;
+    vector<AppData *> cameras;
 
-    memset (&data, 0, sizeof(AppData));
-
+    startup_mark ("start");
     gst_init(&argc, &argv);
     signal(SIGINT, signal_handler);
 
@@ -550,14 +1935,76 @@ main (int argc, char **argv) {
     }
     g_option_context_free (optctx);
 
+    if (rec_index) {
+        if (!dd_rec_print_index (rec_index, stdout)) {
+            ret = DD_ERROR_FILE_IO;
+            g_printerr ("%s is not a recording: %s\n", rec_index, error_to_string (ret));
+            return ret;
+        }
+        return DD_SUCCESS;
+    }
+
+    dd_gate_config_default (&gate_config);
+    load_app_config ();
+    if (track) {
+        gate = TRUE;
+        gate_config.track = TRUE;
+    }
+    /* Before any thread is started, so that those in no group inherit the main placement */
+    if (affinity) {
+        dd_affinity_set_config (&affinity_config);
+        if (!dd_affinity_apply_main ())
+            g_printerr ("The main thread placement could not be applied, see above\n");
+    }
+    startup_mark ("init");
+
+    if (g_getenv (DD_TRACE_ENV) && g_strcmp0 (g_getenv (DD_TRACE_ENV), "0"))
+        trace = TRUE;
+    headless = benchmark || batch;
+
+    ret = parse_dump_outputs ();
+    if (ret != DD_SUCCESS) {
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        return ret;
+    }
+
     if (in_file) {
         file_playback = TRUE;
     }
+    if (dd_rec_is_recording (in_file)) {
+        DDRecHeader header;
+        if (!dd_rec_read_header (in_file, &header)) {
+            ret = DD_ERROR_FILE_IO;
+            g_printerr ("%s is not a recording: %s\n", in_file, error_to_string (ret));
+            return ret;
+        }
+        /* Played as recorded */
+        width = header.width;
+        height = header.height;
+        if (header.fps_n && header.fps_d)
+            framerate = header.fps_n / header.fps_d;
+    }
 
     if (out_file) {
         file_dump = true;
     }
 
+    if (batch && (in_file || file_dump || !dump_outputs.empty() || loop_input || trace || demo_mode || benchmark)) {
+        ret = DD_ERROR_BATCH_OPTIONS_INVALID;
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        return ret;
+    }
+    if (batch) {
+        /* Offline re-inspection, always up to the decision */
+        file_playback = TRUE;
+        dp = STAGE_FINAL;
+    }
+    if (media_devices && (file_playback || benchmark)) {
+        ret = DD_ERROR_MEDIA_DEVICE_INVALID;
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        return ret;
+    }
+
     if (in_file) {
         GST_DEBUG ("In file is %s", in_file);
     }
@@ -573,11 +2020,15 @@ main (int argc, char **argv) {
     if (config_path)
         GST_DEBUG ("config path is %s", config_path);
 
-    if (dev_node.c_str())
-        GST_DEBUG ("media node is %s", dev_node.c_str());
+    if (stats_file && dd_stats_load (stats_file) != 0)
+        GST_WARNING ("Could not restore statistics from %s, starting from zero", stats_file);
 
-    if (width > MAX_WIDTH || height > MAX_HEIGHT) {
+    max_width = MAX_WIDTH;
+    max_height = MAX_HEIGHT;
+    kernel_max_resolution (&max_width, &max_height);
+    if (width > max_width || height > max_height) {
         ret = DD_ERROR_RESOLUTION_NOT_SUPPORTED;
+        g_printerr ("%ux%u requested, the accelerators support up to %ux%u\n", width, height, max_width, max_height);
         g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
         return ret;
     }
@@ -586,106 +2037,254 @@ main (int argc, char **argv) {
         g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
         return ret;
     }
+    if (benchmark && (demo_mode || file_dump)) {
+        ret = DD_ERROR_BENCHMARK_OPTIONS_INVALID;
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        return ret;
+    }
 
-    if (access("/dev/dri/by-path/platform-fd4a0000.display-card", F_OK) != 0) {
+    if (headless) {
+        GST_DEBUG ("Headless mode, display and capture device are not used");
+    } else if (access(DRM_CARD, F_OK) != 0) {
         g_printerr("ERROR: Mixer device is not ready.\n%s", msg_firmware);
         return -1;
     } else {
-        exec("echo | modetest -M xlnx -D fd4a0000.display -s 43@41:1920x1080-60@BG24 -w 40:\"alpha\":255");
+        DDDisplayConfig display = { DRM_CARD, DRM_CONNECTOR_ID, DRM_CRTC_ID, DRM_PLANE_ID,
+                                    width, height, DISPLAY_REFRESH, 255 };
+        if (!dd_display_setup (&display))
+            g_printerr ("WARNING: Could not set the display mode, leaving it to the sink\n");
     }
+    startup_mark ("display");
 
-    if (!file_playback && (check_capture_src() != 0)) {
+    if (!file_playback && !headless && (check_capture_src() != 0)) {
         g_printerr ("Media node not found, please check the connection of camera\n");
         return -1;
     }
-    if (!file_playback ) {
-        std::string script_caller;
-        GST_DEBUG ("Calling default sensor calibration script");
-        script_caller = "echo | configure " + dev_node;
-        exec(script_caller.c_str());
+    startup_mark ("capture devices");
+    if (!capture_devs.empty()) {
+        string sensor_config = string(config_path) + SENSOR_JSON_FILE;
+        for (const std::string &dev : capture_devs) {
+            GST_DEBUG ("media node is %s", dev.c_str());
+            if (!dd_media_configure (dev.c_str(), sensor_config.c_str(), width, height)) {
+                ret = DD_ERROR_CAPTURE_SETUP_FAIL;
+                g_printerr ("%s: %s\n", dev.c_str(), error_to_string (ret));
+                return ret;
+            }
+        }
+        startup_mark ("sensor");
     }
+    if (batch && !dd_batch_list_clips (batch, batch_run.clips)) {
+        ret = DD_ERROR_FILE_IO;
+        g_printerr ("No capture matches %s: %s\n", batch, error_to_string (ret));
+        return ret;
+    }
+
+    if (results_file) {
+        DDResultsFormat format = DD_RESULTS_JSONL;
+        vector<const gchar *> sources;
+        if (results_format && !dd_results_format_from_string (results_format, &format)) {
+            ret = DD_ERROR_RESULTS_FORMAT_INVALID;
+            g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+            return ret;
+        }
+        if (batch) {
+            for (const string &clip : batch_run.clips)
+                sources.push_back (clip.c_str());
+        } else if (!capture_devs.empty()) {
+            for (const string &dev : capture_devs)
+                sources.push_back (dev.c_str());
+        } else {
+            sources.push_back (in_file ? in_file : headless ? "videotestsrc" : "camera");
+        }
+        sources.push_back (NULL);
+        data.results_writer = dd_results_writer_new (results_file, format, sources.data());
+        if (!data.results_writer) {
+            ret = DD_ERROR_FILE_IO;
+            g_printerr ("Could not open %s: %s\n", results_file, error_to_string (ret));
+            return ret;
+        }
+    }
+
+    g_unix_signal_add (SIGUSR1, stats_dump_cb, NULL);
+    /* Tunable kernel parameters follow their config files while running */
+    reload = dd_reload_new (config_path, MAX (capture_devs.size(), 1));
+    if (batch) {
+        if (!start_control ()) {
+            ret = DD_ERROR_CONTROL_SOCKET_FAIL;
+            g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+            goto CLOSE;
+        }
+        if (!start_metrics (data.results_writer)) {
+            ret = DD_ERROR_METRICS_FAIL;
+            g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+            goto CLOSE;
+        }
+        batch_run.results_writer = data.results_writer;
+        run_batch (batch_jobs ());
+        goto CLOSE;
+    }
+
+    data.location = in_file;
+    data.media_device = capture_devs.empty() ? NULL : capture_devs[0].c_str();
+    data.stage = dp;
+    data.headless = headless;
     ret = create_pipeline (&data);
     if (ret != DD_SUCCESS) {
         g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
-        return ret;
+        goto CLOSE;
     }
 
-    ret = link_pipeline (&data);
+    ret = set_pipeline_config (&data);
     if (ret != DD_SUCCESS) {
         g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
-        return ret;
+        goto CLOSE;
     }
 
-    ret = set_pipeline_config (&data);
+    ret = create_camera_pipelines (&data, cameras);
     if (ret != DD_SUCCESS) {
         g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
-        return ret;
+        goto CLOSE;
+    }
+
+    if (trace && dd_tracer_enable ()) {
+        dd_tracer_watch (&data.topo);
+        for (AppData *cam : cameras)
+            dd_tracer_watch (&cam->topo);
+    }
+    app_streams.push_back (&data);
+    app_streams.insert (app_streams.end (), cameras.begin (), cameras.end ());
+    startup_mark ("pipelines");
+    if (!start_control ()) {
+        ret = DD_ERROR_CONTROL_SOCKET_FAIL;
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        goto CLOSE;
+    }
+    if (!start_metrics (data.results_writer)) {
+        ret = DD_ERROR_METRICS_FAIL;
+        g_printerr ("Exiting the app with an error: %s\n", error_to_string (ret));
+        goto CLOSE;
+    }
+    if (startup_profile && data.sink) {
+        GstPad *pad = gst_element_get_static_pad (data.sink, "sink");
+        gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, first_frame_probe, NULL, NULL);
+        gst_object_unref (pad);
+    }
+    if (benchmark) {
+        DDBenchConfig bench_config;
+        bench_config.max_frames = MAX (bench_frames, 0);
+        bench_config.seconds = MAX (bench_seconds, 0);
+        if (!bench_config.max_frames && !bench_config.seconds)
+            bench_config.seconds = DD_BENCH_DEFAULT_SECONDS;
+        bench_config.json_path = bench_json;
+        bench = dd_bench_new (&data.topo, data.pipeline, &bench_config);
     }
 
     /* we add a message handler */
     bus = gst_pipeline_get_bus (GST_PIPELINE (data.pipeline));
     bus_watch_id = gst_bus_add_watch (bus, (GstBusFunc)(message_cb), &data);
     gst_object_unref (bus);
-
-    if (!file_playback) {
-        g_signal_connect (data.src, "pad-added", G_CALLBACK (pad_added_cb), &data);
+    dd_affinity_watch (data.pipeline);
+    for (AppData *cam : cameras) {
+        bus = gst_pipeline_get_bus (GST_PIPELINE (cam->pipeline));
+        cam->bus_watch_id = gst_bus_add_watch (bus, (GstBusFunc)(message_cb), cam);
+        gst_object_unref (bus);
+        dd_affinity_watch (cam->pipeline);
     }
+
     GST_DEBUG ("Triggering play command");
     if (GST_STATE_CHANGE_FAILURE == gst_element_set_state (data.pipeline, GST_STATE_PLAYING)) {
         g_printerr ("state change to Play failed\n");
         goto CLOSE;
     }
+    for (AppData *cam : cameras) {
+        if (GST_STATE_CHANGE_FAILURE == gst_element_set_state (cam->pipeline, GST_STATE_PLAYING)) {
+            g_printerr ("state change to Play failed for %s\n", cam->media_device);
+            goto CLOSE;
+        }
+    }
+    startup_mark ("playing");
     GST_DEBUG ("waiting for the loop");
     loop = g_main_loop_new (NULL, FALSE);
     g_main_loop_run (loop);
 CLOSE:
-    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    /* Control requests act on the pipelines, so stop serving them first.
+     * The metrics probes run on the streaming threads until the pipelines
+     * are stopped, and the endpoint reads the pipelines until it is freed:
+     * stop the pipelines, then the metrics, then release the pipelines.
+     * Batch pipelines are all stopped by now. Failed setups come here too,
+     * with the pipelines built so far, so that the results writer is
+     * always flushed and freed. */
+    stop_control ();
+    if (!batch) {
+        print_queue_stats (stdout);
+        print_pool_stats (stdout);
+        print_copy_stats (stdout);
+        print_gate_stats ();
+    }
+    if (data.pipeline)
+        gst_element_set_state (data.pipeline, GST_STATE_NULL);
+    for (AppData *cam : cameras) {
+        if (cam->pipeline)
+            gst_element_set_state (cam->pipeline, GST_STATE_NULL);
+    }
+    stop_metrics ();
+    if (batch)
+        goto RESULTS;
     if (data.pipeline) {
         gst_object_unref (GST_OBJECT (data.pipeline));
         data.pipeline = NULL;
     }
     GST_DEBUG ("Removing bus");
-    g_source_remove (bus_watch_id);
+    /* Left at 0 when startup failed before the bus watches were added */
+    if (bus_watch_id)
+        g_source_remove (bus_watch_id);
+    for (AppData *cam : cameras) {
+        if (cam->pipeline)
+            gst_object_unref (GST_OBJECT (cam->pipeline));
+        if (cam->bus_watch_id)
+            g_source_remove (cam->bus_watch_id);
+        delete cam;
+    }
+
+    dd_mmapsrc_free (data.mmapsrc);
+RESULTS:
+    dd_reload_free (reload);
+    if (data.results_writer) {
+        if (dd_results_writer_dropped (data.results_writer))
+            g_printerr ("%" G_GUINT64_FORMAT " results could not be written in time and were dropped\n",
+                        dd_results_writer_dropped (data.results_writer));
+        dd_results_writer_free (data.results_writer);
+    }
+
+    if (bench) {
+        dd_bench_report (bench);
+        dd_bench_free (bench);
+    } else if (trace) {
+        dd_tracer_dump (stdout);
+    }
+
+    print_stats_summary (MAX (capture_devs.size(), 1));
+    if (capture_devs.size() > 1)
+        print_sched_summary (capture_devs.size());
+    for (const string &config : stream_configs)
+        unlink (config.c_str());
+    if (stats_file) {
+        if (dd_stats_save (stats_file) != 0)
+            g_printerr ("Failed to save statistics to %s\n", stats_file);
+        g_free (stats_file);
+    }
 
     if (in_file)
         g_free (in_file);
     if (out_file)
         g_free (out_file);
+    g_free (topology);
+    g_free (queue_policy);
+    g_strfreev (dumps);
+    g_free (bench_json);
+    g_free (results_file);
+    g_free (results_format);
+    g_free (batch);
+    g_strfreev (media_devices);
     return ret;
 }
-
-/** @brief
- *  This function will be called by the pad-added signal
- *
- *  mediasrcbin has sometimes pad for which pad-added signal
- *  is required to be attached with source element.
- *  This function will be called when pad is created and is
- *  ready to link with peer element.
- *
- *  @param src The GstElement to be connected with peer element.
- *  @param new_pad is the pad of source element which needs to be
- *  linked.
- *  @param data is the application structure pointer.
- *  @return Void.
- */
-static void
-pad_added_cb (GstElement *src, GstPad *new_pad, AppData *data) {
-    GstPadLinkReturn ret;
-    GstPad *sink_pad = gst_element_get_static_pad (data->capsfilter, "sink");
-    GST_DEBUG ("Received new pad '%s' from '%s':", GST_PAD_NAME (new_pad), GST_ELEMENT_NAME (src));
-
-    /* If our capsfilter is already linked, we have nothing to do here */
-    if (gst_pad_is_linked (sink_pad)) {
-        GST_DEBUG ("Pad is already linked. Ignoring");
-        goto exit;
-    }
-
-    /* Attempt the link */
-    ret = gst_pad_link (new_pad, sink_pad);
-    if (GST_PAD_LINK_FAILED (ret)) {
-        GST_ERROR ("Linking failed");
-    }
-exit:
-    /* Unreference the sink pad */
-    gst_object_unref (sink_pad);
-}
@@ -17,9 +17,8 @@
 #include <vvas/vvaslogs.h>
 #include <vvas/vvas_kernel.h>
 #include <gst/vvas/gstinferencemeta.h>
+#include "dd_kernel_config.h"
 
-#define MAX_SUPPORTED_WIDTH         1920
-#define MAX_SUPPORTED_HEIGHT        1080
 
 typedef struct _kern_priv
 {
@@ -27,6 +26,7 @@ typedef struct _kern_priv
     VVASFrame *mem;
     VVASFrame *mango_pix;
     VVASFrame *defect_pix;
+    DDKernelConfig config;
 } KernelPriv;
 
 int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NUM_OBJECT], VVASFrame *output[MAX_NUM_OBJECT]);
@@ -58,7 +58,6 @@ int32_t xlnx_kernel_init(VVASKernel *handle)
     if (!kernel_priv) {
         printf("Error: Unable to allocate PPE kernel memory\n");
     }
-    uint32_t resolution = MAX_SUPPORTED_HEIGHT * MAX_SUPPORTED_WIDTH;
     kernel_priv->mango_pix  = vvas_alloc_buffer (handle, 1*(sizeof(uint32_t)), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
     kernel_priv->defect_pix = vvas_alloc_buffer (handle, 1*(sizeof(uint32_t)), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
     kernel_priv->mem   = vvas_alloc_buffer (handle, 1*(sizeof(uint32_t)), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
@@ -69,6 +68,9 @@ int32_t xlnx_kernel_init(VVASKernel *handle)
     else
 	    kernel_priv->log_level = json_integer_value (val);
     LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: debug_level %d", kernel_priv->log_level);
+    dd_kernel_config_parse (jconfig, DD_SCHED_KERNEL_CCA, &kernel_priv->config);
+    LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: max resolution %ux%u",
+                 kernel_priv->config.max_width, kernel_priv->config.max_height);
 
     handle->kernel_priv = (void *)kernel_priv;
     handle->is_multiprocess = 1;
@@ -79,10 +81,17 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
 {
     KernelPriv *kernel_priv;
     int ret;
+    uint64_t acquired;
     VVASFrame *outframe = output[0];
     VVASFrame *inframe = input[0];
 
     kernel_priv = (KernelPriv *)handle->kernel_priv;
+    if (input[0]->props.width > kernel_priv->config.max_width ||
+        input[0]->props.height > kernel_priv->config.max_height) {
+        LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "%ux%u is above the %ux%u the kernel supports",
+                     input[0]->props.width, input[0]->props.height, kernel_priv->config.max_width, kernel_priv->config.max_height);
+        return FALSE;
+    }
 
     uint8_t *frwd_pass;
     GstInferenceMeta *infer_meta;
@@ -102,6 +111,7 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
         frwd_pass =   (uint8_t *) child->reserved_1;
         mango_pixel = (uint32_t *)child->reserved_2;
     }
+    acquired = dd_sched_acquire (kernel_priv->config.sched, kernel_priv->config.stream_id);
     ret = vvas_kernel_start (handle, "puppuu", input[0]->paddr[0], frwd_pass, \
                              output[0]->paddr[0], kernel_priv->mem->paddr[0], \
                              input[0]->props.height, output[0]->props.stride);
@@ -111,13 +121,16 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
                              input[0]->props.height, input[0]->props.width, input[0]->props.stride);
 #endif
     if (ret < 0) {
+        dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to issue execute command");
         return FALSE;
     }
 
     /* wait for kernel completion */
     ret = vvas_kernel_done (handle, 1000);
+    dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
     if (ret < 0) {
+        dd_sched_timeout (kernel_priv->config.sched, kernel_priv->config.stream_id);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to receive response from kernel");
         return FALSE;
     }
@@ -17,11 +17,14 @@
 #include <vvas/vvaslogs.h>
 #include <vvas/vvas_kernel.h>
 #include <gst/vvas/gstinferencemeta.h>
+#include "dd_kernel_config.h"
+
 
 typedef struct _kern_priv
 {
     int log_level;
     VVASFrame *mem;
+    DDKernelConfig config;
 } PreProcessingKernelPriv;
 
 int32_t  xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NUM_OBJECT], VVASFrame *output[MAX_NUM_OBJECT]);
@@ -59,6 +62,9 @@ int32_t xlnx_kernel_init(VVASKernel *handle)
     else
 	    kernel_priv->log_level = json_integer_value (val);
     LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: debug_level %d", kernel_priv->log_level);
+    dd_kernel_config_parse (jconfig, DD_SCHED_KERNEL_OTSU, &kernel_priv->config);
+    LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: max resolution %ux%u",
+                 kernel_priv->config.max_width, kernel_priv->config.max_height);
 
     handle->kernel_priv = (void *)kernel_priv;
     handle->is_multiprocess = 1;
@@ -69,11 +75,19 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
 {
     PreProcessingKernelPriv *kernel_priv;
     int ret;
+    uint64_t acquired;
     uint32_t *thr;
     float sigma = 0.0;
     GstInferenceMeta *infer_meta = NULL;
     VVASFrame *outframe = output[0];
     kernel_priv = (PreProcessingKernelPriv *)handle->kernel_priv;
+    if (input[0]->props.width > kernel_priv->config.max_width ||
+        input[0]->props.height > kernel_priv->config.max_height) {
+        LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "%ux%u is above the %ux%u the kernel supports",
+                     input[0]->props.width, input[0]->props.height, kernel_priv->config.max_width, kernel_priv->config.max_height);
+        return FALSE;
+    }
+    acquired = dd_sched_acquire (kernel_priv->config.sched, kernel_priv->config.stream_id);
     ret = vvas_kernel_start (handle, "ppuufp", input[0]->paddr[0], \
                              output[0]->paddr[0], input[0]->props.height, input[0]->props.width, sigma, kernel_priv->mem->paddr[0]);
 #if 0
@@ -83,13 +97,16 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
 #endif
 
     if (ret < 0) {
+        dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to issue execute command");
         return FALSE;
     }
 
     /* wait for kernel completion */
     ret = vvas_kernel_done (handle, 1000);
+    dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
     if (ret < 0) {
+        dd_sched_timeout (kernel_priv->config.sched, kernel_priv->config.stream_id);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to receive response from kernel");
         return FALSE;
     }
@@ -17,18 +17,22 @@
 #include <vvas/vvaslogs.h>
 #include <vvas/vvas_kernel.h>
 #include <gst/vvas/gstinferencemeta.h>
+#include "dd_params.h"
+#include "dd_kernel_config.h"
 
 #define DEFAULT_MAX_VALUE	255
-#define DEFAULT_STRIDE_VALUE	1920
 #define NORMALIZE_THRESHOLD 13
 
 typedef struct _kern_priv
 {
     int threshold;
     int max_value;
-    int stride_value;
+    int stride_value;           /* 0 for the stride negotiated downstream */
+    size_t tmp_size;
     int log_level;
     VVASFrame *tmp_mem, *mem;
+    DDKernelConfig config;
+    uint64_t params_generation;
 } PreProcessingKernelPriv;
 
 int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NUM_OBJECT], VVASFrame *output[MAX_NUM_OBJECT]);
@@ -36,6 +40,19 @@ int32_t xlnx_kernel_done(VVASKernel *handle);
 int32_t xlnx_kernel_init(VVASKernel *handle);
 uint32_t xlnx_kernel_deinit(VVASKernel *handle);
 
+/* Pick up the parameters reloaded by the app, between two frames */
+static void update_params(PreProcessingKernelPriv *kernel_priv)
+{
+    DDParams params;
+
+    if (!dd_params_read (kernel_priv->config.stream_id, kernel_priv->params_generation, &params))
+        return;
+    if (dd_params_has (&params, DD_PARAM_MAX_VALUE))
+        kernel_priv->max_value = (int) params.values[DD_PARAM_MAX_VALUE];
+    kernel_priv->params_generation = params.generation;
+    LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: max_value %d", kernel_priv->max_value);
+}
+
 uint32_t xlnx_kernel_deinit(VVASKernel *handle)
 {
     PreProcessingKernelPriv *kernel_priv;
@@ -59,9 +76,6 @@ int32_t xlnx_kernel_init(VVASKernel *handle)
     if (!kernel_priv) {
         printf("Error: Unable to allocate PPE kernel memory\n");
     }
-    uint32_t resolution = 1920 * 1080;
-
-    kernel_priv->tmp_mem   = vvas_alloc_buffer (handle, resolution*(sizeof(uint8_t)), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
     kernel_priv->mem = vvas_alloc_buffer (handle, 1*(sizeof(uint32_t)), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
 
     /* parse config */
@@ -80,10 +94,14 @@ int32_t xlnx_kernel_init(VVASKernel *handle)
     LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: max_value %d", kernel_priv->max_value);
     val = json_object_get (jconfig, "stride_value");
     if (!val || !json_is_integer (val))
-	    kernel_priv->stride_value = DEFAULT_STRIDE_VALUE;
+	    kernel_priv->stride_value = 0;
     else
 	    kernel_priv->stride_value = json_integer_value (val);
     LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: stride_value %d", kernel_priv->stride_value);
+    dd_kernel_config_parse (jconfig, DD_SCHED_KERNEL_PREPROCESS, &kernel_priv->config);
+    LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: max resolution %ux%u",
+                 kernel_priv->config.max_width, kernel_priv->config.max_height);
+
     handle->kernel_priv = (void *)kernel_priv;
     handle->is_multiprocess = 1;
     return 0;
@@ -93,7 +111,10 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
 {
     PreProcessingKernelPriv *kernel_priv;
     int ret;
+    uint64_t acquired;
     uint32_t *thr;
+    uint32_t stride;
+    size_t needed;
     VVASFrame *inframe  = input[0];
     VVASFrame *outframe = output[0];
     kernel_priv = (PreProcessingKernelPriv *)handle->kernel_priv;
@@ -114,20 +135,47 @@ int32_t xlnx_kernel_start(VVASKernel *handle, int start, VVASFrame *input[MAX_NU
         thr = (uint32_t *)child->reserved_1;
     }
 
+    if (input[0]->props.width > kernel_priv->config.max_width ||
+        input[0]->props.height > kernel_priv->config.max_height) {
+        LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "%ux%u is above the %ux%u the kernel supports",
+                     input[0]->props.width, input[0]->props.height, kernel_priv->config.max_width, kernel_priv->config.max_height);
+        return FALSE;
+    }
+    stride = kernel_priv->stride_value ? kernel_priv->stride_value : outframe->props.stride;
+    /* The forward pass image follows the frame size, grown on demand */
+    needed = (size_t) inframe->props.height * stride;
+    if (needed > kernel_priv->tmp_size) {
+        if (kernel_priv->tmp_mem)
+            vvas_free_buffer (handle, kernel_priv->tmp_mem);
+        kernel_priv->tmp_mem = vvas_alloc_buffer (handle, needed * sizeof(uint8_t), VVAS_INTERNAL_MEMORY, DEFAULT_MEM_BANK, NULL);
+        if (!kernel_priv->tmp_mem) {
+            kernel_priv->tmp_size = 0;
+            LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Unable to allocate %zu bytes for the forward pass", needed);
+            return FALSE;
+        }
+        kernel_priv->tmp_size = needed;
+        LOG_MESSAGE (LOG_LEVEL_INFO, kernel_priv->log_level, "VVAS PPE: forward pass buffer of %zu bytes", needed);
+    }
+
     kernel_priv->threshold = *thr - NORMALIZE_THRESHOLD;
+    update_params (kernel_priv);
 
+    acquired = dd_sched_acquire (kernel_priv->config.sched, kernel_priv->config.stream_id);
     ret = vvas_kernel_start (handle, "ppppuuuuu", input[0]->paddr[0], output[0]->paddr[0], \
                              kernel_priv->tmp_mem->paddr[0], kernel_priv->mem->paddr[0], \
                              kernel_priv->threshold, kernel_priv->max_value, input[0]->props.height, \
-                             input[0]->props.width, kernel_priv->stride_value);
+                             input[0]->props.width, stride);
     if (ret < 0) {
+        dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to issue execute command");
         return FALSE;
     }
 
     /* wait for kernel completion */
     ret = vvas_kernel_done (handle, 1000);
+    dd_sched_release (kernel_priv->config.sched, kernel_priv->config.stream_id, acquired);
     if (ret < 0) {
+        dd_sched_timeout (kernel_priv->config.sched, kernel_priv->config.stream_id);
         LOG_MESSAGE (LOG_LEVEL_ERROR, kernel_priv->log_level, "Failed to receive response from kernel");
         return FALSE;
     }
@@ -18,6 +18,9 @@
 #include <opencv2/imgproc.hpp>
 #include <vvas/vvas_kernel.h>
 #include <gst/vvas/gstinferencemeta.h>
+#include "dd_params.h"
+#include "dd_result_meta.h"
+#include "dd_stats.h"
 
 int log_level;
 using namespace cv;
@@ -68,10 +71,38 @@ struct vvas_xoverlaypriv
   unsigned int font;
   unsigned int y_offset;
   unsigned int x_offset;
-  unsigned int total_defect;
+  unsigned int stream_id;
+  uint64_t frames;
+  uint64_t params_generation;
   struct overlayframe_info frameinfo;
 };
 
+/* Pick up the parameters reloaded by the app, between two frames */
+static void
+update_params (vvas_xoverlaypriv *kpriv)
+{
+  DDParams params;
+
+  if (!dd_params_read (kpriv->stream_id, kpriv->params_generation, &params))
+    return;
+  if (dd_params_has (&params, DD_PARAM_DEFECT_THRESHOLD))
+    kpriv->defect_threshold = params.values[DD_PARAM_DEFECT_THRESHOLD];
+  if (dd_params_has (&params, DD_PARAM_FONT_SIZE))
+    kpriv->font_size = params.values[DD_PARAM_FONT_SIZE];
+  if (dd_params_has (&params, DD_PARAM_FONT))
+    kpriv->font = params.values[DD_PARAM_FONT];
+  if (dd_params_has (&params, DD_PARAM_X_OFFSET))
+    kpriv->x_offset = params.values[DD_PARAM_X_OFFSET];
+  if (dd_params_has (&params, DD_PARAM_Y_OFFSET))
+    kpriv->y_offset = params.values[DD_PARAM_Y_OFFSET];
+  if (dd_params_has (&params, DD_PARAM_IS_ACC_RESULT))
+    kpriv->is_acc_result = params.values[DD_PARAM_IS_ACC_RESULT];
+  kpriv->params_generation = params.generation;
+  LOG_MESSAGE (LOG_LEVEL_INFO, "parameters %" G_GUINT64_FORMAT ": defect threshold %lf, font %u size %lf, offset %u,%u",
+               kpriv->params_generation, kpriv->defect_threshold, kpriv->font, kpriv->font_size,
+               kpriv->x_offset, kpriv->y_offset);
+}
+
 
 extern "C"
 {
@@ -86,9 +117,6 @@ extern "C"
     json_t *jconfig = handle->kernel_config;
     json_t *val;
 
-    /* Initialize config params with default values */
-    kpriv->total_defect = 0;
-
     val = json_object_get (jconfig, "debug_level");
     if (!val || !json_is_integer (val))
         log_level = LOG_LEVEL_WARNING;
@@ -138,6 +166,13 @@ extern "C"
         kpriv->x_offset = json_integer_value (val);
     LOG_MESSAGE (LOG_LEVEL_DEBUG, "X Offset %u", kpriv->x_offset);
 
+    val = json_object_get (jconfig, "stream_id");
+    if (!val || !json_is_integer (val) || json_integer_value (val) >= DD_STATS_MAX_STREAMS)
+        kpriv->stream_id = 0;
+    else
+        kpriv->stream_id = json_integer_value (val);
+    LOG_MESSAGE (LOG_LEVEL_DEBUG, "Stream id %u", kpriv->stream_id);
+
     handle->kernel_priv = (void *) kpriv;
     return 0;
   }
@@ -162,8 +197,9 @@ extern "C"
 
     char *lumaBuf = (char *) frameinfo->inframe->vaddr[0];
 
-    frameinfo->lumaImg.create (input[0]->props.height, input[0]->props.stride, CV_8U);
-    frameinfo->lumaImg.data = (unsigned char *) lumaBuf;
+    /* Draw in place: a header over the frame, no copy or allocation whatever its size */
+    frameinfo->lumaImg = Mat (input[0]->props.height, input[0]->props.width, CV_8U,
+                              lumaBuf, input[0]->props.stride);
     GstInferenceMeta *infer_meta;
     infer_meta = ((GstInferenceMeta *) gst_buffer_get_meta((GstBuffer *)frameinfo->inframe->app_priv,
                                                                  gst_inference_meta_api_get_type()));
@@ -171,25 +207,44 @@ extern "C"
         LOG_MESSAGE(LOG_LEVEL_INFO, "vvas meta data is not available for crop");
         return FALSE;
     }
-    uint32_t *mango_pixel, *defect_pixel;
+    uint32_t *mango_pixel, *defect_pixel, *threshold = NULL;
     GstInferencePrediction *root = infer_meta->prediction;
     /* Iterate through the immediate child predictions */
     GSList *tmp = gst_inference_prediction_get_children(root);
 
     for (GSList *child_predictions = tmp; child_predictions; child_predictions = g_slist_next(child_predictions)) {
         GstInferencePrediction *child = (GstInferencePrediction *)child_predictions->data;
+        /* The first child comes from otsu */
+        if (!threshold)
+            threshold = (uint32_t *)child->reserved_1;
         mango_pixel = (uint32_t *)child->reserved_1;
         defect_pixel = (uint32_t *)child->reserved_2;
     }
 
+    update_params (kpriv);
     double defect_density = ((double)*defect_pixel / *mango_pixel) * 100.0;
     bool defect_decision = (defect_density > kpriv->defect_threshold);
 
+    /* Keep the figures by value for the stages after us */
+    const gchar *result_names[] = DD_RESULT_NAMES;
+    gdouble result[DD_RESULT_VALUES];
+    result[DD_RESULT_FRAME] = kpriv->frames++;
+    result[DD_RESULT_THRESHOLD] = *threshold;
+    result[DD_RESULT_FRUIT_PIXELS] = *mango_pixel;
+    result[DD_RESULT_DEFECT_PIXELS] = *defect_pixel;
+    result[DD_RESULT_DENSITY] = defect_density;
+    result[DD_RESULT_DONE_NS] = dd_stats_now_ns ();
+    GstInferencePrediction *predict = gst_inference_prediction_new ();
+    GstInferenceClassification *a = gst_inference_classification_new_full (defect_decision, defect_density,
+                                                                            DD_RESULT_LABEL, DD_RESULT_VALUES,
+                                                                            result, (gchar **) result_names);
+    gst_inference_prediction_append_classification (predict, a);
+    gst_inference_prediction_append (root, predict);
+
     char text_buffer[512] = {0,};
     int y_point = kpriv->y_offset;
-    if (defect_decision) {
-        kpriv->total_defect++;
-    }
+    dd_stats_record (kpriv->stream_id, dd_stats_now_ns (), *mango_pixel, *defect_pixel,
+                     defect_density, defect_decision);
 
     LOG_MESSAGE (LOG_LEVEL_DEBUG, "Defect Density: %.2lf %%", defect_density);
     sprintf(text_buffer, "Defect Density: %.2lf %%", defect_density);
@@ -208,8 +263,10 @@ extern "C"
     y_point += 30;
 
     if (kpriv->is_acc_result) {
-        LOG_MESSAGE (LOG_LEVEL_DEBUG, "Accumulated Defects: %u", kpriv->total_defect);
-        sprintf(text_buffer, "Accumulated defects: %u", kpriv->total_defect);
+        DDStatsSnapshot total;
+        dd_stats_snapshot (kpriv->stream_id, DD_STATS_WINDOW_TOTAL, dd_stats_now_ns (), &total);
+        LOG_MESSAGE (LOG_LEVEL_DEBUG, "Accumulated Defects: %lu", (unsigned long) total.defects);
+        sprintf(text_buffer, "Accumulated defects: %lu", (unsigned long) total.defects);
         LOG_MESSAGE (LOG_LEVEL_DEBUG, "text buffer : %s", text_buffer);
          /* Draw label text on the filled rectanngle */
         putText(frameinfo->lumaImg, text_buffer, cv::Point(kpriv->x_offset, y_point), kpriv->font,
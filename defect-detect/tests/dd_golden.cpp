@@ -0,0 +1,471 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Golden-output regression suite of the kernel libraries.
+ *
+ * Every libvvas_*.so is loaded as vvas_xfilter loads it and driven through
+ * xlnx_kernel_init/start/deinit with the configs of config/, frame by frame
+ * over a corpus of .y8 frames, with the accelerators emulated by libvvasemu
+ * (emu/dd_emu.h). The thresholds, pixel counts, densities, decisions and
+ * masks are compared with the golden results within their tolerances, and
+ * each kernel call is timed.
+ *
+ * The golden results never come from the software models the suite runs:
+ * those of the synthetic corpus are written from the ground truth of its
+ * scenes (dd_sw_make_truth), and those of a corpus captured on the board
+ * hold the results the hardware produced.
+ */
+
+#include <jansson.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "dd_emu.h"
+#include "dd_kernel_sw.h"
+
+using namespace std;
+
+typedef struct _FrameResult {
+    DDEmuResult result;
+    guint32 preprocess_mask[DD_SW_GRID * DD_SW_GRID];
+    guint32 cca_mask[DD_SW_GRID * DD_SW_GRID];
+} FrameResult;
+
+typedef struct _Tolerance {
+    guint32 threshold;
+    gdouble pixels;
+    guint32 min_pixels;
+    gdouble density;
+    gdouble mask;
+} Tolerance;
+
+static gchar *lib_dir = NULL;
+static gchar *config_dir = NULL;
+static gchar *corpus_dir = NULL;
+static gchar *golden_file = NULL;
+static gchar *make_corpus = NULL;
+static gint stride = 768;
+
+/* Tolerances written with the golden results of the synthetic corpus */
+static const Tolerance synthetic_tolerance = { 2, 0.01, 8, 0.05, 0.01 };
+
+static GOptionEntry entries[] =
+{
+    { "libdir",      'l', 0, G_OPTION_ARG_FILENAME, &lib_dir, "Directory of the kernel libraries", "lib path"},
+    { "cfgpath",     'c', 0, G_OPTION_ARG_FILENAME, &config_dir, "Directory of the kernel configs", "config path"},
+    { "corpus",      'i', 0, G_OPTION_ARG_FILENAME, &corpus_dir, "Directory of the .y8 frames", "corpus path"},
+    { "golden",      'g', 0, G_OPTION_ARG_FILENAME, &golden_file, "Golden results", "json file"},
+    { "stride",      's', 0, G_OPTION_ARG_INT, &stride, "Row size of the preprocess and cca outputs", "768"},
+    { "make-corpus", 'm', 0, G_OPTION_ARG_FILENAME, &make_corpus, "Write the synthetic corpus to a directory, and its golden results to --golden, and exit", "corpus path"},
+    { NULL }
+};
+
+static void
+grid_stage (DDEmuStage stage, VVASFrame *frame, gpointer user_data) {
+    FrameResult *result = (FrameResult *) user_data;
+
+    /* Before the overlay draws on the cca output */
+    if (stage == DD_EMU_STAGE_PREPROCESS)
+        dd_sw_mask_grid ((guint8 *) frame->vaddr[0], frame->props.width, frame->props.height,
+                         frame->props.stride, result->preprocess_mask);
+    else if (stage == DD_EMU_STAGE_CCA)
+        dd_sw_mask_grid ((guint8 *) frame->vaddr[0], frame->props.width, frame->props.height,
+                         frame->props.stride, result->cca_mask);
+}
+
+static gboolean
+write_corpus (const gchar *dir) {
+    vector<guint8> frame (DD_SW_CORPUS_WIDTH * DD_SW_CORPUS_HEIGHT);
+
+    if (g_mkdir_with_parents (dir, 0755)) {
+        g_printerr ("Cannot create %s\n", dir);
+        return FALSE;
+    }
+    for (guint i = 0; i < DD_SW_CORPUS_FRAMES; i++) {
+        gchar *name = g_strdup_printf ("frame%03u.y8", i);
+        gchar *path = g_build_filename (dir, name, NULL);
+        GError *error = NULL;
+        gboolean ok;
+
+        dd_sw_make_frame (i, DD_SW_CORPUS_WIDTH, DD_SW_CORPUS_HEIGHT, frame.data ());
+        ok = g_file_set_contents (path, (const gchar *) frame.data (), frame.size (), &error);
+        g_free (name);
+        g_free (path);
+        if (!ok) {
+            g_printerr ("%s\n", error->message);
+            g_clear_error (&error);
+            return FALSE;
+        }
+    }
+    g_print ("%u frames of %ux%u written to %s\n", DD_SW_CORPUS_FRAMES, DD_SW_CORPUS_WIDTH,
+             DD_SW_CORPUS_HEIGHT, dir);
+    return TRUE;
+}
+
+static json_t *
+grid_to_json (const guint32 *grid) {
+    json_t *array = json_array ();
+    for (guint i = 0; i < DD_SW_GRID * DD_SW_GRID; i++)
+        json_array_append_new (array, json_integer (grid[i]));
+    return array;
+}
+
+/** @brief
+ *  Read the defect density threshold from the text2overlay config.
+ *
+ *  @param dir is the config directory.
+ *  @param threshold is set to the threshold.
+ *  @return TRUE on success, FALSE otherwise.
+ */
+static gboolean
+read_defect_threshold (const gchar *dir, gdouble *threshold) {
+    gchar *path = g_build_filename (dir, "text2overlay.json", NULL);
+    json_error_t jerror;
+    json_t *root, *kernel, *value;
+    gboolean ok = FALSE;
+
+    root = json_load_file (path, JSON_DECODE_ANY, &jerror);
+    if (!root) {
+        g_printerr ("%s: %s at line %d\n", path, jerror.text, jerror.line);
+        g_free (path);
+        return FALSE;
+    }
+    kernel = json_array_get (json_object_get (root, "kernels"), 0);
+    value = json_object_get (json_object_get (kernel, "config"), "defect_threshold");
+    if (json_is_number (value)) {
+        *threshold = json_number_value (value);
+        ok = TRUE;
+    }
+    else {
+        g_printerr ("%s: no defect_threshold\n", path);
+    }
+    json_decref (root);
+    g_free (path);
+    return ok;
+}
+
+/** @brief
+ *  Golden result of frame @index of the synthetic corpus, from the
+ *  ground truth of its scene: the fruit is what preprocess must keep,
+ *  the spots are the holes cca must find, and the Otsu threshold must
+ *  binarize between the two.
+ *
+ *  @param index is the frame number.
+ *  @param defect_threshold is the density above which a fruit is defective.
+ *  @return the golden result.
+ */
+static json_t *
+truth_to_json (guint index, gdouble defect_threshold) {
+    vector<guint8> labels (DD_SW_CORPUS_WIDTH * DD_SW_CORPUS_HEIGHT);
+    vector<guint8> fruit (labels.size ()), defects (labels.size ());
+    guint32 fruit_grid[DD_SW_GRID * DD_SW_GRID], defect_grid[DD_SW_GRID * DD_SW_GRID];
+    guint32 fruit_pixels = 0, defect_pixels = 0, min, max;
+    gdouble density;
+    gchar *file = g_strdup_printf ("frame%03u.y8", index);
+    json_t *entry = json_object (), *range = json_array ();
+
+    dd_sw_make_truth (index, DD_SW_CORPUS_WIDTH, DD_SW_CORPUS_HEIGHT, labels.data ());
+    for (gsize i = 0; i < labels.size (); i++) {
+        fruit[i] = labels[i] == DD_SW_FRUIT ? 255 : 0;
+        defects[i] = labels[i] == DD_SW_DEFECT ? 255 : 0;
+        fruit_pixels += labels[i] == DD_SW_FRUIT;
+        defect_pixels += labels[i] == DD_SW_DEFECT;
+    }
+    dd_sw_mask_grid (fruit.data (), DD_SW_CORPUS_WIDTH, DD_SW_CORPUS_HEIGHT, DD_SW_CORPUS_WIDTH, fruit_grid);
+    dd_sw_mask_grid (defects.data (), DD_SW_CORPUS_WIDTH, DD_SW_CORPUS_HEIGHT, DD_SW_CORPUS_WIDTH, defect_grid);
+    density = (gdouble) defect_pixels / fruit_pixels * 100.0;
+
+    /* The Otsu threshold the libraries report, above the one preprocess
+     * binarizes at */
+    dd_sw_threshold_range (&min, &max);
+    json_array_append_new (range, json_integer (min + DD_SW_PREPROCESS_OFFSET));
+    json_array_append_new (range, json_integer (max + DD_SW_PREPROCESS_OFFSET));
+
+    json_object_set_new (entry, "file", json_string (file));
+    json_object_set_new (entry, "threshold_range", range);
+    json_object_set_new (entry, "fruit_pixels", json_integer (fruit_pixels));
+    json_object_set_new (entry, "defect_pixels", json_integer (defect_pixels));
+    json_object_set_new (entry, "density", json_real (density));
+    json_object_set_new (entry, "defective", json_boolean (density > defect_threshold));
+    json_object_set_new (entry, "preprocess_mask", grid_to_json (fruit_grid));
+    json_object_set_new (entry, "cca_mask", grid_to_json (defect_grid));
+    g_free (file);
+    return entry;
+}
+
+/** @brief
+ *  Write the golden results of the synthetic corpus from its ground
+ *  truth.
+ *
+ *  @param path is the golden results file.
+ *  @param config is the config directory, for the defect threshold.
+ *  @return TRUE on success, FALSE otherwise.
+ */
+static gboolean
+write_golden (const gchar *path, const gchar *config) {
+    json_t *golden, *tol, *frames;
+    gdouble defect_threshold;
+    gboolean ok;
+
+    if (!read_defect_threshold (config, &defect_threshold))
+        return FALSE;
+
+    tol = json_object ();
+    json_object_set_new (tol, "threshold", json_integer (synthetic_tolerance.threshold));
+    json_object_set_new (tol, "pixels", json_real (synthetic_tolerance.pixels));
+    json_object_set_new (tol, "min_pixels", json_integer (synthetic_tolerance.min_pixels));
+    json_object_set_new (tol, "density", json_real (synthetic_tolerance.density));
+    json_object_set_new (tol, "mask", json_real (synthetic_tolerance.mask));
+    frames = json_array ();
+    for (guint i = 0; i < DD_SW_CORPUS_FRAMES; i++)
+        json_array_append_new (frames, truth_to_json (i, defect_threshold));
+
+    golden = json_object ();
+    json_object_set_new (golden, "width", json_integer (DD_SW_CORPUS_WIDTH));
+    json_object_set_new (golden, "height", json_integer (DD_SW_CORPUS_HEIGHT));
+    json_object_set_new (golden, "stride", json_integer (stride));
+    json_object_set_new (golden, "tolerance", tol);
+    json_object_set_new (golden, "frames", frames);
+    ok = !json_dump_file (golden, path, JSON_INDENT (2) | JSON_PRESERVE_ORDER | JSON_REAL_PRECISION (6));
+    json_decref (golden);
+    if (!ok) {
+        g_printerr ("Cannot write %s\n", path);
+        return FALSE;
+    }
+    g_print ("Golden results of %u frames written to %s\n", DD_SW_CORPUS_FRAMES, path);
+    return TRUE;
+}
+
+static gboolean
+grid_from_json (json_t *array, guint32 *grid) {
+    if (json_array_size (array) != DD_SW_GRID * DD_SW_GRID)
+        return FALSE;
+    for (guint i = 0; i < DD_SW_GRID * DD_SW_GRID; i++)
+        grid[i] = json_integer_value (json_array_get (array, i));
+    return TRUE;
+}
+
+static gboolean
+pixels_match (guint32 got, guint32 want, const Tolerance *tol) {
+    gdouble allowed = MAX (want * tol->pixels, (gdouble) tol->min_pixels);
+    return ABS ((gdouble) got - want) <= allowed;
+}
+
+/** @brief
+ *  Compare a frame with its golden result.
+ *
+ *  @param file is the frame file, for the report.
+ *  @param got is the result of the run.
+ *  @param golden is the golden result of the frame.
+ *  @param tol is the tolerances.
+ *  @param cell is the pixels of a mask cell.
+ *  @return the number of mismatches.
+ */
+static guint
+compare_frame (const gchar *file, const FrameResult *got, json_t *golden, const Tolerance *tol, guint cell) {
+    guint32 want_pre[DD_SW_GRID * DD_SW_GRID], want_cca[DD_SW_GRID * DD_SW_GRID];
+    json_t *range = json_object_get (golden, "threshold_range");
+    json_t *pre = json_object_get (golden, "preprocess_mask");
+    json_t *cca = json_object_get (golden, "cca_mask");
+    guint32 want_threshold = json_integer_value (json_object_get (golden, "threshold"));
+    guint32 want_fruit = json_integer_value (json_object_get (golden, "fruit_pixels"));
+    guint32 want_defect = json_integer_value (json_object_get (golden, "defect_pixels"));
+    gdouble want_density = json_number_value (json_object_get (golden, "density"));
+    gboolean want_defective = json_is_true (json_object_get (golden, "defective"));
+    guint failures = 0;
+
+    /* A range from the truth of a scene, or the threshold of a capture */
+    if (json_array_size (range) == 2) {
+        guint32 min = json_integer_value (json_array_get (range, 0));
+        guint32 max = json_integer_value (json_array_get (range, 1));
+        if (got->result.threshold < min || got->result.threshold > max) {
+            g_printerr ("%s: threshold %u, golden %u..%u\n", file, got->result.threshold, min, max);
+            failures++;
+        }
+    }
+    else if (ABS ((gint) got->result.threshold - (gint) want_threshold) > (gint) tol->threshold) {
+        g_printerr ("%s: threshold %u, golden %u\n", file, got->result.threshold, want_threshold);
+        failures++;
+    }
+    if (!pixels_match (got->result.fruit_pixels, want_fruit, tol)) {
+        g_printerr ("%s: fruit pixels %u, golden %u\n", file, got->result.fruit_pixels, want_fruit);
+        failures++;
+    }
+    if (!pixels_match (got->result.defect_pixels, want_defect, tol)) {
+        g_printerr ("%s: defect pixels %u, golden %u\n", file, got->result.defect_pixels, want_defect);
+        failures++;
+    }
+    if (ABS (got->result.density - want_density) > tol->density) {
+        g_printerr ("%s: density %.4f, golden %.4f\n", file, got->result.density, want_density);
+        failures++;
+    }
+    if (got->result.defective != want_defective) {
+        g_printerr ("%s: decision %s, golden %s\n", file, got->result.defective ? "defective" : "good",
+                    want_defective ? "defective" : "good");
+        failures++;
+    }
+    /* Captures from the board have no masks */
+    if (!pre && !cca)
+        return failures;
+    if (!grid_from_json (pre, want_pre) || !grid_from_json (cca, want_cca)) {
+        g_printerr ("%s: golden masks are not %ux%u grids\n", file, DD_SW_GRID, DD_SW_GRID);
+        return failures + 1;
+    }
+    for (guint i = 0; i < DD_SW_GRID * DD_SW_GRID; i++) {
+        if (ABS ((gdouble) got->preprocess_mask[i] - want_pre[i]) > tol->mask * cell) {
+            g_printerr ("%s: preprocess mask cell %u,%u has %u pixels, golden %u\n", file,
+                        i % DD_SW_GRID, i / DD_SW_GRID, got->preprocess_mask[i], want_pre[i]);
+            failures++;
+        }
+        if (ABS ((gdouble) got->cca_mask[i] - want_cca[i]) > tol->mask * cell) {
+            g_printerr ("%s: cca mask cell %u,%u has %u pixels, golden %u\n", file,
+                        i % DD_SW_GRID, i / DD_SW_GRID, got->cca_mask[i], want_cca[i]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static void
+print_timing (DDEmuChain *chain) {
+    g_print ("%-26s %8s %10s %10s\n", "library", "calls", "mean ms", "max ms");
+    for (guint i = 0; i < DD_EMU_STAGES; i++) {
+        DDEmuStats stats;
+        dd_emu_kernel_stats (dd_emu_chain_kernel (chain, (DDEmuStage) i), &stats);
+        g_print ("%-26s %8" G_GUINT64_FORMAT " %10.3f %10.3f\n", stats.name, stats.calls,
+                 stats.calls ? stats.total_ns / 1e6 / stats.calls : 0.0, stats.max_ns / 1e6);
+    }
+}
+
+int
+main (int argc, char *argv[]) {
+    GOptionContext *optctx;
+    GError *error = NULL;
+    json_error_t jerror;
+    json_t *golden, *frames, *tol_obj;
+    DDEmuChain *chain = NULL;
+    Tolerance tol;
+    guint width, height, failures = 0, cell;
+    int ret = 1;
+
+    optctx = g_option_context_new ("- Golden-output regression suite of the defect detect kernel libraries");
+    g_option_context_add_main_entries (optctx, entries, NULL);
+    g_option_context_add_group (optctx, gst_init_get_option_group ());
+    if (!g_option_context_parse (optctx, &argc, &argv, &error)) {
+        g_printerr ("Error parsing options: %s\n", error->message);
+        g_option_context_free (optctx);
+        g_clear_error (&error);
+        return -1;
+    }
+    g_option_context_free (optctx);
+
+    if (make_corpus) {
+        if (golden_file && !config_dir) {
+            g_printerr ("--cfgpath is required to write the golden results\n");
+            return -1;
+        }
+        if (!write_corpus (make_corpus) || (golden_file && !write_golden (golden_file, config_dir)))
+            return 1;
+        return 0;
+    }
+
+    if (!lib_dir || !config_dir || !corpus_dir || !golden_file) {
+        g_printerr ("--libdir, --cfgpath, --corpus and --golden are required\n");
+        return -1;
+    }
+    gst_init (&argc, &argv);
+
+    golden = json_load_file (golden_file, JSON_DECODE_ANY, &jerror);
+    if (!golden) {
+        g_printerr ("%s: %s at line %d\n", golden_file, jerror.text, jerror.line);
+        return 1;
+    }
+    width  = json_integer_value (json_object_get (golden, "width"));
+    height = json_integer_value (json_object_get (golden, "height"));
+    frames = json_object_get (golden, "frames");
+    tol_obj = json_object_get (golden, "tolerance");
+    tol.threshold  = json_integer_value (json_object_get (tol_obj, "threshold"));
+    tol.pixels     = json_number_value (json_object_get (tol_obj, "pixels"));
+    tol.min_pixels = json_integer_value (json_object_get (tol_obj, "min_pixels"));
+    tol.density    = json_number_value (json_object_get (tol_obj, "density"));
+    tol.mask       = json_number_value (json_object_get (tol_obj, "mask"));
+    if (!width || !height || (guint) stride < width || !json_array_size (frames)) {
+        g_printerr ("%s: no frames, or a size the stride does not fit\n", golden_file);
+        goto done;
+    }
+    cell = (width / DD_SW_GRID) * (height / DD_SW_GRID);
+
+    chain = dd_emu_chain_open (lib_dir, config_dir);
+    if (!chain) {
+        g_printerr ("Cannot load the kernel libraries, see GST_DEBUG=ddemu:5\n");
+        goto done;
+    }
+
+    for (gsize i = 0; i < json_array_size (frames); i++) {
+        json_t *entry = json_array_get (frames, i);
+        const gchar *file = json_string_value (json_object_get (entry, "file"));
+        gchar *path, *data = NULL;
+        gsize size = 0;
+        FrameResult result = { 0 };
+
+        if (!file) {
+            g_printerr ("%s: frame %" G_GSIZE_FORMAT " has no file\n", golden_file, i);
+            failures++;
+            continue;
+        }
+        path = g_build_filename (corpus_dir, file, NULL);
+        if (!g_file_get_contents (path, &data, &size, &error) || size != width * height) {
+            g_printerr ("%s: %s\n", path, error ? error->message : "not a frame of the golden size");
+            g_clear_error (&error);
+            g_free (path);
+            g_free (data);
+            failures++;
+            continue;
+        }
+        g_free (path);
+
+        if (!dd_emu_chain_run (chain, (guint8 *) data, width, height, stride, &result.result, grid_stage, &result)) {
+            g_printerr ("%s: the pipeline failed\n", file);
+            failures++;
+        }
+        else {
+            failures += compare_frame (file, &result, entry, &tol, cell);
+        }
+        g_free (data);
+    }
+
+    /* Every call of an accelerator wrapper must have reached its emulation */
+    for (guint i = 0; i < DD_EMU_STAGE_TEXT2OVERLAY; i++) {
+        DDEmuStats stats;
+        dd_emu_kernel_stats (dd_emu_chain_kernel (chain, (DDEmuStage) i), &stats);
+        if (stats.emulated != stats.calls) {
+            g_printerr ("%s: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " calls emulated\n",
+                        stats.name, stats.emulated, stats.calls);
+            failures++;
+        }
+    }
+
+    print_timing (chain);
+    g_print ("%" G_GSIZE_FORMAT " frames, %u mismatches\n", json_array_size (frames), failures);
+    ret = failures ? 1 : 0;
+
+done:
+    dd_emu_chain_close (chain);
+    json_decref (golden);
+    return ret;
+}
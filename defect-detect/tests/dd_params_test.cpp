@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit tests of the reloadable kernel parameters (dd_params.h): sets
+ * published back to back while kernels of the stream read them, which
+ * must only ever see a whole set, and newer ones.
+ */
+
+#include "dd_params.h"
+#include "dd_test.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define PUBLISHES       200000
+#define READERS         3
+/* Sets each reader must have applied before the publisher stops */
+#define READER_SETS     1000
+
+/* Set @n of the test: every value is @n, so a torn copy shows */
+static void
+make_set (uint64_t n, DDParams *params) {
+    params->generation = 0;
+    params->set = (1u << DD_PARAM_COUNT) - 1;
+    for (unsigned int i = 0; i < DD_PARAM_COUNT; i++)
+        params->values[i] = (double) n;
+}
+
+static void
+test_single (void) {
+    const unsigned int stream = 0;
+    DDParams params, got;
+
+    DD_CHECK (dd_params_read (stream, 0, &got) == 0);
+
+    params.generation = 0;
+    params.set = 1u << DD_PARAM_DEFECT_THRESHOLD;
+    params.values[DD_PARAM_DEFECT_THRESHOLD] = 0.2;
+    DD_CHECK (dd_params_publish (stream, &params) == 1);
+    DD_CHECK (dd_params_read (stream, 0, &got) == 1);
+    DD_CHECK (got.generation == 1 && got.values[DD_PARAM_DEFECT_THRESHOLD] == 0.2);
+    DD_CHECK (dd_params_has (&got, DD_PARAM_DEFECT_THRESHOLD) && !dd_params_has (&got, DD_PARAM_FONT));
+    /* Nothing new since generation 1 */
+    DD_CHECK (dd_params_read (stream, 1, &got) == 0);
+
+    DD_CHECK (dd_params_publish (DD_PARAMS_MAX_STREAMS, &params) == 0);
+    DD_CHECK (dd_params_read (DD_PARAMS_MAX_STREAMS, 0, &got) == 0);
+}
+
+static void
+test_reload (void) {
+    const unsigned int stream = 1;
+    atomic<bool> done (false);
+    atomic<unsigned int> busy (READERS);
+    vector<thread> readers;
+    DDParams params;
+    uint64_t n;
+
+    for (unsigned int r = 0; r < READERS; r++) {
+        readers.emplace_back ([&done, &busy] {
+            unsigned int sets = 0;
+            uint64_t since = 0;
+            DDParams got;
+
+            while (!done.load ()) {
+                if (!dd_params_read (stream, since, &got)) {
+                    this_thread::yield ();
+                    continue;
+                }
+                DD_CHECK (got.generation > since);
+                DD_CHECK (got.set == (1u << DD_PARAM_COUNT) - 1);
+                for (unsigned int i = 0; i < DD_PARAM_COUNT; i++)
+                    DD_CHECK (got.values[i] == (double) got.generation);
+                since = got.generation;
+                if (++sets == READER_SETS)
+                    busy--;
+            }
+        });
+    }
+
+    for (n = 1; n <= PUBLISHES || busy.load (); n++) {
+        make_set (n, &params);
+        DD_CHECK (dd_params_publish (stream, &params) == n);
+        if (n % 64 == 0)
+            this_thread::yield ();
+    }
+    done.store (true);
+    for (auto &reader : readers)
+        reader.join ();
+
+    /* A kernel that starts now gets the last set */
+    DD_CHECK (dd_params_read (stream, 0, &params) == 1);
+    DD_CHECK (params.generation == n - 1 && params.values[0] == (double) (n - 1));
+}
+
+int
+main (void) {
+    test_single ();
+    test_reload ();
+    return dd_test_result ("dd-params-test");
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit tests of the compute unit scheduler (dd_sched.h): no more calls
+ * than compute units run at once, every call is counted, and a stream
+ * with a backlog does not keep a compute unit from the other streams.
+ */
+
+#include "dd_sched.h"
+#include "dd_test.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define COMPUTE_UNITS   2
+#define CALLS           2000
+
+/* Let the threads started so far queue on the compute unit */
+#define SETTLE_US       50000
+
+static void
+test_compute_units (void) {
+    DDSched *sched = dd_sched_get ("test-units", COMPUTE_UNITS);
+    atomic<unsigned int> running (0);
+    vector<thread> callers;
+    uint64_t calls = 0;
+
+    DD_CHECK (sched != NULL);
+    DD_CHECK (dd_sched_get ("test-units", 1) == sched);
+
+    /* Two callers per stream */
+    for (unsigned int i = 0; i < 2 * DD_SCHED_MAX_STREAMS; i++) {
+        callers.emplace_back ([sched, i, &running] {
+            for (unsigned int c = 0; c < CALLS; c++) {
+                uint64_t acquired = dd_sched_acquire (sched, i % DD_SCHED_MAX_STREAMS);
+                DD_CHECK (++running <= COMPUTE_UNITS);
+                if (c % 64 == 0)
+                    this_thread::yield ();
+                running--;
+                dd_sched_release (sched, i % DD_SCHED_MAX_STREAMS, acquired);
+            }
+        });
+    }
+    for (auto &caller : callers)
+        caller.join ();
+
+    for (unsigned int s = 0; s < DD_SCHED_MAX_STREAMS; s++) {
+        DDSchedStats stats;
+
+        DD_CHECK (dd_sched_stats ("test-units", s, &stats) == 0);
+        DD_CHECK (stats.calls == 2 * CALLS);
+        calls += stats.calls;
+    }
+    DD_CHECK (calls == 2ULL * DD_SCHED_MAX_STREAMS * CALLS);
+    {
+        DDSchedStats stats;
+
+        DD_CHECK (dd_sched_stats ("test-units", DD_SCHED_MAX_STREAMS, &stats) == -1);
+        DD_CHECK (dd_sched_stats ("test-none", 0, &stats) == -1);
+    }
+}
+
+static void
+test_fairness (void) {
+    DDSched *sched = dd_sched_get ("test-fair", 1);
+    vector<unsigned int> order;
+    vector<thread> callers;
+    mutex order_lock;
+    uint64_t held;
+
+    /* Hold the only compute unit while stream 0 queues a backlog of three
+     * calls, then stream 1 queues one */
+    held = dd_sched_acquire (sched, 2);
+    for (unsigned int i = 0; i < 4; i++) {
+        unsigned int stream = i < 3 ? 0 : 1;
+
+        callers.emplace_back ([sched, stream, &order, &order_lock] {
+            uint64_t acquired = dd_sched_acquire (sched, stream);
+            {
+                lock_guard<mutex> guard (order_lock);
+                order.push_back (stream);
+            }
+            dd_sched_release (sched, stream, acquired);
+        });
+        usleep (SETTLE_US);
+    }
+    dd_sched_release (sched, 2, held);
+    for (auto &caller : callers)
+        caller.join ();
+
+    /* Stream 1 is served right after the first call of stream 0, not
+     * behind its backlog */
+    DD_CHECK (order.size () == 4 && order[0] == 0 && order[1] == 1 && order[2] == 0 && order[3] == 0);
+}
+
+int
+main (void) {
+    test_compute_units ();
+    test_fairness ();
+    return dd_test_result ("dd-sched-test");
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit tests of the rolling defect statistics (dd_stats.h): the windows
+ * of a single thread, and snapshots taken by several readers while one
+ * or several writers record on the stream, as the overlays of concurrent
+ * batch pipelines do. No frame may be lost and no reader may see a half
+ * updated bucket.
+ */
+
+#include "dd_stats.h"
+#include "dd_test.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define WRITER_FRAMES   1000000
+#define READERS         3
+
+/* Every frame of the concurrent test records these */
+#define FRUIT_PIXELS    1000
+#define DEFECT_PIXELS   10
+#define DENSITY         0.5
+
+static void
+test_windows (void) {
+    const unsigned int stream = 0;
+    uint64_t t0 = 10 * 3600 * 1000000000ULL;
+    DDStatsSnapshot snap;
+
+    dd_stats_record (stream, t0, 1000, 0, 0.0, 0);
+    dd_stats_record (stream, t0 + 1000, 1000, 20, 2.0, 1);
+
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_1S, t0 + 2000, &snap) == 0);
+    DD_CHECK (snap.frames == 2 && snap.defects == 1);
+    DD_CHECK (snap.fruit_pixels == 2000 && snap.defect_pixels == 20);
+    DD_CHECK (dd_stats_yield (&snap) == 50.0);
+    DD_CHECK (dd_stats_mean_density (&snap) == 1.0);
+    DD_CHECK (snap.density_max == 2.0);
+    /* 0.0 goes to the first bin, 2.0 to [1.28, 2.56) */
+    DD_CHECK (snap.hist[0] == 1 && snap.hist[8] == 1);
+
+    /* Two seconds later the frames left the 1 s window, not the others */
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_1S, t0 + 2000000000ULL, &snap) == 0);
+    DD_CHECK (snap.frames == 0);
+    DD_CHECK (dd_stats_yield (&snap) == 100.0 && dd_stats_mean_density (&snap) == 0.0);
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_1M, t0 + 2000000000ULL, &snap) == 0);
+    DD_CHECK (snap.frames == 2);
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_TOTAL, t0 + 7200000000000ULL, &snap) == 0);
+    DD_CHECK (snap.frames == 2);
+
+    DD_CHECK (dd_stats_snapshot (DD_STATS_MAX_STREAMS, DD_STATS_WINDOW_1S, t0, &snap) == -1);
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_COUNT, t0, &snap) == -1);
+}
+
+/* Every counter of a snapshot must agree with its frame count */
+static void
+check_consistent (const DDStatsSnapshot *snap) {
+    uint64_t hist = 0;
+
+    for (unsigned int i = 0; i < DD_STATS_HIST_BINS; i++)
+        hist += snap->hist[i];
+    DD_CHECK (snap->defects == snap->frames);
+    DD_CHECK (snap->fruit_pixels == snap->frames * FRUIT_PIXELS);
+    DD_CHECK (snap->defect_pixels == snap->frames * DEFECT_PIXELS);
+    DD_CHECK (snap->density_sum == snap->frames * DENSITY);
+    DD_CHECK (hist == snap->frames);
+}
+
+static void
+test_concurrent (unsigned int stream, unsigned int writers) {
+    atomic<bool> done (false);
+    vector<thread> readers, recorders;
+    DDStatsSnapshot snap;
+
+    for (unsigned int r = 0; r < READERS; r++) {
+        readers.emplace_back ([&done, stream, r] {
+            DDStatsWindow window = r % 2 ? DD_STATS_WINDOW_1S : DD_STATS_WINDOW_TOTAL;
+            uint64_t last = 0;
+            DDStatsSnapshot snap;
+
+            while (!done.load ()) {
+                DD_CHECK (dd_stats_snapshot (stream, window, dd_stats_now_ns (), &snap) == 0);
+                check_consistent (&snap);
+                /* The lifetime total never goes back */
+                if (window == DD_STATS_WINDOW_TOTAL) {
+                    DD_CHECK (snap.frames >= last);
+                    last = snap.frames;
+                }
+            }
+        });
+    }
+
+    for (unsigned int w = 0; w < writers; w++) {
+        recorders.emplace_back ([stream, writers] {
+            for (unsigned int i = 0; i < WRITER_FRAMES / writers; i++)
+                dd_stats_record (stream, dd_stats_now_ns (), FRUIT_PIXELS, DEFECT_PIXELS, DENSITY, 1);
+        });
+    }
+    for (auto &recorder : recorders)
+        recorder.join ();
+    done.store (true);
+    for (auto &reader : readers)
+        reader.join ();
+
+    DD_CHECK (dd_stats_snapshot (stream, DD_STATS_WINDOW_TOTAL, dd_stats_now_ns (), &snap) == 0);
+    DD_CHECK (snap.frames == WRITER_FRAMES / writers * writers);
+    check_consistent (&snap);
+}
+
+int
+main (void) {
+    test_windows ();
+    test_concurrent (1, 1);
+    test_concurrent (2, 3);
+    return dd_test_result ("dd-stats-test");
+}
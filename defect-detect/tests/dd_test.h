@@ -0,0 +1,47 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DD_TEST_H
+#define DD_TEST_H
+
+/*
+ * Checks of the ddutil unit tests. A failed check is reported with its
+ * location and counted, from any thread, and the test goes on so that a
+ * run lists every failure; main returns dd_test_result ().
+ */
+
+#include <stdio.h>
+#include <atomic>
+
+static std::atomic<unsigned int> dd_test_failures (0);
+
+#define DD_CHECK(cond) do {                                              \
+        if (!(cond)) {                                                   \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__,      \
+                     __LINE__, #cond);                                   \
+            dd_test_failures++;                                          \
+        }                                                                \
+    } while (0)
+
+static inline int
+dd_test_result (const char *name) {
+    unsigned int failures = dd_test_failures.load ();
+
+    printf ("%s: %u failed checks\n", name, failures);
+    return failures ? 1 : 0;
+}
+
+#endif /* DD_TEST_H */
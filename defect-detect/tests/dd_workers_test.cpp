@@ -0,0 +1,198 @@
+/*
+ * Copyright 2022, Advanced Micro Devices, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit tests of the worker pool (dd_workers.h): every task of a group
+ * runs once before the wait returns, tasks spread over the workers,
+ * tasks may wait on groups of their own, and parallel rows cover a
+ * frame once.
+ */
+
+#include "dd_workers.h"
+#include "dd_test.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define WORKERS         4
+#define TASKS           256
+#define NESTED          16
+
+/* Give up on tasks that wait for each other after this */
+#define TIMEOUT_S       10
+
+struct CountTask {
+    atomic<unsigned int> *count;
+    thread::id runner;
+};
+
+static void
+count_task (void *user_data) {
+    CountTask *t = (CountTask *) user_data;
+
+    usleep (100);
+    t->runner = this_thread::get_id ();
+    (*t->count)++;
+}
+
+static void
+test_completion (void) {
+    vector<CountTask> tasks (TASKS);
+    atomic<unsigned int> count (0);
+    DDWorkersStats before, after;
+    set<thread::id> runners;
+    DDWorkGroup *group;
+
+    dd_workers_stats (&before);
+    group = dd_work_group_new ();
+    for (unsigned int i = 0; i < TASKS; i++) {
+        tasks[i].count = &count;
+        dd_work_group_submit (group, count_task, &tasks[i], DD_WORKERS_ANY);
+    }
+    dd_work_group_wait (group);
+    dd_work_group_free (group);
+    dd_workers_stats (&after);
+
+    DD_CHECK (count.load () == TASKS);
+    for (auto &t : tasks)
+        runners.insert (t.runner);
+    DD_CHECK (runners.size () > 1);
+    DD_CHECK (after.tasks - before.tasks == TASKS);
+}
+
+struct MeetTask {
+    atomic<unsigned int> *started;
+    atomic<bool> met;
+};
+
+/* Returns once every task of the test is running, at the same time */
+static void
+meet_task (void *user_data) {
+    MeetTask *t = (MeetTask *) user_data;
+    auto end = chrono::steady_clock::now () + chrono::seconds (TIMEOUT_S);
+
+    (*t->started)++;
+    while (t->started->load () < WORKERS && chrono::steady_clock::now () < end)
+        this_thread::yield ();
+    t->met = t->started->load () >= WORKERS;
+}
+
+static void
+test_distribution (void) {
+    vector<MeetTask> tasks (WORKERS);
+    atomic<unsigned int> started (0);
+    DDWorkGroup *group = dd_work_group_new ();
+
+    /* One task hinted to each worker, none can finish alone */
+    for (unsigned int i = 0; i < WORKERS; i++) {
+        tasks[i].started = &started;
+        tasks[i].met = false;
+        dd_work_group_submit (group, meet_task, &tasks[i], i);
+    }
+    dd_work_group_wait (group);
+    dd_work_group_free (group);
+
+    for (auto &t : tasks)
+        DD_CHECK (t.met.load ());
+}
+
+static void
+outer_task (void *user_data) {
+    vector<CountTask> tasks (NESTED);
+    DDWorkGroup *group = dd_work_group_new ();
+
+    for (auto &t : tasks) {
+        t.count = (atomic<unsigned int> *) user_data;
+        dd_work_group_submit (group, count_task, &t, DD_WORKERS_ANY);
+    }
+    dd_work_group_wait (group);
+    dd_work_group_free (group);
+}
+
+static void
+test_nested (void) {
+    atomic<unsigned int> count (0);
+    DDWorkGroup *group = dd_work_group_new ();
+
+    /* More waiting tasks than workers, which must help instead of block */
+    for (unsigned int i = 0; i < NESTED; i++)
+        dd_work_group_submit (group, outer_task, &count, DD_WORKERS_ANY);
+    dd_work_group_wait (group);
+    dd_work_group_free (group);
+
+    DD_CHECK (count.load () == NESTED * NESTED);
+}
+
+struct RowsCheck {
+    vector<atomic<unsigned int>> rows;
+    vector<unsigned int> first;
+    vector<unsigned int> end;
+    RowsCheck (unsigned int rows, unsigned int bands) : rows (rows), first (bands), end (bands) {}
+};
+
+static void
+mark_rows (unsigned int band, unsigned int first_row, unsigned int end_row, void *user_data) {
+    RowsCheck *check = (RowsCheck *) user_data;
+
+    check->first[band] = first_row;
+    check->end[band] = end_row;
+    for (unsigned int y = first_row; y < end_row; y++)
+        check->rows[y]++;
+}
+
+static void
+test_parallel_rows (unsigned int rows, unsigned int bands) {
+    RowsCheck check (rows, bands);
+
+    dd_workers_parallel_rows (rows, bands, mark_rows, &check);
+    for (unsigned int y = 0; y < rows; y++)
+        DD_CHECK (check.rows[y].load () == 1);
+    /* Contiguous bands in order, none empty */
+    for (unsigned int i = 0; i < bands; i++) {
+        DD_CHECK (check.first[i] == (i ? check.end[i - 1] : 0));
+        DD_CHECK (check.end[i] > check.first[i]);
+    }
+    DD_CHECK (check.end[bands - 1] == rows);
+}
+
+int
+main (void) {
+    DD_CHECK (dd_workers_init (WORKERS) == WORKERS);
+    /* Later calls get the pool of the first */
+    DD_CHECK (dd_workers_init (2 * WORKERS) == WORKERS);
+
+    test_completion ();
+    test_distribution ();
+    test_nested ();
+
+    DD_CHECK (dd_workers_bands (1080, 64) == WORKERS + 1);
+    DD_CHECK (dd_workers_bands (100, 64) == 1);
+    test_parallel_rows (1080, dd_workers_bands (1080, 64));
+    test_parallel_rows (1081, 7);
+    test_parallel_rows (480, 1);
+    dd_workers_set_max_bands (3);
+    DD_CHECK (dd_workers_bands (1080, 64) == 3);
+    dd_workers_set_max_bands (0);
+
+    return dd_test_result ("dd-workers-test");
+}